@@ -0,0 +1,152 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Runs the native benchmarks of a :py:class:`bob.extension.Library`.
+
+Calling the functions of a library through its Python bindings adds the cost
+of parsing the arguments and of converting arrays, which hides the cost of the
+C++ code itself for small inputs. The ``benchmarks`` of a library register
+kernels with ``bob.extension/benchmark.h``; when the package is built with
+``BOB_BUILD_BENCHMARKS=1``, they are linked with the library into the
+executable ``<library>_benchmark`` next to it. This executable times each
+kernel for a number of sizes: after a warmup, the number of iterations is
+calibrated to a minimum time, and several repetitions are measured while the
+process is pinned to a single CPU. On Linux, the CPU cycles and instructions
+are counted as well, if the perf events are accessible. Use
+:py:func:`run_benchmark` or the ``bob benchmark`` command to run them.
+"""
+
+import os
+import json
+import subprocess
+import logging
+
+logger = logging.getLogger(__name__)
+
+BENCHMARK_SUFFIX = '_benchmark'
+"""The suffix of the benchmark executable of a library"""
+
+
+def benchmarks_enabled(value=None):
+  """Returns whether the benchmarks of libraries are built.
+
+  If ``value`` is not given, the ``BOB_BUILD_BENCHMARKS`` environment variable
+  is used, which enables the benchmarks with any value except ``0``.
+  """
+
+  if value is None:
+    value = os.environ.get('BOB_BUILD_BENCHMARKS', '')
+  return str(value).strip().lower() not in ('', '0', 'false', 'no')
+
+
+def find_benchmarks(package):
+  """Returns the benchmark executables of the libraries of the given package.
+
+  Parameters:
+
+    package : str
+      The name of the package, e.g., ``'bob.example.library'``, or a directory
+
+  Returns:
+
+    [str]: The full paths of the executables
+  """
+
+  if os.path.isdir(package):
+    directories = [package]
+  else:
+    import importlib.util
+    try:
+      spec = importlib.util.find_spec(package)
+    except (ImportError, ValueError):
+      spec = None
+    if spec is None or not spec.submodule_search_locations:
+      return []
+    directories = list(spec.submodule_search_locations)
+
+  executables = []
+  for directory in directories:
+    for root, dirs, files in os.walk(directory):
+      # skip hidden directories and __pycache__
+      dirs[:] = [d for d in dirs if not d.startswith(('.', '__'))]
+      for name in sorted(files):
+        path = os.path.join(root, name)
+        if name.endswith(BENCHMARK_SUFFIX) and os.access(path, os.X_OK):
+          executables.append(path)
+  return sorted(executables)
+
+
+def run_benchmark(executable, sizes=None, min_time=None, warmup=None, repetitions=None, cpu=None, filter=None):
+  """Runs the given benchmark executable, and returns its results.
+
+  Parameters:
+
+    executable : str
+      The benchmark executable of a library, see :py:func:`find_benchmarks`
+
+    sizes : [int] or ``None``
+      The sizes to run each kernel with
+
+    min_time : float or ``None``
+      The minimum time of each repetition, in seconds
+
+    warmup : float or ``None``
+      The time each kernel is run before measuring it, in seconds
+
+    repetitions : int or ``None``
+      The number of measured repetitions
+
+    cpu : int or ``None``
+      The CPU to pin the process to, ``-1`` to not pin it; by default, the
+      CPU the process is started on
+
+    filter : str or ``None``
+      Only runs the kernels whose name contains this text
+
+  Returns:
+
+    dict: The ``library``, the ``cpu`` the process was pinned to (or ``-1``),
+    the names of the hardware ``counters``, and the ``results`` of each kernel
+    and size: the ``kernel``, ``size``, ``iterations``, the ``min``,
+    ``median``, ``mean`` and ``stddev`` of the ``ns_per_iteration``, the
+    ``items_per_second``, if the kernel sets the items, and, e.g.,
+    ``cycles_per_iteration``, if the counters are available
+
+  Raises:
+
+    RuntimeError: If the executable fails
+  """
+
+  command = [executable, '--json', '-']
+  if sizes:
+    command += ['--sizes', ','.join(str(s) for s in sizes)]
+  for option, value in (('--min-time', min_time), ('--warmup', warmup),
+                        ('--repetitions', repetitions), ('--cpu', cpu),
+                        ('--filter', filter)):
+    if value is not None:
+      command += [option, str(value)]
+  logger.info("Running %s", ' '.join(command))
+  process = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+  if process.returncode != 0:
+    raise RuntimeError("The benchmark %s failed: %s" % (executable, process.stderr.decode().strip()))
+  return json.loads(process.stdout.decode())
+
+
+def format_results(results):
+  """Formats the results of :py:func:`run_benchmark` as a table"""
+
+  counters = results.get('counters', [])
+  header = ['kernel', 'size', 'iterations', 'ns/iteration', '+-', 'items/s'] + counters
+  rows = [header]
+  for result in results['results']:
+    ns = result['ns_per_iteration']
+    row = [result['kernel'], str(result['size']), str(result['iterations']),
+           '%.4g' % ns['median'], '%.2g' % ns['stddev'],
+           '%.4g' % result['items_per_second'] if 'items_per_second' in result else '-']
+    row += ['%.4g' % result[c + '_per_iteration'] for c in counters]
+    rows.append(row)
+  widths = [max(len(r[i]) for r in rows) for i in range(len(header))]
+  lines = ['%s (pinned to CPU %d)' % (results['library'], results['cpu']) if results['cpu'] >= 0 else '%s (not pinned)' % results['library']]
+  for row in rows:
+    lines.append('  '.join([row[0].ljust(widths[0])] + [c.rjust(w) for c, w in zip(row[1:], widths[1:])]))
+  return '\n'.join(lines)
@@ -9,7 +9,6 @@ import os
 import re
 import sys
 import glob
-from distutils.version import LooseVersion
 
 from .utils import uniq, egrep, find_header, find_library
 
@@ -78,6 +77,8 @@ class boost:
 
     else:
 
+      from distutils.version import LooseVersion
+
       # requirement is 'operator' 'version'
       operator, required = [k.strip() for k in requirement.split(' ', 1)]
 
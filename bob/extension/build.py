@@ -0,0 +1,803 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""The extensions, libraries and the command that build them, which are
+imported on first use by :py:mod:`bob.extension`, since setuptools and the
+build modes are not needed by the packages at run time
+"""
+
+import os
+import sys
+import platform
+import threading
+import functools
+from setuptools.extension import Extension as DistutilsExtension
+from setuptools.command.build_ext import build_ext as _build_ext
+import distutils.sysconfig
+
+from pkg_resources import resource_filename
+
+from . import check_packages, generate_self_macros, reorganize_isystem, \
+    normalize_requirements, get_bob_libraries, get_full_libname, \
+    find_system_include_paths
+from .boost import boost
+from .utils import uniq, uniq_paths, find_executable
+from .cmake import CMakeListsGenerator, cmake_generator, compiler_launcher
+from .unity import unity_batch_size, write_unity_sources
+from .pch import precompile, precompiled_headers, DEFAULT_LIBRARY_PRECOMPILED_HEADERS
+from .pgo import lto_enabled, lto_flags, pgo_training_command, profile_generate_flags, profile_use_flags, merge_profiles, run_training
+from .isa import isa_variants, isa_flags, isa_variant_path, compiler_supports_isa
+from .scheduler import job_limit, JobServer, parallel_compile, run_graph
+from . import object_cache, compile_times, symbols, benchmark
+
+
+class Extension(DistutilsExtension):
+  """Extension building with pkg-config packages.
+
+  See the documentation for :py:class:`distutils.extension.Extension` for more
+  details on input parameters.
+  """
+
+  def __init__(self, name, sources, **kwargs):
+    """Initialize the extension with parameters.
+
+    External package extensions (mostly coming from pkg-config), adds a single
+    parameter to the standard arguments of the constructor:
+
+    packages : [string]
+      This should be a list of strings indicating the name of the bob
+      (pkg-config) modules you would like to have linked to your extension
+      **additionally** to ``bob-python``. Candidates are module names like
+      "bob-machine" or "bob-math".
+
+      For convenience, you can also specify "opencv" or other 'pkg-config'
+      registered packages as a dependencies.
+
+    boost_modules : [string]
+      A list of boost modules that we need to link against.
+
+    bob_packages : [string]
+      A list of bob libraries (such as ``'bob.core'``) containing C++ code
+      that should be included and linked
+
+    system_include_dirs : [string]
+      A list of include directories that are not in one of our packages,
+      and which should be included with the -isystem compiler option
+
+    unity_batch_size : int
+      If greater than 1, up to this number of sources are compiled in a single
+      translation unit by :py:class:`build_ext`. If not given, the
+      ``BOB_BUILD_UNITY`` environment variable is used, see
+      :py:func:`bob.extension.unity.unity_batch_size`.
+
+    precompiled_headers : bool or [string]
+      A list of headers that are precompiled once by :py:class:`build_ext`,
+      and shared by all extensions of the package that are compiled with the
+      same flags and macros. ``True`` selects the
+      :py:data:`bob.extension.pch.DEFAULT_PRECOMPILED_HEADERS`. If not given,
+      the ``BOB_BUILD_PCH`` environment variable is used, see
+      :py:func:`bob.extension.pch.precompiled_headers`.
+
+    lto : bool
+      Compiles and links this extension with link-time optimization. If not
+      given, the ``BOB_BUILD_LTO`` environment variable is used, see
+      :py:func:`bob.extension.pgo.lto_enabled`.
+
+    isa_variants : bool or [string]
+      A list of micro-architecture levels (such as ``'x86-64-v3'``), for which
+      :py:class:`build_ext` compiles this extension in addition to the
+      baseline. The best variant for the running CPU is imported, see
+      :py:func:`bob.extension.isa.install_import_hook`. If not given, the
+      ``BOB_BUILD_ISA`` environment variable is used, see
+      :py:func:`bob.extension.isa.isa_variants`.
+
+    """
+
+    packages = []
+
+    self.unity_batch_size = unity_batch_size(kwargs.pop('unity_batch_size', None))
+    self.precompiled_headers = precompiled_headers(kwargs.pop('precompiled_headers', None))
+    self.lto = lto_enabled(kwargs.pop('lto', None))
+    self.isa_variants = isa_variants(kwargs.pop('isa_variants', None))
+
+    if 'packages' in kwargs:
+      if isinstance(kwargs['packages'], str):
+        packages.append(kwargs['packages'])
+      else:
+        packages.extend(kwargs['packages'])
+      del kwargs['packages']
+
+    # uniformize packages
+    packages = normalize_requirements([k.strip().lower() for k in packages])
+
+    # check if we have bob libraries to link against
+    if 'bob_packages' in kwargs:
+      self.bob_packages = kwargs['bob_packages']
+      del kwargs['bob_packages']
+    else:
+      self.bob_packages = None
+
+    bob_includes, bob_libraries, bob_library_dirs, bob_macros = get_bob_libraries(self.bob_packages)
+
+    # system include directories
+    if 'system_include_dirs' in kwargs:
+      system_includes = kwargs['system_include_dirs']
+      del kwargs['system_include_dirs']
+    else:
+      system_includes = []
+
+    # Boost requires a special treatment
+    boost_req = ''
+    for i, pkg in enumerate(packages):
+      if pkg.startswith('boost'):
+        boost_req = pkg
+        del packages[i]
+
+    # We still look for the keyword 'boost_modules'
+    boost_modules = []
+    if 'boost_modules' in kwargs:
+      if isinstance(kwargs['boost_modules'], str):
+        boost_modules.append(kwargs['boost_modules'])
+      else:
+        boost_modules.extend(kwargs['boost_modules'])
+      del kwargs['boost_modules']
+
+    if boost_modules and not boost_req: boost_req = 'boost >= 1.0'
+
+    # Was a version parameter given?
+    version = None
+    if 'version' in kwargs:
+      version = kwargs['version']
+      del kwargs['version']
+
+    # Mixing
+    parameters = {
+        'define_macros': generate_self_macros(name, version) + bob_macros,
+        'extra_compile_args': os.environ.get('CXXFLAGS', '').split(),
+        'extra_link_args': [],
+        'library_dirs': [],
+        'libraries': bob_libraries,
+        }
+
+    # Compilation options for macOS builds
+    if platform.system() == 'Darwin':
+
+      sdkroot = os.environ.get('SDKROOT')
+      if sdkroot is not None and sdkroot:
+        parameters['extra_compile_args'] = ['-isysroot', sdkroot] + \
+            parameters['extra_compile_args']
+
+      parameters['extra_compile_args'] += ['-Wno-#warnings']
+
+    user_includes = kwargs.get('include_dirs', [])
+    self.pkg_includes = []
+    self.pkg_libraries = []
+    self.pkg_library_directories = []
+    self.pkg_macros = []
+
+    # Updates for boost
+    if boost_req:
+
+      boost_pkg = boost(boost_req.replace('boost', '').strip())
+
+      # Adds macros
+      parameters['define_macros'] += boost_pkg.macros()
+
+      # Adds the include directory (enough for using just the template library)
+      if boost_pkg.include_directory not in user_includes:
+        system_includes.append(boost_pkg.include_directory)
+        self.pkg_includes.append(boost_pkg.include_directory)
+
+      # Adds specific boost libraries requested by the user
+      if boost_modules:
+        boost_libdirs, boost_libraries = boost_pkg.libconfig(boost_modules)
+        parameters['library_dirs'].extend(boost_libdirs)
+        self.pkg_library_directories.extend(boost_libdirs)
+        parameters['libraries'].extend(boost_libraries)
+        self.pkg_libraries.extend(boost_libraries)
+
+    # Checks all other pkg-config requirements
+    pkgs = check_packages(packages)
+
+    for pkg in pkgs:
+
+      # Adds parameters for each package, in order
+      parameters['define_macros'] += pkg.package_macros()
+      self.pkg_macros += pkg.package_macros()
+
+      # Include directories are added with a special path
+      for k in pkg.include_directories():
+        if k in user_includes or k in self.pkg_includes: continue
+        system_includes.append(k)
+        self.pkg_includes.append(k)
+
+      parameters['library_dirs'] += pkg.library_directories()
+      self.pkg_library_directories += pkg.library_directories()
+
+      if pkg.name.find('bob-') == 0: # one of bob's packages
+
+        # make-up the names of versioned Bob libraries we must link against
+
+        if platform.system() == 'Darwin':
+          libs = ['%s.%s' % (k, pkg.version) for k in pkg.libraries()]
+        elif platform.system() == 'Linux':
+          libs = [':lib%s.so.%s' % (k, pkg.version) for k in pkg.libraries()]
+        else:
+          raise RuntimeError("supports only MacOSX and Linux builds")
+
+      else:
+
+        libs = pkg.libraries()
+
+      parameters['libraries'] += libs
+      self.pkg_libraries += libs
+
+      # if used libraries require extra compilation flags, add them to the mix
+      parameters['extra_compile_args'].extend(
+          pkg.cflags_other().get('extra_compile_args', [])
+          )
+
+      parameters['extra_link_args'] += pkg.other_libraries()
+
+    # add the -isystem to all system include dirs
+    compiler_includes = find_system_include_paths()
+    system_includes = [k for k in system_includes if k not in compiler_includes]
+    for k in system_includes:
+      parameters['extra_compile_args'].extend(['-isystem', k])
+
+    # Filter and make unique
+    for key in parameters.keys():
+
+      # Tune input parameters if they were set, but assure that our parameters come first
+      if key in kwargs:
+        kwargs[key] = parameters[key] + kwargs[key]
+      else: kwargs[key] = parameters[key]
+
+      if key in ('extra_compile_args'): continue
+
+      kwargs[key] = uniq(kwargs[key])
+
+    # add our include dir by default
+    self_include_dir = resource_filename(__package__, 'include')
+    kwargs.setdefault('include_dirs', []).append(self_include_dir)
+    kwargs['include_dirs'] = user_includes + bob_includes + kwargs['include_dirs']
+
+    # Uniq'fy parameters that are not on our parameter list
+    kwargs['include_dirs'] = uniq_paths(kwargs['include_dirs'])
+
+    # Stream-line '-isystem' includes
+    kwargs['extra_compile_args'] = reorganize_isystem(kwargs['extra_compile_args'])
+
+    # Make sure the language is correctly set to C++
+    kwargs['language'] = 'c++'
+
+    # On Linux, set the runtime path
+    if platform.system() == 'Linux':
+      kwargs.setdefault('runtime_library_dirs', [])
+      kwargs['runtime_library_dirs'] += kwargs['library_dirs']
+      kwargs['runtime_library_dirs'] = uniq_paths(kwargs['runtime_library_dirs'])
+
+    # .. except for the bob libraries
+    kwargs['library_dirs'] += bob_library_dirs
+
+    # Uniq'fy library directories
+    kwargs['library_dirs'] = uniq_paths(kwargs['library_dirs'])
+
+    # Run the constructor for the base class
+    DistutilsExtension.__init__(self, name, sources, **kwargs)
+
+
+class Library (Extension):
+  """A class to compile a pure C++ code library used within and outside an extension using CMake."""
+
+  def __init__(self, name, sources, version, bob_packages = [], packages = [], boost_modules=[], include_dirs = [], system_include_dirs = [], libraries = [], library_dirs = [], define_macros = [], unity_batch_size = None, precompiled_headers = None, lto = None, isa_variants = None, visibility = None, exports = None, symbolic = None, benchmarks = []):
+    """Initializes a pure C++ library that will be compiled with CMake.
+
+    By default, the include directory of this package is automatically added to the ``include_dirs``.
+    It is expected to be in the `include`` directory in the main package directory (which, e.g., is ``bob/core`` for package ``bob.core``).
+
+    .. note::
+      This library, including the library and include directories, is also automatically added to **all other** :py:class:`Extension`'s that are compiled within this package.
+
+    .. warning::
+      IMPORTANT! To compile this library with CMake, the :py:class:`build_ext` class provided in this module is required.
+      Please include::
+
+        cmdclass = {
+          'build_ext': build_ext
+        },
+
+      as a parameter to the ``setup`` function in your setup.py.
+
+    Keyword parameters:
+
+    name : string
+      The name of the library to generate, e.g., ``'bob.core.bob_core'``
+
+    sources : [string]
+      A list of files (relative to the base directory) that should be compiled and linked by CMake
+
+    version : string
+      The version of the library, which is usually identical to the version of the package
+
+    bob_packages : [string]
+      A list of bob packages that the pure C++ code relies on.
+      Libraries and include directories of these packages will be automatically added.
+
+    packages : [string]
+      A list of pkg-config based packages, see :py:class:`Extension`.
+      Macros, libraries and include directories of these packages will be automatically added.
+
+    boost_modules : [string]
+      A list of boost modules that we need to link against.
+
+    include_dirs : [string]
+      An additional list of include directories that is not covered by ``bob_packages`` and ``packages``
+
+    system_include_dirs : [string]
+      A list of include directories that are not in one of our packages,
+      and which should be included with the SYSTEM option
+
+    libraries : [string]
+      An additional list of libraries that is not covered by ``bob_packages`` and ``packages``
+
+    library_dirs : [string]
+      An additional list of library directories that is not covered by ``bob_packages`` and ``packages``
+
+    define_macros : [(string, string)]
+      An additional list of preprocessor definitions that is not covered by ``packages``
+
+    unity_batch_size : int
+      If greater than 1, up to this number of ``sources`` are compiled in a single translation unit, see :py:class:`Extension`
+
+    precompiled_headers : bool or [string]
+      A list of headers that CMake should precompile for all ``sources``.
+      ``True`` selects the :py:data:`bob.extension.pch.DEFAULT_LIBRARY_PRECOMPILED_HEADERS`.
+      If not given, the ``BOB_BUILD_PCH`` environment variable is used, see :py:func:`bob.extension.pch.precompiled_headers`.
+
+    lto : bool
+      Compiles and links this library with link-time optimization, see :py:class:`Extension`
+
+    isa_variants : bool or [string]
+      A list of micro-architecture levels, for which this library is compiled in addition to the baseline, see :py:class:`Extension`.
+      Each variant is written to a sub-directory named after its level, and :py:func:`load_bob_library` loads the best one for the running CPU.
+
+    visibility : string
+      The default visibility of the symbols of this library.
+      With ``'hidden'``, only the functions and classes marked with ``BOB_EXPORT`` from ``bob.extension/export.h`` are exported.
+      If not given, the ``BOB_BUILD_VISIBILITY`` environment variable is used, see :py:func:`bob.extension.symbols.visibility`.
+
+    exports : [string]
+      A list of patterns of symbols to export, e.g., ``['bob::core::*']``; all other symbols are hidden, see :py:func:`bob.extension.symbols.version_script`.
+      Only used for ELF libraries (e.g., on Linux).
+
+    symbolic : bool
+      Binds calls to functions within the library at link time, so that they need no relocation when loading the library.
+      If not given, this is enabled when ``visibility`` is ``'hidden'`` or ``exports`` are given.
+      Only used for ELF libraries (e.g., on Linux).
+
+    benchmarks : [string]
+      A list of files (relative to the base directory) that register benchmarks of the functions of this library with ``bob.extension/benchmark.h``.
+      When ``BOB_BUILD_BENCHMARKS`` is set, they are linked with the library into the executable ``<name>_benchmark``, see :py:mod:`bob.extension.benchmark`.
+    """
+    name_split = name.split('.')
+    if len(name_split) <= 1:
+      raise ValueError("The name of the library must contain the package name, e.g., bob.core.bob_core")
+    self.c_name = name_split[-1]
+    self.c_package_directory = os.path.realpath('.')
+    self.c_sub_directory = os.path.join(*(name_split[:-1]))
+    self.c_sources = sources
+    self.c_version = version
+    self.c_self_include_directory = os.path.join(self.c_package_directory, self.c_sub_directory, 'include')
+    # the include directory of this package provides bob.extension/export.h
+    self.c_include_directories = [self.c_self_include_directory] + include_dirs + [resource_filename(__package__, 'include')]
+    self.c_system_include_directories = system_include_dirs
+    self.c_libraries = libraries[:]
+    self.c_library_directories = library_dirs[:]
+    self.c_define_macros = define_macros[:]
+    self.c_precompiled_headers = precompiled_headers
+    self.c_visibility = symbols.visibility(visibility)
+    self.c_exports = exports
+    self.c_symbolic = symbolic if symbolic is not None else (self.c_visibility == 'hidden' or bool(exports))
+    self.c_benchmarks = benchmarks
+
+    # add includes and libs for bob packages as the PREFERRED path (i.e., in front)
+    bob_includes, bob_libraries, bob_library_dirs, bob_macros = get_bob_libraries(bob_packages)
+    self.c_include_directories = bob_includes + self.c_include_directories
+    self.c_libraries = bob_libraries + self.c_libraries
+    self.c_library_directories = bob_library_dirs + self.c_library_directories
+    self.c_define_macros = bob_macros + self.c_define_macros
+
+    # find the cmake executable
+    cmake = find_executable("cmake")
+    if not cmake:
+      raise OSError("The Library class needs CMake version >= 3.13 to be installed, but CMake cannot be found")
+    self.c_cmake = cmake[0]
+
+    # call base class constructor, i.e., to handle the packages
+    Extension.__init__(self, name, sources, packages=packages, boost_modules=boost_modules, unity_batch_size=unity_batch_size, lto=lto, isa_variants=isa_variants)
+
+    # add the include directories for the packages as well
+    self.c_system_include_directories.extend(self.pkg_includes)
+    self.c_libraries.extend(self.pkg_libraries)
+    self.c_library_directories.extend(self.pkg_library_directories)
+    self.c_define_macros.extend(self.pkg_macros)
+
+
+  def compile(self, build_directory, compiler = None, stdout=None, extra_compile_args = [], extra_link_args = [], lto = None, parallel = None):
+    """This function will automatically create a CMakeLists.txt file in the ``package_directory`` including the required information.
+    Afterwards, the library is built using CMake in the given ``build_directory``.
+    The build type is automatically taken from the debug option in the buildout.cfg.
+    To change the compiler, use the ``compiler`` parameter.
+
+    The library is built with ``Ninja``, if available, and with ``make`` otherwise, see :py:func:`bob.extension.cmake.cmake_generator`.
+    All compiler calls are wrapped with ``ccache`` or ``sccache``, if available, see :py:func:`bob.extension.cmake.compiler_launcher`.
+
+    The ``extra_compile_args`` and ``extra_link_args`` are added to the compiler and linker calls, e.g., for profile-guided optimization.
+    Link-time optimization is enabled when ``lto`` is set, or, if not given, when it was enabled in the constructor.
+    The number of parallel compiler calls can be set with ``parallel``, and it defaults to the ``BOB_BUILD_PARALLEL`` environment variable.
+
+    The number of exported symbols of the library is logged, see :py:func:`bob.extension.symbols.report_symbols`.
+    When ``BOB_BUILD_BENCHMARKS`` is set, the ``benchmarks`` are built into an executable next to the library, see :py:func:`bob.extension.benchmark.benchmarks_enabled`.
+    Afterwards, the ISA variants of the library are built in separate build directories, see :py:func:`bob.extension.isa.isa_variant_path`.
+    """
+    self.c_target_directory = os.path.join(os.path.realpath(build_directory), self.c_sub_directory)
+    # compile our stuff in a different directory
+    final_build_dir = os.path.join(os.path.dirname(os.path.realpath(build_directory)), 'build_cmake', self.c_name)
+    lto = self.lto if lto is None else lto
+    if parallel is None: parallel = os.environ.get("BOB_BUILD_PARALLEL")
+    benchmark_sources = self.c_benchmarks if benchmark.benchmarks_enabled() else []
+    self._compile(final_build_dir, self.c_target_directory, compiler, stdout, extra_compile_args, extra_link_args, lto, parallel, benchmark_sources)
+    symbols.report_symbols(self.c_name, get_full_libname(self.c_name, self.c_target_directory))
+
+    cxx = compiler or os.environ.get('CXX', 'c++').split()[-1]
+    for level in self.isa_variants:
+      if compiler_supports_isa(cxx, level):
+        flags = isa_flags(level)
+        self._compile(final_build_dir + '-' + level, os.path.join(self.c_target_directory, level), compiler, stdout, extra_compile_args + flags, extra_link_args + flags, lto, parallel)
+
+
+  def _compile(self, build_directory, target_directory, compiler, stdout, extra_compile_args, extra_link_args, lto, parallel, benchmark_sources = []):
+    """Generates the CMakeLists.txt in the given ``build_directory`` and builds the library into the ``target_directory``"""
+    if not os.path.exists(target_directory):
+      os.makedirs(target_directory)
+    if not os.path.exists(build_directory):
+      os.makedirs(build_directory)
+    # version scripts and -Bsymbolic are only supported for ELF libraries
+    version_script, symbolic = None, False
+    if symbols.supports_version_scripts():
+      if self.c_exports:
+        version_script = symbols.write_version_script(os.path.join(build_directory, self.c_name + '.map'), self.c_exports)
+      symbolic = self.c_symbolic
+    # generate CMakeLists.txt makefile
+    generator = CMakeListsGenerator(
+      name = self.c_name,
+      sources = self.c_sources,
+      target_directory = target_directory,
+      version = self.c_version,
+      include_directories = uniq_paths(self.c_include_directories),
+      system_include_directories = uniq_paths(self.c_system_include_directories),
+      libraries = uniq(self.c_libraries),
+      library_directories = uniq_paths(self.c_library_directories),
+      macros = uniq(self.c_define_macros),
+      compiler_launcher = compiler_launcher(),
+      unity_batch_size = self.unity_batch_size,
+      precompiled_headers = precompiled_headers(self.c_precompiled_headers, DEFAULT_LIBRARY_PRECOMPILED_HEADERS),
+      compile_options = extra_compile_args,
+      link_options = extra_link_args,
+      interprocedural_optimization = lto,
+      visibility = self.c_visibility,
+      version_script = version_script,
+      symbolic = symbolic,
+      benchmark_sources = benchmark_sources,
+    )
+
+    changed = generator.generate(self.c_package_directory, build_directory)
+
+    # compile in the build directory
+    import subprocess
+    env = {'VERBOSE' : '1'}
+    env.update(os.environ)
+    if compiler is not None:
+      env['CXX'] = compiler
+    # configure cmake
+    cmake_generator_name, build_program = cmake_generator(build_directory)
+    # an unchanged CMakeLists.txt does not need to be re-configured
+    if changed or not os.path.exists(os.path.join(build_directory, 'CMakeCache.txt')):
+      command = [self.c_cmake, '-G', cmake_generator_name]
+      if build_program is not None:
+        command += ['-DCMAKE_MAKE_PROGRAM=%s' % build_program]
+      command += [build_directory]
+      if subprocess.call(command, cwd=build_directory, env=env, stdout=stdout) != 0:
+        raise OSError("Could not generate %s build files with CMake" % cmake_generator_name)
+    # run the build; Ninja is parallel by default, make only when requested
+    build_call = [self.c_cmake, '--build', build_directory]
+    if parallel: build_call += ['--parallel', str(parallel)]
+    if subprocess.call(build_call, cwd=build_directory, env=env, stdout=stdout) != 0:
+      raise OSError("CMake compilation stopped with an error; stopping ...")
+
+
+class build_ext(_build_ext):
+  """Compile the C++ :py:class`Library`'s using CMake, and the python extensions afterwards
+
+  See the documentation for :py:class:`distutils.command.build_ext` for more
+  information.
+  """
+
+  user_options = _build_ext.user_options + [
+      ('lto', None, "compile all extensions with link-time optimization [default: BOB_BUILD_LTO]"),
+      ('pgo-train=', None, "shell command to train profile-guided optimization with [default: BOB_BUILD_PGO]"),
+      ]
+
+  boolean_options = _build_ext.boolean_options + ['lto']
+
+  def initialize_options(self):
+    _build_ext.initialize_options(self)
+    self.lto = None
+    self.pgo_train = None
+    self.pgo_phase = None
+    self.isa_level = None
+    self.job_server = None
+    self.lock = threading.Lock()
+
+  def finalize_options(self):
+    # check if the "BOB_BUILD_DIRECTORY" environment variable is set
+    env = os.environ
+    if 'BOB_BUILD_DIRECTORY' in env and env['BOB_BUILD_DIRECTORY']:
+      # HACKISH: check if we are currently developed by inspecting the way we got called
+      if 'develop' in sys.argv:
+        self.build_temp = os.path.join(env['BOB_BUILD_DIRECTORY'], 'build_temp')
+        self.build_lib = os.path.join(env['BOB_BUILD_DIRECTORY'], 'build_lib')
+    _build_ext.finalize_options(self)
+    self.lto = lto_enabled(self.lto)
+    self.pgo_train = pgo_training_command(self.pgo_train)
+
+  def run(self):
+    """Iterates through the list of Extension packages and reorders them, so that the Library's come first
+
+    When a ``pgo_train`` command is given, the extensions are built twice for profile-guided optimization.
+    First, all extensions are built with instrumentation, and the training command is run.
+    Then, all extensions are re-built with link-time optimization, using the profiles collected for each of them.
+    """
+    # here, we simply re-order the extensions such that we get the Library first
+    self.extensions = [ext for ext in self.extensions if isinstance(ext, Library)] + [ext for ext in self.extensions if not isinstance(ext, Library)]
+    if not self.pgo_train:
+      # call the base class function
+      return _build_ext.run(self)
+
+    # remove profiles of previous trainings, as GCC would accumulate them
+    import shutil
+    shutil.rmtree(os.path.join(self.build_temp, 'pgo'), ignore_errors=True)
+
+    # all objects need to be re-built in both phases; the compiler name is
+    # replaced by the compiler object during the build
+    force, compiler = self.force, self.compiler
+    self.force = True
+    try:
+      self.pgo_phase = 'generate'
+      _build_ext.run(self)
+      python_path = [] if self.inplace else [os.path.realpath(self.build_lib)]
+      run_training(self.pgo_train, python_path)
+      for ext in self.extensions:
+        merge_profiles(self.profile_compiler(ext), self.profile_directory(ext))
+      self.pgo_phase = 'use'
+      self.compiler = compiler
+      return _build_ext.run(self)
+    finally:
+      self.force = force
+      self.pgo_phase = None
+
+
+  def build_extensions(self):
+    """Builds all extensions concurrently, see :py:func:`bob.extension.scheduler.run_graph`
+
+    All Library's are built first, and all other extensions, which link against them, afterwards.
+    The sources of each extension are compiled in parallel, too.
+    At most ``--parallel`` (or ``BOB_BUILD_PARALLEL``, or the number of CPU cores) compiler and linker processes are run at the same time, for all extensions together.
+
+    When ``BOB_BUILD_CACHE`` is set, objects and extensions are taken from the object cache, see :py:mod:`bob.extension.object_cache`.
+    When ``BOB_BUILD_TIMES`` is set, the compile times of all translation units are recorded instead, see :py:mod:`bob.extension.compile_times`.
+    """
+    self.check_extensions_list(self.extensions)
+    limit = job_limit(self.parallel)
+    self.job_server = JobServer(limit)
+    compile, spawn = self.compiler.compile, self.compiler.spawn
+    uninstall = None
+    if self.compiler.compiler_type == 'unix':
+      self.compiler.compile = functools.partial(parallel_compile, self.compiler, limit)
+      cache_directory = object_cache.cache_directory()
+      if compile_times.times_directory() is not None:
+        uninstall = compile_times.install(self.compiler, compile_times.times_directory())
+      elif cache_directory is not None:
+        uninstall = object_cache.install(self.compiler, object_cache.ObjectCache(cache_directory))
+    self.compiler.spawn = self.job_server.wrap(spawn)
+    try:
+      run_graph(self.extensions, self.dependencies, self.build_single_extension, limit)
+    finally:
+      self.compiler.compile, self.compiler.spawn = compile, spawn
+      if uninstall is not None: uninstall()
+      self.job_server = None
+
+
+  def dependencies(self, ext):
+    """Returns the extensions that need to be built before the given one, i.e., all Library's for all other extensions"""
+    if isinstance(ext, Library):
+      return []
+    return [other for other in self.extensions if isinstance(other, Library)]
+
+
+  def build_single_extension(self, ext):
+    """Builds the given extension; failures of optional extensions are reported as warnings"""
+    with self._filter_build_errors(ext):
+      self.build_extension(ext)
+
+
+  def profile_directory(self, ext):
+    """Returns the directory, where the PGO profiles of the given extension are stored"""
+    return os.path.join(os.path.realpath(self.build_temp), 'pgo', ext.name)
+
+
+  def profile_compiler(self, ext):
+    """Returns the compiler executable used for the given extension"""
+    if isinstance(ext, Library):
+      return os.environ.get('CXX', 'c++').split()[-1]
+    return self.compiler.compiler_so[0]
+
+
+  def optimization_flags(self, ext):
+    """Returns the additional compiler and linker flags, and whether to use link-time optimization for the given extension"""
+    flags = []
+    if self.pgo_phase == 'generate':
+      flags = profile_generate_flags(self.profile_directory(ext))
+    elif self.pgo_phase == 'use':
+      flags = profile_use_flags(self.profile_compiler(ext), self.profile_directory(ext))
+    lto = self.pgo_phase == 'use' or self.lto or getattr(ext, 'lto', False)
+    return flags, lto
+
+
+  def build_extension(self, ext):
+    """Builds the given extension.
+
+    When the extension is of type Library, it compiles the library with CMake, otherwise the default compilation mechanism is used.
+    Afterwards, it adds the according library, and the include and library directories of the Library's, so that other Extensions can find the newly generated lib.
+    """
+
+    # HACK: remove the "-Wstrict-prototypes" option keyword
+    self.compiler.compiler = [c for c in self.compiler.compiler if c != "-Wstrict-prototypes"]
+    self.compiler.compiler_so = [c for c in self.compiler.compiler_so if c != "-Wstrict-prototypes"]
+    if "-Wno-strict-aliasing" not in self.compiler.compiler:
+      self.compiler.compiler.append("-Wno-strict-aliasing")
+    if "-Wno-strict-aliasing" not in self.compiler.compiler_so:
+      self.compiler.compiler_so.append("-Wno-strict-aliasing")
+
+    # check if it is our type of extension
+    if isinstance(ext, Library):
+      # TODO: get compiler and add it to the compiler
+      # TODO: get the debug status and add the build_type parameter
+      # build libraries using the provided functions
+      # compile
+      flags, lto = self.optimization_flags(ext)
+      # CMake runs its own parallel build; share the jobs among all libraries
+      parallel = None
+      if self.job_server is not None:
+        libraries = [other for other in self.extensions if isinstance(other, Library)]
+        parallel = self.job_server.acquire(self.job_server.limit // len(libraries))
+      try:
+        ext.compile(self.build_lib, extra_compile_args=flags, extra_link_args=flags, lto=lto, parallel=parallel)
+      finally:
+        if parallel: self.job_server.release(parallel)
+      libs = [ext.c_name]
+      lib_dirs = [ext.c_target_directory]
+      include_dirs = [ext.c_self_include_directory]
+
+      # set the DEFAULT library path and include path for all other extensions
+      with self.lock:
+        for other_ext in self.extensions:
+          if other_ext != ext:
+            other_ext.libraries = uniq(libs + (other_ext.libraries if other_ext.libraries else []))
+            other_ext.library_dirs = uniq(lib_dirs + (other_ext.library_dirs if other_ext.library_dirs else []))
+            other_ext.include_dirs = uniq(include_dirs + (other_ext.include_dirs if other_ext.include_dirs else []))
+    else:
+      # all other libs are build with the default command, possibly batching
+      # sources and using precompiled headers; the original sources stay
+      # dependencies, so that changing them triggers a re-build
+      sources, depends, extra_compile_args, extra_link_args = ext.sources, ext.depends, ext.extra_compile_args, ext.extra_link_args
+      try:
+        flags, lto = self.optimization_flags(ext)
+        if lto: flags = flags + lto_flags()
+        ext.extra_compile_args = extra_compile_args + flags
+        ext.extra_link_args = extra_link_args + flags
+        if getattr(ext, 'unity_batch_size', 0) > 1:
+          unity_dir = os.path.join(self.build_temp, 'unity')
+          ext.sources = write_unity_sources(ext.name.replace('.', '_'), sources, ext.unity_batch_size, unity_dir)
+          ext.depends = depends + sources
+        if getattr(ext, 'precompiled_headers', None) and self.compiler.compiler_type == 'unix':
+          ext.extra_compile_args = ['-include', self.precompile_headers(ext), '-Winvalid-pch'] + ext.extra_compile_args
+        _build_ext.build_extension(self, ext)
+      finally:
+        ext.sources, ext.depends, ext.extra_compile_args, ext.extra_link_args = sources, depends, extra_compile_args, extra_link_args
+
+      if self.isa_level is None:
+        self.build_isa_variants(ext)
+
+
+  def build_isa_variants(self, ext):
+    """Builds the ISA variants of the given extension.
+
+    Each variant is compiled with its own temporary directory, and written next to the extension into a sub-directory named after its level, see :py:func:`bob.extension.isa.isa_variant_path`.
+    Since other extensions are built concurrently, the variants are built by a copy of this command.
+    """
+    import copy
+    extra_compile_args, extra_link_args = ext.extra_compile_args, ext.extra_link_args
+    try:
+      for level in getattr(ext, 'isa_variants', []):
+        if self.compiler.compiler_type != 'unix' or not compiler_supports_isa(self.compiler.compiler_so[0], level):
+          continue
+        variant = copy.copy(self)
+        variant.isa_level = level
+        variant.build_temp = os.path.join(self.build_temp, level)
+        ext.extra_compile_args = extra_compile_args + isa_flags(level)
+        ext.extra_link_args = extra_link_args + isa_flags(level)
+        variant.build_extension(ext)
+    finally:
+      ext.extra_compile_args, ext.extra_link_args = extra_compile_args, extra_link_args
+
+
+  def precompile_headers(self, ext):
+    """Precompiles the ``precompiled_headers`` of the given extension.
+
+    The precompiled header is generated with the same compiler, flags, macros
+    and include directories as the sources of the extension. The macros
+    generated by :py:func:`generate_self_macros` are ignored, so that all
+    extensions of a package can share the same precompiled header.
+
+    Returns the prefix header to be included with ``-include``, see
+    :py:func:`bob.extension.pch.precompile`.
+    """
+
+    from distutils.ccompiler import gen_preprocess_options
+    macros = [m for m in ext.define_macros if not m[0].startswith('BOB_EXT_')]
+    macros += [(undef,) for undef in ext.undef_macros]
+    include_dirs = (ext.include_dirs or []) + (self.compiler.include_dirs or [])
+    args = gen_preprocess_options(macros, include_dirs) + ext.extra_compile_args
+    if self.debug: args = ['-g'] + args
+    return precompile(self.compiler.compiler_so, ext.precompiled_headers, args, os.path.join(self.build_temp, 'pch'), self.compiler.spawn)
+
+
+  def get_ext_filename(self, fullname):
+    """Returns the library path for the given name"""
+    filename = _build_ext.get_ext_filename(self, fullname)
+    if fullname in self.ext_map:
+      ext = self.ext_map[fullname]
+      if isinstance(ext, Library):
+        # remove any extension that was artificially added by python
+        basename = filename.replace(distutils.sysconfig.get_config_var("SO"), "")
+        # HACK: (for some python versions the above code doesn't seem to work)
+        index = basename.find("cpython-")
+        if index > 0:
+          basename = basename[:index-1]
+
+        return get_full_libname(os.path.basename(basename), os.path.dirname(basename))
+    return filename
+
+
+  def get_ext_fullpath(self, ext_name):
+    """Returns the path of the given extension, or of its variant while building ISA variants"""
+    path = _build_ext.get_ext_fullpath(self, ext_name)
+    return isa_variant_path(path, self.isa_level) if self.isa_level else path
+
+
+  def copy_extensions_to_source(self):
+    """Copies the extensions, including their ISA variants, into the source directory for ``--inplace`` builds"""
+    _build_ext.copy_extensions_to_source(self)
+    build_py = self.get_finalized_command('build_py')
+    for ext in self.extensions:
+      if not getattr(ext, 'isa_variants', None): continue
+      fullname = self.get_ext_fullname(ext.name)
+      filename = self.get_ext_filename(fullname)
+      package_dir = build_py.get_package_dir('.'.join(fullname.split('.')[:-1]))
+      for level in ext.isa_variants:
+        regular_file = isa_variant_path(os.path.join(self.build_lib, filename), level)
+        if os.path.exists(regular_file):
+          self.mkpath(os.path.join(package_dir, level))
+          self.copy_file(regular_file, isa_variant_path(os.path.join(package_dir, os.path.basename(filename)), level), level=self.verbose)
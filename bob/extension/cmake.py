@@ -1,4 +1,13 @@
+import io
 import os
+import sys
+
+from .utils import find_executable
+from .unity import write_unity_sources
+from .pch import include_directive
+from . import object_cache
+from .object_cache import cache_directory
+from .compile_times import times_directory, launcher_command
 
 HEADER = (
   '\n'
@@ -44,10 +53,14 @@ HEADER = (
 )
 
 
+CMAKE_MINIMUM_VERSION = '3.13'
+"""The minimum CMake version required by the generated CMakeLists.txt files"""
+
+
 class CMakeListsGenerator:
   """Generates a CMakeLists.txt file for the given sources, include directories and libraries."""
 
-  def __init__(self, name, sources, target_directory, version = '1.0.0', include_directories = [], system_include_directories=[], libraries = [], library_directories = [], macros = []):
+  def __init__(self, name, sources, target_directory, version = '1.0.0', include_directories = [], system_include_directories=[], libraries = [], library_directories = [], macros = [], compiler_launcher = None, unity_batch_size = 0, precompiled_headers = [], compile_options = [], link_options = [], interprocedural_optimization = False, visibility = 'default', version_script = None, symbolic = False, benchmark_sources = []):
     """Initializes the CMakeLists generator.
 
     Keyword parameters:
@@ -79,6 +92,38 @@ class CMakeListsGenerator:
 
     macros : [(string, string)]
       A list of preprocessor defines ``name=value`` that will be added to the compilation
+
+    compiler_launcher : string or None
+      A program (such as ``ccache`` or ``sccache``) that should wrap all compiler calls, see :py:func:`compiler_launcher`
+
+    unity_batch_size : int
+      If greater than 1, up to this number of ``sources`` are compiled in a single translation unit, see :py:mod:`bob.extension.unity`
+
+    precompiled_headers : [string]
+      A list of headers that should be precompiled for all ``sources``, e.g., ``['<vector>', 'blitz/array.h']``.
+      Precompiled headers are only used with CMake version 3.16 or newer.
+
+    compile_options : [string]
+      A list of additional compiler flags, e.g., for profile-guided optimization
+
+    link_options : [string]
+      A list of additional linker flags
+
+    interprocedural_optimization : bool
+      Enables link-time optimization of the library, if supported by the compiler
+
+    visibility : string
+      The default visibility of symbols, ``'default'`` or ``'hidden'``, see :py:mod:`bob.extension.symbols`
+
+    version_script : string or None
+      A linker version script that selects the exported symbols, see :py:func:`bob.extension.symbols.version_script`
+
+    symbolic : bool
+      Binds the references to functions within the library at link time (``-Bsymbolic-functions``)
+
+    benchmark_sources : [string]
+      A list of source files registering benchmarks with ``bob.extension/benchmark.h``.
+      If given, they are linked with the library into the executable ``<name>_benchmark`` in the ``target_directory``, see :py:mod:`bob.extension.benchmark`
     """
 
     self.name = name
@@ -90,9 +135,26 @@ class CMakeListsGenerator:
     self.libraries = libraries
     self.library_directories = library_directories
     self.macros = macros
+    self.compiler_launcher = compiler_launcher
+    self.unity_batch_size = unity_batch_size
+    self.precompiled_headers = precompiled_headers
+    self.compile_options = compile_options
+    self.link_options = link_options
+    self.interprocedural_optimization = interprocedural_optimization
+    self.visibility = visibility
+    self.version_script = version_script
+    self.symbolic = symbolic
+    self.benchmark_sources = benchmark_sources
 
   def generate(self, source_directory, build_directory):
-    """Generates the CMakeLists.txt file in the given directory."""
+    """Generates the CMakeLists.txt file in the given directory.
+
+    An existing file is only re-written when its contents change, so that CMake does not need to re-configure the build.
+
+    Returns:
+
+      bool: Whether the CMakeLists.txt file was (re-)written
+    """
 
     # check if CFLAGS or CXXFLAGS are set, and set them if not
     if 'CFLAGS' not in os.environ:
@@ -105,28 +167,223 @@ class CMakeListsGenerator:
     # source and target in different directories -> use absolute paths
     source_files = [os.path.join(source_dir, s) for s in self.sources]
 
+    # batch sources into jumbo translation units, if requested
+    if self.unity_batch_size > 1:
+      source_files = write_unity_sources(self.name, source_files, self.unity_batch_size, os.path.join(build_directory, 'unity'))
+
     filename = os.path.join(build_directory, "CMakeLists.txt")
-    with open(filename, 'w') as f:
+    with io.StringIO() as f:
       f.write('# WARNING! This file is automatically generated. Do not change its contents.\n\n')
-      f.write('cmake_minimum_required(VERSION 2.8)\n')
+      f.write('cmake_minimum_required(VERSION %s)\n' % CMAKE_MINIMUM_VERSION)
       f.write('project(%s)\n' % self.name)
       f.write(HEADER)
+      # compile this library
+      f.write('add_library(${PROJECT_NAME} \n\t' + "\n\t".join(source_files) + '\n)\n')
+      f.write('set_target_properties(${PROJECT_NAME} PROPERTIES POSITION_INDEPENDENT_CODE TRUE)\n')
+      f.write('set_target_properties(${PROJECT_NAME} PROPERTIES LIBRARY_OUTPUT_DIRECTORY %s)\n' % self.target_directory)
+      # use ccache/sccache (or any other launcher) to wrap the compiler
+      if self.compiler_launcher:
+        launcher = self._launcher()
+        f.write('set_target_properties(${PROJECT_NAME} PROPERTIES C_COMPILER_LAUNCHER %s CXX_COMPILER_LAUNCHER %s)\n' % (launcher, launcher))
+      f.write('\n')
       # add include directories
       for directory in self.includes:
-        f.write('include_directories(%s)\n' % directory)
+        f.write('target_include_directories(${PROJECT_NAME} PRIVATE %s)\n' % directory)
       for directory in self.system_includes:
-        f.write('include_directories(SYSTEM %s)\n' % directory)
+        f.write('target_include_directories(${PROJECT_NAME} SYSTEM PRIVATE %s)\n' % directory)
       # add link directories
       # TODO: handle RPATH and Non-RPATH differently (don't know, how, though)
       for directory in self.library_directories:
-        f.write('link_directories(%s)\n' % directory)
+        f.write('target_link_directories(${PROJECT_NAME} PRIVATE %s)\n' % directory)
       # add defines
-      for macro in self.macros:
-        f.write('add_definitions(-D%s=%s)\n' % macro)
-      # compile this library
-      f.write('\nadd_library(${PROJECT_NAME} \n\t' + "\n\t".join(source_files) + '\n)\n')
-      f.write('set_target_properties(${PROJECT_NAME} PROPERTIES POSITION_INDEPENDENT_CODE TRUE)\n')
-      f.write('set_target_properties(${PROJECT_NAME} PROPERTIES LIBRARY_OUTPUT_DIRECTORY %s)\n\n' % self.target_directory)
+      for name, value in self.macros:
+        if value is None:
+          f.write('target_compile_definitions(${PROJECT_NAME} PRIVATE %s)\n' % name)
+        else:
+          f.write('target_compile_definitions(${PROJECT_NAME} PRIVATE %s=%s)\n' % (name, value))
+      # additional flags and link-time optimization
+      if self.compile_options:
+        f.write('target_compile_options(${PROJECT_NAME} PRIVATE %s)\n' % " ".join(self.compile_options))
+      if self.link_options:
+        f.write('target_link_options(${PROJECT_NAME} PRIVATE %s)\n' % " ".join(self.link_options))
+      # export only the public symbols
+      if self.visibility == 'hidden':
+        f.write('set_target_properties(${PROJECT_NAME} PROPERTIES C_VISIBILITY_PRESET hidden CXX_VISIBILITY_PRESET hidden VISIBILITY_INLINES_HIDDEN TRUE)\n')
+      if self.version_script:
+        f.write('target_link_options(${PROJECT_NAME} PRIVATE -Wl,--version-script=%s)\n' % self.version_script)
+        f.write('set_target_properties(${PROJECT_NAME} PROPERTIES LINK_DEPENDS %s)\n' % self.version_script)
+      if self.symbolic:
+        f.write('target_link_options(${PROJECT_NAME} PRIVATE -Wl,-Bsymbolic-functions)\n')
+      if self.interprocedural_optimization:
+        f.write('include(CheckIPOSupported)\n')
+        f.write('check_ipo_supported(RESULT IPO_SUPPORTED OUTPUT IPO_OUTPUT)\n')
+        f.write('if(IPO_SUPPORTED)\n')
+        f.write('  set_target_properties(${PROJECT_NAME} PROPERTIES INTERPROCEDURAL_OPTIMIZATION TRUE)\n')
+        f.write('else()\n')
+        f.write('  message(WARNING "Link-time optimization is not supported: ${IPO_OUTPUT}")\n')
+        f.write('endif()\n')
+      # precompile common headers (CMake takes care of flags and macros)
+      if self.precompiled_headers:
+        f.write('if(NOT CMAKE_VERSION VERSION_LESS 3.16)\n')
+        f.write('  target_precompile_headers(${PROJECT_NAME} PRIVATE %s)\n' % " ".join('"%s"' % include_directive(h) for h in self.precompiled_headers))
+        f.write('endif()\n')
       # link libraries
       if self.libraries:
-        f.write('target_link_libraries(${PROJECT_NAME} %s)\n\n' % " ".join(self.libraries))
+        f.write('\ntarget_link_libraries(${PROJECT_NAME} PRIVATE %s)\n\n' % " ".join(self.libraries))
+      # the native benchmarks of this library
+      if self.benchmark_sources:
+        self._write_benchmark(f, source_dir, build_directory)
+
+      contents = f.getvalue()
+
+    return _write_if_changed(filename, contents)
+
+  def _launcher(self):
+    """Returns the compiler launcher, quoted for CMake"""
+
+    launcher = self.compiler_launcher
+    if ';' in launcher or ' ' in launcher:
+      launcher = '"%s"' % launcher
+    return launcher
+
+  def _write_benchmark(self, f, source_dir, build_directory):
+    """Writes the executable that runs the benchmarks of this library"""
+
+    main = os.path.join(build_directory, 'benchmark_main.cpp')
+    _write_if_changed(main, BENCHMARK_MAIN)
+    sources = [main] + [os.path.join(source_dir, s) for s in self.benchmark_sources]
+    f.write('add_executable(${PROJECT_NAME}_benchmark \n\t' + "\n\t".join(sources) + '\n)\n')
+    f.write('set_target_properties(${PROJECT_NAME}_benchmark PROPERTIES RUNTIME_OUTPUT_DIRECTORY %s BUILD_RPATH %s)\n' % (self.target_directory, self.target_directory))
+    if self.compiler_launcher:
+      f.write('set_target_properties(${PROJECT_NAME}_benchmark PROPERTIES CXX_COMPILER_LAUNCHER %s)\n' % self._launcher())
+    for directory in self.includes:
+      f.write('target_include_directories(${PROJECT_NAME}_benchmark PRIVATE %s)\n' % directory)
+    for directory in self.system_includes:
+      f.write('target_include_directories(${PROJECT_NAME}_benchmark SYSTEM PRIVATE %s)\n' % directory)
+    for directory in self.library_directories:
+      f.write('target_link_directories(${PROJECT_NAME}_benchmark PRIVATE %s)\n' % directory)
+    for name, value in self.macros:
+      if value is None:
+        f.write('target_compile_definitions(${PROJECT_NAME}_benchmark PRIVATE %s)\n' % name)
+      else:
+        f.write('target_compile_definitions(${PROJECT_NAME}_benchmark PRIVATE %s=%s)\n' % (name, value))
+    f.write('target_compile_definitions(${PROJECT_NAME}_benchmark PRIVATE "BOB_BENCHMARK_LIBRARY=\\"${PROJECT_NAME}\\"")\n')
+    f.write('target_link_libraries(${PROJECT_NAME}_benchmark PRIVATE %s)\n' % " ".join(['${PROJECT_NAME}'] + self.libraries))
+
+
+BENCHMARK_MAIN = (
+  '// WARNING! This file is automatically generated. Do not change its contents.\n'
+  '#include <bob.extension/benchmark.h>\n\n'
+  'int main(int argc, char** argv){\n'
+  '  return bob::extension::benchmark::main(argc, argv);\n'
+  '}\n'
+)
+
+
+def _write_if_changed(filename, contents):
+  """Writes the file, unless it exists with the same contents, and returns whether it was written"""
+
+  # re-writing the file would trigger a re-configuration of CMake, or a re-compilation
+  if os.path.exists(filename):
+    with open(filename) as old:
+      if old.read() == contents:
+        return False
+  with open(filename, 'w') as new:
+    new.write(contents)
+  return True
+
+
+def cmake_generator(build_directory=None):
+  """Returns the CMake generator to be used for building libraries.
+
+  The generator can be set with the ``BOB_BUILD_GENERATOR`` environment
+  variable, e.g., to ``"Unix Makefiles"``. Otherwise, ``Ninja`` is used when
+  the ``ninja`` executable can be found, and ``Unix Makefiles`` if not.
+
+  CMake refuses to configure a build directory with a generator different from
+  the one it has been configured with before. When ``build_directory``
+  contains a stale ``CMakeCache.txt`` generated with another generator, that
+  cache is removed.
+
+  Returns:
+
+    str: The name of the CMake generator
+
+    str or None: The path to the build program (``ninja`` or ``make``), if it
+      was found; ``None`` for generators that find their build program
+      themselves (e.g., ``Xcode`` or ``Visual Studio``)
+  """
+
+  generator = os.environ.get('BOB_BUILD_GENERATOR')
+  if generator:
+    if generator.startswith('Ninja'):
+      program = find_executable('ninja')
+    elif generator.endswith('Makefiles'):
+      program = find_executable('make')
+    else:
+      program = None
+  else:
+    program = find_executable('ninja')
+    generator = 'Ninja' if program else 'Unix Makefiles'
+    if not program:
+      program = find_executable('make')
+
+  program = program[0] if program else None
+
+  if build_directory is not None:
+    cache = os.path.join(build_directory, 'CMakeCache.txt')
+    if os.path.exists(cache):
+      with open(cache) as f:
+        cached = [l.strip().split('=', 1)[-1] for l in f if l.startswith('CMAKE_GENERATOR:')]
+      if cached and cached[0] != generator:
+        import shutil
+        os.remove(cache)
+        shutil.rmtree(os.path.join(build_directory, 'CMakeFiles'), ignore_errors=True)
+
+  return generator, program
+
+
+def compiler_launcher():
+  """Returns the compiler launcher (e.g., ``ccache``) to wrap the compiler with.
+
+  The launcher can be set with the ``BOB_BUILD_LAUNCHER`` environment variable,
+  either as an executable name or as a full path. If this variable is empty or
+  ``none``, no launcher is used. If it is not set and the object cache is
+  enabled with ``BOB_BUILD_CACHE``, the :py:func:`bob.extension.object_cache.launcher`
+  is used. Otherwise, ``ccache`` and ``sccache`` are searched for, in this
+  order.
+
+  When compile times are recorded with ``BOB_BUILD_TIMES``, the
+  :py:func:`bob.extension.compile_times.launcher` is used instead of any other
+  launcher, so that all translation units are compiled and measured.
+
+  Returns:
+
+    str or None: The full path to the compiler launcher (a CMake list for the
+      object cache), or ``None``
+  """
+
+  directory = times_directory()
+  if directory is not None:
+    return ';'.join(launcher_command(directory))
+
+  launcher = os.environ.get('BOB_BUILD_LAUNCHER')
+  if launcher is not None:
+    if launcher.strip().lower() in ('', 'none'):
+      return None
+    if os.path.isabs(launcher):
+      return launcher
+    candidates = [launcher]
+  elif cache_directory() is not None:
+    # run as a script, which is much faster than importing this package
+    script = os.path.splitext(object_cache.__file__)[0] + '.py'
+    return '%s;%s' % (sys.executable, script)
+  else:
+    candidates = ['ccache', 'sccache']
+
+  for candidate in candidates:
+    found = find_executable(candidate)
+    if found:
+      return found[0]
+
+  return None
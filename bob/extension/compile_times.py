@@ -0,0 +1,411 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Measures the compilation of each translation unit, and reports the most
+expensive translation units, headers and templates.
+
+When ``BOB_BUILD_TIMES`` is set, all compiler calls of extensions and libraries
+are run through :py:func:`launcher`, which records the wall time and the peak
+memory of the compiler, as well as the timing information of the compiler
+itself (``-ftime-report`` of GCC, ``-ftime-trace`` of clang). Use
+:py:func:`report` or the ``bob compile-times`` command to aggregate the
+records. This module only depends on the standard library, since it is run as
+a compiler launcher.
+"""
+
+import os
+import re
+import sys
+import json
+import time
+import shutil
+import hashlib
+import tempfile
+import subprocess
+import logging
+
+# run as a script by the launcher, see launcher_command
+try:
+  from .object_cache import _PATH_OPTIONS
+except ImportError:
+  from object_cache import _PATH_OPTIONS
+
+logger = logging.getLogger(__name__)
+
+DEFAULT_TIMES_DIRECTORY = os.path.join('build', 'compile_times')
+"""The directory (relative to the package) the records are written to when
+``BOB_BUILD_TIMES=1``"""
+
+_SOURCE_EXTENSIONS = ('.c', '.cc', '.cpp', '.cxx', '.C')
+
+
+def times_directory(directory=None):
+  """Returns the directory the compile times are recorded in, or ``None`` if
+  they are not recorded.
+
+  If ``directory`` is not given, the ``BOB_BUILD_TIMES`` environment variable
+  is used: ``1`` selects the :py:data:`DEFAULT_TIMES_DIRECTORY`, any other
+  value except ``0`` is taken as the directory.
+  """
+
+  if directory is None:
+    directory = os.environ.get('BOB_BUILD_TIMES', '').strip()
+  if directory in ('', '0'):
+    return None
+  if directory == '1':
+    directory = DEFAULT_TIMES_DIRECTORY
+  return os.path.realpath(os.path.expanduser(directory))
+
+
+def launcher_command(directory):
+  """Returns the command that runs the :py:func:`launcher` for the given
+  directory, to be prepended to compiler calls"""
+
+  # run as a script, which is much faster than importing this package
+  return [sys.executable, os.path.splitext(__file__)[0] + '.py', directory]
+
+
+def _atomic_write(filename, contents):
+  directory = os.path.dirname(filename)
+  try:
+    os.makedirs(directory)
+  except OSError:
+    if not os.path.isdir(directory): raise
+  with tempfile.NamedTemporaryFile('w', dir=directory, delete=False) as f:
+    f.write(contents)
+  os.replace(f.name, filename)
+
+
+def compiler_flavor(compiler, directory):
+  """Returns ``'clang'``, ``'gcc'`` or ``None`` for the given compiler
+  executable; the result is cached in the given directory"""
+
+  path = shutil.which(compiler) or compiler
+  try:
+    identity = '%s %d' % (os.path.realpath(path), os.stat(path).st_mtime_ns)
+  except OSError:
+    return None
+  cached = os.path.join(directory, 'compilers', hashlib.sha1(identity.encode('utf-8')).hexdigest())
+  if os.path.exists(cached):
+    with open(cached) as f:
+      return f.read() or None
+
+  try:
+    version = subprocess.check_output([compiler, '--version'], stderr=subprocess.STDOUT).decode('utf-8', 'replace').lower()
+  except (OSError, subprocess.CalledProcessError):
+    version = ''
+  flavor = 'clang' if 'clang' in version else 'gcc' if ('gcc' in version or 'free software foundation' in version) else ''
+  _atomic_write(cached, flavor)
+  return flavor or None
+
+
+def timing_flags(flavor):
+  """Returns the flags that make the compiler of the given flavor report its
+  timing information"""
+
+  if flavor == 'clang':
+    return ['-ftime-trace']
+  if flavor == 'gcc':
+    # -H lists the included headers
+    return ['-ftime-report', '-H']
+  return []
+
+
+def parse_gcc_report(stderr):
+  """Splits the standard error output of GCC called with ``-ftime-report -H``.
+
+  Returns:
+
+    str: The remaining output, i.e., the diagnostics of the compiler
+
+    dict: The wall time of each phase and timing variable, in seconds
+
+    [str]: The headers included by the translation unit, in inclusion order
+  """
+
+  diagnostics, phases, headers = [], {}, []
+  section = None
+  for line in stderr.splitlines(True):
+    stripped = line.strip()
+    if re.match(r'\.+ ', line):
+      headers.append(stripped.split(' ', 1)[1])
+    elif stripped.startswith('Multiple include guards may be useful for'):
+      section = 'guards'
+    elif stripped.startswith('Time variable'):
+      section = 'times'
+    elif section == 'times' and stripped:
+      # name : usr (%) sys (%) wall (%) memory
+      match = re.match(r'\|?(.+?)\s*:\s*([\d.]+)\s*(?:\(\s*\d+%\))?\s*([\d.]+)\s*(?:\(\s*\d+%\))?\s*([\d.]+)', stripped)
+      if match:
+        phases[match.group(1)] = float(match.group(4))
+      if stripped.startswith('TOTAL'):
+        section = None
+    elif section == 'guards' and stripped and ':' not in stripped:
+      # a header that could use include guards
+      pass
+    elif section == 'guards':
+      section = None
+      if stripped: diagnostics.append(line)
+    elif section is None:
+      diagnostics.append(line)
+  return ''.join(diagnostics), phases, list(dict.fromkeys(headers))
+
+
+def parse_time_trace(filename):
+  """Reads the given ``-ftime-trace`` file written by clang.
+
+  Returns:
+
+    dict: The total time of each event (such as ``Frontend``, ``Backend``,
+    ``InstantiateClass`` or ``Source``), in seconds
+
+    dict: The inclusive parsing time of each header, in seconds
+
+    dict: The instantiation time of each template, in seconds
+  """
+
+  with open(filename) as f:
+    events = json.load(f).get('traceEvents', [])
+  phases, headers, templates = {}, {}, {}
+  for event in events:
+    name, detail = event.get('name', ''), event.get('args', {}).get('detail')
+    seconds = event.get('dur', 0) / 1e6
+    if name.startswith('Total '):
+      phases[name[6:]] = seconds
+    elif name == 'Source' and detail:
+      headers[detail] = headers.get(detail, 0) + seconds
+    elif name in ('InstantiateClass', 'InstantiateFunction') and detail:
+      templates[detail] = templates.get(detail, 0) + seconds
+  return phases, headers, templates
+
+
+def _peak_memory():
+  try:
+    import resource
+  except ImportError:
+    return None
+  maxrss = resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss
+  # kilobytes on Linux, bytes on macOS
+  return maxrss if sys.platform == 'darwin' else maxrss * 1024
+
+
+def launcher(argv):
+  """Runs the compiler command ``argv[1:]``, and records its compile times
+  in the directory ``argv[0]``; this is the compiler launcher used for
+  extensions and by CMake.
+
+  Each record is a JSON file named after the hash of the object file, and
+  contains the ``source``, the ``object``, the ``wall`` time in seconds, the
+  peak ``memory`` in bytes, the exit ``status`` and the ``phases`` of the
+  compiler (see :py:func:`parse_gcc_report` and :py:func:`parse_time_trace`),
+  as well as the included ``headers`` and, for clang, the ``templates``. The
+  trace files of clang are kept next to the records.
+
+  Returns:
+
+    int: The exit status of the compiler
+  """
+
+  directory, command = argv[0], argv[1:]
+  if '-c' not in command or '-o' not in command:
+    return subprocess.call(command)
+  output = command[command.index('-o') + 1]
+  sources = [a for i, a in enumerate(command[1:], 1)
+      if os.path.splitext(a)[1] in _SOURCE_EXTENSIONS and not a.startswith('-') and command[i-1] not in _PATH_OPTIONS]
+  if len(sources) != 1:
+    return subprocess.call(command)
+
+  flavor = compiler_flavor(command[0], directory)
+  with tempfile.TemporaryFile() as errors:
+    start = time.perf_counter()
+    status = subprocess.call(command + timing_flags(flavor), stderr=errors)
+    wall = time.perf_counter() - start
+    errors.seek(0)
+    stderr = errors.read().decode('utf-8', 'replace')
+
+  key = hashlib.sha1(os.path.realpath(output).encode('utf-8')).hexdigest()
+  record = {
+      'source': os.path.realpath(sources[0]),
+      'object': os.path.realpath(output),
+      'compiler': flavor,
+      'wall': wall,
+      'memory': _peak_memory(),
+      'status': status,
+      'phases': {},
+      'headers': {},
+      'templates': {},
+      }
+
+  if flavor == 'gcc':
+    stderr, record['phases'], headers = parse_gcc_report(stderr)
+    # GCC does not measure headers; their time is unknown (None), and the
+    # report attributes the frontend time of the unit to each instead
+    record['headers'] = dict((k, None) for k in headers)
+  elif flavor == 'clang':
+    trace = os.path.splitext(output)[0] + '.json'
+    if os.path.exists(trace):
+      record['phases'], record['headers'], record['templates'] = parse_time_trace(trace)
+      shutil.move(trace, os.path.join(directory, key + '.trace.json'))
+
+  sys.stderr.write(stderr)
+  _atomic_write(os.path.join(directory, key + '.json'), json.dumps(record))
+  return status
+
+
+def install(compiler, directory):
+  """Wraps the ``_compile`` method of the given
+  :py:class:`distutils.unixccompiler.UnixCCompiler`, so that all compiler
+  calls are run through the :py:func:`launcher`.
+
+  Returns:
+
+    callable: A function that removes the wrapper again
+  """
+
+  from distutils.errors import DistutilsExecError, CompileError
+  from distutils import unixccompiler
+  fixup = getattr(unixccompiler, 'compiler_fixup', lambda compiler_so, args: compiler_so)
+  _compile = compiler._compile
+
+  # those lines are copied from distutils.unixccompiler.UnixCCompiler
+  def _timed_compile(obj, src, ext, cc_args, extra_postargs, pp_opts):
+    compiler_so = fixup(compiler.compiler_so, cc_args + extra_postargs)
+    try:
+      compiler.spawn(launcher_command(directory) + compiler_so + cc_args + [src, '-o', obj] + extra_postargs)
+    except DistutilsExecError as msg:
+      raise CompileError(msg)
+
+  compiler._compile = _timed_compile
+
+  def _uninstall():
+    compiler._compile = _compile
+  return _uninstall
+
+
+def load_records(directory):
+  """Returns all records in the given directory, see :py:func:`launcher`"""
+
+  records = []
+  for name in sorted(os.listdir(directory)) if os.path.isdir(directory) else []:
+    if name.endswith('.json') and not name.endswith('.trace.json'):
+      try:
+        with open(os.path.join(directory, name)) as f:
+          records.append(json.load(f))
+      except (ValueError, OSError):
+        logger.warning("Ignoring the corrupt record `%s'", name)
+  return records
+
+
+def _frontend(record):
+  phases = record['phases']
+  if record['compiler'] == 'clang':
+    return phases.get('Frontend')
+  if 'phase parsing' in phases:
+    return phases['phase parsing'] + phases.get('phase lang. deferred', 0)
+  return None
+
+
+def _instantiation(record):
+  phases = record['phases']
+  if record['compiler'] == 'clang':
+    return phases.get('InstantiateClass', 0) + phases.get('InstantiateFunction', 0) if phases else None
+  return phases.get('template instantiation')
+
+
+def _backend(record):
+  phases = record['phases']
+  return phases.get('Backend' if record['compiler'] == 'clang' else 'phase opt and generate')
+
+
+def report(directory, top=20):
+  """Aggregates the records in the given directory.
+
+  Parameters:
+
+    directory : str
+      The directory with the records, see :py:func:`times_directory`
+
+    top : int
+      The number of entries in each list of the report
+
+  Returns:
+
+    dict: With the entries:
+
+    * ``units``: the most expensive translation units (by wall time), each a
+      dictionary with the ``source``, ``wall``, ``memory`` and ``frontend``,
+      ``templates`` and ``backend`` times
+    * ``headers``: the most expensive headers, as dictionaries with the
+      ``header``, the number of ``units`` including it, and its ``time``. For
+      clang, the time is the time spent parsing the header; GCC does not
+      measure headers, so the time is the frontend time of all units that
+      include it, which is an upper bound.
+    * ``templates``: the most expensive template instantiations (clang only),
+      with the ``template``, the number of ``units`` and the ``time``
+    * ``total``: the summed wall time of all units
+  """
+
+  records = load_records(directory)
+  units = [{
+      'source': r['source'],
+      'wall': r['wall'],
+      'memory': r['memory'],
+      'frontend': _frontend(r),
+      'templates': _instantiation(r),
+      'backend': _backend(r),
+      'status': r['status'],
+      } for r in records]
+
+  headers, templates = {}, {}
+  for r in records:
+    for header, seconds in r['headers'].items():
+      if seconds is None: seconds = _frontend(r) or 0
+      count, total = headers.get(header, (0, 0))
+      headers[header] = (count + 1, total + seconds)
+    for template, seconds in r['templates'].items():
+      count, total = templates.get(template, (0, 0))
+      templates[template] = (count + 1, total + seconds)
+
+  return {
+      'units': sorted(units, key=lambda u: -u['wall'])[:top],
+      # on ties, headers stay in inclusion order, i.e., the headers included
+      # by the sources come before the headers they include
+      'headers': [{'header': k, 'units': v[0], 'time': v[1]} for k, v in
+        sorted(headers.items(), key=lambda i: (-i[1][1], -i[1][0]))[:top]],
+      'templates': [{'template': k, 'units': v[0], 'time': v[1]} for k, v in
+        sorted(templates.items(), key=lambda i: (-i[1][1], i[0]))[:top]],
+      'total': sum(u['wall'] for u in units),
+      'count': len(units),
+      }
+
+
+def _seconds(value):
+  return '%8.2fs' % value if value is not None else '%9s' % '-'
+
+
+def format_report(report):
+  """Returns the given :py:func:`report` as text"""
+
+  lines = ['Translation units: %d, compiled in %.2fs' % (report['count'], report['total']), '']
+  if report['units']:
+    lines.append('%9s %9s %9s %9s %9s  %s' % ('wall', 'memory', 'frontend', 'templates', 'backend', 'source'))
+    for u in report['units']:
+      memory = '%8.0fM' % (u['memory'] / 2.**20) if u['memory'] else '%9s' % '-'
+      lines.append('%s %s %s %s %s  %s%s' % (_seconds(u['wall']), memory, _seconds(u['frontend']),
+        _seconds(u['templates']), _seconds(u['backend']), u['source'], '' if u['status'] == 0 else ' (failed)'))
+    lines.append('')
+  if report['headers']:
+    lines.append('%9s %9s  %s' % ('time', 'units', 'header'))
+    for h in report['headers']:
+      lines.append('%s %9d  %s' % (_seconds(h['time']), h['units'], h['header']))
+    lines.append('')
+  if report['templates']:
+    lines.append('%9s %9s  %s' % ('time', 'units', 'template'))
+    for t in report['templates']:
+      lines.append('%s %9d  %s' % (_seconds(t['time']), t['units'], t['template']))
+    lines.append('')
+  return '\n'.join(lines)
+
+
+if __name__ == '__main__':
+  sys.exit(launcher(sys.argv[1:]))
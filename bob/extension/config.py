@@ -5,17 +5,148 @@
 '''
 
 import imp
+import os
+import types
+import pickle
+import marshal
+import hashlib
 import pkgutil
+import tempfile
+import importlib
+import importlib.util
 from os.path import isfile
 import logging
-import pkg_resources
+from .entry_points import entry_points
 
 logger = logging.getLogger(__name__)
 
 LOADED_CONFIGS = []
 
+DEFAULT_CACHE_DIRECTORY = os.path.join(
+    os.path.expanduser('~'), '.cache', 'bob.extension', 'configs')
+'''The directory of the compiled configuration files, see
+:py:func:`cache_directory`'''
 
-def _load_context(path, mod):
+
+def cache_directory(directory=None):
+  '''Returns the directory that caches the compiled configuration files and
+  their snapshots, or ``None`` if the cache is disabled.
+
+  If ``directory`` is not given, the ``BOB_CONFIG_CACHE`` environment variable
+  is used: ``0`` disables the cache, any other value except ``1`` is taken as
+  the cache directory; by default, the :py:data:`DEFAULT_CACHE_DIRECTORY` is
+  used.
+  '''
+
+  if directory is None:
+    directory = os.environ.get('BOB_CONFIG_CACHE', '1').strip()
+  if directory in ('', '0'):
+    return None
+  if directory == '1':
+    return DEFAULT_CACHE_DIRECTORY
+  return os.path.realpath(os.path.expanduser(directory))
+
+
+def _snapshots_enabled(snapshot=None):
+  '''Whether the contexts of configuration files are snapshot, see
+  :py:func:`load`'''
+
+  if snapshot is None:
+    snapshot = os.environ.get('BOB_CONFIG_SNAPSHOT', '').strip() not in ('', '0')
+  return bool(snapshot) and cache_directory() is not None
+
+
+def _cache_file(key, extension):
+  return os.path.join(cache_directory(), key[:2], key[2:] + extension)
+
+
+def _write_cache_file(filename, data):
+  '''Writes the cache file atomically, so that concurrent readers never see
+  incomplete files'''
+
+  try:
+    os.makedirs(os.path.dirname(filename), exist_ok=True)
+    with tempfile.NamedTemporaryFile(dir=os.path.dirname(filename),
+                                     delete=False) as f:
+      f.write(data)
+    os.replace(f.name, filename)
+  except OSError as e:
+    logger.debug("Cannot write the config cache file `%s': %s", filename, e)
+
+
+def _compile(path, source):
+  '''Compiles the source of the configuration file, taking the code from the
+  cache when the file was compiled before
+
+  The code is keyed on the contents and path of the file and on the Python
+  version, so that modified files are compiled again.
+  '''
+
+  if cache_directory() is None:
+    return compile(source, path, 'exec')
+  digest = hashlib.sha256(importlib.util.MAGIC_NUMBER)
+  digest.update(path.encode('utf-8') + b'\0')
+  digest.update(source)
+  filename = _cache_file(digest.hexdigest(), '.code')
+  try:
+    with open(filename, 'rb') as f:
+      return marshal.load(f)
+  except (OSError, EOFError, ValueError, TypeError):
+    pass
+  code = compile(source, path, 'exec')
+  _write_cache_file(filename, marshal.dumps(code))
+  return code
+
+
+def _context_state(mod):
+  '''Returns the variables of the module that can be pickled, with imported
+  modules replaced by their names, or ``None`` if some cannot be pickled'''
+
+  values, modules = {}, {}
+  for k, v in mod.__dict__.items():
+    if k.startswith('__') and k.endswith('__'):
+      continue
+    if isinstance(v, types.ModuleType):
+      modules[k] = v.__name__
+    else:
+      values[k] = v
+  try:
+    return pickle.dumps((values, modules), protocol=4)
+  except Exception:
+    return None
+
+
+def _snapshot_key(path, source, mod):
+  '''The key of the snapshot of the configuration file, which depends on its
+  contents and on the incoming context, or ``None`` if the context cannot be
+  pickled'''
+
+  state = _context_state(mod)
+  if state is None:
+    return None
+  digest = hashlib.sha256(importlib.util.MAGIC_NUMBER)
+  digest.update(path.encode('utf-8') + b'\0')
+  digest.update(source + b'\0')
+  digest.update(state)
+  return digest.hexdigest()
+
+
+def _restore_snapshot(key, mod):
+  '''Updates the module with the snapshot of the given key, and returns
+  whether it existed'''
+
+  try:
+    with open(_cache_file(key, '.context'), 'rb') as f:
+      values, modules = pickle.load(f)
+    for k, name in modules.items():
+      values[k] = importlib.import_module(name)
+  except Exception:
+    return False
+  mod.__dict__.update(values)
+  return True
+
+
+def _load_context(path, mod, snapshot=False):
   '''Loads the Python file as module, returns a resolved context
 
   This function is implemented in a way that is both Python 2 and Python 3
@@ -33,6 +164,10 @@ def _load_context(path, mod):
       imp.new_module('name'); m.__dict__.update(ctxt)`` where ``ctxt`` is a
       python dictionary with string -> object values representing the contents
       of the module to be created.
+  snapshot : :py:class:`bool`, optional
+      If ``True``, the resulting context is taken from a snapshot when this
+      file was loaded with the same incoming context before, and snapshot
+      otherwise, see :any:`load`.
 
   Returns
   -------
@@ -40,8 +175,24 @@ def _load_context(path, mod):
       A python module with the fully resolved context
   '''
 
+  with open(path, "rb") as f:
+    source = f.read()
+
+  key = _snapshot_key(path, source, mod) if snapshot else None
+  if key is not None and _restore_snapshot(key, mod):
+    logger.debug("Took the context of `%s' from its snapshot", path)
+    return mod
+
   # executes the module code on the context of previously imported modules
-  exec(compile(open(path, "rb").read(), path, 'exec'), mod.__dict__)
+  exec(_compile(path, source), mod.__dict__)
+
+  if key is not None:
+    state = _context_state(mod)
+    if state is None:
+      logger.debug("Not snapshotting `%s', since its context cannot be "
+                   "pickled", path)
+    else:
+      _write_cache_file(_cache_file(key, '.context'), state)
 
   return mod
 
@@ -107,8 +258,7 @@ def _resolve_entry_point_or_modules(paths, entry_point_group,
       The name of objects that are supposed to be picked from paths.
   """
 
-  entries = {e.name: e for e in
-             pkg_resources.iter_entry_points(entry_point_group)}
+  entries = {e.name: e for e in entry_points(entry_point_group)}
 
   files = []
   module_names = []
@@ -154,7 +304,8 @@ def _resolve_entry_point_or_modules(paths, entry_point_group,
   return files, module_names, object_names
 
 
-def load(paths, context=None, entry_point_group=None, attribute_name=None):
+def load(paths, context=None, entry_point_group=None, attribute_name=None,
+         snapshot=None):
   '''Loads a set of configuration files, in sequence
 
   This method will load one or more configuration files. Every time a
@@ -180,6 +331,18 @@ def load(paths, context=None, entry_point_group=None, attribute_name=None):
       files. Paths ending with `some_path:variable_name` can override the
       attribute_name. The entry_point_group must provided as well
       attribute_name is not None.
+  snapshot : :py:class:`bool`, optional
+      If ``True``, the context that results from each configuration file is
+      stored in the cache, and taken from there instead of executing the file
+      when it is loaded again with the same incoming context. Only contexts
+      whose variables can be pickled (except imported modules, which are
+      imported again) are stored. Use this only for configuration files whose
+      result depends on nothing but their source and their incoming context
+      (e.g., not on other files or environment variables). By default, the
+      ``BOB_CONFIG_SNAPSHOT`` environment variable enables the snapshots.
+
+  The compiled code of all configuration files is cached in the
+  :py:func:`cache_directory`, and recompiled when the files change.
 
   Returns
   -------
@@ -209,6 +372,7 @@ def load(paths, context=None, entry_point_group=None, attribute_name=None):
   else:
     names = len(paths) * ['user_config']
 
+  snapshot = _snapshots_enabled(snapshot)
   ctxt = imp.new_module('initial_context')
   if context is not None:
     ctxt.__dict__.update(context)
@@ -228,7 +392,7 @@ def load(paths, context=None, entry_point_group=None, attribute_name=None):
     ctxt.__dict__.pop('__package__', None)
     mod.__dict__.update(ctxt.__dict__)
     LOADED_CONFIGS.append(mod)
-    ctxt = _load_context(k, mod)
+    ctxt = _load_context(k, mod, snapshot)
 
   if not attribute_name:
     return mod
@@ -282,7 +446,7 @@ def resource_keys(entry_point_group, exclude_packages=[], strip=['dummy']):
       List of found resources.
   """
   ret_list = [entry_point.name for entry_point in
-              pkg_resources.iter_entry_points(entry_point_group)
-              if (entry_point.dist.project_name not in exclude_packages and
+              entry_points(entry_point_group)
+              if (entry_point.dist not in exclude_packages and
                   not entry_point.name.startswith(tuple(strip)))]
   return sorted(ret_list)
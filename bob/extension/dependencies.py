@@ -0,0 +1,297 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Resolves the dependency graph of installed packages from their metadata,
+without importing them, and computes the order in which they can be built.
+
+The requirements of each package are read with :py:mod:`importlib.metadata`.
+The C++ externals of a package (the ``externals`` of its ``version`` module)
+can only be read by importing that module, which is done in a subprocess and
+cached, keyed on the version module file, so that it happens only once per
+installation of each package.
+"""
+
+import os
+import re
+import sys
+import glob
+import json
+import tempfile
+import subprocess
+import logging
+
+logger = logging.getLogger(__name__)
+
+DEFAULT_CACHE_FILE = os.path.join(os.path.expanduser('~'), '.cache', 'bob.extension', 'externals.json')
+"""The file the C++ externals of the packages are cached in"""
+
+
+def normalize(name):
+  """Returns the key of a package name, as :py:mod:`pkg_resources` does, e.g.,
+  ``bob.extension`` or ``click-plugins``"""
+
+  return re.sub(r'[^A-Za-z0-9.]+', '-', name).lower()
+
+
+def _requirement(line):
+  """Parses a requirement of the metadata, and returns its name or ``None`` if
+  it does not apply to this environment (e.g., it belongs to an extra)"""
+
+  try:
+    from packaging.requirements import Requirement
+  except ImportError:
+    from pkg_resources.extern.packaging.requirements import Requirement
+  requirement = Requirement(line)
+  if requirement.marker is not None and not requirement.marker.evaluate({'extra': ''}):
+    return None
+  return normalize(requirement.name)
+
+
+def requirements(package):
+  """Returns the normalized names of the packages the given package requires,
+  read from its installed metadata.
+
+  Raises:
+
+    importlib.metadata.PackageNotFoundError: If the package is not installed
+  """
+
+  import importlib.metadata
+  dist = importlib.metadata.distribution(package)
+  names = []
+  for line in dist.requires or []:
+    name = _requirement(line)
+    if name is not None and name not in names:
+      names.append(name)
+  return names
+
+
+def _version_module(package):
+  """Finds the file of the ``version`` module of the package in the
+  ``sys.path`` without importing the package, or returns ``None``"""
+
+  parts = package.split('.')
+  for entry in sys.path:
+    directory = os.path.join(entry or os.getcwd(), *parts)
+    candidates = sorted(glob.glob(os.path.join(directory, 'version.*')))
+    candidates = [c for c in candidates if c.endswith(('.so', '.pyd', '.py'))]
+    if candidates:
+      return candidates[0]
+  return None
+
+
+class ExternalsCache(object):
+  """The C++ externals of packages, cached in a JSON file"""
+
+  def __init__(self, filename=DEFAULT_CACHE_FILE):
+    self.filename = filename
+    self.entries = {}
+    self.modified = False
+    if filename is not None and os.path.exists(filename):
+      try:
+        with open(filename) as f:
+          self.entries = json.load(f)
+      except (ValueError, OSError):
+        logger.warning("Ignoring the corrupt externals cache `%s'", filename)
+
+  def externals(self, package):
+    """Returns the names of the externals of the package, or ``[]`` if it has
+    no ``version`` module with ``externals``"""
+
+    module = _version_module(package)
+    if module is None:
+      return []
+    stat = os.stat(module)
+    stamp = [module, stat.st_mtime_ns, stat.st_size]
+    cached = self.entries.get(package)
+    if cached is not None and cached['stamp'] == stamp:
+      return cached['externals']
+
+    logger.debug("Reading the externals of %s", package)
+    code = ("import sys, json, importlib\n"
+            "m = importlib.import_module(sys.argv[1] + '.version')\n"
+            "print(json.dumps(sorted(getattr(m, 'externals', {}))))\n")
+    try:
+      # the subprocess finds the packages in the same paths
+      env = dict(os.environ, PYTHONPATH=os.pathsep.join(p or os.getcwd() for p in sys.path))
+      output = subprocess.check_output([sys.executable, '-c', code, package], stderr=subprocess.PIPE, env=env)
+      externals = json.loads(output.decode().strip().splitlines()[-1])
+    except (subprocess.CalledProcessError, ValueError, IndexError) as e:
+      logger.warning("Cannot read the externals of %s: %s", package, e)
+      externals = []
+    self.entries[package] = {'stamp': stamp, 'externals': externals}
+    self.modified = True
+    return externals
+
+  def save(self):
+    """Writes the cache, if it was modified"""
+
+    if self.filename is None or not self.modified:
+      return
+    directory = os.path.dirname(self.filename)
+    try:
+      os.makedirs(directory, exist_ok=True)
+      with tempfile.NamedTemporaryFile('w', dir=directory, delete=False) as f:
+        json.dump(self.entries, f)
+      os.replace(f.name, self.filename)
+      self.modified = False
+    except OSError as e:
+      logger.debug("Cannot write the externals cache `%s': %s", self.filename, e)
+
+
+def dependency_graph(packages, externals_of=(), cache_file=DEFAULT_CACHE_FILE):
+  """Resolves the dependencies of the given packages recursively.
+
+  Parameters:
+
+    packages : [str]
+      The names of the packages.
+
+    externals_of : [str] or tuple
+      Packages (or prefixes of packages, e.g., ``'bob'``) whose C++ externals
+      are read as well.
+
+    cache_file : str or ``None``
+      The file the externals are cached in.
+
+  Returns:
+
+    dependencies : dict
+      The normalized names of the requirements of each package; packages that
+      are not installed have no requirements.
+
+    externals : dict
+      The C++ externals of the packages that match ``externals_of``.
+  """
+
+  import importlib.metadata
+  prefixes = tuple(externals_of)
+  cache = ExternalsCache(cache_file) if prefixes else None
+  dependencies = {}
+  externals = {}
+  pending = [normalize(p) for p in packages]
+  while pending:
+    package = pending.pop()
+    if package in dependencies:
+      continue
+    try:
+      dependencies[package] = requirements(package)
+    except importlib.metadata.PackageNotFoundError:
+      logger.warning("The package %s is not installed", package)
+      dependencies[package] = []
+    if prefixes and package.startswith(prefixes):
+      externals[package] = cache.externals(package)
+    pending.extend(dependencies[package])
+  if cache is not None:
+    cache.save()
+  return dependencies, externals
+
+
+def transitive_closure(dependencies):
+  """Returns all packages that each package depends on, directly or through
+  other packages, in the order they are found, like
+  :py:func:`pkg_resources.require` does.
+
+  Parameters:
+
+    dependencies : dict
+      The requirements of each package, see :py:func:`dependency_graph`.
+
+  Returns:
+
+    dict: The packages each package depends on.
+  """
+
+  closure = {}
+  for package in dependencies:
+    found, pending = [], list(dependencies[package])
+    while pending:
+      dep = pending.pop(0)
+      if dep == package or dep in found:
+        continue
+      found.append(dep)
+      pending.extend(dependencies.get(dep, []))
+    closure[package] = found
+  return closure
+
+
+def transitive_reduction(dependencies):
+  """Removes the dependencies that are implied by other dependencies, e.g.,
+  ``bob.extension`` from the dependencies of ``bob.core`` when it also
+  depends on ``bob.blitz``. The result is the same for the direct
+  requirements of :py:func:`dependency_graph` and for their
+  :py:func:`transitive_closure`.
+
+  Parameters:
+
+    dependencies : dict
+      The requirements of each package, see :py:func:`dependency_graph`.
+
+  Returns:
+
+    dict: The dependencies of each package that are not dependencies of its
+    other dependencies.
+  """
+
+  closure = transitive_closure(dependencies)
+  reduced = {}
+  for package, deps in dependencies.items():
+    indirect = set(d for dep in deps for d in closure.get(dep, []))
+    reduced[package] = [dep for dep in deps if dep not in indirect]
+  return reduced
+
+
+def build_order(dependencies, packages=None):
+  """Sorts the packages into layers, each of which only depends on the
+  packages of earlier layers, so that the packages of one layer can be built
+  in parallel.
+
+  Parameters:
+
+    dependencies : dict
+      The requirements of each package, see :py:func:`dependency_graph`.
+
+    packages : [str] or ``None``
+      Only orders these packages (e.g., the packages of the bob stack), which
+      is done over the dependencies of the whole graph; by default, all
+      packages are ordered.
+
+  Returns:
+
+    [[str]]: The sorted packages of each layer.
+
+  Raises:
+
+    ValueError: If the dependencies contain a cycle
+  """
+
+  selected = set(dependencies if packages is None else (normalize(p) for p in packages))
+
+  # the selected packages that each package depends on, directly or through
+  # packages that are not selected
+  memo = {}
+
+  def _selected_deps(package, visiting=()):
+    if package in memo:
+      return memo[package]
+    result = set()
+    for dep in dependencies.get(package, []):
+      if dep in selected:
+        result.add(dep)
+      elif dep not in visiting:
+        result |= _selected_deps(dep, visiting + (package,))
+    memo[package] = result
+    return result
+
+  remaining = {p: _selected_deps(p) - {p} for p in selected}
+  layers = []
+  while remaining:
+    layer = sorted(p for p, deps in remaining.items() if not deps)
+    if not layer:
+      raise ValueError("The dependencies of %s contain a cycle" % ', '.join(sorted(remaining)))
+    layers.append(layer)
+    for p in layer:
+      del remaining[p]
+    for deps in remaining.values():
+      deps.difference_update(layer)
+  return layers
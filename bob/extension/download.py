@@ -3,35 +3,266 @@
 # Tiago de Freitas Pereira <tiago.pereira@idiap.ch>
 
 import os
+import sys
+import time
+import hashlib
+import contextlib
 import logging
 logger = logging.getLogger(__name__)
 
+DEFAULT_CACHE_DIRECTORY = os.path.join(
+    os.path.expanduser('~'), '.cache', 'bob.extension', 'downloads')
+"""The directory of the download cache if ``BOB_DOWNLOAD_CACHE`` is not set"""
 
-def _unzip(zip_file, directory):
+_CHUNK_SIZE = 1024 * 1024
+
+
+_COMPRESSIONS = {
+    '.gz': 'gz', '.tgz': 'gz',
+    '.bz2': 'bz2', '.tbz2': 'bz2',
+    '.xz': 'xz', '.txz': 'xz',
+}
+
+# multi-threaded decompressors that are used if they are installed, with the
+# option that sets their number of threads
+_PARALLEL_DECOMPRESSORS = {
+    'gz': [(['pigz', '-d', '-c'], '-p%d')],
+    'bz2': [(['lbzip2', '-d', '-c'], '-n%d'), (['pbzip2', '-d', '-c'], '-p%d')],
+    'xz': [(['xz', '-d', '-c'], '-T%d')],
+}
+
+
+def _parallel_decompressor(kind, threads=None):
+    """Returns the command of a multi-threaded decompressor, or ``None``"""
+    from shutil import which
+    if threads is None:
+        # xz uses all cores with 0
+        threads = 0 if kind == 'xz' else os.cpu_count() or 1
+    for command, option in _PARALLEL_DECOMPRESSORS.get(kind, []):
+        if which(command[0]) is not None:
+            return command + [option % threads]
+    return None
+
+
+@contextlib.contextmanager
+def _decompressed(fileobj, kind, threads=None):
+    """Yields a readable stream of the decompressed contents of ``fileobj``,
+    which is decompressed by a multi-threaded decompressor in another process
+    if one is installed"""
+    if kind is None:
+        yield fileobj
+        return
+    command = _parallel_decompressor(kind, threads)
+    if command is None:
+        import gzip
+        import bz2
+        import lzma
+        opener = {'gz': gzip.GzipFile, 'bz2': bz2.BZ2File,
+                  'xz': lzma.LZMAFile}[kind]
+        with opener(fileobj=fileobj) if kind == 'gz' else opener(fileobj) as f:
+            yield f
+        return
+
+    import shutil
+    import subprocess
+    import threading
+    process = subprocess.Popen(command, stdin=subprocess.PIPE,
+                               stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    errors = []
+
+    def feed():
+        try:
+            shutil.copyfileobj(fileobj, process.stdin, _CHUNK_SIZE)
+        except BrokenPipeError:
+            pass
+        except BaseException as e:
+            errors.append(e)
+        finally:
+            try:
+                process.stdin.close()
+            except BrokenPipeError:
+                pass
+
+    feeder = threading.Thread(target=feed, daemon=True)
+    feeder.start()
+    try:
+        yield process.stdout
+        # reads the rest, e.g., the padding after the end of a tar file
+        while process.stdout.read(_CHUNK_SIZE):
+            pass
+    finally:
+        if process.poll() is None and sys.exc_info()[0] is not None:
+            process.kill()
+        feeder.join()
+        stderr = process.stderr.read()
+        process.stdout.close()
+        process.stderr.close()
+        returncode = process.wait()
+    if errors:
+        raise errors[0]
+    if returncode != 0:
+        raise IOError("%s failed: %s" % (' '.join(command),
+                                         stderr.decode(errors='replace')))
+
+
+def _archive_type(filename):
+    """Returns the compression (or ``'zip'``) of the given file and whether it
+    is a tar file, or ``(None, False)`` if it is not extracted"""
+    ext = os.path.splitext(filename)[-1].lower()
+    header = os.path.splitext(filename)[0].lower()
+    if ext == ".zip":
+        return 'zip', False
+    if header[-4:] == ".tar" or ext in (".tar", ".tgz", ".tbz2", ".txz"):
+        return _COMPRESSIONS.get(ext), True
+    if ext == ".bz2":
+        return 'bz2', False
+    return None, False
+
+
+def _extract_stream(fileobj, filename, directory, threads=None):
+    """Extracts the (compressed) tar or bz2 file ``filename``, whose contents
+    are read from ``fileobj``, into the directory; the contents are
+    decompressed and written as they are read, i.e., with a bounded amount of
+    memory"""
+    import tarfile
+    import shutil
+    kind, is_tar = _archive_type(filename)
+    with _decompressed(fileobj, kind, threads) as stream:
+        if is_tar:
+            logger.info("Untar/gzip in {0}".format(filename))
+            with tarfile.open(fileobj=stream, mode='r|') as t:
+                t.extractall(directory)
+        else:
+            logger.info("Unbz2 in {0}".format(filename))
+            output = os.path.basename(os.path.splitext(filename)[0])
+            with open(os.path.join(directory, output), 'wb') as f:
+                shutil.copyfileobj(stream, f, _CHUNK_SIZE)
+
+
+def _unzip(zip_file, directory, threads=None):
+    """Extracts the members of the zip file in parallel threads, each of which
+    reads the zip file with its own handle"""
     import zipfile
+    import threading
+    from concurrent.futures import ThreadPoolExecutor
 
     with zipfile.ZipFile(zip_file) as myzip:
-        myzip.extractall(directory)
+        members = myzip.infolist()
+    if (threads or os.cpu_count() or 1) == 1 or len(members) < 2:
+        with zipfile.ZipFile(zip_file) as myzip:
+            myzip.extractall(directory)
+        return
 
+    # creates the directories first, which the threads would race for
+    with zipfile.ZipFile(zip_file) as myzip:
+        for member in members:
+            if member.is_dir():
+                myzip.extract(member, directory)
+            else:
+                parts = [p for p in member.filename.split('/')[:-1]
+                         if p not in ('', '.', '..')]
+                os.makedirs(os.path.join(directory, *parts), exist_ok=True)
 
-def _untar(tar_file, directory, ext):
+    local = threading.local()
+    handles = []
+    lock = threading.Lock()
 
-    if ext in [".bz2" or ".tbz2"]:
-        mode = "r:bz2"
-    elif ext in [".gz" or ".tgz"]:
-        mode = "r:gz"
-    else:
-        mode = "r"
+    def extract(member):
+        if not hasattr(local, 'zip'):
+            local.zip = zipfile.ZipFile(zip_file)
+            with lock:
+                handles.append(local.zip)
+        local.zip.extract(member, directory)
 
-    import tarfile
-    with tarfile.open(name=tar_file, mode=mode) as t:
-        t.extractall(directory)
+    files = sorted((m for m in members if not m.is_dir()),
+                   key=lambda m: m.file_size, reverse=True)
+    try:
+        with ThreadPoolExecutor(threads) as executor:
+            list(executor.map(extract, files))
+    finally:
+        for handle in handles:
+            handle.close()
+
+
+def _untar(tar_file, directory, ext, threads=None):
+    with open(tar_file, 'rb') as f:
+        _extract_stream(f, tar_file, directory, threads)
 
 
-def _unbz2(bz2_file):
-    import bz2
-    with bz2.BZ2File(bz2_file) as t:
-        open(os.path.splitext(bz2_file)[0], 'wb').write(t.read())
+def _unbz2(bz2_file, threads=None):
+    with open(bz2_file, 'rb') as f:
+        _extract_stream(f, bz2_file, os.path.dirname(bz2_file), threads)
+
+
+class _Pipe(object):
+    """A bounded pipe of chunks from the download to the extraction thread.
+
+    The download writes the chunks with their offset in the file, and data
+    that was written before (e.g., when a download is resumed or restarted) is
+    skipped. The extraction reads them as a file.
+    """
+
+    _END = object()
+
+    def __init__(self, max_chunks=16):
+        import queue
+        self._queue = queue.Queue(max_chunks)
+        self.position = 0
+        self.closed = False
+        self._chunk = b''
+        self._index = 0
+        self._done = False
+
+    def _put(self, item):
+        import queue
+        while not self.closed:
+            try:
+                self._queue.put(item, timeout=0.1)
+                return
+            except queue.Full:
+                continue
+
+    def write(self, offset, data):
+        skip = self.position - offset
+        if skip >= len(data):
+            return
+        if offset > self.position:
+            raise IOError("Data is missing in the download stream")
+        data = bytes(data[skip:]) if skip > 0 else bytes(data)
+        self.position += len(data)
+        self._put(data)
+
+    def finish(self, error=None):
+        self._put(self._END if error is None else error)
+
+    def readable(self):
+        return True
+
+    def read(self, size=-1):
+        import queue
+        while self._index >= len(self._chunk):
+            if self._done or self.closed:
+                return b''
+            try:
+                item = self._queue.get(timeout=0.1)
+            except queue.Empty:
+                continue
+            if item is self._END:
+                self._done = True
+                return b''
+            if isinstance(item, BaseException):
+                self._done = True
+                raise item
+            self._chunk, self._index = item, 0
+        end = len(self._chunk) if size is None or size < 0 else \
+            min(len(self._chunk), self._index + size)
+        data = self._chunk[self._index:end]
+        self._index = end
+        return data
+
+    def close(self):
+        # unblocks the download, if the extraction stopped early
+        self.closed = True
 
 
 def download_file(url, out_file):
@@ -62,13 +293,303 @@ def download_file(url, out_file):
         copyfileobj(response, f)
 
 
-def download_and_unzip(urls, filename):
+def download_cache_directory(directory=None):
+    """Returns the directory of the download cache, or ``None`` if downloads
+    are not cached.
+
+    If ``directory`` is not given, the ``BOB_DOWNLOAD_CACHE`` environment
+    variable is used: ``0`` disables the cache, any other value except ``1``
+    is taken as the directory; by default, the
+    :py:data:`DEFAULT_CACHE_DIRECTORY` is used. The directory can be shared by
+    several jobs and nodes, e.g., on a network file system that supports
+    :py:func:`fcntl.flock`.
+    """
+    if directory is None:
+        directory = os.environ.get('BOB_DOWNLOAD_CACHE', '1').strip()
+    if directory in ('', '0'):
+        return None
+    if directory == '1':
+        return DEFAULT_CACHE_DIRECTORY
+    return os.path.realpath(os.path.expanduser(directory))
+
+
+def file_hash(filename):
+    """Returns the SHA-256 hash of the given file as a hexadecimal string"""
+    digest = hashlib.sha256()
+    with open(filename, 'rb') as f:
+        for chunk in iter(lambda: f.read(_CHUNK_SIZE), b''):
+            digest.update(chunk)
+    return digest.hexdigest()
+
+
+@contextlib.contextmanager
+def _locked(path):
+    """Holds an exclusive lock on the given lock file; on systems without
+    :py:mod:`fcntl`, no lock is taken"""
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, 'a') as f:
+        try:
+            import fcntl
+        except ImportError:
+            fcntl = None
+        if fcntl is not None:
+            fcntl.flock(f, fcntl.LOCK_EX)
+        try:
+            yield
+        finally:
+            if fcntl is not None:
+                fcntl.flock(f, fcntl.LOCK_UN)
+
+
+def _feed(filename, sink):
+    """Passes the contents of the file to the sink"""
+    offset = 0
+    with open(filename, 'rb') as f:
+        for chunk in iter(lambda: f.read(_CHUNK_SIZE), b''):
+            sink(offset, chunk)
+            offset += len(chunk)
+
+
+def _fetch(url, partial, timeout, sink=None):
+    """Downloads the url into the ``partial`` file, continuing a previous
+    download with an HTTP range request if the file exists, and returns the
+    SHA-256 hash of the complete file.
+
+    All data of the file, including the previously downloaded part, is also
+    passed to ``sink(offset, data)`` if given; data may be passed more than
+    once, e.g., if the server does not support ranges."""
+    from urllib.request import Request, urlopen
+
+    digest = hashlib.sha256()
+    offset = 0
+    if os.path.exists(partial):
+        with open(partial, 'rb') as f:
+            for chunk in iter(lambda: f.read(_CHUNK_SIZE), b''):
+                digest.update(chunk)
+                if sink is not None:
+                    sink(offset, chunk)
+                offset += len(chunk)
+
+    request = Request(url)
+    if offset:
+        request.add_header('Range', 'bytes=%d-' % offset)
+    try:
+        response = urlopen(request, timeout=timeout)
+    except Exception as e:
+        # the file was complete already
+        if offset and getattr(e, 'code', None) == 416:
+            return digest.hexdigest()
+        raise
+    with response:
+        if offset and response.status != 206:
+            # the server does not support ranges; starts from scratch
+            logger.debug("Restarting the download of %s", url)
+            digest = hashlib.sha256()
+            offset = 0
+        elif offset:
+            logger.info("Resuming the download of %s at byte %d", url, offset)
+        expected = response.headers.get('Content-Length')
+        received = 0
+        with open(partial, 'ab' if offset else 'wb') as f:
+            for chunk in iter(lambda: response.read(_CHUNK_SIZE), b''):
+                f.write(chunk)
+                digest.update(chunk)
+                if sink is not None:
+                    sink(offset + received, chunk)
+                received += len(chunk)
+    if expected is not None and received < int(expected):
+        # the partial file is kept, so that the next attempt resumes it
+        raise IOError("The download of %s stopped after %d of %s bytes" %
+                      (url, offset + received, offset + int(expected)))
+    return digest.hexdigest()
+
+
+def _fetch_with_retries(url, partial, timeout, retries, sink=None):
+    """Calls :py:func:`_fetch` up to ``retries`` times, each of which resumes
+    the previous attempt, and returns the hash or ``None`` if all failed"""
+    for attempt in range(retries):
+        try:
+            logger.info("Downloading from %s ...", url)
+            return _fetch(url, partial, timeout, sink)
+        except Exception:
+            logger.warning(
+                "Could not download from the %s url (attempt %d of %d)",
+                url, attempt + 1, retries, exc_info=True)
+            if attempt + 1 < retries:
+                time.sleep(min(2 ** attempt, 30) * 0.1)
+    return None
+
+
+def cached_download(urls, sha256, cache_directory=None, retries=3,
+                    timeout=60, sink=None):
+    """Downloads a file into the download cache and returns its path.
+
+    Files are stored by their SHA-256 hash, so that a file is downloaded only
+    once, even if several jobs request it at the same time: the first one
+    downloads it while holding a lock, and the others wait for it and use the
+    cached file. Interrupted downloads are resumed with HTTP range requests,
+    and files are only moved into the cache once they are complete and
+    verified; they are read-only in the cache.
+
+    Parameters
+    ----------
+    urls : str or list
+        The URL of the file, or a list of mirrors that are tried in order.
+    sha256 : str
+        The expected SHA-256 hash of the file, under which it is cached.
+    cache_directory : :py:class:`str`, optional
+        The cache directory, see :py:func:`download_cache_directory`.
+    retries : :py:class:`int`, optional
+        The number of attempts for each URL; each attempt resumes the
+        previous one.
+    timeout : :py:class:`float`, optional
+        The timeout of the connections in seconds.
+    sink : :py:class:`callable`, optional
+        Called as ``sink(offset, data)`` with the contents of the file while
+        it is downloaded (or read from the cache), e.g., to extract it at the
+        same time. Parts of the file may be passed more than once, with the
+        same offset. With a sink, other URLs are not tried if the hash of a
+        download does not match.
+
+    Returns
+    -------
+    str
+        The path of the file in the cache, which must not be modified.
+
+    Raises
+    ------
+    RuntimeError
+        If the file cannot be downloaded from any of the URLs, or its hash
+        does not match.
+    ValueError
+        If the cache is disabled, or no hash is given; without a hash, files
+        could not be told apart from newer versions at the same URL.
+    """
+    if isinstance(urls, str):
+        urls = [urls]
+    directory = download_cache_directory(cache_directory)
+    if directory is None:
+        raise ValueError("The download cache is disabled")
+    if sha256 is None:
+        raise ValueError("Only files with a known SHA-256 hash are cached")
+    sha256 = sha256.lower()
+    blob = os.path.join(directory, 'sha256', sha256[:2], sha256)
+    partial = os.path.join(directory, 'partial', sha256)
+
+    if not os.path.exists(blob):
+        with _locked(partial + '.lock'):
+            # another job may have completed the download in the meantime
+            if not os.path.exists(blob):
+                _download_locked(urls, sha256, blob, partial, retries,
+                                 timeout, sink)
+                return blob
+    if sink is not None:
+        _feed(blob, sink)
+    return blob
+
+
+def _download_locked(urls, sha256, blob, partial, retries, timeout, sink):
+    """Downloads the file into the cache, see :py:func:`cached_download`"""
+    for url in urls:
+        digest = _fetch_with_retries(url, partial, timeout, retries, sink)
+        if digest is None:
+            continue
+        if digest != sha256:
+            logger.warning("The file downloaded from %s has the SHA-256 hash "
+                           "%s, expected %s", url, digest, sha256)
+            os.remove(partial)
+            if sink is not None:
+                raise RuntimeError("The SHA-256 hash of the file downloaded "
+                                   "from %s does not match" % url)
+            continue
+        os.makedirs(os.path.dirname(blob), exist_ok=True)
+        # cached files are shared, so they must not be modified
+        os.chmod(partial, 0o444)
+        os.replace(partial, blob)
+        return
+    raise RuntimeError("Could not download the file from any of %s" % urls)
+
+
+def _copy_from_cache(path, filename):
+    """Copies the cached file to ``filename``; it is not linked, so that
+    changes of ``filename`` do not change the cached file"""
+    import shutil
+    directory = os.path.dirname(os.path.abspath(filename))
+    os.makedirs(directory, exist_ok=True)
+    temporary = filename + '.%d.tmp' % os.getpid()
+    shutil.copyfile(path, temporary)
+    os.replace(temporary, filename)
+
+
+def _download(urls, filename, sha256, cache_directory, sink=None, retries=3):
+    """Downloads the file, through the cache if it is enabled and the hash
+    is known; returns
+    whether it was downloaded, or a previously downloaded file is used since
+    none of the URLs work"""
+    if sha256 is not None and \
+            download_cache_directory(cache_directory) is not None:
+        _copy_from_cache(
+            cached_download(urls, sha256, cache_directory, sink=sink),
+            filename)
+        return True
+
+    partial = filename + '.part'
+    for url in urls:
+        digest = _fetch_with_retries(url, partial, 60, retries, sink)
+        if digest is None:
+            continue
+        if sha256 is not None and digest != sha256.lower():
+            os.remove(partial)
+            message = "The SHA-256 hash of the file downloaded from {} " \
+                "does not match".format(url)
+            if sink is not None:
+                raise RuntimeError(message)
+            logger.warning(message)
+            continue
+        os.replace(partial, filename)
+        return True
+    if not os.path.isfile(filename):
+        raise RuntimeError("Could not download the file.")
+    return False
+
+
+def _move_into(source, directory):
+    """Moves the contents of the ``source`` directory into ``directory``,
+    merging them with existing sub-directories like an extraction would"""
+    import shutil
+    for name in os.listdir(source):
+        path, target = os.path.join(source, name), os.path.join(directory, name)
+        if os.path.isdir(path) and not os.path.islink(path) and \
+                os.path.isdir(target) and not os.path.islink(target):
+            _move_into(path, target)
+            continue
+        if os.path.isdir(target) and not os.path.islink(target):
+            shutil.rmtree(target)
+        os.replace(path, target)
+
+
+def download_and_unzip(urls, filename, sha256=None, cache_directory=None,
+                       stream=True, threads=None):
     """
     Download a file from a given URL list, save it somewhere and unzip/untar if necessary
     
     Example:
        download_and_unzip(["https://mytesturl.co/my_file_example.tag.bz2"], filename="~/my_file_example.tag.bz2")
 
+    If ``sha256`` is given and the download cache is not disabled (see
+    :py:func:`download_cache_directory`), the file is downloaded with
+    :py:func:`cached_download` and copied to ``filename``. Otherwise, it is
+    downloaded directly, since a file without a known hash might change.
+
+    Tar files (optionally compressed with gzip, bzip2 or xz) and bz2 files
+    are extracted while they are downloaded, unless ``stream`` is disabled.
+    If ``sha256`` is given, they are extracted into a temporary directory
+    next to ``filename``, whose contents are only moved into place when the
+    hash of the download matches.
+    They are decompressed with ``pigz``, ``lbzip2``/``pbzip2`` or ``xz`` in
+    several threads if these are installed, and in Python otherwise. The
+    members of zip files are extracted in parallel threads after the
+    download. All of them use a bounded amount of memory.
    
     Parameters
     ----------
@@ -80,39 +601,81 @@ def download_and_unzip(urls, filename):
       filename: str
         File name (full path) where the downloaded file will be written and uncompressed
 
+      sha256: str
+        The expected SHA-256 hash of the file, which is verified and used to
+        cache the file if given
+
+      cache_directory: str
+        The directory of the download cache, see
+        :py:func:`download_cache_directory`
+
+      stream: bool
+        Extracts tar and bz2 files while they are downloaded
+
+      threads: int
+        The number of threads for the decompression and the extraction of zip
+        files, by default the number of cores
+
     """
 
     # Just testing if string and wrap it in a list if it's the case
     if isinstance(urls, str):
         urls = [urls]
 
-    for url in urls:
-        try:
-            logger.info(
-                "Downloading from "
-                "{} ...".format(url))
-            download_file(url, filename)
+    # Uncompressing if it is the case
+    kind, is_tar = _archive_type(filename)
+    directory = os.path.dirname(filename)
+    streamed = kind != 'zip' and (is_tar or kind is not None)
 
-            break
-        except Exception:
-            logger.warning(
-                "Could not download from the %s url", url, exc_info=True)
-    else:  # else is for the for loop
-        if not os.path.isfile(filename):
-            raise RuntimeError("Could not download the file.")
+    if stream and streamed:
+        import shutil
+        import tempfile
+        import threading
+        pipe = _Pipe()
+        errors = []
+        # the hash is only known at the end of the download, so verified
+        # files are extracted next to the directory first, and only moved
+        # into it once the hash matches
+        target = directory if sha256 is None else tempfile.mkdtemp(
+            prefix='.%s.' % os.path.basename(filename), dir=directory or None)
 
-    # Uncompressing if it is the case
-    ext = os.path.splitext(filename)[-1].lower()
-    header = os.path.splitext(filename)[0].lower()
-    if ext == ".zip":
-        logger.info("Unziping in {0}".format(filename))
-        _unzip(filename, os.path.dirname(filename))
- 
-    elif header[-4:] == ".tar" or ext in [".tgz", ".tbz2"]:
-        logger.info("Untar/gzip in {0}".format(filename))
-        _untar(filename, os.path.dirname(filename), ext)
+        def extract():
+            try:
+                _extract_stream(pipe, filename, target, threads)
+            except BaseException as e:
+                errors.append(e)
+            finally:
+                pipe.close()
+
+        extractor = threading.Thread(target=extract, daemon=True)
+        extractor.start()
+        try:
+            try:
+                downloaded = _download(urls, filename, sha256,
+                                       cache_directory, pipe.write)
+            except BaseException as e:
+                pipe.finish(e)
+                extractor.join()
+                raise
+            pipe.finish(None if downloaded else
+                        RuntimeError("Using the previously downloaded file"))
+            extractor.join()
+            if downloaded:
+                if errors:
+                    raise errors[0]
+                if target != directory:
+                    _move_into(target, directory)
+                return
+        finally:
+            if target != directory:
+                shutil.rmtree(target, ignore_errors=True)
+    else:
+        _download(urls, filename, sha256, cache_directory)
 
-    elif ext == ".bz2":
-        logger.info("Unbz2 in {0}".format(filename))
-        _unbz2(filename)
+    if kind == 'zip':
+        logger.info("Unziping in {0}".format(filename))
+        _unzip(filename, directory, threads)
 
+    elif streamed:
+        with open(filename, 'rb') as f:
+            _extract_stream(f, filename, directory, threads)
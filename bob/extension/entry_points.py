@@ -0,0 +1,219 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""An index of the entry points of all installed distributions, such as the
+configuration resources and the ``bob.cli`` commands, so that finding them
+does not scan all distributions with :py:mod:`pkg_resources` on every start.
+
+The index is built with :py:mod:`importlib.metadata` and persisted, and it is
+rebuilt whenever a distribution is installed, removed or re-registered, i.e.,
+whenever the ``sys.path`` or the contents or ``entry_points.txt`` files of its
+directories change.
+"""
+
+import os
+import sys
+import json
+import hashlib
+import tempfile
+import importlib
+import threading
+import logging
+
+logger = logging.getLogger(__name__)
+
+DEFAULT_INDEX_FILE = os.path.join(os.path.expanduser('~'), '.cache', 'bob.extension', 'entry_points-%s.json' %
+    hashlib.sha1(('%s\0%s' % (sys.prefix, sys.executable)).encode('utf-8', 'surrogateescape')).hexdigest()[:16])
+"""The file the entry point index is persisted to by default, which is
+specific to the Python environment (i.e., its prefix and executable), so that
+environments do not overwrite the index of each other"""
+
+_INDEX = None
+_LOCK = threading.Lock()
+
+
+def index_file(filename=None):
+  """Returns the file to persist the entry point index to, or ``None`` if the
+  index is only kept in memory.
+
+  If ``filename`` is not given, the ``BOB_ENTRY_POINT_INDEX`` environment
+  variable is used: ``0`` keeps the index in memory, any other value except
+  ``1`` is taken as the file name; by default, the :py:data:`DEFAULT_INDEX_FILE`
+  is used.
+  """
+
+  if filename is None:
+    filename = os.environ.get('BOB_ENTRY_POINT_INDEX', '1').strip()
+  if filename in ('', '0'):
+    return None
+  if filename == '1':
+    return DEFAULT_INDEX_FILE
+  return os.path.realpath(os.path.expanduser(filename))
+
+
+class EntryPoint(object):
+  """An entry point of the index, with the attributes of
+  :py:class:`pkg_resources.EntryPoint` that are used by this package"""
+
+  __slots__ = ('name', 'value', 'group', 'dist')
+
+  def __init__(self, name, value, group, dist):
+    self.name = name
+    self.value = value
+    self.group = group
+    self.dist = dist
+
+  @property
+  def module_name(self):
+    """The name of the module the entry point refers to"""
+    return self.value.split(':')[0].strip()
+
+  @property
+  def attrs(self):
+    """The attribute path inside the module, as a tuple"""
+    if ':' not in self.value:
+      return ()
+    # removes the extras, e.g., ``module:object [extra]``
+    return tuple(self.value.split(':', 1)[1].split('[')[0].strip().split('.'))
+
+  def load(self):
+    """Imports the module and returns the object the entry point refers to"""
+    obj = importlib.import_module(self.module_name)
+    for attr in self.attrs:
+      obj = getattr(obj, attr)
+    return obj
+
+  def __repr__(self):
+    return 'EntryPoint(%r, %r, %r, %r)' % (self.name, self.value, self.group, self.dist)
+
+
+def environment_key():
+  """Returns a key that changes whenever a distribution is installed, removed,
+  or re-registered (e.g., with ``setup.py develop``) in the ``sys.path``"""
+
+  digest = hashlib.sha256(sys.executable.encode('utf-8'))
+  for entry in sys.path:
+    entry = entry or os.getcwd()
+    digest.update(b'\0' + entry.encode('utf-8', 'surrogateescape'))
+    try:
+      stat = os.stat(entry)
+    except OSError:
+      continue
+    digest.update(b'%d' % stat.st_mtime_ns)
+    if not os.path.isdir(entry):
+      continue
+    try:
+      names = sorted(os.listdir(entry))
+    except OSError:
+      continue
+    for name in names:
+      if name.endswith(('.dist-info', '.egg-info', '.egg-link', '.pth')):
+        try:
+          mtime = os.stat(os.path.join(entry, name, 'entry_points.txt')).st_mtime_ns
+        except OSError:
+          mtime = 0
+        digest.update(b'\0%s\0%d' % (name.encode('utf-8', 'surrogateescape'), mtime))
+  return digest.hexdigest()
+
+
+def scan():
+  """Collects the entry points of all distributions with
+  :py:mod:`importlib.metadata`.
+
+  Returns:
+
+    dict: The entry points of each group, as lists of ``[name, value,
+    distribution name]``; if a distribution is found several times in the
+    ``sys.path``, the first one is used, as by the import system
+  """
+
+  import importlib.metadata
+  groups = {}
+  seen = set()
+  for dist in importlib.metadata.distributions():
+    entries = dist.entry_points
+    if not entries:
+      continue
+    name = dist.metadata['Name'] or ''
+    normalized = name.lower().replace('_', '-')
+    if normalized in seen:
+      continue
+    seen.add(normalized)
+    for entry in entries:
+      groups.setdefault(entry.group, []).append([entry.name, entry.value, name])
+  return groups
+
+
+class EntryPointIndex(object):
+  """The entry points of all installed distributions, which are loaded from
+  ``filename`` when the :py:func:`environment_key` did not change, and scanned
+  otherwise"""
+
+  def __init__(self, filename=None):
+    self.filename = filename
+    self.key = environment_key()
+    self.groups = None
+    if filename is not None and os.path.exists(filename):
+      try:
+        with open(filename) as f:
+          persisted = json.load(f)
+        if persisted.get('key') == self.key:
+          self.groups = persisted['groups']
+      except (ValueError, TypeError, KeyError, OSError):
+        logger.warning("Ignoring the corrupt entry point index `%s'", filename)
+    if self.groups is None:
+      self.groups = scan()
+      self.save()
+
+  def save(self):
+    """Writes the index to its file"""
+
+    if self.filename is None:
+      return
+    directory = os.path.dirname(self.filename)
+    try:
+      os.makedirs(directory, exist_ok=True)
+      with tempfile.NamedTemporaryFile('w', dir=directory, delete=False) as f:
+        json.dump({'key': self.key, 'groups': self.groups}, f)
+      os.replace(f.name, self.filename)
+    except OSError as e:
+      logger.debug("Cannot write the entry point index `%s': %s", self.filename, e)
+
+  def entry_points(self, group):
+    """Returns the :py:class:`EntryPoint` objects of the given group"""
+
+    return [EntryPoint(name, value, group, dist) for name, value, dist in self.groups.get(group, [])]
+
+
+def entry_point_index():
+  """Returns the entry point index of this process, which is created on first
+  use, see :py:func:`index_file`"""
+
+  global _INDEX
+  with _LOCK:
+    if _INDEX is None:
+      _INDEX = EntryPointIndex(index_file())
+    return _INDEX
+
+
+def invalidate_entry_point_index():
+  """Drops the entry point index of this process, e.g., after installing a
+  package from within the process; it is re-validated on next use"""
+
+  global _INDEX
+  with _LOCK:
+    _INDEX = None
+
+
+def entry_points(group):
+  """Returns the entry points of the given group, like
+  :py:func:`pkg_resources.iter_entry_points`, from the index.
+
+  Returns:
+
+    [:py:class:`EntryPoint`]: The entry points, which have a ``name``, a
+    ``module_name``, ``attrs``, the name of their ``dist`` and a ``load()``
+    method
+  """
+
+  return entry_point_index().entry_points(group)
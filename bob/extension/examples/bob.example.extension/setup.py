@@ -143,6 +143,11 @@ setup(
       'console_scripts' : [
         'bob_example_extension_reverse.py = bob.example.extension.script.reverse:main',
       ],
+
+      # the benchmarks of the overhead of the Python bindings, see ``bob overhead``
+      'bob.overhead': [
+        'bob.example.extension = bob.example.extension.benchmark:cases',
+      ],
     },
 
     # Classifiers are important if you plan to distribute this package through
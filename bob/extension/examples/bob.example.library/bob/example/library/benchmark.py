@@ -0,0 +1,34 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Benchmarks of the overhead of the Python bindings of this package
+
+Run them with ``bob overhead bob.example.library``. The first run stores
+the results as the baseline, later runs flag the cases that became slower.
+"""
+
+import numpy
+from bob.extension.overhead import Case
+
+
+def _array(size):
+  return (numpy.arange(size, dtype=numpy.float64),), {}
+
+
+def _keyword(size):
+  return (), {'array': numpy.arange(size, dtype=numpy.float64)}
+
+
+def cases():
+  """Returns the benchmark cases: each step of the bindings of
+  :py:func:`bob.example.library.reverse` is added to the previous ones; the
+  kernel itself is benchmarked natively, see ``cpp/benchmark.cpp``"""
+
+  from . import _library
+  return [
+    Case('empty call', _library._empty),
+    Case('argument parsing', _library._parse, _array),
+    Case('keyword parsing', _library._parse, _keyword),
+    Case('conversion', _library._convert, _array),
+    Case('reverse', _library.reverse, _array),
+  ]
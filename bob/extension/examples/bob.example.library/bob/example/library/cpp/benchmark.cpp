@@ -0,0 +1,20 @@
+#include <bob.extension/benchmark.h>
+#include <bob.example.library/Function.h>
+
+/**
+  Benchmarks of the functions of this library, without the Python bindings.
+  They are built with BOB_BUILD_BENCHMARKS=1, and run with:
+
+    $ bob benchmark bob.example.library
+*/
+
+BOB_BENCHMARK(reverse){
+  // the setup is not timed
+  blitz::Array<double,1> array(state.size());
+  array = blitz::tensor::i;
+  while (state.keep_running()){
+    bob::extension::benchmark::do_not_optimize(bob::example::library::reverse(array));
+  }
+  // report the throughput in elements per second
+  state.set_items(state.size());
+}
@@ -58,6 +58,55 @@ static PyObject* PyBobExampleLibrary_Reverse(PyObject*, PyObject* args, PyObject
 }
 
 
+//////////////////////////////////////////////////////////////////////////
+/////// Overhead probes //////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// These functions run the steps of the bindings of ``reverse`` one after
+// another, so that the cost of each step can be measured with
+// ``bob overhead bob.example.library``, see bob.example.library.benchmark.
+// They are not part of the API.
+
+// the cost of calling a function of this module
+static PyObject* PyOverheadEmpty(PyObject*, PyObject*) {
+  Py_RETURN_NONE;
+}
+
+// ... plus parsing the arguments into a PyBlitzArrayObject
+static PyObject* PyOverheadParse(PyObject*, PyObject* args, PyObject* kwargs) {
+
+  BOB_TRY
+
+  char** kwlist = reverse_doc.kwlist(0);
+  PyBlitzArrayObject* array;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O&", kwlist, &PyBlitzArray_Converter, &array)) return 0;
+  auto array_ = make_safe(array);
+  Py_RETURN_NONE;
+
+  BOB_CATCH_FUNCTION("_parse", 0)
+}
+
+// ... plus converting to blitz, and an output array of the same shape back to numpy
+static PyObject* PyOverheadConvert(PyObject*, PyObject* args, PyObject* kwargs) {
+
+  BOB_TRY
+
+  char** kwlist = reverse_doc.kwlist(0);
+  PyBlitzArrayObject* array;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O&", kwlist, &PyBlitzArray_Converter, &array)) return 0;
+  auto array_ = make_safe(array);
+  if (array->type_num != NPY_FLOAT64 || array->ndim != 1){
+    PyErr_Format(PyExc_TypeError, "%s : Only 1D arrays of type float are allowed", reverse_doc.name());
+    return 0;
+  }
+  blitz::Array<double, 1> bz = *PyBlitzArrayCxx_AsBlitz<double, 1>(array);
+  blitz::Array<double, 1> output(bz.shape());
+  return PyBlitzArrayCxx_AsNumpy(output);
+
+  BOB_CATCH_FUNCTION("_convert", 0)
+}
+
+
 //////////////////////////////////////////////////////////////////////////
 /////// Python module declaration ////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
@@ -70,6 +119,24 @@ static PyMethodDef module_methods[] = {
     METH_VARARGS|METH_KEYWORDS,
     reverse_doc.doc()
   },
+  {
+    "_empty",
+    (PyCFunction)PyOverheadEmpty,
+    METH_NOARGS,
+    "Overhead probe: calls an empty function"
+  },
+  {
+    "_parse",
+    (PyCFunction)PyOverheadParse,
+    METH_VARARGS|METH_KEYWORDS,
+    "Overhead probe: parses the arguments of reverse"
+  },
+  {
+    "_convert",
+    (PyCFunction)PyOverheadConvert,
+    METH_VARARGS|METH_KEYWORDS,
+    "Overhead probe: converts the arguments and the result of reverse"
+  },
   {NULL}  // Sentinel
 };
 
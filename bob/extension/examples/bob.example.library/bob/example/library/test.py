@@ -11,3 +11,12 @@ def test_reverse():
   target = reverse(source)
   for i in range(count):
     assert target[i] == source[count-i-1]
+
+def test_overhead_cases():
+  # the benchmark cases of ``bob overhead`` run, and convert like reverse
+  from .benchmark import cases
+  from ._library import _convert
+  from bob.extension.overhead import run_cases
+  results = run_cases(cases(), sizes=[16], min_time=0.001, repetitions=1)
+  assert len(results) == 5
+  assert _convert(array=[1., 2., 3.]).shape == (3,)
@@ -108,6 +108,10 @@ setup(
         # additional parameters, see Library documentation
         version = version,
         bob_packages = bob_packages,
+        # native benchmarks, built with BOB_BUILD_BENCHMARKS=1
+        benchmarks = [
+          "bob/example/library/cpp/benchmark.cpp",
+        ],
       ),
 
       # The second extension contains the actual C++ code and the Python bindings
@@ -149,6 +153,11 @@ setup(
       'console_scripts': [
         'bob_example_library_reverse.py = bob.example.library.script.reverse:main',
       ],
+
+      # the benchmarks of the overhead of the Python bindings, see ``bob overhead``
+      'bob.overhead': [
+        'bob.example.library = bob.example.library.benchmark:cases',
+      ],
     },
 
     # Classifiers are important if you plan to distribute this package through
@@ -0,0 +1,478 @@
+/**
+ * @file bob/extension/include/bob.extension/benchmark.h
+ *
+ * @brief A harness to benchmark the C++ code of a Library without Python
+ *
+ * Copyright (C) 2026 Idiap Research Institute, Martigny, Switzerland
+ */
+
+
+/** The kernels of a bob.extension.Library can be benchmarked natively, so that
+* the cost of the Python bindings does not hide their cost. Kernels are
+* registered in the sources given as the ``benchmarks`` of the Library:
+*
+*   #include <bob.extension/benchmark.h>
+*   #include <bob.example.library/Function.h>
+*
+*   BOB_BENCHMARK(reverse){
+*     blitz::Array<double,1> array(state.size());    // setup, not timed
+*     array = 1.;
+*     while (state.keep_running()){
+*       bob::extension::benchmark::do_not_optimize(bob::example::library::reverse(array));
+*     }
+*     state.set_items(state.size());
+*   }
+*
+* When the package is built with BOB_BUILD_BENCHMARKS=1, these sources are
+* linked with the library into an executable <library>_benchmark next to the
+* library, which runs each kernel for each size: after a warmup, the number of
+* iterations is calibrated to the minimum time, and the time per iteration is
+* measured in several repetitions. The process is pinned to a single CPU, and
+* CPU cycles and instructions are counted, when the perf events of Linux are
+* available. Results are written as a table or as JSON (--json), see --help
+* and the ``bob benchmark`` command.
+*/
+
+#ifndef BOB_EXTENSION_BENCHMARK_H_INCLUDED
+#define BOB_EXTENSION_BENCHMARK_H_INCLUDED
+
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#ifndef BOB_BENCHMARK_LIBRARY
+#define BOB_BENCHMARK_LIBRARY ""
+#endif
+
+namespace bob{
+  namespace extension{
+    namespace benchmark{
+
+      /**
+       * Prevents the compiler from optimizing away the computation of the given value.
+       */
+      template <typename T>
+      inline void do_not_optimize(const T& value){
+#if defined(__GNUC__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile const void* sink;
+        sink = &value;
+#endif
+      }
+
+      /**
+       * The hardware counters of the calling thread, if the perf events of Linux are available.
+       */
+      class Counters {
+        public:
+          static const unsigned Count = 2;
+
+          Counters() : m_fd{-1, -1} {
+#if defined(__linux__)
+            const uint64_t configs[Count] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS};
+            for (unsigned i = 0; i < Count; ++i){
+              perf_event_attr attr;
+              memset(&attr, 0, sizeof(attr));
+              attr.size = sizeof(attr);
+              attr.type = PERF_TYPE_HARDWARE;
+              attr.config = configs[i];
+              attr.disabled = i == 0;
+              attr.exclude_kernel = 1;
+              attr.exclude_hv = 1;
+              attr.read_format = PERF_FORMAT_GROUP;
+              m_fd[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, i ? m_fd[0] : -1, 0);
+              if (m_fd[i] < 0){
+                close_all();
+                return;
+              }
+            }
+#endif
+          }
+
+          ~Counters() {close_all();}
+
+          /** Whether the counters are available */
+          bool available() const {return m_fd[0] >= 0;}
+
+          /** The names of the counters */
+          static const char* name(unsigned index){
+            static const char* names[Count] = {"cycles", "instructions"};
+            return names[index];
+          }
+
+          void start(){
+#if defined(__linux__)
+            if (!available()) return;
+            ioctl(m_fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(m_fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+          }
+
+          /** Stops counting, and writes the counts into values */
+          void stop(double* values){
+#if defined(__linux__)
+            if (!available()) return;
+            ioctl(m_fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            uint64_t buffer[Count + 1];
+            if (read(m_fd[0], buffer, sizeof(buffer)) == (ssize_t)sizeof(buffer)){
+              for (unsigned i = 0; i < Count; ++i) values[i] = (double)buffer[i + 1];
+            }
+#endif
+          }
+
+        private:
+          void close_all(){
+#if defined(__linux__)
+            for (unsigned i = 0; i < Count; ++i){
+              if (m_fd[i] >= 0) close(m_fd[i]);
+              m_fd[i] = -1;
+            }
+#endif
+          }
+
+          int m_fd[Count];
+      };
+
+      /**
+       * The state of a single run of a kernel, which runs the timed loop.
+       */
+      class State {
+        public:
+          State(size_t size, size_t iterations, Counters* counters)
+          : m_size(size), m_iterations(iterations), m_remaining(iterations), m_items(0), m_started(false), m_seconds(0.), m_counters(counters)
+          {
+            for (unsigned i = 0; i < Counters::Count; ++i) m_counts[i] = 0.;
+          }
+
+          /** The size of the problem, which the kernel is free to interpret */
+          size_t size() const {return m_size;}
+
+          /** Returns true while the loop should continue; the time is measured from the first to the last call */
+          bool keep_running(){
+            if (!m_started){
+              m_started = true;
+              if (m_counters) m_counters->start();
+              m_start = std::chrono::steady_clock::now();
+            }
+            if (m_remaining){
+              --m_remaining;
+              return true;
+            }
+            m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+            if (m_counters) m_counters->stop(m_counts);
+            return false;
+          }
+
+          /** Sets the number of items processed in each iteration, to report the throughput */
+          void set_items(size_t items) {m_items = items;}
+
+          size_t iterations() const {return m_iterations;}
+          size_t items() const {return m_items;}
+          double seconds() const {return m_seconds;}
+          const double* counts() const {return m_counts;}
+          bool finished() const {return m_started && !m_remaining;}
+
+        private:
+          size_t m_size;
+          size_t m_iterations;
+          size_t m_remaining;
+          size_t m_items;
+          bool m_started;
+          std::chrono::steady_clock::time_point m_start;
+          double m_seconds;
+          Counters* m_counters;
+          double m_counts[Counters::Count];
+      };
+
+      typedef void (*Kernel)(State& state);
+
+      struct Benchmark {
+        std::string name;
+        Kernel kernel;
+      };
+
+      /** The registered benchmarks */
+      inline std::vector<Benchmark>& benchmarks(){
+        static std::vector<Benchmark> registry;
+        return registry;
+      }
+
+      /** Registers a benchmark, see BOB_BENCHMARK */
+      struct Registration {
+        Registration(const char* name, Kernel kernel){
+          benchmarks().push_back(Benchmark{name, kernel});
+        }
+      };
+
+      /** Runs the benchmarks according to the command line, see --help */
+      inline int main(int argc, char** argv);
+
+    }
+  }
+}
+
+/** Defines and registers a kernel; the body can use the State& state */
+#define BOB_BENCHMARK(name) \
+  static void bob_benchmark_##name(bob::extension::benchmark::State& state); \
+  static bob::extension::benchmark::Registration bob_benchmark_registration_##name(#name, bob_benchmark_##name); \
+  static void bob_benchmark_##name(bob::extension::benchmark::State& state)
+
+
+namespace bob{
+  namespace extension{
+    namespace benchmark{
+
+      struct Options {
+        std::vector<size_t> sizes;
+        double min_time;
+        double warmup;
+        unsigned repetitions;
+        int cpu;
+        std::string filter;
+        std::string json;
+        bool list;
+      };
+
+      inline void _usage(const char* program){
+        printf(
+          "Usage: %s [options]\n\n"
+          "Benchmarks the kernels of the library %s.\n\n"
+          "Options:\n"
+          "  --sizes N,N,...      the problem sizes [default: 16,256,4096,65536,1048576]\n"
+          "  --min-time SECONDS   the minimum time of each repetition [default: 0.1]\n"
+          "  --warmup SECONDS     the time to run each kernel before measuring [default: 0.05]\n"
+          "  --repetitions N      the number of repetitions [default: 5]\n"
+          "  --cpu N              the CPU to pin to, -1 for none [default: the current CPU]\n"
+          "  --filter TEXT        only runs the kernels whose name contains TEXT\n"
+          "  --json FILE          writes the results as JSON to FILE, - for stdout\n"
+          "  --list               lists the kernels\n",
+          program, BOB_BENCHMARK_LIBRARY
+        );
+      }
+
+      inline bool _parse(int argc, char** argv, Options& options){
+        options.sizes = {16, 256, 4096, 65536, 1048576};
+        options.min_time = 0.1;
+        options.warmup = 0.05;
+        options.repetitions = 5;
+        options.cpu = -2;
+        options.list = false;
+        for (int i = 1; i < argc; ++i){
+          std::string arg = argv[i];
+          if (arg == "--help" || arg == "-h"){
+            _usage(argv[0]);
+            exit(0);
+          }
+          if (arg == "--list"){
+            options.list = true;
+            continue;
+          }
+          if (i + 1 == argc){
+            fprintf(stderr, "%s: unknown option or missing value: %s\n", argv[0], arg.c_str());
+            return false;
+          }
+          std::string value = argv[++i];
+          if (arg == "--sizes"){
+            options.sizes.clear();
+            std::istringstream stream(value);
+            std::string size;
+            while (std::getline(stream, size, ',')) options.sizes.push_back(strtoull(size.c_str(), 0, 10));
+          }
+          else if (arg == "--min-time") options.min_time = atof(value.c_str());
+          else if (arg == "--warmup") options.warmup = atof(value.c_str());
+          else if (arg == "--repetitions") options.repetitions = std::max(1, atoi(value.c_str()));
+          else if (arg == "--cpu") options.cpu = atoi(value.c_str());
+          else if (arg == "--filter") options.filter = value;
+          else if (arg == "--json") options.json = value;
+          else {
+            fprintf(stderr, "%s: unknown option: %s\n", argv[0], arg.c_str());
+            return false;
+          }
+        }
+        return true;
+      }
+
+      // pins the process to the given CPU (-2 for the current one), and returns the CPU or -1
+      inline int _pin(int cpu){
+#if defined(__linux__)
+        if (cpu == -2) cpu = sched_getcpu();
+        if (cpu < 0) return -1;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0){
+          fprintf(stderr, "Cannot pin to CPU %d, continuing unpinned\n", cpu);
+          return -1;
+        }
+        return cpu;
+#else
+        (void)cpu;
+        return -1;
+#endif
+      }
+
+      inline void _run(const Benchmark& benchmark, State& state){
+        benchmark.kernel(state);
+        if (!state.finished()) throw std::runtime_error("the kernel did not run the loop of State::keep_running() to its end");
+      }
+
+      struct Result {
+        std::string kernel;
+        size_t size;
+        size_t iterations;
+        size_t items;
+        std::vector<double> seconds;
+        std::vector<double> counts[Counters::Count];
+      };
+
+      inline double _median(std::vector<double> values){
+        std::sort(values.begin(), values.end());
+        size_t n = values.size();
+        return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2.;
+      }
+
+      inline Result _measure(const Benchmark& benchmark, size_t size, const Options& options, Counters& counters){
+        // warm up the caches and the branch predictors, and find the time of a single iteration
+        size_t iterations = 1;
+        double elapsed = 0., total = 0.;
+        while (true){
+          State state(size, iterations, 0);
+          _run(benchmark, state);
+          elapsed = state.seconds();
+          total += elapsed;
+          if (total >= options.warmup && elapsed >= options.min_time / 10.) break;
+          if (elapsed >= options.min_time) break;
+          iterations = (size_t)(iterations * (elapsed > 0. ? std::max(2., std::min(10., options.min_time / 5. / elapsed)) : 10.));
+        }
+        // calibrate the number of iterations to the minimum time
+        if (elapsed < options.min_time){
+          iterations = (size_t)std::ceil(iterations * options.min_time / std::max(elapsed, 1e-9));
+        }
+
+        Result result;
+        result.kernel = benchmark.name;
+        result.size = size;
+        result.iterations = iterations;
+        result.items = 0;
+        for (unsigned r = 0; r < options.repetitions; ++r){
+          State state(size, iterations, counters.available() ? &counters : 0);
+          _run(benchmark, state);
+          result.items = state.items();
+          result.seconds.push_back(state.seconds());
+          if (counters.available()){
+            for (unsigned i = 0; i < Counters::Count; ++i) result.counts[i].push_back(state.counts()[i]);
+          }
+        }
+        return result;
+      }
+
+      inline void _write_json(FILE* f, const std::vector<Result>& results, int cpu, bool counters, const Options& options){
+        fprintf(f, "{\n  \"library\": \"%s\",\n  \"cpu\": %d,\n  \"min_time\": %g,\n  \"repetitions\": %u,\n  \"counters\": [", BOB_BENCHMARK_LIBRARY, cpu, options.min_time, options.repetitions);
+        for (unsigned i = 0; counters && i < Counters::Count; ++i) fprintf(f, "%s\"%s\"", i ? ", " : "", Counters::name(i));
+        fprintf(f, "],\n  \"results\": [");
+        for (size_t r = 0; r < results.size(); ++r){
+          const Result& result = results[r];
+          double n = (double)result.iterations;
+          std::vector<double> ns(result.seconds.size());
+          double mean = 0., variance = 0.;
+          for (size_t i = 0; i < ns.size(); ++i){
+            ns[i] = result.seconds[i] * 1e9 / n;
+            mean += ns[i] / ns.size();
+          }
+          for (size_t i = 0; i < ns.size(); ++i) variance += (ns[i] - mean) * (ns[i] - mean) / ns.size();
+          double median = _median(ns);
+          fprintf(f, "%s\n    {\"kernel\": \"%s\", \"size\": %zu, \"iterations\": %zu, ", r ? "," : "", result.kernel.c_str(), result.size, result.iterations);
+          fprintf(f, "\"ns_per_iteration\": {\"min\": %.6g, \"median\": %.6g, \"mean\": %.6g, \"stddev\": %.6g}",
+                  *std::min_element(ns.begin(), ns.end()), median, mean, std::sqrt(variance));
+          if (result.items) fprintf(f, ", \"items_per_second\": %.6g", result.items * 1e9 / median);
+          for (unsigned i = 0; counters && i < Counters::Count; ++i){
+            fprintf(f, ", \"%s_per_iteration\": %.6g", Counters::name(i), _median(result.counts[i]) / n);
+          }
+          fprintf(f, "}");
+        }
+        fprintf(f, "\n  ]\n}\n");
+      }
+
+      inline void _write_table(FILE* f, const std::vector<Result>& results, bool counters){
+        fprintf(f, "%-30s %10s %12s %14s %14s", "kernel", "size", "iterations", "ns/iteration", "items/s");
+        for (unsigned i = 0; counters && i < Counters::Count; ++i) fprintf(f, " %14s", Counters::name(i));
+        fprintf(f, "\n");
+        for (size_t r = 0; r < results.size(); ++r){
+          const Result& result = results[r];
+          double n = (double)result.iterations;
+          double median = _median(result.seconds) * 1e9 / n;
+          fprintf(f, "%-30s %10zu %12zu %14.6g", result.kernel.c_str(), result.size, result.iterations, median);
+          if (result.items) fprintf(f, " %14.6g", result.items * 1e9 / median);
+          else fprintf(f, " %14s", "-");
+          for (unsigned i = 0; counters && i < Counters::Count; ++i) fprintf(f, " %14.6g", _median(result.counts[i]) / n);
+          fprintf(f, "\n");
+        }
+      }
+
+      inline int main(int argc, char** argv){
+        Options options;
+        if (!_parse(argc, argv, options)){
+          _usage(argv[0]);
+          return 2;
+        }
+        std::vector<Benchmark> selected;
+        for (const Benchmark& benchmark : benchmarks()){
+          if (benchmark.name.find(options.filter) != std::string::npos) selected.push_back(benchmark);
+        }
+        if (options.list){
+          for (const Benchmark& benchmark : selected) printf("%s\n", benchmark.name.c_str());
+          return 0;
+        }
+
+        int cpu = _pin(options.cpu);
+        Counters counters;
+        std::vector<Result> results;
+        try {
+          for (const Benchmark& benchmark : selected){
+            for (size_t size : options.sizes){
+              results.push_back(_measure(benchmark, size, options, counters));
+              if (options.json != "-") fprintf(stderr, ".");
+            }
+          }
+        } catch (std::exception& e) {
+          fprintf(stderr, "\n%s: %s\n", argv[0], e.what());
+          return 1;
+        }
+        if (options.json != "-") fprintf(stderr, "\n");
+
+        if (options.json.empty()){
+          _write_table(stdout, results, counters.available());
+          return 0;
+        }
+        FILE* f = options.json == "-" ? stdout : fopen(options.json.c_str(), "w");
+        if (!f){
+          fprintf(stderr, "%s: cannot write %s\n", argv[0], options.json.c_str());
+          return 1;
+        }
+        _write_json(f, results, cpu, counters.available(), options);
+        if (f != stdout) fclose(f);
+        return 0;
+      }
+
+    }
+  }
+}
+
+#endif // BOB_EXTENSION_BENCHMARK_H_INCLUDED
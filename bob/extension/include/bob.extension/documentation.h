@@ -169,6 +169,20 @@ namespace bob{
           return kwlists[index];
         }
 
+        /**
+         * Returns the number of prototypes that were added with add_prototype().
+         */
+        unsigned prototypes() const {return kwlists.size();}
+
+        /**
+         * Returns the variables of the prototype with the given index, as they were given to add_prototype(), e.g., "x, [y]".
+         * @param index  The index of the prototype
+         */
+        const char* prototype(unsigned index = 0) const{
+          if (index >= prototype_variables.size()) throw std::runtime_error("The prototype for the given index is not found");
+          return prototype_variables[index].c_str();
+        }
+
         /**
          * Generates and prints the usage string, simply listing the possible ways to call the function.
          *
@@ -273,6 +287,20 @@ namespace bob{
           return constructor.front().kwlist(index);
         }
 
+        /**
+         * Returns the number of prototypes of the constructor documentation, or 0 if there is none.
+         */
+        unsigned prototypes() const {return constructor.empty() ? 0 : constructor.front().prototypes();}
+
+        /**
+         * Returns the variables of the constructor prototype with the given index, e.g., "x, [y]".
+         * @param index  The index of the prototype
+         */
+        const char* prototype(unsigned index = 0) const{
+          if (constructor.empty()) throw std::runtime_error("The class documentation does not have constructor documentation");
+          return constructor.front().prototype(index);
+        }
+
         /**
          * Prints the usage string of the constructor, if available.
          */
@@ -0,0 +1,33 @@
+/**
+ * @file bob/extension/include/bob.extension/export.h
+ *
+ * @brief Macros to control which symbols a bob.extension.Library exports
+ *
+ * Copyright (C) 2026 Idiap Research Institute, Martigny, Switzerland
+ */
+
+
+/** When a Library is built with ``visibility = 'hidden'`` (or with
+* ``BOB_BUILD_VISIBILITY=hidden``), only the functions, classes and variables
+* that are marked with BOB_EXPORT are exported from the shared library:
+*
+*   class BOB_EXPORT Array { ... };
+*   BOB_EXPORT int api_function();
+*
+* With ELF and Mach-O, the same attribute is used when building and when using
+* the library, so that a single macro is enough for all libraries. The macros
+* are empty for compilers that do not support visibility attributes.
+*/
+
+#ifndef BOB_EXTENSION_EXPORT_H_INCLUDED
+#define BOB_EXTENSION_EXPORT_H_INCLUDED
+
+#if defined(__GNUC__) || defined(__clang__)
+#define BOB_EXPORT __attribute__((visibility("default")))
+#define BOB_NO_EXPORT __attribute__((visibility("hidden")))
+#else
+#define BOB_EXPORT
+#define BOB_NO_EXPORT
+#endif
+
+#endif // BOB_EXTENSION_EXPORT_H_INCLUDED
@@ -0,0 +1,192 @@
+/**
+ * @file bob/extension/include/bob.extension/processor.h
+ *
+ * @brief Native processors, which can be fused into a single C++ chain by
+ * bob.extension.processors.SequentialProcessor
+ *
+ * Copyright (C) 2026 Idiap Research Institute, Martigny, Switzerland
+ */
+
+
+/** A C++ extension that implements a processor (e.g., a feature extractor
+* working on blitz::Array<double,2>) can expose it with the
+* __native_processor__ attribute of its Python object:
+*
+*   static PyObject* PyBobExample_native(PyBobExampleObject* self, void*){
+*     return bob::extension::native_processor<blitz::Array<double,2>>(self->cxx);
+*   }
+*
+* where self->cxx is a std::shared_ptr to a class derived from
+* bob::extension::NativeProcessor<blitz::Array<double,2>>. When consecutive
+* processors of a SequentialProcessor share the same array type, they are run
+* as a single NativeChain: the input is converted from Python once, the arrays
+* are passed directly from one stage to the next with the GIL released, and
+* only the final output is converted back to Python.
+*
+* The conversion is defined by a specialization of
+* bob::extension::NativeConverter for the array type, which is usually
+* provided by the package that binds the array type (e.g., bob.blitz).
+*/
+
+#ifndef BOB_EXTENSION_PROCESSOR_H_INCLUDED
+#define BOB_EXTENSION_PROCESSOR_H_INCLUDED
+
+#include <Python.h>
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <exception>
+
+namespace bob{
+  namespace extension{
+
+    /**
+     * The interface of a native processor, which converts an input array to an output array of the same type.
+     * The process() function is called without holding the GIL, so it must not access any Python object.
+     */
+    template <typename Array>
+    class NativeProcessor {
+      public:
+        virtual ~NativeProcessor() {}
+
+        /**
+         * Processes the given input and returns the output.
+         * Exceptions derived from std::exception are translated into a Python RuntimeError.
+         */
+        virtual Array process(const Array& input) const = 0;
+    };
+
+    /**
+     * Converts arrays of the given type from and to Python.
+     * Specializations must provide:
+     *
+     *   static const char* name();
+     *     A unique name of the array type, e.g., "blitz::Array<double,2>", which must be a static string.
+     *
+     *   static bool from_python(PyObject* object, Array& array);
+     *     Binds array to the given Python object (e.g., with blitz::Array::reference) or copies it.
+     *     Returns false with a Python exception set when the object cannot be converted.
+     *
+     *   static PyObject* to_python(const Array& array);
+     *     Returns a new reference to a Python object holding the array, or NULL with a Python exception set.
+     */
+    template <typename Array>
+    struct NativeConverter;
+
+    /**
+     * A chain of native processors, which passes the output of each stage directly to the next stage.
+     * Arrays are only copy-constructed (and never assigned), so that array types with reference semantics, such as blitz::Array, are not copied.
+     */
+    template <typename Array>
+    class NativeChain : public NativeProcessor<Array> {
+      public:
+        /**
+         * Appends the given stage to the chain.
+         */
+        void add(std::shared_ptr<const NativeProcessor<Array>> stage){stages.push_back(stage);}
+
+        /**
+         * Returns the number of stages of the chain.
+         */
+        size_t size() const {return stages.size();}
+
+        virtual Array process(const Array& input) const {return run(0, input);}
+
+      private:
+        Array run(size_t index, const Array& data) const {
+          if (index == stages.size()) return data;
+          return run(index + 1, stages[index]->process(data));
+        }
+
+        std::vector<std::shared_ptr<const NativeProcessor<Array>>> stages;
+    };
+
+    namespace detail{
+
+      template <typename Array>
+      void delete_native_processor(PyObject* capsule){
+        delete static_cast<std::shared_ptr<const NativeProcessor<Array>>*>(PyCapsule_GetPointer(capsule, NativeConverter<Array>::name()));
+      }
+
+      /**
+       * run_native_chain(stages, data) -> output
+       * Runs the native processors of the given sequence of capsules on data, with the GIL released.
+       */
+      template <typename Array>
+      PyObject* run_native_chain(PyObject*, PyObject* args){
+        PyObject* stages;
+        PyObject* data;
+        if (!PyArg_ParseTuple(args, "OO:run_native_chain", &stages, &data)) return 0;
+
+        NativeChain<Array> chain;
+        PyObject* sequence = PySequence_Fast(stages, "stages must be a sequence of native processors");
+        if (!sequence) return 0;
+        for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(sequence); ++i){
+          void* stage = PyCapsule_GetPointer(PySequence_Fast_GET_ITEM(sequence, i), NativeConverter<Array>::name());
+          if (!stage){
+            Py_DECREF(sequence);
+            return 0;
+          }
+          chain.add(*static_cast<std::shared_ptr<const NativeProcessor<Array>>*>(stage));
+        }
+        Py_DECREF(sequence);
+
+        std::unique_ptr<Array> output;
+        std::string error;
+        try {
+          Array input;
+          if (!NativeConverter<Array>::from_python(data, input)) return 0;
+          // data is kept alive by args, so that input may refer to its memory
+          Py_BEGIN_ALLOW_THREADS
+          try {
+            output.reset(new Array(chain.process(input)));
+          } catch (std::exception& e) {
+            error = e.what();
+            if (error.empty()) error = "unknown exception in native processor";
+          } catch (...) {
+            error = "unknown exception in native processor";
+          }
+          Py_END_ALLOW_THREADS
+        } catch (std::exception& e) {
+          error = e.what();
+        }
+        if (!output){
+          PyErr_SetString(PyExc_RuntimeError, error.c_str());
+          return 0;
+        }
+        return NativeConverter<Array>::to_python(*output);
+      }
+
+    } // namespace detail
+
+    /**
+     * Returns the value of the __native_processor__ attribute of the Python object that binds the given processor.
+     * This is a tuple (name, capsule, runner), where name is the name of the array type, capsule holds a reference to the processor, and runner runs a sequence of such capsules as a NativeChain.
+     */
+    template <typename Array>
+    PyObject* native_processor(std::shared_ptr<const NativeProcessor<Array>> processor){
+      static PyMethodDef runner = {
+        "run_native_chain",
+        (PyCFunction)detail::run_native_chain<Array>,
+        METH_VARARGS,
+        "run_native_chain(stages, data) -> output\n\nRuns the given native processors on data, with the GIL released"
+      };
+      std::shared_ptr<const NativeProcessor<Array>>* pointer = new std::shared_ptr<const NativeProcessor<Array>>(processor);
+      PyObject* capsule = PyCapsule_New(pointer, NativeConverter<Array>::name(), detail::delete_native_processor<Array>);
+      if (!capsule){
+        delete pointer;
+        return 0;
+      }
+      PyObject* function = PyCFunction_New(&runner, 0);
+      if (!function){
+        Py_DECREF(capsule);
+        return 0;
+      }
+      return Py_BuildValue("(sNN)", NativeConverter<Array>::name(), capsule, function);
+    }
+
+  } // namespace extension
+} // namespace bob
+
+#endif // BOB_EXTENSION_PROCESSOR_H_INCLUDED
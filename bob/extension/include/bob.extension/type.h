@@ -0,0 +1,532 @@
+/**
+ * @file bob/extension/include/bob.extension/type.h
+ *
+ * @brief Generates the Python type of a C++ class from its ClassDoc, with a
+ * vectorcall constructor, an optional freelist and attribute accessors
+ *
+ * Copyright (C) 2026 Idiap Research Institute, Martigny, Switzerland
+ */
+
+
+/** Instead of writing the PyTypeObject, tp_new, tp_init and tp_dealloc of a
+* class by hand, a binding can declare a static ExtensionType for the C++
+* class, which stores the C++ object inside the Python object (without a
+* separate heap allocation):
+*
+*   static auto Point_doc = bob::extension::ClassDoc("bob.example.Point", "A point")
+*     .add_constructor(bob::extension::FunctionDoc("Point", "Creates a point").add_prototype("x, [y]", ""));
+*
+*   static bool Point_make(void* memory, unsigned prototype, PyObject* const* args){
+*     // args holds the arguments of the matching constructor prototype, NULL if not given
+*     double x = PyFloat_AsDouble(args[0]);
+*     ...
+*     if (PyErr_Occurred()) return false;
+*     new (memory) Point(x, y);
+*     return true;
+*   }
+*
+*   static bob::extension::ExtensionType<Point, 64> PointType(Point_doc, Point_make);
+*
+* Attributes and methods are added with add_attribute() and add_method(),
+* which highlight them in the ClassDoc, and the type is added to the module
+* with ready(). The arguments are matched against each constructor prototype
+* of the ClassDoc in turn, and the index of the first prototype that takes
+* them is passed to the constructor function. Calling the type uses
+* vectorcall (Python >= 3.9), so the arguments are neither packed into a
+* tuple nor a dict. With a FreeListSize, the memory of up to that many
+* deleted objects is kept and reused for new objects, which makes
+* short-lived wrapper objects much cheaper; objects returned from C++ code
+* are created with ExtensionType<T>::create(...).
+*/
+
+#ifndef BOB_EXTENSION_TYPE_H_INCLUDED
+#define BOB_EXTENSION_TYPE_H_INCLUDED
+
+#include <Python.h>
+#include <bob.extension/documentation.h>
+
+#include <new>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+
+namespace bob{
+  namespace extension{
+
+    /**
+     * The Python type of the C++ class T, generated from its ClassDoc.
+     * Use a single static object of this class for each bound class.
+     * @tparam T             The C++ class, which is stored inside the Python object
+     * @tparam FreeListSize  The number of deleted objects whose memory is kept for reuse
+     */
+    template <typename T, unsigned FreeListSize = 0>
+    class ExtensionType {
+      public:
+        /** The layout of the Python objects */
+        struct Object {
+          PyObject_HEAD
+          bool constructed;
+          alignas(T) unsigned char storage[sizeof(T)];
+        };
+
+        /**
+         * Constructs T with placement new at the given memory from the arguments of the given constructor prototype of the ClassDoc, which are NULL if not given.
+         * Returns false with a Python exception set if T could not be constructed.
+         */
+        typedef bool (*Constructor)(void* memory, unsigned prototype, PyObject* const* arguments);
+        /** Returns a new reference to the value of an attribute */
+        typedef PyObject* (*Getter)(const T& object);
+        /** Sets an attribute, and returns 0, or -1 with a Python exception set */
+        typedef int (*Setter)(T& object, PyObject* value);
+
+        /** The maximum number of arguments of each constructor prototype */
+        static const unsigned MaxArguments = 16;
+
+        /**
+         * Generates the type.
+         * @param doc          The documentation of the class, including the constructor; its name is the (qualified) name of the type
+         * @param constructor  The function that constructs T
+         * @param module_name  The name of the module, if the name of the ClassDoc is not qualified
+         */
+        ExtensionType(ClassDoc& doc, Constructor constructor, const char* module_name = 0);
+
+        /**
+         * Adds an attribute, which is also highlighted in the ClassDoc.
+         * @param doc     The documentation of the attribute, which gives its name
+         * @param getter  The function that returns the value
+         * @param setter  The function that sets the value; read-only if not given
+         */
+        ExtensionType& add_attribute(const VariableDoc& doc, Getter getter, Setter setter = 0);
+
+        /**
+         * Adds a method, which is also highlighted in the ClassDoc.
+         * The method receives the Python object, see cxx().
+         * @param doc       The documentation of the method, which gives its name
+         * @param function  The implementation of the method
+         * @param flags     The calling convention, e.g., METH_NOARGS or METH_VARARGS | METH_KEYWORDS
+         */
+        ExtensionType& add_method(const FunctionDoc& doc, PyCFunction function, int flags = METH_VARARGS | METH_KEYWORDS);
+
+        /**
+         * Finalizes the type and adds it to the given module.
+         * No attributes or methods can be added afterwards.
+         * @return false, with a Python exception set, on failure
+         */
+        bool ready(PyObject* module);
+
+        /** The Python type */
+        PyTypeObject* type() {return &m_type;}
+
+        /** Returns whether the given object is an instance of the type */
+        static bool check(PyObject* object) {return Py_TYPE(object) == &s_instance->m_type;}
+
+        /** Returns the C++ object of the given Python object, which must be an instance of the type */
+        static T& cxx(PyObject* object) {return *reinterpret_cast<T*>(reinterpret_cast<Object*>(object)->storage);}
+
+        /**
+         * Creates a new Python object holding a T constructed from the given arguments, e.g., to return a C++ object to Python.
+         * @return A new reference, or NULL with a Python exception set
+         */
+        template <typename... Args>
+        static PyObject* create(Args&&... args);
+
+        /** Frees the memory of the objects in the freelist */
+        static void clear_freelist();
+
+        /** The number of objects in the freelist */
+        static unsigned freelist_size() {return s_freelist_size;}
+
+      private:
+        struct Accessor {
+          VariableDoc doc;
+          Getter getter;
+          Setter setter;
+        };
+
+        struct Prototype {
+          std::vector<PyObject*> names;
+          // whether each argument is required, i.e., not in brackets
+          std::vector<bool> required;
+        };
+
+        static Object* _allocate(PyTypeObject* type);
+        static void _dealloc(PyObject* object);
+        static PyObject* _construct(PyTypeObject* type, unsigned prototype, PyObject* const* values);
+        static bool _match(const Prototype& prototype, PyObject* const* args, Py_ssize_t nargs, PyObject* const* kwnames, PyObject* const* kwvalues, Py_ssize_t nkwargs, PyObject** values, bool report);
+        static bool _parse(PyObject* const* args, Py_ssize_t nargs, PyObject* const* kwnames, PyObject* const* kwvalues, Py_ssize_t nkwargs, PyObject** values, unsigned& prototype);
+        static PyObject* _new(PyTypeObject* type, PyObject* args, PyObject* kwargs);
+#if PY_VERSION_HEX >= 0x03090000
+        static PyObject* _vectorcall(PyObject* type, PyObject* const* args, size_t nargsf, PyObject* kwnames);
+#endif
+        static PyObject* _get(PyObject* self, void* closure);
+        static int _set(PyObject* self, PyObject* value, void* closure);
+
+        ClassDoc& m_doc;
+        Constructor m_constructor;
+        std::string m_name;
+        PyTypeObject m_type;
+        std::vector<Prototype> m_prototypes;
+        std::deque<Accessor> m_accessors;
+        std::deque<FunctionDoc> m_method_docs;
+        std::vector<PyGetSetDef> m_getset;
+        std::vector<PyMethodDef> m_methods;
+
+        static ExtensionType* s_instance;
+        static Object* s_freelist[FreeListSize ? FreeListSize : 1];
+        static unsigned s_freelist_size;
+    };
+
+    template <typename T, unsigned FreeListSize>
+    ExtensionType<T, FreeListSize>* ExtensionType<T, FreeListSize>::s_instance = 0;
+
+    template <typename T, unsigned FreeListSize>
+    typename ExtensionType<T, FreeListSize>::Object* ExtensionType<T, FreeListSize>::s_freelist[FreeListSize ? FreeListSize : 1];
+
+    template <typename T, unsigned FreeListSize>
+    unsigned ExtensionType<T, FreeListSize>::s_freelist_size = 0;
+
+  }
+}
+
+
+template <typename T, unsigned FreeListSize>
+inline bob::extension::ExtensionType<T, FreeListSize>::ExtensionType(
+  bob::extension::ClassDoc& doc,
+  Constructor constructor,
+  const char* module_name
+) : m_doc(doc), m_constructor(constructor), m_type()
+{
+  if (s_instance) throw std::runtime_error("Only a single ExtensionType can be created for each class");
+  s_instance = this;
+  m_name = doc.name();
+  if (m_name.find('.') == std::string::npos){
+    if (!module_name) throw std::runtime_error("The module name is required for the unqualified class name " + m_name);
+    m_name = std::string(module_name) + "." + m_name;
+  }
+#if PY_VERSION_HEX >= 0x03090000
+  Py_SET_REFCNT((PyObject*)&m_type, 1);
+#else
+  Py_REFCNT(&m_type) = 1;
+#endif
+}
+
+template <typename T, unsigned FreeListSize>
+inline bob::extension::ExtensionType<T, FreeListSize>& bob::extension::ExtensionType<T, FreeListSize>::add_attribute(
+  const bob::extension::VariableDoc& doc,
+  Getter getter,
+  Setter setter
+){
+  if (m_type.tp_dict) throw std::runtime_error("Attributes cannot be added after ready()");
+  m_accessors.push_back(Accessor{doc, getter, setter});
+  m_doc.highlight(doc);
+  return *this;
+}
+
+template <typename T, unsigned FreeListSize>
+inline bob::extension::ExtensionType<T, FreeListSize>& bob::extension::ExtensionType<T, FreeListSize>::add_method(
+  const bob::extension::FunctionDoc& doc,
+  PyCFunction function,
+  int flags
+){
+  if (m_type.tp_dict) throw std::runtime_error("Methods cannot be added after ready()");
+  m_method_docs.push_back(doc);
+  m_methods.push_back(PyMethodDef{m_method_docs.back().name(), function, flags, m_method_docs.back().doc()});
+  m_doc.highlight(doc);
+  return *this;
+}
+
+template <typename T, unsigned FreeListSize>
+inline bool bob::extension::ExtensionType<T, FreeListSize>::ready(
+  PyObject* module
+){
+  try {
+    if (!m_doc.prototypes()) throw std::runtime_error("The class documentation does not have constructor documentation");
+    for (unsigned p = 0; p < m_doc.prototypes(); ++p){
+      Prototype prototype;
+      for (char** kwlist = m_doc.kwlist(p); *kwlist; ++kwlist){
+        PyObject* name = PyUnicode_InternFromString(*kwlist);
+        if (!name) return false;
+        prototype.names.push_back(name);
+      }
+      // arguments in brackets, e.g., "x, [y]" or "x, [y, z]", are optional
+      std::string variables = m_doc.prototype(p);
+      int depth = 0;
+      for (size_t begin = 0; begin <= variables.size() && prototype.required.size() < prototype.names.size(); ){
+        size_t end = std::min(variables.find(',', begin), variables.size());
+        std::string variable = variables.substr(begin, end - begin);
+        prototype.required.push_back(depth == 0 && variable.find('[') == std::string::npos);
+        for (size_t i = 0; i < variable.size(); ++i){
+          if (variable[i] == '[') ++depth;
+          else if (variable[i] == ']') --depth;
+        }
+        begin = end + 1;
+      }
+      prototype.required.resize(prototype.names.size(), true);
+      if (prototype.names.size() > MaxArguments){
+        PyErr_Format(PyExc_RuntimeError, "%s: the constructor can have at most %u arguments", m_name.c_str(), MaxArguments);
+        return false;
+      }
+      m_prototypes.push_back(prototype);
+    }
+  } catch (std::exception& e) {
+    PyErr_Format(PyExc_RuntimeError, "%s: %s", m_name.c_str(), e.what());
+    return false;
+  }
+
+  for (auto it = m_accessors.begin(); it != m_accessors.end(); ++it){
+    m_getset.push_back(PyGetSetDef{it->doc.name(), _get, it->setter ? _set : 0, it->doc.doc(), &*it});
+  }
+  m_getset.push_back(PyGetSetDef());
+  m_methods.push_back(PyMethodDef());
+
+  m_type.tp_name = m_name.c_str();
+  m_type.tp_basicsize = sizeof(Object);
+  m_type.tp_flags = Py_TPFLAGS_DEFAULT;
+  m_type.tp_doc = m_doc.doc();
+  m_type.tp_new = _new;
+  m_type.tp_dealloc = _dealloc;
+  m_type.tp_getset = m_getset.data();
+  m_type.tp_methods = m_methods.data();
+#if PY_VERSION_HEX >= 0x03090000
+  m_type.tp_vectorcall = _vectorcall;
+#endif
+  if (PyType_Ready(&m_type) < 0) return false;
+
+  const char* short_name = strrchr(m_name.c_str(), '.') + 1;
+  Py_INCREF(&m_type);
+  if (PyModule_AddObject(module, short_name, (PyObject*)&m_type) < 0){
+    Py_DECREF(&m_type);
+    return false;
+  }
+  return true;
+}
+
+template <typename T, unsigned FreeListSize>
+inline typename bob::extension::ExtensionType<T, FreeListSize>::Object* bob::extension::ExtensionType<T, FreeListSize>::_allocate(
+  PyTypeObject* type
+){
+  Object* self;
+  if (FreeListSize && s_freelist_size){
+    self = s_freelist[--s_freelist_size];
+    PyObject_Init((PyObject*)self, type);
+  } else {
+    self = reinterpret_cast<Object*>(type->tp_alloc(type, 0));
+    if (!self) return 0;
+  }
+  self->constructed = false;
+  return self;
+}
+
+template <typename T, unsigned FreeListSize>
+inline void bob::extension::ExtensionType<T, FreeListSize>::_dealloc(
+  PyObject* object
+){
+  Object* self = reinterpret_cast<Object*>(object);
+  if (self->constructed){
+    reinterpret_cast<T*>(self->storage)->~T();
+    self->constructed = false;
+  }
+  if (FreeListSize && s_freelist_size < FreeListSize){
+    s_freelist[s_freelist_size++] = self;
+    return;
+  }
+  Py_TYPE(object)->tp_free(object);
+}
+
+template <typename T, unsigned FreeListSize>
+inline void bob::extension::ExtensionType<T, FreeListSize>::clear_freelist(){
+  while (s_freelist_size){
+    PyObject_Free(s_freelist[--s_freelist_size]);
+  }
+}
+
+template <typename T, unsigned FreeListSize>
+inline PyObject* bob::extension::ExtensionType<T, FreeListSize>::_construct(
+  PyTypeObject* type,
+  unsigned prototype,
+  PyObject* const* values
+){
+  Object* self = _allocate(type);
+  if (!self) return 0;
+  bool constructed = false;
+  try {
+    constructed = s_instance->m_constructor(self->storage, prototype, values);
+  } catch (std::exception& e) {
+    PyErr_Format(PyExc_RuntimeError, "%s - cannot create object: C++ exception caught: '%s'", type->tp_name, e.what());
+  } catch (...) {
+    PyErr_Format(PyExc_RuntimeError, "%s - cannot create object: unknown exception caught", type->tp_name);
+  }
+  if (!constructed){
+    Py_DECREF(self);
+    return 0;
+  }
+  self->constructed = true;
+  return (PyObject*)self;
+}
+
+template <typename T, unsigned FreeListSize>
+template <typename... Args>
+inline PyObject* bob::extension::ExtensionType<T, FreeListSize>::create(
+  Args&&... args
+){
+  Object* self = _allocate(&s_instance->m_type);
+  if (!self) return 0;
+  try {
+    new (self->storage) T(std::forward<Args>(args)...);
+  } catch (std::exception& e) {
+    PyErr_Format(PyExc_RuntimeError, "%s - cannot create object: C++ exception caught: '%s'", s_instance->m_type.tp_name, e.what());
+    Py_DECREF(self);
+    return 0;
+  } catch (...) {
+    PyErr_Format(PyExc_RuntimeError, "%s - cannot create object: unknown exception caught", s_instance->m_type.tp_name);
+    Py_DECREF(self);
+    return 0;
+  }
+  self->constructed = true;
+  return (PyObject*)self;
+}
+
+template <typename T, unsigned FreeListSize>
+inline bool bob::extension::ExtensionType<T, FreeListSize>::_match(
+  const Prototype& prototype,
+  PyObject* const* args,
+  Py_ssize_t nargs,
+  PyObject* const* kwnames,
+  PyObject* const* kwvalues,
+  Py_ssize_t nkwargs,
+  PyObject** values,
+  bool report
+){
+  const char* type_name = s_instance->m_type.tp_name;
+  const std::vector<PyObject*>& names = prototype.names;
+  if (nargs > (Py_ssize_t)names.size()){
+    if (report) PyErr_Format(PyExc_TypeError, "%s() takes at most %d arguments (%d given)", type_name, (int)names.size(), (int)nargs);
+    return false;
+  }
+  for (size_t i = 0; i < names.size(); ++i){
+    values[i] = (Py_ssize_t)i < nargs ? args[i] : 0;
+  }
+  for (Py_ssize_t k = 0; k < nkwargs; ++k){
+    PyObject* name = kwnames[k];
+    size_t index = names.size();
+    // keyword names are usually interned, as are our names
+    for (size_t i = 0; i < names.size(); ++i){
+      if (names[i] == name){index = i; break;}
+    }
+    if (index == names.size()){
+      for (size_t i = 0; i < names.size(); ++i){
+        if (PyUnicode_Check(name) && PyUnicode_Compare(names[i], name) == 0){index = i; break;}
+      }
+    }
+    if (index == names.size()){
+      if (report) PyErr_Format(PyExc_TypeError, "'%S' is an invalid keyword argument for %s()", name, type_name);
+      return false;
+    }
+    if (values[index]){
+      if (report) PyErr_Format(PyExc_TypeError, "argument '%S' of %s() given by name and position", name, type_name);
+      return false;
+    }
+    values[index] = kwvalues[k];
+  }
+  for (size_t i = 0; i < names.size(); ++i){
+    if (prototype.required[i] && !values[i]){
+      if (report) PyErr_Format(PyExc_TypeError, "%s() missing required argument '%S'", type_name, names[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename T, unsigned FreeListSize>
+inline bool bob::extension::ExtensionType<T, FreeListSize>::_parse(
+  PyObject* const* args,
+  Py_ssize_t nargs,
+  PyObject* const* kwnames,
+  PyObject* const* kwvalues,
+  Py_ssize_t nkwargs,
+  PyObject** values,
+  unsigned& prototype
+){
+  const std::vector<Prototype>& prototypes = s_instance->m_prototypes;
+  // with a single prototype, the reason for a mismatch is reported
+  bool report = prototypes.size() == 1;
+  for (prototype = 0; prototype < prototypes.size(); ++prototype){
+    if (_match(prototypes[prototype], args, nargs, kwnames, kwvalues, nkwargs, values, report)) return true;
+    if (report) return false;
+  }
+  PyErr_Format(PyExc_TypeError, "the arguments of %s() match none of its %d constructor prototypes", s_instance->m_type.tp_name, (int)prototypes.size());
+  return false;
+}
+
+template <typename T, unsigned FreeListSize>
+inline PyObject* bob::extension::ExtensionType<T, FreeListSize>::_new(
+  PyTypeObject* type,
+  PyObject* args,
+  PyObject* kwargs
+){
+  PyObject* values[MaxArguments];
+  PyObject* kwnames[MaxArguments];
+  PyObject* kwvalues[MaxArguments];
+  Py_ssize_t nkwargs = 0;
+  if (kwargs){
+    if (PyDict_GET_SIZE(kwargs) > (Py_ssize_t)MaxArguments){
+      PyErr_Format(PyExc_TypeError, "%s() takes at most %u arguments", type->tp_name, MaxArguments);
+      return 0;
+    }
+    Py_ssize_t position = 0;
+    while (PyDict_Next(kwargs, &position, &kwnames[nkwargs], &kwvalues[nkwargs])) ++nkwargs;
+  }
+  unsigned prototype;
+  if (!_parse(&PyTuple_GET_ITEM(args, 0), PyTuple_GET_SIZE(args), kwnames, kwvalues, nkwargs, values, prototype)) return 0;
+  return _construct(type, prototype, values);
+}
+
+#if PY_VERSION_HEX >= 0x03090000
+template <typename T, unsigned FreeListSize>
+inline PyObject* bob::extension::ExtensionType<T, FreeListSize>::_vectorcall(
+  PyObject* type,
+  PyObject* const* args,
+  size_t nargsf,
+  PyObject* kwnames
+){
+  PyObject* values[MaxArguments];
+  Py_ssize_t nargs = PyVectorcall_NARGS(nargsf);
+  Py_ssize_t nkwargs = kwnames ? PyTuple_GET_SIZE(kwnames) : 0;
+  unsigned prototype;
+  if (!_parse(args, nargs, nkwargs ? &PyTuple_GET_ITEM(kwnames, 0) : 0, args + nargs, nkwargs, values, prototype)) return 0;
+  return _construct(reinterpret_cast<PyTypeObject*>(type), prototype, values);
+}
+#endif
+
+template <typename T, unsigned FreeListSize>
+inline PyObject* bob::extension::ExtensionType<T, FreeListSize>::_get(
+  PyObject* self,
+  void* closure
+){
+  const Accessor* accessor = static_cast<const Accessor*>(closure);
+BOB_TRY
+  return accessor->getter(cxx(self));
+BOB_CATCH_MEMBER("cannot get attribute", 0)
+}
+
+template <typename T, unsigned FreeListSize>
+inline int bob::extension::ExtensionType<T, FreeListSize>::_set(
+  PyObject* self,
+  PyObject* value,
+  void* closure
+){
+  const Accessor* accessor = static_cast<const Accessor*>(closure);
+  if (!value){
+    PyErr_Format(PyExc_TypeError, "%s: the attribute '%s' cannot be deleted", Py_TYPE(self)->tp_name, accessor->doc.name());
+    return -1;
+  }
+BOB_TRY
+  return accessor->setter(cxx(self), value);
+BOB_CATCH_MEMBER("cannot set attribute", -1)
+}
+
+#endif // BOB_EXTENSION_TYPE_H_INCLUDED
@@ -0,0 +1,339 @@
+"""Records how long the stages of the :ref:`bob.extension.processors` take,
+how much memory they allocate and how large their outputs are.
+
+Instrumentation is opt-in: pass an :py:class:`Instrumentation` to a
+:py:class:`bob.extension.processors.SequentialProcessor` or
+:py:class:`bob.extension.processors.ParallelProcessor`. Without it, the
+processors are called directly.
+"""
+
+import os
+import sys
+import json
+import time
+import random
+import functools
+import threading
+import tracemalloc
+
+
+def stage_name(processor):
+    """Returns a readable name of the given processor.
+
+    Parameters
+    ----------
+    processor : callable
+        The processor.
+
+    Returns
+    -------
+    str
+        The name of the function or the class of the processor.
+    """
+    if isinstance(processor, functools.partial):
+        return stage_name(processor.func)
+    processors = getattr(processor, 'processors', None)
+    if isinstance(processors, (list, tuple)):
+        return '{}({})'.format(type(processor).__name__,
+                               ', '.join(stage_name(p) for p in processors))
+    name = getattr(processor, '__name__', None)
+    if isinstance(name, str):
+        return name
+    return type(processor).__name__
+
+
+def output_size(output):
+    """Returns the size of the given output in bytes: the ``nbytes`` of numpy
+    arrays, the length of byte strings, the sum of the sizes of the elements of
+    lists and tuples, or :py:func:`sys.getsizeof` otherwise.
+
+    Parameters
+    ----------
+    output : object
+        The output of a processor.
+
+    Returns
+    -------
+    int
+        The size in bytes.
+    """
+    nbytes = getattr(output, 'nbytes', None)
+    if isinstance(nbytes, int):
+        return nbytes
+    if isinstance(output, (bytes, bytearray)):
+        return len(output)
+    if isinstance(output, (list, tuple)):
+        return sum(output_size(o) for o in output)
+    return sys.getsizeof(output)
+
+
+def measure(processor, data, kwargs, memory=False):
+    """Calls the processor on the data and measures the call.
+
+    This function can be run in another process, e.g., on the process pool of
+    a :py:class:`bob.extension.processors.ParallelProcessor`, and the
+    measurement be recorded by the calling process with
+    :py:meth:`Instrumentation.record`.
+
+    Parameters
+    ----------
+    processor : callable
+        The processor.
+    data : object
+        The data that needs to be processed.
+    kwargs : dict
+        The kwargs that are passed to the processor.
+    memory : bool
+        Whether to measure the allocated memory with :py:mod:`tracemalloc`,
+        which is started if needed.
+
+    Returns
+    -------
+    output : object
+        The output of the processor, or ``None`` if it raised.
+    record : dict
+        The ``start`` time and ``duration`` of the call in seconds, the ``pid``
+        and ``tid`` that ran it, the peak of the memory ``allocated`` during
+        the call in bytes (or ``None``), the ``output`` size in bytes, and
+        whether the call raised an ``error``.
+    error : Exception or None
+        The exception raised by the processor.
+    """
+    if memory:
+        if not tracemalloc.is_tracing():
+            tracemalloc.start()
+        before = tracemalloc.get_traced_memory()[0]
+        tracemalloc.reset_peak()
+    error = output = None
+    start = time.perf_counter()
+    try:
+        output = processor(data, **kwargs)
+    except Exception as e:
+        error = e
+    duration = time.perf_counter() - start
+    record = {
+        'start': start,
+        'duration': duration,
+        'pid': os.getpid(),
+        'tid': threading.get_ident(),
+        'allocated': tracemalloc.get_traced_memory()[1] - before
+        if memory else None,
+        'output': output_size(output) if error is None else None,
+        'error': error is not None,
+    }
+    return output, record, error
+
+
+def _percentile(values, fraction):
+    """The nearest-rank percentile of the sorted values"""
+    if not values:
+        return None
+    index = min(len(values) - 1, max(0, int(round(fraction * len(values))) - 1))
+    return values[index]
+
+
+class Instrumentation(object):
+    """Collects the measurements of the stages of processors.
+
+    The latencies of each stage are kept in a uniform random sample (of at
+    most ``samples`` calls), from which their percentiles are computed, and
+    the first ``max_events`` calls are kept for :py:meth:`trace`. It can be
+    shared by several processors and threads.
+
+    Attributes
+    ----------
+    memory : bool
+        Whether the memory allocated by the stages is measured.
+    """
+
+    def __init__(self, memory=False, samples=10000, max_events=100000):
+        """Initialization
+
+        Parameters
+        ----------
+        memory : :py:class:`bool`, optional
+            Measures the peak of the memory allocated during each call with
+            :py:mod:`tracemalloc`, which slows down all Python code. As
+            :py:mod:`tracemalloc` is global, the measurements of stages that
+            run concurrently in the same process include each other's
+            allocations.
+        samples : :py:class:`int`, optional
+            The number of latencies kept for each stage.
+        max_events : :py:class:`int`, optional
+            The number of calls kept for the Chrome trace.
+        """
+        self.memory = memory
+        self.samples = samples
+        self.max_events = max_events
+        self._lock = threading.Lock()
+        self._random = random.Random(0)
+        self._tracing = False
+        if memory and not tracemalloc.is_tracing():
+            tracemalloc.start()
+            self._tracing = True
+        self.clear()
+
+    def clear(self):
+        """Discards all measurements"""
+        with self._lock:
+            self._stages = {}
+            self._events = []
+
+    def close(self):
+        """Stops :py:mod:`tracemalloc`, if it was started by this object"""
+        if self._tracing:
+            tracemalloc.stop()
+            self._tracing = False
+
+    def call(self, name, processor, data, **kwargs):
+        """Calls the processor on the data, and records the measurement as the
+        stage ``name``.
+
+        Returns
+        -------
+        object
+            The output of the processor, whose exceptions are re-raised.
+        """
+        output, record, error = measure(processor, data, kwargs, self.memory)
+        self.record(name, record)
+        if error is not None:
+            raise error
+        return output
+
+    def record(self, name, record):
+        """Records the given measurement of :py:func:`measure` as the stage
+        ``name``"""
+        with self._lock:
+            stage = self._stages.get(name)
+            if stage is None:
+                stage = self._stages[name] = {
+                    'calls': 0, 'errors': 0, 'time': 0.,
+                    'latencies': [], 'allocated': [], 'output': [],
+                }
+            stage['calls'] += 1
+            stage['errors'] += record['error']
+            stage['time'] += record['duration']
+            # reservoir sampling, so that the latencies of a long run are a
+            # uniform sample of all calls
+            if len(stage['latencies']) < self.samples:
+                index = len(stage['latencies'])
+            else:
+                index = self._random.randrange(stage['calls'])
+            if index < self.samples:
+                for key, value in (('latencies', record['duration']),
+                                   ('allocated', record['allocated']),
+                                   ('output', record['output'])):
+                    if index < len(stage[key]):
+                        stage[key][index] = value
+                    else:
+                        stage[key].append(value)
+            if len(self._events) < self.max_events:
+                self._events.append((name, record))
+
+    def report(self):
+        """Summarizes the measurements of each stage.
+
+        Returns
+        -------
+        list
+            For each stage in the order of their first call, a dict with the
+            ``name``, the number of ``calls`` and ``errors``, the ``total`` and
+            ``mean`` time, the ``p50``, ``p99`` and ``max`` latencies in
+            seconds, the ``allocated`` bytes (mean and ``max_allocated``, or
+            ``None`` if not measured) and the mean ``output`` size in bytes.
+        """
+        result = []
+        with self._lock:
+            stages = [(name, dict(stage, latencies=sorted(stage['latencies'])))
+                      for name, stage in self._stages.items()]
+        for name, stage in stages:
+            latencies = stage['latencies']
+            allocated = [a for a in stage['allocated'] if a is not None]
+            output = [o for o in stage['output'] if o is not None]
+            result.append({
+                'name': name,
+                'calls': stage['calls'],
+                'errors': stage['errors'],
+                'total': stage['time'],
+                'mean': stage['time'] / stage['calls'],
+                'p50': _percentile(latencies, 0.5),
+                'p99': _percentile(latencies, 0.99),
+                'max': latencies[-1] if latencies else None,
+                'allocated': sum(allocated) / len(allocated)
+                if allocated else None,
+                'max_allocated': max(allocated) if allocated else None,
+                'output': sum(output) / len(output) if output else None,
+            })
+        return result
+
+    def format_report(self):
+        """Returns the :py:meth:`report` as a table"""
+        def bytes_(value):
+            if value is None:
+                return '-'
+            for unit in ('B', 'KiB', 'MiB'):
+                if abs(value) < 1024:
+                    return '{:.0f} {}'.format(value, unit)
+                value /= 1024.
+            return '{:.1f} GiB'.format(value)
+
+        def ms(value):
+            return '-' if value is None else '{:.3f}'.format(value * 1000)
+
+        lines = ['{:<40} {:>8} {:>10} {:>10} {:>10} {:>10} {:>10}'.format(
+            'stage', 'calls', 'total [s]', 'p50 [ms]', 'p99 [ms]',
+            'allocated', 'output')]
+        for stage in self.report():
+            lines.append(
+                '{:<40} {:>8} {:>10.3f} {:>10} {:>10} {:>10} {:>10}'.format(
+                    stage['name'][:40], stage['calls'], stage['total'],
+                    ms(stage['p50']), ms(stage['p99']),
+                    bytes_(stage['allocated']), bytes_(stage['output'])))
+        return '\n'.join(lines)
+
+    def trace(self):
+        """Returns the recorded calls in the Chrome trace event format, which
+        can be viewed in ``chrome://tracing`` or https://ui.perfetto.dev.
+
+        Returns
+        -------
+        dict
+            The trace, which can be written as JSON.
+        """
+        with self._lock:
+            events = list(self._events)
+        origin = min((record['start'] for _, record in events), default=0.)
+        return {
+            'displayTimeUnit': 'ms',
+            'traceEvents': [{
+                'name': name,
+                'cat': 'processor',
+                'ph': 'X',
+                'ts': (record['start'] - origin) * 1e6,
+                'dur': record['duration'] * 1e6,
+                'pid': record['pid'],
+                'tid': record['tid'],
+                'args': {
+                    'allocated': record['allocated'],
+                    'output': record['output'],
+                    'error': record['error'],
+                },
+            } for name, record in events],
+        }
+
+    def __getstate__(self):
+        # e.g., for the processors of a ParallelProcessor that run on a
+        # process pool, whose own measurements stay in the worker processes
+        state = self.__dict__.copy()
+        del state['_lock']
+        state['_tracing'] = False
+        return state
+
+    def __setstate__(self, state):
+        self.__dict__.update(state)
+        self._lock = threading.Lock()
+
+    def write_trace(self, filename):
+        """Writes the :py:meth:`trace` to the given JSON file"""
+        with open(filename, 'w') as f:
+            json.dump(self.trace(), f)
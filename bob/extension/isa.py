@@ -0,0 +1,223 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Builds several instruction set (ISA) variants of extensions and libraries,
+and selects the best variant for the running CPU at import time"""
+
+import os
+import sys
+import platform
+import subprocess
+import logging
+
+logger = logging.getLogger(__name__)
+
+ISA_FEATURES = {
+    'x86-64-v2': ('cx16', 'lahf_lm', 'popcnt', 'sse4_1', 'sse4_2', 'ssse3'),
+    'x86-64-v3': ('cx16', 'lahf_lm', 'popcnt', 'sse4_1', 'sse4_2', 'ssse3',
+                  'avx', 'avx2', 'bmi1', 'bmi2', 'f16c', 'fma', 'abm', 'movbe',
+                  'xsave'),
+    'x86-64-v4': ('cx16', 'lahf_lm', 'popcnt', 'sse4_1', 'sse4_2', 'ssse3',
+                  'avx', 'avx2', 'bmi1', 'bmi2', 'f16c', 'fma', 'abm', 'movbe',
+                  'xsave', 'avx512f', 'avx512bw', 'avx512cd', 'avx512dq',
+                  'avx512vl'),
+}
+"""The CPU features (as named in ``/proc/cpuinfo``) required by each of the
+supported micro-architecture levels"""
+
+ISA_LEVELS = ('x86-64-v2', 'x86-64-v3', 'x86-64-v4')
+"""The supported micro-architecture levels, from the lowest to the highest"""
+
+DEFAULT_ISA_VARIANTS = ['x86-64-v3', 'x86-64-v4']
+"""The variants that are built next to the baseline when ISA variants are
+enabled without naming them"""
+
+# the names of macOS' sysctl features that differ from the Linux ones
+_DARWIN_FEATURES = {'avx1_0': 'avx', 'lahf': 'lahf_lm', 'lzcnt': 'abm'}
+
+_CPU_FEATURES = None
+_COMPILER_SUPPORT = {}
+
+
+def _is_x86_64():
+  return platform.machine().lower() in ('x86_64', 'amd64')
+
+
+def isa_variants(variants=None):
+  """Returns the list of ISA variants to build in addition to the baseline.
+
+  Parameters:
+
+    variants : bool or str or [str] or None
+      The micro-architecture levels to build, see :py:data:`ISA_LEVELS`.
+      ``True`` selects the :py:data:`DEFAULT_ISA_VARIANTS`; a string may
+      contain several comma-separated levels. If ``None``, the
+      ``BOB_BUILD_ISA`` environment variable is used, where ``1`` selects the
+      default variants.
+
+  Returns:
+
+    [str]: The levels to build, sorted from the lowest to the highest. This
+    list is empty on non-x86-64 machines.
+
+  Raises:
+
+    ValueError: If one of the levels is unknown
+  """
+
+  if variants is None:
+    variants = os.environ.get('BOB_BUILD_ISA', '').strip()
+    if variants in ('', '0'): return []
+    if variants == '1': variants = True
+  if variants is True:
+    variants = DEFAULT_ISA_VARIANTS
+  if not variants:
+    return []
+  if isinstance(variants, str):
+    variants = [v.strip() for v in variants.split(',') if v.strip()]
+
+  unknown = [v for v in variants if v not in ISA_LEVELS]
+  if unknown:
+    raise ValueError("Unknown ISA variant(s) %s; choose from %s" % (', '.join(unknown), ', '.join(ISA_LEVELS)))
+
+  if not _is_x86_64():
+    logger.warning("ISA variants %s are not built on this %s machine", ', '.join(variants), platform.machine())
+    return []
+  return sorted(set(variants), key=ISA_LEVELS.index)
+
+
+def isa_flags(level):
+  """Returns the compiler flags to generate code for the given level"""
+
+  return ['-march=%s' % level]
+
+
+def compiler_supports_isa(compiler, level):
+  """Returns whether the given compiler executable knows the given level,
+  which requires GCC 11 or clang 12"""
+
+  key = (compiler, level)
+  if key not in _COMPILER_SUPPORT:
+    try:
+      with open(os.devnull, 'w') as devnull:
+        status = subprocess.call([compiler] + isa_flags(level) + ['-E', '-x', 'c', os.devnull], stdout=devnull, stderr=devnull)
+    except OSError:
+      status = 1
+    _COMPILER_SUPPORT[key] = status == 0
+    if status != 0:
+      logger.warning("The compiler `%s' does not support `%s'; this ISA variant is not built", compiler, level)
+  return _COMPILER_SUPPORT[key]
+
+
+def isa_variant_path(path, level):
+  """Returns the path of the given ``level`` variant of the given library or
+  extension, i.e., the file with the same name in the ``level`` sub-directory"""
+
+  return os.path.join(os.path.dirname(path), level, os.path.basename(path))
+
+
+def cpu_features():
+  """Returns the set of features of the running CPU, named as in
+  ``/proc/cpuinfo``; the result is cached"""
+
+  global _CPU_FEATURES
+  if _CPU_FEATURES is not None:
+    return _CPU_FEATURES
+
+  features = set()
+  try:
+    if sys.platform.startswith('linux'):
+      with open('/proc/cpuinfo') as f:
+        for line in f:
+          if line.startswith('flags'):
+            features = set(line.split(':', 1)[1].split())
+            break
+    elif sys.platform == 'darwin':
+      output = subprocess.check_output(['sysctl', '-n', 'machdep.cpu.features', 'machdep.cpu.leaf7_features', 'machdep.cpu.extfeatures'])
+      for feature in output.decode().lower().replace('.', '_').split():
+        features.add(_DARWIN_FEATURES.get(feature, feature))
+  except (OSError, subprocess.CalledProcessError):
+    logger.warning("Cannot determine the features of this CPU; using the baseline variants")
+
+  _CPU_FEATURES = features
+  return features
+
+
+def supported_isa_levels():
+  """Returns the levels supported by the running CPU, from the highest to the
+  lowest.
+
+  The ``BOB_ISA`` environment variable limits the levels, e.g., to
+  ``x86-64-v3``; ``baseline`` disables the ISA variants.
+  """
+
+  if not _is_x86_64():
+    return []
+  features = cpu_features()
+  levels = [l for l in ISA_LEVELS if set(ISA_FEATURES[l]) <= features]
+  limit = os.environ.get('BOB_ISA', '').strip()
+  if limit == 'baseline':
+    return []
+  if limit in ISA_LEVELS:
+    levels = [l for l in levels if ISA_LEVELS.index(l) <= ISA_LEVELS.index(limit)]
+  return levels[::-1]
+
+
+def best_isa_variant(path):
+  """Returns the best variant of the given library or extension file for the
+  running CPU, see :py:func:`isa_variant_path`, or ``path`` itself if no
+  variant for this CPU exists"""
+
+  for level in supported_isa_levels():
+    variant = isa_variant_path(path, level)
+    if os.path.exists(variant):
+      return variant
+  return path
+
+
+class IsaFinder(object):
+  """A finder for :py:data:`sys.meta_path` that imports the best ISA variant
+  of extensions, i.e., ``package/<level>/module.so`` instead of
+  ``package/module.so``"""
+
+  def __init__(self):
+    self.levels = supported_isa_levels()
+    self.directories = {}
+
+  def _variant_directories(self, directory):
+    # most packages do not have any variants; check them only once
+    if directory not in self.directories:
+      self.directories[directory] = [os.path.join(directory, l) for l in self.levels if os.path.isdir(os.path.join(directory, l))]
+    return self.directories[directory]
+
+  def find_spec(self, fullname, path, target=None):
+    if not self.levels or not path:
+      return None
+    import importlib.machinery
+    import importlib.util
+    name = fullname.rpartition('.')[2]
+    for directory in path:
+      for variant in self._variant_directories(directory):
+        for suffix in importlib.machinery.EXTENSION_SUFFIXES:
+          filename = os.path.join(variant, name + suffix)
+          if os.path.isfile(filename):
+            logger.debug("Importing `%s' from `%s'", fullname, filename)
+            loader = importlib.machinery.ExtensionFileLoader(fullname, filename)
+            return importlib.util.spec_from_file_location(fullname, filename, loader=loader)
+    return None
+
+  def invalidate_caches(self):
+    self.directories = {}
+
+
+def install_import_hook():
+  """Installs the :py:class:`IsaFinder`, so that extensions are imported in
+  the best variant for the running CPU.
+
+  This is done by :py:func:`bob.extension.load_bob_library`. Packages that
+  do not have a :py:class:`bob.extension.Library` should call this function in
+  their ``__init__.py`` before importing their extensions.
+  """
+
+  if not any(isinstance(finder, IsaFinder) for finder in sys.meta_path):
+    sys.meta_path.insert(0, IsaFinder())
@@ -0,0 +1,349 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""A persistent, content-addressed cache of compiled objects and linked
+extensions, which is shared by all checkouts and builds of the same user.
+
+Objects are keyed on the preprocessed source, the identity of the compiler and
+all flags that are not paths, so that rebuilding unchanged code is a copy.
+This module only depends on the standard library, since it is also run as a
+compiler launcher by CMake, see :py:func:`launcher`.
+"""
+
+import os
+import sys
+import shutil
+import hashlib
+import inspect
+import filecmp
+import tempfile
+import subprocess
+import threading
+import logging
+
+logger = logging.getLogger(__name__)
+
+DEFAULT_CACHE_DIRECTORY = os.path.join(os.path.expanduser('~'), '.cache', 'bob.extension', 'objects')
+"""The cache directory used when ``BOB_BUILD_CACHE=1``"""
+
+# options whose argument is a path, which does not change the generated code
+# (its effects are part of the preprocessed source) but differs between
+# checkouts and build directories
+_PATH_OPTIONS = ('-I', '-isystem', '-iquote', '-idirafter', '-include', '-MF', '-MT', '-MQ', '-o')
+
+_IDENTITIES = {}
+_LOCK = threading.Lock()
+
+
+def cache_directory(directory=None):
+  """Returns the directory of the object cache, or ``None`` if it is disabled.
+
+  If ``directory`` is not given, the ``BOB_BUILD_CACHE`` environment variable
+  is used: ``1`` selects the :py:data:`DEFAULT_CACHE_DIRECTORY`, any other
+  value except ``0`` is taken as the cache directory.
+  """
+
+  if directory is None:
+    directory = os.environ.get('BOB_BUILD_CACHE', '').strip()
+  if directory in ('', '0'):
+    return None
+  if directory == '1':
+    return DEFAULT_CACHE_DIRECTORY
+  return os.path.realpath(os.path.expanduser(directory))
+
+
+def compiler_identity(compiler):
+  """Returns a string that identifies the given compiler executable, i.e., its
+  real path, size, modification time and version; the result is cached"""
+
+  with _LOCK:
+    if compiler in _IDENTITIES:
+      return _IDENTITIES[compiler]
+
+  path = shutil.which(compiler) or compiler
+  try:
+    stat = os.stat(path)
+    version = subprocess.check_output([compiler, '--version'], stderr=subprocess.STDOUT)
+    identity = '%s %d %d %s' % (os.path.realpath(path), stat.st_size, int(stat.st_mtime), version.decode('utf-8', 'replace'))
+  except (OSError, subprocess.CalledProcessError):
+    identity = compiler
+
+  with _LOCK:
+    _IDENTITIES[compiler] = identity
+  return identity
+
+
+def key_arguments(args):
+  """Returns the arguments that are part of the cache key, i.e., without the
+  options that take paths, see ``_PATH_OPTIONS``"""
+
+  retval = []
+  skip = False
+  for arg in args:
+    if skip:
+      skip = False
+      continue
+    if arg in _PATH_OPTIONS:
+      skip = True
+      continue
+    if arg.startswith(_PATH_OPTIONS):
+      continue
+    retval.append(arg)
+  return retval
+
+
+def _has_debug_info(args):
+  return any(a.startswith('-g') and a != '-g0' for a in args)
+
+
+def _hash_file(filename, digest):
+  with open(filename, 'rb') as f:
+    for block in iter(lambda: f.read(1 << 20), b''):
+      digest.update(block)
+
+
+def link_inputs(args):
+  """Splits the given linker arguments into the other arguments, the libraries
+  given with ``-l``, the library directories given with ``-L`` and the
+  libraries and objects given as existing files"""
+
+  others, libraries, directories, files = [], [], [], []
+  option = None
+  for arg in args:
+    if option is not None:
+      (libraries if option == '-l' else directories).append(arg)
+      option = None
+    elif arg in ('-l', '-L'):
+      option = arg
+    elif arg.startswith('-l'):
+      libraries.append(arg[2:])
+    elif arg.startswith('-L'):
+      directories.append(arg[2:])
+    elif not arg.startswith('-') and os.path.splitext(arg)[1] in ('.a', '.so', '.o', '.dylib') and os.path.isfile(arg):
+      files.append(arg)
+    else:
+      others.append(arg)
+  return others, libraries, directories, files
+
+
+def resolve_library(library, directories):
+  """Returns the file the linker takes for ``-l<library>`` from the given
+  directories (shared libraries before static ones), or ``None``"""
+
+  if library.startswith(':'):
+    names = [library[1:]]
+  else:
+    names = ['lib%s%s' % (library, suffix) for suffix in ('.so', '.dylib', '.a')]
+  for directory in directories:
+    for name in names:
+      filename = os.path.join(directory, name)
+      if os.path.isfile(filename):
+        return filename
+  return None
+
+
+class ObjectCache(object):
+  """The cache of compiled objects and linked libraries in the given
+  ``directory``, see :py:func:`cache_directory`"""
+
+  def __init__(self, directory):
+    self.directory = directory
+    self.hits = 0
+    self.misses = 0
+
+  def path(self, key):
+    """Returns the file name of the cached file with the given key"""
+    return os.path.join(self.directory, key[:2], key[2:])
+
+  def object_key(self, compiler, args, source):
+    """Returns the key of the object compiled from ``source`` with the given
+    ``compiler`` command (a list) and ``args`` (without ``-c``, the source and
+    ``-o``), or ``None`` if the object cannot be cached.
+
+    The key is the hash of the compiler identity, the ``args`` (see
+    :py:func:`key_arguments`) and the preprocessed source. Objects with debug
+    information also depend on the source path. Objects compiled with profiles
+    (``-fprofile-use``) are never cached, since the profiles are not part of
+    the key.
+    """
+
+    if any(a.startswith('-fprofile-use') for a in args):
+      return None
+
+    # also writes the dependency file, if requested
+    command = compiler + [a for a in args if a != '-c'] + ['-E', '-P', source]
+    try:
+      preprocessed = subprocess.check_output(command, stderr=subprocess.DEVNULL)
+    except (OSError, subprocess.CalledProcessError):
+      # let the compiler report the error
+      return None
+
+    digest = hashlib.sha256()
+    digest.update(compiler_identity(compiler[0]).encode('utf-8'))
+    digest.update('\0'.join(compiler[1:] + key_arguments(args)).encode('utf-8'))
+    if _has_debug_info(compiler + args):
+      digest.update(os.path.realpath(source).encode('utf-8'))
+    digest.update(b'\0')
+    digest.update(preprocessed)
+    return digest.hexdigest()
+
+  def link_key(self, linker, args, objects, libraries=(), library_dirs=()):
+    """Returns the key of the library linked by the ``linker`` command from the
+    given ``objects`` with the given ``args``, ``libraries`` and
+    ``library_dirs``.
+
+    Libraries given with ``-l`` (or as files) are resolved in the library
+    directories given with ``-L``, and their contents are part of the key, so
+    that a re-built library is linked again; the library directories
+    themselves are not, so that checkouts share linked libraries. Libraries
+    that cannot be resolved (usually system libraries, which are found by the
+    linker itself) are identified by their name.
+    """
+
+    inputs = link_inputs(list(linker[1:]) + [str(a) for a in args])
+    directories = list(library_dirs) + inputs[2]
+    digest = hashlib.sha256()
+    digest.update(compiler_identity(linker[0]).encode('utf-8'))
+    digest.update('\0'.join(inputs[0]).encode('utf-8'))
+    for library in list(libraries) + inputs[1]:
+      digest.update(b'\0-l' + library.encode('utf-8'))
+      filename = resolve_library(library, directories)
+      if filename is not None:
+        digest.update(b'\0')
+        _hash_file(filename, digest)
+    for obj in list(objects) + inputs[3]:
+      digest.update(b'\0')
+      _hash_file(obj, digest)
+    return digest.hexdigest()
+
+  def fetch(self, key, output):
+    """Copies the cached file with the given key to ``output``, and returns
+    whether it was found. An identical ``output`` is not touched, so that
+    build tools do not re-link unchanged objects."""
+
+    if key is None:
+      return False
+    cached = self.path(key)
+    if not os.path.exists(cached):
+      self.misses += 1
+      return False
+    self.hits += 1
+    if os.path.exists(output) and filecmp.cmp(cached, output, shallow=False):
+      return True
+    directory = os.path.dirname(output) or '.'
+    try:
+      os.makedirs(directory)
+    except OSError:
+      if not os.path.isdir(directory): raise
+    with tempfile.NamedTemporaryFile(dir=directory, delete=False) as f:
+      temporary = f.name
+    shutil.copyfile(cached, temporary)
+    shutil.copymode(cached, temporary)
+    os.replace(temporary, output)
+    return True
+
+  def store(self, key, output):
+    """Stores the given ``output`` file under the given key"""
+
+    if key is None or not os.path.exists(output):
+      return
+    cached = self.path(key)
+    directory = os.path.dirname(cached)
+    try:
+      os.makedirs(directory)
+    except OSError:
+      if not os.path.isdir(directory): raise
+    # copy to a temporary file first, so that concurrent builds never see
+    # incomplete files
+    with tempfile.NamedTemporaryFile(dir=directory, delete=False) as f:
+      temporary = f.name
+    shutil.copyfile(output, temporary)
+    shutil.copymode(output, temporary)
+    os.replace(temporary, cached)
+
+
+def install(compiler, cache):
+  """Wraps the ``_compile`` and ``link`` methods of the given
+  :py:class:`distutils.unixccompiler.UnixCCompiler`, so that objects and
+  libraries are taken from the given :py:class:`ObjectCache`.
+
+  Returns:
+
+    callable: A function that removes the wrappers again
+  """
+
+  _compile, link = compiler._compile, compiler.link
+
+  def _cached_compile(obj, src, ext, cc_args, extra_postargs, pp_opts):
+    key = cache.object_key(compiler.compiler_so, cc_args + extra_postargs, src)
+    if cache.fetch(key, obj):
+      logger.info("Taking `%s' from the object cache", obj)
+      return
+    _compile(obj, src, ext, cc_args, extra_postargs, pp_opts)
+    cache.store(key, obj)
+
+  def _cached_link(target_desc, objects, output_filename, output_dir=None, *args, **kwargs):
+    output = os.path.join(output_dir, output_filename) if output_dir is not None else output_filename
+    # the output and temporary directories do not change the linked library
+    arguments = inspect.signature(link).bind(target_desc, objects, output_filename, output_dir, *args, **kwargs).arguments
+    # libraries are resolved to the files they are taken from, see ObjectCache.link_key
+    extra = list(arguments.get('extra_preargs') or []) + list(arguments.get('extra_postargs') or [])
+    options = sorted((k, v) for k, v in arguments.items() if k not in ('objects', 'output_filename', 'output_dir', 'build_temp', 'libraries', 'library_dirs', 'extra_preargs', 'extra_postargs'))
+    key = cache.link_key(compiler.linker_so, [os.path.basename(output)] + options + extra, objects,
+        list(arguments.get('libraries') or []) + list(compiler.libraries),
+        list(arguments.get('library_dirs') or []) + list(compiler.library_dirs))
+    if cache.fetch(key, output):
+      logger.info("Taking `%s' from the object cache", output)
+      return
+    link(target_desc, objects, output_filename, output_dir, *args, **kwargs)
+    cache.store(key, output)
+
+  compiler._compile, compiler.link = _cached_compile, _cached_link
+
+  def _uninstall():
+    compiler._compile, compiler.link = _compile, link
+  return _uninstall
+
+
+def launcher(argv):
+  """Runs the compiler command ``argv``, taking the object from the cache when
+  possible; this is the compiler launcher used by CMake, see
+  :py:func:`bob.extension.cmake.compiler_launcher`.
+
+  Returns:
+
+    int: The exit status of the compiler
+  """
+
+  directory = cache_directory()
+  if directory is None or '-c' not in argv or '-o' not in argv:
+    return subprocess.call(argv)
+
+  # split the command into the compiler, the source, the output and the rest
+  output = argv[argv.index('-o') + 1]
+  args, sources, skip = [], [], False
+  for i, arg in enumerate(argv[1:], 1):
+    if skip:
+      skip = False
+      continue
+    if arg == '-o':
+      skip = True
+    elif not arg.startswith('-') and os.path.splitext(arg)[1] in ('.c', '.cc', '.cpp', '.cxx', '.C') and argv[i-1] not in _PATH_OPTIONS:
+      sources.append(arg)
+    else:
+      args.append(arg)
+  if len(sources) != 1:
+    return subprocess.call(argv)
+
+  cache = ObjectCache(directory)
+  key = cache.object_key(argv[:1], args, sources[0])
+  if cache.fetch(key, output):
+    return 0
+  status = subprocess.call(argv)
+  if status == 0:
+    cache.store(key, output)
+  return status
+
+
+if __name__ == '__main__':
+  sys.exit(launcher(sys.argv[1:]))
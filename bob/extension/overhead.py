@@ -0,0 +1,297 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Measures the overhead of Python bindings, and flags regressions against a
+stored baseline.
+
+A package registers a function returning its benchmark :py:class:`Case`'s in
+the ``bob.overhead`` entry point group, e.g., ``bob.example.extension =
+bob.example.extension.benchmark:cases``. Each case calls a function of the
+bindings in a tight loop, either without arguments, or with arguments created
+for each of a number of sizes. Cases that add one step of the bindings after
+the other (e.g., an empty call, the parsing of the arguments, the conversion
+of arrays and the full function) show the cost of each step, and native
+benchmarks of the library (see :py:mod:`bob.extension.benchmark`) show the
+cost of the kernel itself.
+
+The results of a suite are compared against a baseline, which is stored per
+suite and machine in ``~/.cache/bob.extension/baselines`` (or in the directory
+given by ``BOB_OVERHEAD_BASELINES``), since timings are specific to a machine;
+results of different machines are never compared. Use :py:func:`run_suite` and
+:py:func:`compare`, or the ``bob overhead`` command.
+"""
+
+import os
+import json
+import hashlib
+import time
+import platform
+import itertools
+import tempfile
+import logging
+
+logger = logging.getLogger(__name__)
+
+DEFAULT_BASELINE_DIRECTORY = os.path.join(os.path.expanduser('~'), '.cache', 'bob.extension', 'baselines')
+"""The directory the baselines are stored in by default"""
+
+DEFAULT_SIZES = (1, 16, 256, 4096, 65536)
+"""The sizes the cases with arguments are run with by default"""
+
+ENTRY_POINT_GROUP = 'bob.overhead'
+"""The entry point group the suites are registered in"""
+
+
+class Case(object):
+  """A function of the bindings to benchmark.
+
+  Parameters:
+
+    name : str
+      The name of the case
+
+    function : callable
+      The function to call
+
+    setup : callable or ``None``
+      A function that returns the positional and keyword arguments for a given
+      size, e.g., ``lambda size: ((numpy.zeros(size),), {})``; if not given,
+      the function is called without arguments, once for all sizes
+  """
+
+  def __init__(self, name, function, setup=None):
+    self.name = name
+    self.function = function
+    self.setup = setup
+
+
+def _loop(function, args, kwargs, iterations):
+  """Returns the nanoseconds of calling the function ``iterations`` times"""
+
+  repeat = itertools.repeat(None, iterations)
+  if kwargs:
+    start = time.perf_counter_ns()
+    for _ in repeat:
+      function(*args, **kwargs)
+  else:
+    start = time.perf_counter_ns()
+    for _ in repeat:
+      function(*args)
+  return time.perf_counter_ns() - start
+
+
+def _statistics(values):
+  values = sorted(values)
+  n = len(values)
+  mean = sum(values) / n
+  return {
+      'min': values[0],
+      'median': values[n // 2] if n % 2 else (values[n // 2 - 1] + values[n // 2]) / 2.,
+      'mean': mean,
+      'stddev': (sum((v - mean) ** 2 for v in values) / n) ** 0.5,
+  }
+
+
+def time_calls(function, args=(), kwargs=None, min_time=0.05, repetitions=5):
+  """Measures the time of calling the function.
+
+  The function is called once to warm up, then the number of calls is
+  calibrated so that each repetition takes at least ``min_time`` seconds.
+
+  Returns:
+
+    dict: The number of ``iterations`` of each repetition, and the ``min``,
+    ``median``, ``mean`` and ``stddev`` of the ``ns_per_call``, which
+    includes the (small) cost of the loop
+  """
+
+  _loop(function, args, kwargs, 1)
+  iterations = 1
+  while True:
+    elapsed = _loop(function, args, kwargs, iterations)
+    if elapsed >= min_time * 1e9 / 10 or iterations >= 1 << 30:
+      break
+    iterations *= 10
+  iterations = max(1, int(iterations * min_time * 1e9 / max(elapsed, 1)))
+  times = [_loop(function, args, kwargs, iterations) / iterations for _ in range(repetitions)]
+  return {'iterations': iterations, 'ns_per_call': _statistics(times)}
+
+
+def run_cases(cases, sizes=DEFAULT_SIZES, min_time=0.05, repetitions=5):
+  """Runs the given cases for all sizes, see :py:func:`time_calls`.
+
+  Returns:
+
+    [dict]: The ``case``, the ``size`` (``None`` for cases without arguments),
+    the ``iterations`` and the ``ns_per_call`` of each run
+  """
+
+  results = []
+  for case in cases:
+    for size in (sizes if case.setup is not None else [None]):
+      args, kwargs = case.setup(size) if size is not None else ((), {})
+      logger.debug("Running %s for size %s", case.name, size)
+      result = time_calls(case.function, args, kwargs, min_time, repetitions)
+      result.update(case=case.name, size=size)
+      results.append(result)
+  return results
+
+
+def machine():
+  """Returns a description of this machine and Python, with which the
+  baselines are stored"""
+
+  return '%s %s, Python %s' % (platform.node(), platform.machine() or platform.processor(), platform.python_version())
+
+
+def suite_cases(suite):
+  """Returns the cases of the given suite.
+
+  Parameters:
+
+    suite : str
+      The name of an entry point of the ``bob.overhead`` group (usually the
+      name of the package), or a ``module:function``
+
+  Raises:
+
+    ValueError: If the suite is not registered
+  """
+
+  from .entry_points import entry_points, EntryPoint
+  registered = [e for e in entry_points(ENTRY_POINT_GROUP) if e.name == suite]
+  if registered:
+    entry_point = registered[0]
+  elif ':' in suite:
+    entry_point = EntryPoint(suite, suite, ENTRY_POINT_GROUP, None)
+  else:
+    raise ValueError("The suite `%s' is not registered in the `%s' entry points" % (suite, ENTRY_POINT_GROUP))
+  return list(entry_point.load()())
+
+
+def run_suite(suite, sizes=DEFAULT_SIZES, min_time=0.05, repetitions=5, native=True):
+  """Runs the cases of the given suite, see :py:func:`suite_cases`.
+
+  With ``native``, the native benchmarks of the libraries of the package with
+  the name of the suite are run as well, with the case names ``native
+  <kernel>``, see :py:func:`bob.extension.benchmark.find_benchmarks`.
+
+  Returns:
+
+    dict: The ``suite``, the ``machine`` and the ``results`` of
+    :py:func:`run_cases`
+  """
+
+  results = run_cases(suite_cases(suite), sizes, min_time, repetitions)
+  if native:
+    from .benchmark import find_benchmarks, run_benchmark
+    for executable in find_benchmarks(suite) if ':' not in suite else []:
+      native_results = run_benchmark(executable, sizes=sizes, min_time=min_time, repetitions=repetitions)
+      for result in native_results['results']:
+        results.append({'case': 'native ' + result['kernel'], 'size': result['size'],
+                        'iterations': result['iterations'], 'ns_per_call': result['ns_per_iteration']})
+  return {'suite': suite, 'machine': machine(), 'results': results}
+
+
+def baseline_file(suite, directory=None, machine_name=None):
+  """Returns the file the baseline of the given suite, measured on the machine
+  with the given ``machine_name`` (by default this one, see
+  :py:func:`machine`), is stored in; the name contains a hash of the machine,
+  so that the baselines of several machines can share a directory.
+
+  If ``directory`` is not given, the ``BOB_OVERHEAD_BASELINES`` environment
+  variable is used, or the :py:data:`DEFAULT_BASELINE_DIRECTORY`.
+  """
+
+  if directory is None:
+    directory = os.environ.get('BOB_OVERHEAD_BASELINES', '').strip() or DEFAULT_BASELINE_DIRECTORY
+  if machine_name is None:
+    machine_name = machine()
+  name = suite.replace(':', '-').replace(os.sep, '-')
+  digest = hashlib.sha1(machine_name.encode('utf-8')).hexdigest()[:12]
+  return os.path.join(os.path.expanduser(directory), '%s-%s.json' % (name, digest))
+
+
+def load_baseline(filename):
+  """Returns the baseline stored in the given file, or ``None``"""
+
+  if not os.path.exists(filename):
+    return None
+  try:
+    with open(filename) as f:
+      return json.load(f)
+  except (ValueError, OSError) as e:
+    logger.warning("Ignoring the corrupt baseline `%s': %s", filename, e)
+    return None
+
+
+def save_baseline(results, filename):
+  """Stores the results of :py:func:`run_suite` as the baseline"""
+
+  directory = os.path.dirname(filename)
+  os.makedirs(directory, exist_ok=True)
+  with tempfile.NamedTemporaryFile('w', dir=directory, delete=False) as f:
+    json.dump(results, f, indent=2)
+  os.replace(f.name, filename)
+
+
+def compare(results, baseline, threshold=0.1):
+  """Compares the results of :py:func:`run_suite` with a baseline.
+
+  A run is a regression when its median time per call increased by more than
+  the relative ``threshold``, and by more than twice the standard deviations
+  of both measurements, so that noise is not flagged.
+
+  Returns:
+
+    [dict]: The ``case``, ``size``, the median ``baseline`` and ``current``
+    nanoseconds per call, their relative ``change``, and whether it is a
+    ``regression``, for each run that is in both results
+
+  Raises:
+
+    ValueError: If the baseline was measured on another machine
+  """
+
+  if baseline.get('machine') != results.get('machine'):
+    raise ValueError("The baseline was measured on `%s', not on `%s'" % (baseline.get('machine'), results.get('machine')))
+  old = {(r['case'], r['size']): r['ns_per_call'] for r in baseline['results']}
+  comparison = []
+  for result in results['results']:
+    key = (result['case'], result['size'])
+    if key not in old:
+      continue
+    before, after = old[key], result['ns_per_call']
+    difference = after['median'] - before['median']
+    change = difference / before['median'] if before['median'] > 0 else 0.
+    noise = 2 * (before['stddev'] + after['stddev'])
+    comparison.append({
+        'case': key[0], 'size': key[1],
+        'baseline': before['median'], 'current': after['median'],
+        'change': change,
+        'regression': change > threshold and difference > noise,
+    })
+  return comparison
+
+
+def format_results(results, comparison=None):
+  """Formats the results of :py:func:`run_suite` as a table, with the changes
+  to the baseline, if a ``comparison`` is given"""
+
+  changes = {(c['case'], c['size']): c for c in comparison or []}
+  rows = [['case', 'size', 'ns/call', '+-'] + (['baseline', 'change'] if comparison is not None else [])]
+  for result in results['results']:
+    ns = result['ns_per_call']
+    row = [result['case'], '-' if result['size'] is None else str(result['size']), '%.4g' % ns['median'], '%.2g' % ns['stddev']]
+    if comparison is not None:
+      c = changes.get((result['case'], result['size']))
+      if c is None:
+        row += ['-', 'new']
+      else:
+        row += ['%.4g' % c['baseline'], '%+.1f%%%s' % (100 * c['change'], '  REGRESSION' if c['regression'] else '')]
+    rows.append(row)
+  widths = [max(len(r[i]) for r in rows) for i in range(len(rows[0]))]
+  lines = ['%s (%s)' % (results['suite'], results['machine'])]
+  for row in rows:
+    lines.append('  '.join([row[0].ljust(widths[0])] + [c.rjust(w) for c, w in zip(row[1:-1], widths[1:-1])] + [row[-1]]).rstrip())
+  return '\n'.join(lines)
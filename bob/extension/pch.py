@@ -0,0 +1,173 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Precompiled headers for the common (and heavy) headers of extensions"""
+
+import os
+import json
+import hashlib
+import subprocess
+import threading
+import logging
+
+from .utils import is_clang
+
+logger = logging.getLogger(__name__)
+
+DEFAULT_PRECOMPILED_HEADERS = [
+    'Python.h',
+    'bob.extension/documentation.h',
+]
+"""The headers precompiled for :py:class:`bob.extension.Extension`'s by
+default"""
+
+DEFAULT_LIBRARY_PRECOMPILED_HEADERS = [
+    '<string>',
+    '<vector>',
+    '<set>',
+    '<stdexcept>',
+    '<iostream>',
+]
+"""The headers precompiled for :py:class:`bob.extension.Library`'s by
+default"""
+
+PCH_HEADER = 'bob_pch.h'
+"""The name of the prefix header that includes all precompiled headers"""
+
+# extensions are built concurrently; each precompiled header is built once
+_LOCK = threading.Lock()
+_KEY_LOCKS = {}
+
+
+def precompiled_headers(headers=None, default=DEFAULT_PRECOMPILED_HEADERS):
+  """Returns the list of headers to be precompiled.
+
+  Parameters:
+
+    headers : bool or [str] or None
+      The list of headers to precompile. ``True`` selects the ``default`` list
+      and ``False`` disables precompiled headers. If ``None``, the
+      ``BOB_BUILD_PCH`` environment variable is used: when set to a non-empty
+      value other than ``0``, the ``default`` headers are precompiled.
+
+    default : [str]
+      The default list of headers
+
+  Returns:
+
+    [str]: The headers to precompile, which might be empty
+  """
+
+  if headers is None:
+    headers = os.environ.get('BOB_BUILD_PCH', '0').strip() not in ('', '0')
+  if headers is True:
+    return list(default)
+  if not headers:
+    return []
+  if isinstance(headers, str):
+    return [headers]
+  return list(headers)
+
+
+def include_directive(header):
+  """Returns the argument of the ``#include`` directive for the given header,
+  i.e., ``<Python.h>`` for ``'Python.h'`` and unchanged for ``'<vector>'`` or
+  ``'"my_header.h"'``"""
+
+  if header.startswith(('<', '"')):
+    return header
+  return '<%s>' % header
+
+
+def precompile(compiler, headers, args, directory, spawn=None):
+  """Generates (or re-uses) a precompiled header for the given headers.
+
+  The prefix header :py:data:`PCH_HEADER` is written to a sub-directory of
+  ``directory`` that is named after a hash of the compiler, the compiler
+  arguments (including macros and include directories) and the headers. Hence,
+  all extensions compiled with identical settings share the same precompiled
+  header, which is only built once. The headers it depends on are recorded in
+  a dependency file next to it (see :py:func:`dependencies`), and it is
+  re-built when any of them is newer than the precompiled header.
+
+  Parameters:
+
+    compiler : [str]
+      The compiler command, e.g., ``['gcc', '-fPIC']``
+
+    headers : [str]
+      The list of headers to precompile, see :py:func:`include_directive`
+
+    args : [str]
+      All other compiler arguments, such as ``-D`` and ``-I`` options
+
+    directory : str
+      The base directory to write precompiled headers to
+
+    spawn : callable or None
+      The function to call the compiler with, e.g.
+      :py:meth:`distutils.ccompiler.CCompiler.spawn`; defaults to
+      :py:func:`subprocess.check_call`
+
+  Returns:
+
+    str: The prefix header to be given to the compiler with ``-include``, next
+    to which the precompiled header is located
+  """
+
+  contents = '// WARNING! This file is automatically generated. Do not change its contents.\n' + \
+      ''.join('#include %s\n' % include_directive(h) for h in headers)
+  key = hashlib.sha1(json.dumps([compiler, args, contents]).encode('utf-8')).hexdigest()[:16]
+  pch_dir = os.path.join(directory, key)
+  header = os.path.join(pch_dir, PCH_HEADER)
+  output = header + ('.pch' if is_clang(compiler[0]) else '.gch')
+  depfile = output + '.d'
+
+  with _LOCK:
+    lock = _KEY_LOCKS.setdefault(key, threading.Lock())
+
+  with lock:
+    if _up_to_date(output, depfile):
+      logger.debug("Re-using precompiled header `%s'", output)
+      return header
+
+    try:
+      os.makedirs(pch_dir)
+    except OSError:
+      if not os.path.isdir(pch_dir): raise
+    with open(header, 'w') as f:
+      f.write(contents)
+
+    # compile into a temporary file first, so that interrupted or concurrent
+    # builds never see an incomplete precompiled header
+    logger.info("Precompiling %s into `%s'", ', '.join(headers), output)
+    temporary = '%s.%d.tmp' % (output, os.getpid())
+    command = compiler + args + ['-x', 'c++-header', header, '-o', temporary, '-MD', '-MF', temporary + '.d']
+    (spawn or subprocess.check_call)(command)
+    os.rename(temporary + '.d', depfile)
+    os.rename(temporary, output)
+  return header
+
+
+def dependencies(depfile):
+  """Returns the files listed as prerequisites in the given dependency file,
+  as written by the ``-MD`` option of the compiler"""
+
+  with open(depfile) as f:
+    contents = f.read().replace('\\\n', ' ')
+  # the prerequisites follow the (first) target; spaces in names are escaped
+  contents = contents.split(': ', 1)[-1].replace('\\ ', '\0')
+  return [d.replace('\0', ' ') for d in contents.split()]
+
+
+def _up_to_date(output, depfile):
+  """Returns whether the precompiled header exists, and is newer than all headers it depends on"""
+
+  if not os.path.exists(output) or not os.path.exists(depfile):
+    return False
+  mtime = os.path.getmtime(output)
+  for dependency in dependencies(depfile):
+    if not os.path.exists(dependency) or os.path.getmtime(dependency) > mtime:
+      logger.debug("Precompiled header `%s' is outdated by `%s'", output, dependency)
+      return False
+  return True
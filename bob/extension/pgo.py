@@ -0,0 +1,127 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Link-time optimization (LTO) and profile-guided optimization (PGO) of
+extensions and libraries"""
+
+import os
+import glob
+import subprocess
+import logging
+
+from .utils import is_clang, find_executable
+
+logger = logging.getLogger(__name__)
+
+
+def lto_enabled(lto=None):
+  """Returns whether link-time optimization should be used.
+
+  If ``lto`` is not given, the ``BOB_BUILD_LTO`` environment variable is used:
+  when set to a non-empty value other than ``0``, LTO is enabled.
+  """
+
+  if lto is None:
+    lto = os.environ.get('BOB_BUILD_LTO', '0').strip() not in ('', '0')
+  return bool(lto)
+
+
+def pgo_training_command(command=None):
+  """Returns the training command for profile-guided optimization.
+
+  If ``command`` is not given, the ``BOB_BUILD_PGO`` environment variable is
+  used. Returns ``None`` if PGO is disabled.
+  """
+
+  if command is None:
+    command = os.environ.get('BOB_BUILD_PGO')
+  return command.strip() if command and command.strip() else None
+
+
+def lto_flags():
+  """Returns the compiler and linker flags to enable link-time optimization"""
+
+  return ['-flto']
+
+
+def profile_generate_flags(profile_directory):
+  """Returns the compiler and linker flags to instrument the code, so that
+  profiles are written to the given directory when the code is run"""
+
+  return ['-fprofile-generate=%s' % profile_directory]
+
+
+def profile_use_flags(compiler, profile_directory):
+  """Returns the compiler and linker flags to optimize the code with the
+  profiles collected in the given directory.
+
+  For clang, the profiles need to be merged with :py:func:`merge_profiles`
+  first.
+  """
+
+  if is_clang(compiler):
+    return ['-fprofile-use=%s' % os.path.join(profile_directory, 'default.profdata'),
+        '-Wno-profile-instr-unprofiled', '-Wno-profile-instr-out-of-date']
+  # sources that were not run during training do not have any profile
+  return ['-fprofile-use=%s' % profile_directory, '-fprofile-correction',
+      '-Wno-missing-profile']
+
+
+def merge_profiles(compiler, profile_directory):
+  """Merges the raw profiles written by clang-instrumented code into the
+  ``default.profdata`` file, which is read by :py:func:`profile_use_flags`.
+
+  GCC profiles do not need to be merged, and nothing is done for them. The
+  ``llvm-profdata`` executable can be set with the ``LLVM_PROFDATA``
+  environment variable.
+  """
+
+  if not is_clang(compiler):
+    return
+
+  raw = glob.glob(os.path.join(profile_directory, '*.profraw'))
+  if not raw:
+    logger.warning("No profiles were written to `%s' during training", profile_directory)
+    return
+
+  profdata = os.environ.get('LLVM_PROFDATA')
+  if not profdata:
+    profdata = find_executable('llvm-profdata')
+    if not profdata:
+      raise OSError("Cannot find `llvm-profdata' to merge the profiles in `%s' - set LLVM_PROFDATA" % profile_directory)
+    profdata = profdata[0]
+
+  output = os.path.join(profile_directory, 'default.profdata')
+  if subprocess.call([profdata, 'merge', '-output=%s' % output] + raw) != 0:
+    raise RuntimeError("Could not merge the profiles in `%s'" % profile_directory)
+
+
+def run_training(command, python_path=None, cwd=None):
+  """Runs the training command of profile-guided optimization in a shell.
+
+  Parameters:
+
+    command : str
+      The shell command to run, e.g., ``'nosetests -sv bob.example.library'``
+
+    python_path : [str] or None
+      Directories to be prepended to ``PYTHONPATH``, so that the instrumented
+      extensions are imported by the training command
+
+    cwd : str or None
+      The directory to run the command in
+
+  Raises:
+
+    RuntimeError: If the training command fails
+  """
+
+  env = os.environ.copy()
+  if python_path:
+    paths = python_path + ([env['PYTHONPATH']] if env.get('PYTHONPATH') else [])
+    env['PYTHONPATH'] = os.pathsep.join(paths)
+
+  logger.info("Running PGO training command `%s'", command)
+  status = subprocess.call(command, shell=True, env=env, cwd=cwd)
+  if status != 0:
+    raise RuntimeError("The PGO training command `%s' failed with status %d" % (command, status))
@@ -4,11 +4,25 @@
 # Wed 16 Oct 10:08:42 2013 CEST
 
 import os
+import re
 import sys
+import json
+import shlex
+import atexit
+import tempfile
+import threading
 import subprocess
 import logging
 from .utils import uniq, uniq_paths, find_executable, construct_search_paths
 
+DEFAULT_CACHE_FILE = os.path.join(os.path.expanduser('~'), '.cache', 'bob.extension', 'pkgconfig.json')
+"""The file resolved packages are persisted to when ``BOB_BUILD_PKGCONFIG_CACHE=1``"""
+
+_RESOLVER = None
+_LOCK = threading.Lock()
+
+logger = logging.getLogger(__name__)
+
 
 def call_pkgconfig(cmd, paths=None):
   """Calls pkg-config with a constructed PKG_CONFIG_PATH environment variable.
@@ -88,6 +102,384 @@ def version():
   return stdout.strip()
 
 
+def cache_file(filename=None):
+  """Returns the file to persist resolved packages to, or ``None`` if they are
+  only kept in memory.
+
+  If ``filename`` is not given, the ``BOB_BUILD_PKGCONFIG_CACHE`` environment
+  variable is used: ``1`` selects the :py:data:`DEFAULT_CACHE_FILE`, any other
+  value except ``0`` is taken as the file name.
+  """
+
+  if filename is None:
+    filename = os.environ.get('BOB_BUILD_PKGCONFIG_CACHE', '').strip()
+  if filename in ('', '0'):
+    return None
+  if filename == '1':
+    return DEFAULT_CACHE_FILE
+  return os.path.realpath(os.path.expanduser(filename))
+
+
+class _Unsupported(Exception):
+  """Raised when a package cannot be resolved without pkg-config"""
+
+
+def _split_path(value):
+  return [k for k in (value or '').split(os.pathsep) if k]
+
+
+def _mtime(path):
+  try:
+    return os.stat(path).st_mtime_ns
+  except OSError:
+    return None
+
+
+def _expand(value, variables):
+  """Expands ``${name}`` references to the given variables"""
+
+  def _replace(match):
+    if match.group(0) == '$$':
+      return '$'
+    if match.group(1) not in variables:
+      raise _Unsupported("undefined variable `%s'" % match.group(1))
+    return variables[match.group(1)]
+
+  return re.sub(r'\$\$|\$\{([^}]*)\}', _replace, value)
+
+
+def parse_pc(filename):
+  """Parses the given ``.pc`` file, expanding all variables.
+
+  Parameters
+  ----------
+  filename : str
+      The ``.pc`` file to parse
+
+  Returns
+  -------
+  variables : [(str, str)]
+      The variables defined in the file (including ``pcfiledir``), in the
+      order of their definition.
+  fields : dict
+      The fields of the file, such as ``Version``, ``Cflags`` or ``Requires``.
+  """
+
+  variables = {'pcfiledir': os.path.dirname(filename)}
+  names = ['pcfiledir']
+  fields = {}
+  with open(filename) as f:
+    text = f.read().replace('\\\r\n', '').replace('\\\n', '')
+
+  for line in text.splitlines():
+    # everything after an unescaped '#' is a comment
+    line = re.split(r'(?<!\\)#', line, 1)[0].replace('\\#', '#').strip()
+    match = re.match(r'([A-Za-z0-9_.]+)\s*([:=])\s*(.*)$', line)
+    if match is None:
+      continue
+    key, op, value = match.groups()
+    value = _expand(value.strip(), variables)
+    if op == '=':
+      if key not in variables: names.append(key)
+      # like pkg-config, removes (unescaped) quotes from variables
+      variables[key] = re.sub(r'\\(.)|["\']', lambda m: m.group(1) or '', value)
+    else:
+      fields[key] = value
+
+  return [(k, variables[k]) for k in names], fields
+
+
+def _requirements(value):
+  """Returns the package names in a ``Requires`` field, without versions"""
+
+  retval = []
+  skip = False
+  for token in re.findall(r'[<>=!]+|[^\s,<>=!]+', value or ''):
+    if skip:
+      skip = False
+    elif token[0] in '<>=!':
+      skip = True
+    else:
+      retval.append(token)
+  return retval
+
+
+class PackageResolver(object):
+  """Resolves and memoizes the information pkg-config has on packages.
+
+  Packages are resolved by parsing their ``.pc`` files (and the ones of the
+  packages they require) directly, like pkg-config does. Only packages that
+  cannot be resolved like this (because they are not found, or because their
+  files use features not implemented here) are handed over to pkg-config, with
+  a single call for the versions of all these packages.
+
+  Each package is resolved at most once per process. When the results are
+  persisted to ``filename``, they are re-used by later processes as long as
+  none of the ``.pc`` files involved changed, and no ``.pc`` file was added to
+  or removed from the searched directories.
+  """
+
+  def __init__(self, filename=None):
+    self.filename = filename
+    self.packages = {}
+    self.persisted = {}
+    self.defaults = None
+    self.dirty = False
+    self.calls = 0
+    self.lock = threading.Lock()
+    if filename is not None and os.path.exists(filename):
+      try:
+        with open(filename) as f:
+          data = json.load(f)
+        self.persisted = dict(data['packages'])
+        self.defaults = data.get('defaults')
+      except (ValueError, TypeError, KeyError, OSError):
+        logger.warning("Ignoring the corrupt pkg-config cache `%s'", filename)
+
+  def call(self, cmd, paths=None):
+    """Calls :py:func:`call_pkgconfig`, counting the calls"""
+
+    self.calls += 1
+    return call_pkgconfig(cmd, paths)
+
+  def default_paths(self):
+    """Returns the default search path of pkg-config, and the system include
+    and library directories it does not report"""
+
+    pkg_config = find_executable('pkg-config')
+    identity = [pkg_config[0], _mtime(pkg_config[0])] if pkg_config else None
+    if self.defaults is None or self.defaults[0] != identity:
+      values = []
+      for variable in ('pc_path', 'pc_system_includedirs', 'pc_system_libdirs'):
+        status, stdout, stderr = self.call(['--variable=%s' % variable, 'pkg-config']) if pkg_config else (1, '', '')
+        values.append(stdout.strip() if status == 0 else '')
+      self.defaults = [identity] + values
+      self.dirty = True
+    return (_split_path(self.defaults[1]),
+        _split_path(self.defaults[2] or '/usr/include'),
+        _split_path(self.defaults[3] or os.pathsep.join(('/usr/lib', '/lib'))))
+
+  def search_paths(self, paths=None):
+    """Returns the directories searched for ``.pc`` files, in the order used
+    by :py:func:`call_pkgconfig`"""
+
+    default = self.default_paths()[0]
+    if 'PKG_CONFIG_LIBDIR' in os.environ:
+      default = _split_path(os.environ['PKG_CONFIG_LIBDIR'])
+    return uniq(construct_search_paths(prefixes=paths, suffix=os.sep + 'lib' + os.sep + 'pkgconfig') +
+        _split_path(os.environ.get('PKG_CONFIG_PATH')) + default)
+
+  def system_directories(self):
+    """Returns the include and library directories pkg-config removes from the
+    flags of packages"""
+
+    _, includes, libraries = self.default_paths()
+    if 'PKG_CONFIG_SYSTEM_INCLUDE_PATH' in os.environ:
+      includes = _split_path(os.environ['PKG_CONFIG_SYSTEM_INCLUDE_PATH'])
+    if 'PKG_CONFIG_SYSTEM_LIBRARY_PATH' in os.environ:
+      libraries = _split_path(os.environ['PKG_CONFIG_SYSTEM_LIBRARY_PATH'])
+    includes = includes + _split_path(os.environ.get('C_INCLUDE_PATH')) + _split_path(os.environ.get('CPLUS_INCLUDE_PATH'))
+    if os.environ.get('PKG_CONFIG_ALLOW_SYSTEM_CFLAGS'): includes = []
+    if os.environ.get('PKG_CONFIG_ALLOW_SYSTEM_LIBS'): libraries = []
+    return set(os.path.normpath(k) for k in includes), set(os.path.normpath(k) for k in libraries)
+
+  def _find(self, name, directories, files):
+    for directory in directories:
+      files[directory] = _mtime(directory)
+      if files[directory] is None:
+        continue
+      if os.path.exists(os.path.join(directory, name + '-uninstalled.pc')):
+        raise _Unsupported("uninstalled package `%s'" % name)
+      filename = os.path.join(directory, name + '.pc')
+      if os.path.exists(filename):
+        files[filename] = _mtime(filename)
+        return filename
+    raise _Unsupported("package `%s' not found" % name)
+
+  def _native(self, name, directories):
+    """Resolves the given package from its ``.pc`` file"""
+
+    if os.name == 'nt' or os.environ.get('PKG_CONFIG_SYSROOT_DIR'):
+      raise _Unsupported("relocated packages")
+
+    files = {}
+    parsed = {}
+    def _load(name):
+      if name not in parsed:
+        parsed[name] = parse_pc(self._find(name, directories, files))
+        if 'Version' not in parsed[name][1]:
+          raise _Unsupported("package `%s' has no version" % name)
+      return parsed[name]
+
+    def _collect(name, field, requires):
+      # every package comes before the packages it requires, so that the
+      # libraries are linked in the right order; otherwise, packages are
+      # listed in the order they are required
+      order = []
+      def _visit(name, seen):
+        if name in seen: return
+        seen.add(name)
+        fields = _load(name)[1]
+        for required in reversed(sum((_requirements(fields.get(k)) for k in requires), [])):
+          _visit(required, seen)
+        order.append(name)
+      _visit(name, set())
+      flags = []
+      for name in reversed(order):
+        try:
+          flags.extend(shlex.split(_load(name)[1].get(field, '')))
+        except ValueError:
+          raise _Unsupported("cannot split the %s of package `%s'" % (field, name))
+      return flags
+
+    variables, fields = _load(name)
+    # the compilation flags of private requirements are needed as well
+    cflags = _collect(name, 'Cflags', ('Requires', 'Requires.private'))
+    libs = _collect(name, 'Libs', ('Requires',))
+
+    includes, libraries = self.system_directories()
+    cflags = [k for k in cflags if not (k.startswith('-I') and os.path.normpath(k[2:]) in includes)]
+    libs = [k for k in libs if not (k.startswith('-L') and os.path.normpath(k[2:]) in libraries)]
+
+    return {
+        'version': fields['Version'],
+        'cflags': cflags,
+        'libs': libs,
+        'variables': variables,
+        'files': files,
+        }
+
+  def _fallback(self, name, paths, version):
+    """Resolves the given package by calling pkg-config"""
+
+    record = {'version': version, 'variables': None, 'files': None}
+    for key in ('cflags', 'libs'):
+      status, stdout, stderr = self.call(['--' + key, name], paths)
+      if status != 0:
+        raise RuntimeError("error querying --%s for package `%s': %s" % (key, name, stderr))
+      record[key] = stdout.split()
+    return record
+
+  def _valid(self, record):
+    return all(_mtime(k) == v for k, v in record['files'].items())
+
+  def resolve(self, names, paths=None):
+    """Resolves the given packages.
+
+    Parameters
+    ----------
+    names : [str]
+        The names of the packages
+    paths : [str]
+        Search paths to be added to PKG_CONFIG_PATH, see
+        :py:func:`call_pkgconfig`.
+
+    Returns
+    -------
+    records : [dict]
+        For each package, a dictionary with its ``version``, the lists of
+        ``cflags`` and ``libs``, and its ``variables`` (a list of name and
+        value pairs, or ``None`` if unknown).
+
+    Raises
+    ------
+    RuntimeError
+        If one of the packages is not found.
+    """
+
+    with self.lock:
+      return self._resolve(names, paths)
+
+  def _resolve(self, names, paths=None):
+    directories = self.search_paths(paths)
+    context = os.pathsep.join(directories) + '\0' + '\0'.join(os.environ.get(k, '') for k in
+        ('PKG_CONFIG_SYSTEM_INCLUDE_PATH', 'PKG_CONFIG_SYSTEM_LIBRARY_PATH',
+        'C_INCLUDE_PATH', 'CPLUS_INCLUDE_PATH', 'PKG_CONFIG_ALLOW_SYSTEM_CFLAGS',
+        'PKG_CONFIG_ALLOW_SYSTEM_LIBS', 'PKG_CONFIG_SYSROOT_DIR'))
+
+    missing = []
+    for name in uniq(names):
+      key = name + '\0' + context
+      if key in self.packages:
+        continue
+      if key in self.persisted and self._valid(self.persisted[key]):
+        self.packages[key] = self.persisted[key]
+        continue
+      try:
+        self.packages[key] = self.persisted[key] = self._native(name, directories)
+        self.dirty = True
+      except _Unsupported as e:
+        logger.debug("Asking pkg-config for package `%s': %s", name, e)
+        missing.append(name)
+
+    if missing:
+      # a single call for the versions of all remaining packages
+      status, stdout, stderr = self.call(['--modversion'] + missing, paths)
+      versions = stdout.splitlines()
+      if status != 0 or len(versions) != len(missing):
+        # finds out which package is missing
+        versions = []
+        for name in missing:
+          status, stdout, stderr = self.call(['--modversion', name], paths)
+          if status != 0:
+            raise RuntimeError("pkg-config package `%s' was not found" % name)
+          versions.append(stdout)
+      for name, version in zip(missing, versions):
+        self.packages[name + '\0' + context] = self._fallback(name, paths, version.strip())
+
+    return [self.packages[name + '\0' + context] for name in names]
+
+  def save(self):
+    """Writes the resolved packages to the cache file, if any changed"""
+
+    if self.filename is None or not self.dirty:
+      return
+    directory = os.path.dirname(self.filename)
+    try:
+      if not os.path.exists(directory):
+        os.makedirs(directory)
+      data = {'packages': self.persisted, 'defaults': self.defaults}
+      with tempfile.NamedTemporaryFile('w', dir=directory, delete=False) as f:
+        json.dump(data, f)
+      os.replace(f.name, self.filename)
+      self.dirty = False
+    except OSError as e:
+      logger.warning("Could not write the pkg-config cache `%s': %s", self.filename, e)
+
+
+def package_resolver():
+  """Returns the :py:class:`PackageResolver` of this process, which is
+  persisted at exit if ``BOB_BUILD_PKGCONFIG_CACHE`` is set, see
+  :py:func:`cache_file`"""
+
+  global _RESOLVER
+  with _LOCK:
+    if _RESOLVER is None:
+      _RESOLVER = PackageResolver(cache_file())
+      if _RESOLVER.filename is not None:
+        atexit.register(_RESOLVER.save)
+    return _RESOLVER
+
+
+def invalidate_package_resolver():
+  """Forgets all packages resolved by this process, e.g., after changing
+  ``PKG_CONFIG_PATH`` or installing packages"""
+
+  global _RESOLVER
+  with _LOCK:
+    if _RESOLVER is not None:
+      _RESOLVER.save()
+    _RESOLVER = None
+
+
+def resolve_packages(names, paths=None):
+  """Returns a :py:class:`pkgconfig` object for each of the given packages,
+  resolving all of them at once, see :py:class:`PackageResolver`"""
+
+  records = package_resolver().resolve(names, paths)
+  return [pkgconfig(name, paths, record) for name, record in zip(names, records)]
+
+
 class pkgconfig:
   """A class for capturing configuration information from pkg-config
 
@@ -103,13 +495,13 @@ class pkgconfig:
      >>> blitz.library_directories()
      [...]
 
-  If the package does not exist, a RuntimeError is raised. All calls to any
-  methods of a ``pkgconfig`` object are translated into a subprocess call that
-  queries for that specific information. If ``pkg-config`` fails, a
-  RuntimeError is raised.
+  If the package does not exist, a RuntimeError is raised. The package is
+  resolved once per process by the :py:func:`package_resolver`, and all
+  methods of a ``pkgconfig`` object return the information found then. Use
+  :py:func:`resolve_packages` to resolve several packages at once.
   """
 
-  def __init__(self, name, paths=None):
+  def __init__(self, name, paths=None, record=None):
     """Constructor
 
     Parameters:
@@ -128,16 +520,19 @@ class pkgconfig:
 
        $ PKG_CONFIG_PATH=<paths> pkg-config <name>
 
-    """
+    record
+      The package as resolved by :py:meth:`PackageResolver.resolve`; if not
+      given, the package is resolved by the :py:func:`package_resolver`.
 
-    status, stdout, stderr = call_pkgconfig(['--modversion', name], paths)
+    """
 
-    if status != 0:
-      raise RuntimeError("pkg-config package `%s' was not found" % name)
+    if record is None:
+      record = package_resolver().resolve([name], paths)[0]
 
     self.name = name
-    self.version = stdout.strip()
+    self.version = record['version']
     self.paths = paths
+    self.record = record
 
   def __xcall__(self, cmd):
     """Calls call_pkgconfig() with self.name and self.paths"""
@@ -193,14 +588,9 @@ class pkgconfig:
 
     """
 
-    status, stdout, stderr = self.__xcall__(['--cflags-only-I'])
-
-    if status != 0:
-      raise RuntimeError("error querying --cflags-only-I for package `%s': %s" % (self.name, stderr))
-
     retval = []
-    for token in stdout.split():
-      retval.append(token[2:])
+    for token in self.record['cflags']:
+      if token.startswith('-I'): retval.append(token[2:])
 
     return uniq(retval)
 
@@ -218,19 +608,17 @@ class pkgconfig:
     in the ``setup()`` function of your package.
     """
 
-    status, stdout, stderr = self.__xcall__(['--cflags-only-other'])
-
-    if status != 0:
-      raise RuntimeError("error querying --cflags-only-other for package `%s': %s" % (self.name, stderr))
-
     flag_map = {
         '-D': 'define_macros',
         }
 
     kw = {}
 
-    for token in stdout.split():
-      if token[:2] in flag_map:
+    for token in self.record['cflags']:
+      if token.startswith('-I'):
+        continue
+
+      elif token[:2] in flag_map:
         kw.setdefault(flag_map.get(token[:2]), []).append(token[2:])
 
       else: # throw others to extra_link_args
@@ -260,14 +648,9 @@ class pkgconfig:
 
     """
 
-    status, stdout, stderr = self.__xcall__(['--libs-only-l'])
-
-    if status != 0:
-      raise RuntimeError("error querying --libs-only-l for package `%s': %s" % (self.name, stderr))
-
     retval = []
-    for token in stdout.split():
-      retval.append(token[2:])
+    for token in self.record['libs']:
+      if token.startswith('-l'): retval.append(token[2:])
 
     return uniq(retval)
 
@@ -282,12 +665,7 @@ class pkgconfig:
 
     """
 
-    status, stdout, stderr = self.__xcall__(['--libs-only-other'])
-
-    if status != 0:
-      raise RuntimeError("error querying --libs-only-other for package `%s': %s" % (self.name, stderr))
-
-    return uniq(stdout.split())
+    return uniq(self.extra_link_args())
 
   def library_directories(self):
     """Returns a pre-processed list containing library directories.
@@ -300,14 +678,9 @@ class pkgconfig:
 
     """
 
-    status, stdout, stderr = self.__xcall__(['--libs-only-L'])
-
-    if status != 0:
-      raise RuntimeError("error querying --libs-only-L for package `%s': %s" % (self.name, stderr))
-
     retval = []
-    for token in stdout.split():
-      retval.append(token[2:])
+    for token in self.record['libs']:
+      if token.startswith('-L'): retval.append(token[2:])
 
     return uniq(retval)
 
@@ -322,12 +695,7 @@ class pkgconfig:
 
     """
 
-    status, stdout, stderr = self.__xcall__(['--libs-only-other'])
-
-    if status != 0:
-      raise RuntimeError("error querying --libs-only-other for package `%s': %s" % (self.name, stderr))
-
-    return stdout.strip().split()
+    return [k for k in self.record['libs'] if k[:2] not in ('-l', '-L')]
 
   def variable_names(self):
     """Returns a list with all variable names know to this package
@@ -340,6 +708,10 @@ class pkgconfig:
 
     """
 
+    if self.record['variables'] is not None:
+      # in the order pkg-config lists them
+      return [k for k, v in reversed(self.record['variables'])]
+
     status, stdout, stderr = self.__xcall__(['--print-variables'])
 
     if status != 0:
@@ -362,6 +734,9 @@ class pkgconfig:
        error. Instead, it returns an empty string. So, do we.
     """
 
+    if self.record['variables'] is not None:
+      return dict(self.record['variables']).get(name, '')
+
     status, stdout, stderr = self.__xcall__(['--variable=%s' % name])
 
     if status != 0:
@@ -390,4 +765,5 @@ class pkgconfig:
     NAME = sub(r'[\.\-\s]', '_', self.name.upper())
     return [('HAVE_' + NAME, '1')]
 
-__all__ = ['pkgconfig']
+__all__ = ['pkgconfig', 'resolve_packages', 'parse_pc', 'cache_file',
+    'PackageResolver', 'package_resolver', 'invalidate_package_resolver']
@@ -0,0 +1,153 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""An index of the directories searched by :py:func:`bob.extension.utils.find_file`
+and friends, so that configuring packages with many extensions does not scan
+the file system over and over again"""
+
+import os
+import json
+import glob
+import fnmatch
+import atexit
+import tempfile
+import threading
+import logging
+
+logger = logging.getLogger(__name__)
+
+DEFAULT_INDEX_FILE = os.path.join(os.path.expanduser('~'), '.cache', 'bob.extension', 'prefix_index.json')
+"""The file the index is persisted to when ``BOB_BUILD_INDEX=1``"""
+
+_INDEX = None
+_LOCK = threading.Lock()
+
+
+def index_file(filename=None):
+  """Returns the file to persist the prefix index to, or ``None`` if the index
+  is only kept in memory.
+
+  If ``filename`` is not given, the ``BOB_BUILD_INDEX`` environment variable
+  is used: ``1`` selects the :py:data:`DEFAULT_INDEX_FILE`, any other value
+  except ``0`` is taken as the file name.
+  """
+
+  if filename is None:
+    filename = os.environ.get('BOB_BUILD_INDEX', '').strip()
+  if filename in ('', '0'):
+    return None
+  if filename == '1':
+    return DEFAULT_INDEX_FILE
+  return os.path.realpath(os.path.expanduser(filename))
+
+
+class PrefixIndex(object):
+  """Caches the contents of directories, and the search paths constructed by
+  :py:func:`bob.extension.utils.construct_search_paths`.
+
+  A directory is only listed again when its modification time changed, i.e.,
+  when a file was added to or removed from it, e.g., by a library built
+  earlier in the same process. When the index is persisted to ``filename``,
+  the listings are re-used by later processes in the same way.
+  """
+
+  def __init__(self, filename=None):
+    self.filename = filename
+    self.persisted = {}
+    self.searches = {}
+    self.dirty = False
+    if filename is not None and os.path.exists(filename):
+      try:
+        with open(filename) as f:
+          self.persisted = dict((k, (v[0], frozenset(v[1]))) for k, v in json.load(f).items())
+      except (ValueError, TypeError, IndexError, OSError):
+        logger.warning("Ignoring the corrupt prefix index `%s'", filename)
+
+  def listdir(self, directory):
+    """Returns the entries of the given directory as a set, or ``None`` if it
+    does not exist"""
+
+    # a stat is much cheaper than a listing, and catches files added since
+    try:
+      mtime = os.stat(directory).st_mtime_ns
+      persisted = self.persisted.get(directory)
+      if persisted is not None and persisted[0] == mtime:
+        entries = persisted[1]
+      else:
+        entries = frozenset(os.listdir(directory))
+        self.persisted[directory] = (mtime, entries)
+        self.dirty = True
+    except OSError:
+      entries = None
+    return entries
+
+  def exists(self, path):
+    """Returns whether the given path exists, according to the listing of its
+    parent directory"""
+
+    parent, name = os.path.split(os.path.normpath(path))
+    entries = self.listdir(parent or os.curdir)
+    return entries is not None and name in entries
+
+  def glob(self, pattern):
+    """Returns the paths matching the given pattern, like :py:func:`glob.glob`,
+    with wildcards in the last path component only; other patterns are handed
+    over to :py:func:`glob.glob`"""
+
+    directory, name = os.path.split(pattern)
+    if not glob.has_magic(pattern):
+      return [pattern] if self.exists(pattern) else []
+    if glob.has_magic(directory) or not name:
+      return glob.glob(pattern)
+    entries = self.listdir(directory or os.curdir) or ()
+    return [os.path.join(directory, e) for e in sorted(entries)
+        if fnmatch.fnmatch(e, name) and (name.startswith('.') or not e.startswith('.'))]
+
+  def search_paths(self, key, construct):
+    """Returns the search paths for the given key, which are constructed by
+    calling ``construct()`` the first time"""
+
+    if key not in self.searches:
+      self.searches[key] = construct()
+    return list(self.searches[key])
+
+  def save(self):
+    """Writes the directory listings to the index file, if any changed"""
+
+    if self.filename is None or not self.dirty:
+      return
+    directory = os.path.dirname(self.filename)
+    try:
+      if not os.path.exists(directory):
+        os.makedirs(directory)
+      data = dict((k, [v[0], sorted(v[1])]) for k, v in self.persisted.items())
+      with tempfile.NamedTemporaryFile('w', dir=directory, delete=False) as f:
+        json.dump(data, f)
+      os.replace(f.name, self.filename)
+      self.dirty = False
+    except OSError as e:
+      logger.warning("Could not write the prefix index `%s': %s", self.filename, e)
+
+
+def prefix_index():
+  """Returns the :py:class:`PrefixIndex` of this process, which is persisted
+  at exit if ``BOB_BUILD_INDEX`` is set, see :py:func:`index_file`"""
+
+  global _INDEX
+  with _LOCK:
+    if _INDEX is None:
+      _INDEX = PrefixIndex(index_file())
+      if _INDEX.filename is not None:
+        atexit.register(_INDEX.save)
+    return _INDEX
+
+
+def invalidate_prefix_index():
+  """Forgets all directory listings and search paths of this process, e.g.,
+  after installing files into one of the prefixes"""
+
+  global _INDEX
+  with _LOCK:
+    if _INDEX is not None:
+      _INDEX.save()
+    _INDEX = None
@@ -1,31 +1,332 @@
+import os
+import queue
+import pickle
+import functools
+import threading
+import concurrent.futures
+
+from .instrumentation import stage_name, measure
+
+_MODES = ('sequential', 'thread', 'process', 'auto')
+
+# marks the end of a stream of samples in SequentialProcessor.stream
+_END = object()
+
+
+class _Failure(object):
+    """An exception raised by a stage of SequentialProcessor.stream, which is
+    passed down to the consumer"""
+
+    def __init__(self, exception):
+        self.exception = exception
+
+
+class _Forward(Exception):
+    """Passes a _Failure of the previous stage through the current one"""
+
+    def __init__(self, failure):
+        self.failure = failure
+
+
+def _put(target, item, stop):
+    """Puts the item into the bounded queue, unless the stream was stopped"""
+    while not stop.is_set():
+        try:
+            target.put(item, timeout=0.1)
+            return True
+        except queue.Full:
+            pass
+    return False
+
+
+def _get(source, stop):
+    """Gets the next item of the queue, or _END if the stream was stopped"""
+    while not stop.is_set():
+        try:
+            return source.get(timeout=0.1)
+        except queue.Empty:
+            pass
+    return _END
+
+
+def _batches(samples, size):
+    """Groups the samples into lists of (at most) ``size`` samples"""
+    batch = []
+    for sample in samples:
+        batch.append(sample)
+        if len(batch) == size:
+            yield batch
+            batch = []
+    if batch:
+        yield batch
+
+
+def releases_gil(processor):
+    """Returns whether the given processor (most probably) releases the GIL
+    while it runs, so that it can run concurrently on a thread.
+
+    Processors can state that with a ``releases_gil`` attribute. Otherwise,
+    only numpy ufuncs and the native processors of
+    ``bob.extension/processor.h`` (see :py:func:`native_stage`) are assumed
+    to release the GIL. Other functions implemented in C or C++ usually hold
+    it, and would only run one after another on threads.
+
+    Parameters
+    ----------
+    processor : callable
+        The processor to check.
+
+    Returns
+    -------
+    bool
+        ``True`` if the processor is expected to release the GIL.
+    """
+    flag = getattr(processor, 'releases_gil', None)
+    if flag is not None:
+        return bool(flag)
+    if isinstance(processor, NativeChain) or native_stage(processor):
+        return True
+    if isinstance(processor, functools.partial):
+        return releases_gil(processor.func)
+    try:
+        import numpy
+        if isinstance(processor, numpy.ufunc):
+            return True
+    except ImportError:
+        pass
+    return False
+
+
+def stack_batch(samples):
+    """Stacks the given samples into a single contiguous array, if they are
+    all numpy arrays with the same shape and dtype.
+
+    Parameters
+    ----------
+    samples : list
+        The samples of a batch.
+
+    Returns
+    -------
+    :py:class:`numpy.ndarray` or list
+        The samples stacked along a new first axis, or the list of samples.
+    """
+    first = samples[0] if samples else None
+    shape, dtype = getattr(first, 'shape', None), getattr(first, 'dtype', None)
+    if shape is None or dtype is None:
+        return samples
+    import numpy
+    if not all(isinstance(s, numpy.ndarray) and s.shape == shape and
+               s.dtype == dtype for s in samples):
+        return samples
+    return numpy.stack(samples)
+
+
+def apply_batch(processor, samples, **kwargs):
+    """Applies the processor on a batch of samples.
+
+    Processors that can process several samples at once (e.g., C++ extensions
+    that loop over the samples without crossing into Python) implement the
+    batch protocol: a ``process_batch(batch, **kwargs)`` method, where
+    ``batch`` is the samples stacked by :py:func:`stack_batch`, and which
+    returns a sequence (or an array) with the output of each sample. All other
+    processors are called once for each sample.
+
+    Parameters
+    ----------
+    processor : callable
+        The processor.
+    samples : iterable
+        The samples.
+    **kwargs
+        Any kwargs are passed to the processor.
+
+    Returns
+    -------
+    list
+        The output of each sample.
+    """
+    samples = list(samples)
+    function = getattr(processor, 'process_batch', None)
+    if function is None or not samples:
+        return [processor(sample, **kwargs) for sample in samples]
+    outputs = list(function(stack_batch(samples), **kwargs))
+    if len(outputs) != len(samples):
+        raise ValueError(
+            "{}.process_batch returned {} outputs for {} samples".format(
+                stage_name(processor), len(outputs), len(samples)))
+    return outputs
+
+
+def _stage_name(index, processor):
+    """The name of the stage ``index`` for the instrumentation"""
+    return '{}:{}'.format(index, stage_name(processor))
+
+
+def native_stage(processor):
+    """Returns the native C++ implementation of the given processor, if it has
+    one.
+
+    C++ extensions expose the native implementation of their processors with a
+    ``__native_processor__`` attribute, which is created with
+    ``bob::extension::native_processor`` of ``bob.extension/processor.h``.
+
+    Parameters
+    ----------
+    processor : callable
+        The processor to check.
+
+    Returns
+    -------
+    tuple or None
+        The name of the array type the processor works on, a capsule holding
+        the C++ processor, and a function that runs a list of such capsules;
+        or ``None`` for processors implemented in Python.
+    """
+    try:
+        stage = processor.__native_processor__
+    except Exception:
+        return None
+    if not isinstance(stage, tuple) or len(stage) != 3:
+        return None
+    return stage
+
+
+class NativeChain(object):
+    """Runs several native processors with the same array type as a single C++
+    chain, see :ref:`bob.extension.processors`.
+
+    The input is converted to the C++ array type once, the arrays are passed
+    directly from one processor to the next with the GIL released, and only
+    the output of the last processor is converted back to Python.
+
+    Attributes
+    ----------
+    processors : list
+        The native processors of the chain.
+    """
+
+    def __init__(self, processors):
+        """Initialization
+
+        Parameters
+        ----------
+        processors : :py:class:`list`
+            The processors, which must all have a :py:func:`native_stage` with
+            the same array type.
+        """
+        stages = [native_stage(processor) for processor in processors]
+        if not stages or any(stage is None for stage in stages):
+            raise ValueError("all processors of a NativeChain must be native")
+        if any(stage[0] != stages[0][0] for stage in stages):
+            raise ValueError(
+                "all processors of a NativeChain must work on the same array "
+                "type, not {}".format(sorted(set(s[0] for s in stages))))
+        self.processors = processors
+        self._capsules = tuple(stage[1] for stage in stages)
+        self._run = stages[0][2]
+
+    def __call__(self, data):
+        """Applies the processors on the data.
+
+        Parameters
+        ----------
+        data : object
+            The data, which must be convertible to the array type of the
+            processors.
+
+        Returns
+        -------
+        object
+            The output of the last processor.
+        """
+        return self._run(self._capsules, data)
+
+
 class SequentialProcessor(object):
     """A helper class which takes several processors and applies them one by
     one on data sequentially. See :ref:`bob.extension.processors` for more
     details.
 
+    Streams of samples can be processed with :py:meth:`stream`, which runs the
+    processors as a pipeline.
+
     Attributes
     ----------
     processors : list
         A list of processors to apply.
     """
 
-    def __init__(self, processors, **kwargs):
+    def __init__(self, processors, fuse=True, instrumentation=None,
+                 **kwargs):
         """Initialization
 
         Parameters
         ----------
         processors : :py:class:`list`
             A list of preprocessors to be used.
+        fuse : :py:class:`bool`, optional
+            If ``True``, consecutive native processors (see
+            :py:func:`native_stage`) are run as a single C++ chain.
+        instrumentation : :py:class:`bob.extension.instrumentation.Instrumentation`, optional
+            If given, records the calls of each stage.
         **kwargs
             Any kwargs are passed to the parent class.
         """
         super(SequentialProcessor, self).__init__(**kwargs)
         self.processors = processors
+        self.fuse = fuse
+        self.instrumentation = instrumentation
+        self._fused = None
+
+    def stages(self):
+        """Returns the callables that :py:meth:`__call__` runs one after
+        another: the processors, where consecutive native processors with the
+        same array type are replaced by a single :py:class:`NativeChain`.
+
+        Returns
+        -------
+        list
+            The stages of this processor.
+        """
+        processors = list(self.processors)
+        if self._fused is not None and len(self._fused[0]) == len(processors) \
+                and all(a is b for a, b in zip(self._fused[0], processors)):
+            return self._fused[1]
+        stages, group = [], []
+
+        def flush():
+            if len(group) > 1:
+                stages.append(NativeChain([p for p, _ in group]))
+            else:
+                stages.extend(p for p, _ in group)
+            del group[:]
+
+        for processor in processors:
+            stage = native_stage(processor) if self.fuse else None
+            if stage is None or (group and group[0][1][0] != stage[0]):
+                flush()
+            if stage is None:
+                stages.append(processor)
+            else:
+                group.append((processor, stage))
+        flush()
+        self._fused = (processors, stages)
+        return stages
+
+    def __getstate__(self):
+        # native chains hold capsules, which cannot be pickled
+        state = self.__dict__.copy()
+        state['_fused'] = None
+        return state
 
     def __call__(self, data, **kwargs):
         """Applies the processors on the data sequentially. The output of the
         first one goes as input to the next one.
 
+        Without ``kwargs``, consecutive native processors are run as a single
+        :py:class:`NativeChain`, see :py:meth:`stages`.
+
         Parameters
         ----------
         data : object
@@ -38,39 +339,231 @@ class SequentialProcessor(object):
         object
             The processed data.
         """
-        for processor in self.processors:
-            data = processor(data, **kwargs)
+        if self.fuse and not kwargs:
+            stages = self.stages()
+        else:
+            stages = self.processors
+        if self.instrumentation is not None:
+            for index, stage in enumerate(stages):
+                data = self.instrumentation.call(
+                    _stage_name(index, stage), stage, data, **kwargs)
+            return data
+        for stage in stages:
+            data = stage(data, **kwargs)
         return data
 
+    def process_batch(self, samples, **kwargs):
+        """Applies the processors on a batch of samples, which are passed
+        through each stage at once, see :py:func:`apply_batch`.
+
+        Parameters
+        ----------
+        samples : iterable
+            The samples that need to be processed.
+        **kwargs
+            Any kwargs are passed to the processors.
+
+        Returns
+        -------
+        list
+            The processed samples.
+        """
+        samples = list(samples)
+        stages = self.stages() if self.fuse and not kwargs else self.processors
+        for index, stage in enumerate(stages):
+            if self.instrumentation is None:
+                samples = apply_batch(stage, samples, **kwargs)
+            else:
+                samples = self.instrumentation.call(
+                    _stage_name(index, stage),
+                    functools.partial(apply_batch, stage), samples, **kwargs)
+        return samples
+
+    def stream(self, samples, batch_size=1, queue_size=4, **kwargs):
+        """Applies the processors on a stream of samples, where each processor
+        runs on its own thread.
+
+        The stages are connected by bounded queues, so that while a processor
+        works on a sample, the previous one already works on the next samples,
+        and the iteration of ``samples`` (e.g., loading them from disk)
+        overlaps with the processing. The throughput is hence limited by the
+        slowest processor instead of by the sum of all processors, as long as
+        the processors release the GIL (see :py:func:`releases_gil`) or wait
+        for I/O.
+
+        Parameters
+        ----------
+        samples : iterable
+            The samples to process, which are iterated on a separate thread.
+        batch_size : :py:class:`int` or :py:class:`list`, optional
+            The number of samples that are passed between the stages at once,
+            for all stages or for each stage (the first one being the
+            iteration of ``samples``). Each batch is processed with
+            :py:func:`apply_batch`. Larger batches reduce the overhead of the
+            queues and of the processors that implement the batch protocol,
+            smaller ones deliver the first outputs sooner.
+        queue_size : :py:class:`int`, optional
+            The maximum number of batches waiting between two stages. A stage
+            blocks when its output queue is full, so that a fast stage does
+            not accumulate the outputs of a slow one in memory.
+        **kwargs
+            Any kwargs are passed to the processors.
+
+        Yields
+        ------
+        object
+            The processed samples, in the order of ``samples``. If a processor
+            (or the iteration of ``samples``) raises, the exception is
+            re-raised here, and all stages are stopped.
+        """
+        count = len(self.processors)
+        if isinstance(batch_size, int):
+            batch_size = [batch_size] * (count + 1)
+        if len(batch_size) != count + 1:
+            raise ValueError(
+                "batch_size needs one entry for the samples and each of the "
+                "{} processors, not {}".format(count, len(batch_size)))
+        stop = threading.Event()
+        queues = [queue.Queue(queue_size) for _ in range(count + 1)]
+
+        def feed():
+            try:
+                for batch in _batches(samples, batch_size[0]):
+                    if not _put(queues[0], batch, stop):
+                        return
+            except Exception as e:
+                _put(queues[0], _Failure(e), stop)
+            else:
+                _put(queues[0], _END, stop)
+
+        def inputs(source):
+            while True:
+                item = _get(source, stop)
+                if item is _END:
+                    return
+                if isinstance(item, _Failure):
+                    raise _Forward(item)
+                for sample in item:
+                    yield sample
+
+        def work(index, processor):
+            source, target = queues[index], queues[index + 1]
+            run = functools.partial(apply_batch, processor)
+            if self.instrumentation is not None:
+                run = functools.partial(
+                    self.instrumentation.call, _stage_name(index, processor),
+                    run)
+            try:
+                for batch in _batches(inputs(source), batch_size[index + 1]):
+                    outputs = run(batch, **kwargs)
+                    if not _put(target, outputs, stop):
+                        return
+            except _Forward as e:
+                _put(target, e.failure, stop)
+            except Exception as e:
+                _put(target, _Failure(e), stop)
+            else:
+                _put(target, _END, stop)
+
+        threads = [threading.Thread(target=feed, daemon=True)]
+        threads += [threading.Thread(target=work, args=(index, processor),
+                                     daemon=True)
+                    for index, processor in enumerate(self.processors)]
+        for thread in threads:
+            thread.start()
+        try:
+            while True:
+                item = queues[-1].get()
+                if item is _END:
+                    return
+                if isinstance(item, _Failure):
+                    raise item.exception
+                for output in item:
+                    yield output
+        finally:
+            stop.set()
+            for thread in threads:
+                thread.join()
+
 
 class ParallelProcessor(object):
     """A helper class which takes several processors and applies data on each
     processor separately and yields their outputs one by one. See
     :ref:`bob.extension.processors` for more details.
 
+    By default, the processors are run one after another. With ``mode`` set to
+    ``'thread'``, ``'process'`` or ``'auto'``, they are run concurrently on a
+    pool of threads or processes, see :py:meth:`__init__`.
+
     Attributes
     ----------
     processors : list
         A list of processors to apply.
+    mode : str
+        How the processors are run: ``'sequential'``, ``'thread'``,
+        ``'process'`` or ``'auto'``.
+    max_workers : int
+        The maximum number of processors that run at once.
+    ordered : bool
+        Whether the outputs are yielded in the order of the processors.
     """
 
-    def __init__(self, processors, **kwargs):
+    def __init__(self, processors, mode='sequential', max_workers=None,
+                 ordered=True, instrumentation=None, **kwargs):
         """Initialization
 
         Parameters
         ----------
         processors : :py:class:`list`
             A list of preprocessors to be used.
+        mode : :py:class:`str`, optional
+            ``'sequential'`` runs the processors one after another in the
+            calling thread. ``'thread'`` runs them on a thread pool, which only
+            helps for processors that release the GIL, such as numpy functions
+            and most C++ extensions. ``'process'`` runs them on a process pool,
+            where the processors, the data and the outputs must be picklable.
+            ``'auto'`` runs the processors that release the GIL (see
+            :py:func:`releases_gil`) and those that cannot be pickled on
+            threads, and all others on processes.
+        max_workers : :py:class:`int`, optional
+            The maximum number of processors that run at once, on threads
+            and processes together. By default, the number of processors, but
+            at most the number of CPU cores.
+        ordered : :py:class:`bool`, optional
+            If ``True``, the outputs are yielded in the order of the
+            processors. Otherwise, ``(index, output)`` pairs are yielded as
+            soon as the processors finish, where ``index`` is the position of
+            the processor in :py:attr:`processors`.
+        instrumentation : :py:class:`bob.extension.instrumentation.Instrumentation`, optional
+            If given, records the calls of each processor, also when they run
+            on a process pool.
         **kwargs
             Any kwargs are passed to the parent class.
         """
         super(ParallelProcessor, self).__init__(**kwargs)
+        if mode not in _MODES:
+            raise ValueError(
+                "mode must be one of {}, not `{}'".format(_MODES, mode))
         self.processors = processors
+        self.mode = mode
+        self.max_workers = max_workers or \
+            max(1, min(len(processors), os.cpu_count() or 1))
+        self.ordered = ordered
+        self.instrumentation = instrumentation
+        self._executors = {}
+        self._kinds = {}
+        # threads and processes of the 'auto' mode share max_workers
+        self._budget = threading.BoundedSemaphore(self.max_workers)
 
     def __call__(self, data, **kwargs):
         """Applies the processors on the data independently and outputs a
         generator of their outputs.
 
+        In the concurrent modes, all processors are started right away, and
+        the generator waits for their outputs. If a processor raises, the
+        processors that have not started yet are cancelled and the exception
+        is re-raised by the generator.
+
         Parameters
         ----------
         data : object
@@ -81,7 +574,165 @@ class ParallelProcessor(object):
         Yields
         ------
         object
-            The processed data from processors one by one.
+            The processed data from processors one by one, or ``(index,
+            output)`` pairs if :py:attr:`ordered` is ``False``.
+        """
+        if self.mode == 'sequential':
+            return self._sequential(data, **kwargs)
+        if self.instrumentation is None:
+            futures = [self._submit(processor, processor, data, **kwargs)
+                       for processor in self.processors]
+        else:
+            # the measurements are taken by the workers, but recorded here
+            futures = [self._submit(
+                processor, measure, processor, data, kwargs,
+                self.instrumentation.memory)
+                for processor in self.processors]
+        return self._collect(futures)
+
+    def process_batch(self, samples, **kwargs):
+        """Applies each processor on a batch of samples, see
+        :py:func:`apply_batch`. In the concurrent modes, the processors run
+        concurrently, each on the whole batch.
+
+        Parameters
+        ----------
+        samples : iterable
+            The samples that need to be processed.
+        **kwargs
+            Any kwargs are passed to the processors.
+
+        Returns
+        -------
+        list
+            For each sample, the list of the outputs of the processors.
         """
-        for processor in self.processors:
-            yield processor(data, **kwargs)
+        samples = list(samples)
+        batches = [functools.partial(apply_batch, processor)
+                   for processor in self.processors]
+        if self.mode == 'sequential':
+            if self.instrumentation is None:
+                results = [batch(samples, **kwargs) for batch in batches]
+            else:
+                results = [self.instrumentation.call(
+                    _stage_name(index, processor), batch, samples, **kwargs)
+                    for index, (processor, batch) in
+                    enumerate(zip(self.processors, batches))]
+        else:
+            if self.instrumentation is None:
+                futures = [self._submit(processor, batch, samples, **kwargs)
+                    for processor, batch in zip(self.processors, batches)]
+            else:
+                futures = [self._submit(
+                    processor, measure, batch, samples, kwargs,
+                    self.instrumentation.memory)
+                    for processor, batch in zip(self.processors, batches)]
+            try:
+                results = [self._result(index, future)
+                           for index, future in enumerate(futures)]
+            finally:
+                for future in futures:
+                    future.cancel()
+        return [list(outputs) for outputs in zip(*results)]
+
+    def _sequential(self, data, **kwargs):
+        for index, processor in enumerate(self.processors):
+            if self.instrumentation is None:
+                output = processor(data, **kwargs)
+            else:
+                output = self.instrumentation.call(
+                    _stage_name(index, processor), processor, data, **kwargs)
+            yield output if self.ordered else (index, output)
+
+    def _result(self, index, future):
+        if self.instrumentation is None:
+            return future.result()
+        output, record, error = future.result()
+        self.instrumentation.record(
+            _stage_name(index, self.processors[index]), record)
+        if error is not None:
+            raise error
+        return output
+
+    def _collect(self, futures):
+        indices = dict((future, index) for index, future in enumerate(futures))
+        try:
+            if self.ordered:
+                for index, future in enumerate(futures):
+                    yield self._result(index, future)
+            else:
+                for future in concurrent.futures.as_completed(futures):
+                    index = indices[future]
+                    yield index, self._result(index, future)
+        finally:
+            for future in futures:
+                future.cancel()
+
+    def _kind(self, processor):
+        if self.mode != 'auto':
+            return self.mode
+        # pickling large processors is expensive, so decide only once; the
+        # processor is kept, so that its id is not re-used
+        cached = self._kinds.get(id(processor))
+        if cached is not None:
+            return cached[1]
+        if releases_gil(processor):
+            kind = 'thread'
+        else:
+            try:
+                pickle.dumps(processor)
+                kind = 'process'
+            except Exception:
+                kind = 'thread'
+        self._kinds[id(processor)] = (processor, kind)
+        return kind
+
+    def _submit(self, processor, function, *args, **kwargs):
+        # waits for a free worker of the budget, which is returned when the
+        # future is done or cancelled
+        executor = self._executor(processor)
+        self._budget.acquire()
+        try:
+            future = executor.submit(function, *args, **kwargs)
+        except BaseException:
+            self._budget.release()
+            raise
+        future.add_done_callback(lambda _: self._budget.release())
+        return future
+
+    def _executor(self, processor):
+        kind = self._kind(processor)
+        if kind not in self._executors:
+            if kind == 'thread':
+                self._executors[kind] = concurrent.futures.ThreadPoolExecutor(
+                    self.max_workers)
+            else:
+                self._executors[kind] = \
+                    concurrent.futures.ProcessPoolExecutor(self.max_workers)
+        return self._executors[kind]
+
+    def close(self):
+        """Shuts down the thread and process pools of the concurrent modes,
+        which are otherwise kept for the next calls"""
+        for executor in self._executors.values():
+            executor.shutdown()
+        self._executors = {}
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def __getstate__(self):
+        # the pools cannot be pickled, e.g., when this processor is run by
+        # another ParallelProcessor in a process pool
+        state = self.__dict__.copy()
+        state['_executors'] = {}
+        state['_kinds'] = {}
+        del state['_budget']
+        return state
+
+    def __setstate__(self, state):
+        self.__dict__.update(state)
+        self._budget = threading.BoundedSemaphore(self.max_workers)
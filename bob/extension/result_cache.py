@@ -0,0 +1,441 @@
+"""A persistent, content-addressed cache of the outputs of processors, see
+:ref:`bob.extension.processors`.
+
+The outputs are keyed on the identity and parameters of the processor and on
+a hash of its input, so that re-running a chain of processors on the same data
+skips all stages whose inputs have not changed. NumPy arrays are stored as
+``.npy`` files, which are memory-mapped when they are read.
+"""
+
+import os
+import types
+import pickle
+import hashlib
+import tempfile
+import functools
+import threading
+import logging
+
+from .processors import apply_batch
+
+logger = logging.getLogger(__name__)
+
+DEFAULT_CACHE_DIRECTORY = os.path.join(
+    os.path.expanduser('~'), '.cache', 'bob.extension', 'results')
+"""The directory of the :py:class:`ResultCache` if no other is given"""
+
+DEFAULT_MAX_SIZE = 10 * 1024 ** 3
+"""The default size limit of the :py:class:`ResultCache` in bytes"""
+
+
+def _update_value(digest, value):
+    """Adds the given value to the digest, hashing the memory of arrays
+    directly and pickling all other objects"""
+    try:
+        import numpy
+    except ImportError:
+        numpy = None
+    if numpy is not None and isinstance(value, numpy.ndarray) and \
+            value.dtype != object:
+        digest.update(b'ndarray\0')
+        digest.update(value.dtype.str.encode('ascii'))
+        digest.update(repr(value.shape).encode('ascii'))
+        digest.update(memoryview(numpy.ascontiguousarray(value)).cast('B'))
+    elif isinstance(value, (bytes, bytearray)):
+        digest.update(b'bytes\0%d\0' % len(value))
+        digest.update(value)
+    elif isinstance(value, (list, tuple)):
+        digest.update(b'%s\0%d\0' % (type(value).__name__.encode('ascii'),
+                                     len(value)))
+        for v in value:
+            _update_value(digest, v)
+    elif isinstance(value, dict):
+        digest.update(b'dict\0%d\0' % len(value))
+        for k in sorted(value, key=repr):
+            _update_value(digest, k)
+            _update_value(digest, value[k])
+    else:
+        digest.update(b'pickle\0')
+        digest.update(pickle.dumps(value, protocol=4))
+
+
+def hash_value(value):
+    """Returns a hash of the given value, e.g., the input of a processor.
+
+    NumPy arrays are hashed by their dtype, shape and memory, lists, tuples and
+    dicts by their elements, and all other objects by their pickled
+    representation.
+
+    Parameters
+    ----------
+    value : object
+        The value to hash.
+
+    Returns
+    -------
+    str
+        The hexadecimal BLAKE2b hash of the value.
+    """
+    digest = hashlib.blake2b(digest_size=20)
+    _update_value(digest, value)
+    return digest.hexdigest()
+
+
+def _update_code(digest, code):
+    """Adds the byte code of the given code object to the digest, with the
+    names it uses (e.g., of global functions) and its constants, including the
+    code of nested functions"""
+    digest.update(b'code\0')
+    digest.update(code.co_code)
+    digest.update('\0'.join(code.co_names).encode('utf-8'))
+    for const in code.co_consts:
+        if isinstance(const, types.CodeType):
+            _update_code(digest, const)
+        elif isinstance(const, frozenset):
+            # the order of sets of strings differs between processes
+            digest.update(repr(sorted(const, key=repr)).encode('utf-8'))
+        else:
+            digest.update(repr(const).encode('utf-8'))
+        digest.update(b'\0')
+
+
+def _update_function(digest, function):
+    """Adds the code, the default arguments and the values captured in the
+    closure of the given Python function to the digest"""
+    _update_code(digest, function.__code__)
+    _update_value(digest, getattr(function, '__defaults__', None))
+    _update_value(digest, getattr(function, '__kwdefaults__', None))
+    for cell in getattr(function, '__closure__', None) or ():
+        try:
+            contents = cell.cell_contents
+        except ValueError:
+            # an empty cell, e.g., of a variable assigned later
+            digest.update(b'empty\0')
+            continue
+        try:
+            _update_value(digest, contents)
+        except Exception:
+            raise ValueError(
+                "Cannot identify the function `%s' for the result cache, "
+                "since the value `%r' in its closure cannot be pickled; "
+                "please define its `cache_identity'" %
+                (function.__qualname__, contents))
+
+
+def processor_identity(processor):
+    """Returns a string that identifies the given processor and its
+    parameters, which is part of the keys of the :py:class:`ResultCache`.
+
+    Processors can define their identity with a ``cache_identity`` attribute
+    (a string, or a method returning one), e.g., to include the version of a
+    model file. Otherwise, functions are identified by their qualified name
+    and, for Python functions, their byte code (including the names it uses
+    and nested functions), their default arguments and the values in their
+    closure; :py:func:`functools.partial`
+    objects by their function and arguments; processors with ``processors``
+    (such as :py:class:`bob.extension.processors.SequentialProcessor`) by
+    their processors; and all other objects by their class and their pickled
+    state.
+
+    Parameters
+    ----------
+    processor : callable
+        The processor.
+
+    Returns
+    -------
+    str
+        The identity of the processor.
+    """
+    identity = getattr(processor, 'cache_identity', None)
+    if identity is not None:
+        return identity() if callable(identity) else str(identity)
+    if isinstance(processor, functools.partial):
+        return 'partial(%s, %s)' % (processor_identity(processor.func),
+                                    hash_value((processor.args,
+                                                processor.keywords)))
+    processors = getattr(processor, 'processors', None)
+    if isinstance(processors, (list, tuple)):
+        return '%s(%s)' % (type(processor).__name__,
+                           ', '.join(processor_identity(p) for p in processors))
+    if isinstance(processor, types.MethodType):
+        return '%s@%s' % (processor_identity(processor.__func__),
+                          processor_identity(processor.__self__))
+    name = getattr(processor, '__qualname__', None)
+    if isinstance(name, str):
+        module = getattr(processor, '__module__', None) or ''
+        code = getattr(processor, '__code__', None)
+        if code is not None:
+            digest = hashlib.blake2b(digest_size=20)
+            _update_function(digest, processor)
+            return '%s.%s:%s' % (module, name, digest.hexdigest())
+        owner = getattr(processor, '__self__', None)
+        if owner is not None and not isinstance(owner, (types.ModuleType, type)):
+            # a builtin method of an object
+            return '%s.%s@%s' % (module, name, processor_identity(owner))
+        return '%s.%s' % (module, name)
+    cls = type(processor)
+    try:
+        state = hash_value(processor)
+    except Exception:
+        raise ValueError(
+            "Cannot identify the processor `%r' for the result cache, since "
+            "it cannot be pickled; please define its `cache_identity'" %
+            (processor,))
+    return '%s.%s:%s' % (cls.__module__, cls.__qualname__, state)
+
+
+class ResultCache(object):
+    """A persistent cache of processor outputs in the given ``directory``.
+
+    The least recently used outputs are removed when the total size of the
+    cache exceeds ``max_size`` bytes. All files are written atomically, so
+    that the cache can be shared by several processes.
+
+    Attributes
+    ----------
+    directory : str
+        The directory of the cache.
+    max_size : int
+        The size limit in bytes.
+    hits : int
+        The number of outputs taken from the cache.
+    misses : int
+        The number of outputs that were not in the cache.
+    """
+
+    def __init__(self, directory=None, max_size=DEFAULT_MAX_SIZE):
+        """Initialization
+
+        Parameters
+        ----------
+        directory : :py:class:`str`, optional
+            The directory of the cache, by default the
+            :py:data:`DEFAULT_CACHE_DIRECTORY`.
+        max_size : :py:class:`int`, optional
+            The size limit in bytes.
+        """
+        self.directory = os.path.realpath(os.path.expanduser(
+            directory or DEFAULT_CACHE_DIRECTORY))
+        self.max_size = max_size
+        self.hits = 0
+        self.misses = 0
+        self._size = None
+        self._lock = threading.Lock()
+
+    def __getstate__(self):
+        # e.g., for the process pool of a ParallelProcessor
+        state = self.__dict__.copy()
+        del state['_lock']
+        return state
+
+    def __setstate__(self, state):
+        self.__dict__.update(state)
+        self._lock = threading.Lock()
+
+    def key(self, processor, data, kwargs=None, identity=None):
+        """Returns the key of the output of the processor for the given data
+        and kwargs; the ``identity`` of the processor (see
+        :py:func:`processor_identity`) can be given when it is known already,
+        so that it is not computed again for each sample"""
+        if identity is None:
+            identity = processor_identity(processor)
+        digest = hashlib.blake2b(digest_size=20)
+        digest.update(identity.encode('utf-8'))
+        digest.update(b'\0')
+        _update_value(digest, data)
+        _update_value(digest, kwargs or {})
+        return digest.hexdigest()
+
+    def _path(self, key, extension):
+        return os.path.join(self.directory, key[:2], key[2:] + extension)
+
+    def fetch(self, key):
+        """Returns whether the output with the given key is cached, and the
+        output. Arrays are returned as read-only memory maps."""
+        for extension in ('.npy', '.pkl'):
+            path = self._path(key, extension)
+            try:
+                if extension == '.npy':
+                    import numpy
+                    output = numpy.load(path, mmap_mode='r')
+                else:
+                    with open(path, 'rb') as f:
+                        output = pickle.load(f)
+            except (OSError, EOFError, ValueError, pickle.UnpicklingError):
+                continue
+            # marks the output as recently used
+            try:
+                os.utime(path)
+            except OSError:
+                pass
+            self.hits += 1
+            return True, output
+        self.misses += 1
+        return False, None
+
+    def store(self, key, output):
+        """Stores the given output under the given key; outputs that cannot be
+        pickled (such as generators) are not stored"""
+        try:
+            import numpy
+            is_array = isinstance(output, numpy.ndarray) and \
+                output.dtype != object
+        except ImportError:
+            is_array = False
+        path = self._path(key, '.npy' if is_array else '.pkl')
+        directory = os.path.dirname(path)
+        os.makedirs(directory, exist_ok=True)
+        with tempfile.NamedTemporaryFile(dir=directory, delete=False) as f:
+            try:
+                if is_array:
+                    numpy.save(f, output, allow_pickle=False)
+                else:
+                    pickle.dump(output, f, protocol=4)
+            except Exception as e:
+                logger.debug("Not caching the output `%s': %s", key, e)
+                f.close()
+                os.remove(f.name)
+                return False
+            temporary = f.name
+        os.replace(temporary, path)
+        self._grow(os.path.getsize(path))
+        return True
+
+    def size(self):
+        """Returns the total size of the cached outputs in bytes"""
+        total = 0
+        for path, stat in self._files():
+            total += stat.st_size
+        return total
+
+    def _files(self):
+        for root, _, files in os.walk(self.directory):
+            for name in files:
+                path = os.path.join(root, name)
+                try:
+                    yield path, os.stat(path)
+                except OSError:
+                    pass
+
+    def _grow(self, size):
+        with self._lock:
+            if self._size is None:
+                self._size = self.size()
+            else:
+                self._size += size
+            if self._size <= self.max_size:
+                return
+            # removes the least recently used outputs down to 90% of the limit
+            files = sorted(self._files(), key=lambda f: f[1].st_mtime)
+            self._size = sum(stat.st_size for _, stat in files)
+            for path, stat in files:
+                if self._size <= 0.9 * self.max_size:
+                    break
+                try:
+                    os.remove(path)
+                except OSError:
+                    continue
+                self._size -= stat.st_size
+
+
+class CachedProcessor(object):
+    """Wraps a processor, so that its outputs are taken from a
+    :py:class:`ResultCache` when it was run on the same data before.
+
+    The processor must be deterministic, i.e., its output may only depend on
+    its identity (see :py:func:`processor_identity`), its input and its
+    kwargs. The identity is computed once, when the first sample is processed,
+    so the processor must not be changed afterwards. Cached arrays are
+    returned as read-only memory maps.
+
+    Attributes
+    ----------
+    processor : callable
+        The wrapped processor.
+    cache : ResultCache
+        The cache of its outputs.
+    """
+
+    def __init__(self, processor, cache=None):
+        """Initialization
+
+        Parameters
+        ----------
+        processor : callable
+            The processor to wrap.
+        cache : :py:class:`ResultCache` or :py:class:`str`, optional
+            The cache, or its directory.
+        """
+        if not isinstance(cache, ResultCache):
+            cache = ResultCache(cache)
+        self.processor = processor
+        self.cache = cache
+        self.__name__ = getattr(processor, '__name__', type(processor).__name__)
+        self._identity = None
+
+    @property
+    def cache_identity(self):
+        # e.g., pickling a processor holding a model is expensive
+        if self._identity is None:
+            self._identity = processor_identity(self.processor)
+        return self._identity
+
+    def __call__(self, data, **kwargs):
+        """Returns the cached output of the processor for the data, or runs
+        the processor and caches its output.
+
+        Parameters
+        ----------
+        data : object
+            The data that needs to be processed.
+        **kwargs
+            Any kwargs are passed to the processor, and are part of the key.
+
+        Returns
+        -------
+        object
+            The output of the processor.
+        """
+        key = self.cache.key(self.processor, data, kwargs, self.cache_identity)
+        found, output = self.cache.fetch(key)
+        if found:
+            return output
+        output = self.processor(data, **kwargs)
+        self.cache.store(key, output)
+        return output
+
+    def process_batch(self, samples, **kwargs):
+        """Returns the cached outputs of the processor for the given samples,
+        running the processor only on the samples that are not cached, with
+        :py:func:`bob.extension.processors.apply_batch`.
+
+        Parameters
+        ----------
+        samples : iterable
+            The samples that need to be processed.
+        **kwargs
+            Any kwargs are passed to the processor, and are part of the keys.
+
+        Returns
+        -------
+        list
+            The output of each sample.
+        """
+        samples = list(samples)
+        identity = self.cache_identity
+        keys = [self.cache.key(self.processor, sample, kwargs, identity)
+                for sample in samples]
+        outputs, missing = [], []
+        for index, key in enumerate(keys):
+            found, output = self.cache.fetch(key)
+            outputs.append(output)
+            if not found:
+                missing.append(index)
+        if missing:
+            computed = apply_batch(self.processor,
+                                   [samples[i] for i in missing], **kwargs)
+            for index, output in zip(missing, computed):
+                self.cache.store(keys[index], output)
+                outputs[index] = output
+        return outputs
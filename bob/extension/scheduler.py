@@ -0,0 +1,178 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Builds the extensions of a package concurrently, respecting their
+dependencies, with a single limit on the number of compiler processes"""
+
+import os
+import threading
+import concurrent.futures
+import logging
+
+logger = logging.getLogger(__name__)
+
+
+def job_limit(jobs=None):
+  """Returns the maximum number of compiler and linker processes to run at
+  once.
+
+  Parameters:
+
+    jobs : int or None
+      The number of jobs, e.g., from the ``--parallel`` option of
+      ``build_ext``. If not given, the ``BOB_BUILD_PARALLEL`` environment
+      variable is used, and the number of CPU cores if that is not set either.
+
+  Returns:
+
+    int: The number of jobs, which is at least 1
+  """
+
+  if jobs is None or jobs is True:
+    jobs = os.environ.get('BOB_BUILD_PARALLEL') or os.cpu_count() or 1
+  try:
+    jobs = int(jobs)
+  except ValueError:
+    raise ValueError("BOB_BUILD_PARALLEL must be an integer, not `%s'" % jobs)
+  return max(jobs, 1)
+
+
+class JobServer(object):
+  """A pool of ``limit`` job tokens shared by all concurrent builds.
+
+  Every compiler or linker call holds one token, see :py:meth:`wrap`, and
+  builds that run their own parallel build tool (such as CMake for
+  :py:class:`bob.extension.Library`) hold several tokens at once.
+  """
+
+  def __init__(self, limit):
+    self.limit = limit
+    self.available = limit
+    self.condition = threading.Condition()
+
+  def acquire(self, count=1):
+    """Blocks until ``count`` tokens (but at most :py:attr:`limit`) are
+    available, and returns the number of acquired tokens"""
+
+    count = max(1, min(count, self.limit))
+    with self.condition:
+      while self.available < count:
+        self.condition.wait()
+      self.available -= count
+    return count
+
+  def release(self, count=1):
+    """Returns ``count`` tokens to the pool"""
+
+    with self.condition:
+      self.available += count
+      self.condition.notify_all()
+
+  def wrap(self, function):
+    """Returns a version of ``function`` that holds one token while running,
+    e.g., for :py:meth:`distutils.ccompiler.CCompiler.spawn`"""
+
+    def _wrapped(*args, **kwargs):
+      self.acquire()
+      try:
+        return function(*args, **kwargs)
+      finally:
+        self.release()
+    return _wrapped
+
+
+def parallel_compile(compiler, workers, sources, output_dir=None, macros=None, include_dirs=None, debug=0, extra_preargs=None, extra_postargs=None, depends=None):
+  """Compiles the given ``sources`` with up to ``workers`` threads.
+
+  This function has the signature of
+  :py:meth:`distutils.ccompiler.CCompiler.compile` after the ``compiler`` and
+  ``workers`` arguments, and it replaces that method of ``compiler``. The
+  number of concurrent compiler processes is limited by the
+  :py:class:`JobServer` that wraps the ``spawn`` method of ``compiler``.
+
+  Raises:
+
+    distutils.errors.CompileError: The first error of any of the sources, after
+    all other sources have been compiled
+  """
+
+  # those lines are copied from distutils.ccompiler.CCompiler directly
+  macros, objects, extra_postargs, pp_opts, build = compiler._setup_compile(output_dir, macros, include_dirs, sources, depends, extra_postargs)
+  cc_args = compiler._get_cc_args(pp_opts, debug, extra_preargs)
+
+  def _single_compile(obj):
+    src, ext = build[obj]
+    compiler._compile(obj, src, ext, cc_args, extra_postargs, pp_opts)
+
+  todo = [obj for obj in objects if obj in build]
+  if workers <= 1 or len(todo) <= 1:
+    for obj in todo:
+      _single_compile(obj)
+  else:
+    with concurrent.futures.ThreadPoolExecutor(min(workers, len(todo))) as executor:
+      futures = [executor.submit(_single_compile, obj) for obj in todo]
+    for future in futures:
+      future.result()
+
+  return objects
+
+
+def run_graph(tasks, dependencies, run, workers):
+  """Runs ``run(task)`` for all ``tasks`` in up to ``workers`` threads, where
+  each task starts only after all of its ``dependencies`` have succeeded.
+
+  Tasks are started in the given order as soon as they are ready. When a task
+  fails, no further tasks are started; the running tasks are completed and the
+  error of the first failed task is raised.
+
+  Parameters:
+
+    tasks : [object]
+      The tasks to run, e.g., the extensions to build
+
+    dependencies : callable
+      Returns the list of tasks that the given task depends on; dependencies
+      that are not in ``tasks`` are ignored
+
+    run : callable
+      The function that runs a single task
+
+    workers : int
+      The number of tasks to run concurrently
+
+  Raises:
+
+    RuntimeError: If the dependencies contain a cycle
+  """
+
+  waiting = dict((task, set(d for d in dependencies(task) if d in tasks and d is not task)) for task in tasks)
+  pending = list(tasks)
+  running = {}
+  errors = []
+
+  with concurrent.futures.ThreadPoolExecutor(max(1, workers)) as executor:
+    while True:
+      if not errors:
+        for task in [t for t in pending if not waiting[t]]:
+          pending.remove(task)
+          running[executor.submit(run, task)] = task
+      if not running:
+        break
+
+      finished, _ = concurrent.futures.wait(running, return_when=concurrent.futures.FIRST_COMPLETED)
+      for future in finished:
+        task = running.pop(future)
+        error = future.exception()
+        if error is not None:
+          logger.error("Building `%s' failed: %s", getattr(task, 'name', task), error)
+          errors.append(error)
+          continue
+        for remaining in waiting.values():
+          remaining.discard(task)
+
+  if errors:
+    if pending:
+      logger.error("Not building %s due to the previous error(s)", ', '.join("`%s'" % getattr(t, 'name', t) for t in pending))
+    raise errors[0]
+  if pending:
+    raise RuntimeError("Cyclic dependencies between %s" % ', '.join("`%s'" % getattr(t, 'name', t) for t in pending))
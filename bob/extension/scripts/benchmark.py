@@ -0,0 +1,87 @@
+"""Runs the native benchmarks of the libraries of packages built with
+``BOB_BUILD_BENCHMARKS``.
+"""
+from ..benchmark import find_benchmarks, run_benchmark, format_results
+from .click_helper import verbosity_option
+import os
+import json
+import logging
+import click
+
+logger = logging.getLogger(__name__)
+
+
+@click.command(epilog='''\b
+Examples:
+
+  $ BOB_BUILD_BENCHMARKS=1 buildout
+  $ bob benchmark bob.example.library
+  $ bob benchmark -s 16,1048576 -f reverse --json results.json bob.example.library
+''')
+@click.argument('packages', nargs=-1, required=True)
+@click.option('-s', '--sizes', help='The comma-separated sizes to run each '
+              'kernel with [default: 16,256,4096,65536,1048576].')
+@click.option('-t', '--min-time', type=float,
+              help='The minimum time of each repetition in seconds '
+              '[default: 0.1].')
+@click.option('-w', '--warmup', type=float,
+              help='The time to run each kernel before measuring it in '
+              'seconds [default: 0.05].')
+@click.option('-r', '--repetitions', type=int,
+              help='The number of repetitions [default: 5].')
+@click.option('-c', '--cpu', type=int,
+              help='The CPU to pin the benchmarks to, -1 to not pin them '
+              '[default: the current CPU].')
+@click.option('-f', '--filter', 'kernel_filter',
+              help='Only runs the kernels whose name contains this text.')
+@click.option('--json', 'json_file', type=click.Path(dir_okay=False),
+              help='Writes the results as JSON to this file, - for the '
+              'standard output.')
+@verbosity_option()
+def benchmark(packages, sizes, min_time, warmup, repetitions, cpu,
+              kernel_filter, json_file, **kwargs):
+    """Benchmarks the C++ kernels of the libraries of PACKAGES, without Python.
+
+    Each of PACKAGES is either the name of a package, a directory or a
+    benchmark executable. The kernels are registered in the ``benchmarks`` of
+    a ``bob.extension.Library`` with ``bob.extension/benchmark.h``, which are
+    only built when ``BOB_BUILD_BENCHMARKS=1`` is set during the build.
+    """
+    executables = []
+    for package in packages:
+        if os.path.isfile(package) and os.access(package, os.X_OK):
+            executables.append(package)
+            continue
+        found = find_benchmarks(package)
+        if not found:
+            raise click.ClickException(
+                "No benchmarks were found for `{}'; build it with "
+                "BOB_BUILD_BENCHMARKS=1".format(package))
+        executables.extend(found)
+
+    if sizes:
+        try:
+            sizes = [int(s) for s in sizes.split(',')]
+        except ValueError:
+            raise click.BadParameter('expected comma-separated integers',
+                                     param_hint='--sizes')
+
+    all_results = []
+    for executable in executables:
+        try:
+            results = run_benchmark(
+                executable, sizes=sizes, min_time=min_time, warmup=warmup,
+                repetitions=repetitions, cpu=cpu, filter=kernel_filter)
+        except RuntimeError as e:
+            raise click.ClickException(str(e))
+        results['executable'] = executable
+        all_results.append(results)
+        if json_file is None:
+            click.echo(format_results(results))
+
+    if json_file == '-':
+        click.echo(json.dumps(all_results, indent=2))
+    elif json_file is not None:
+        with open(json_file, 'w') as f:
+            json.dump(all_results, f, indent=2)
+        logger.info("Wrote the results to `%s'", json_file)
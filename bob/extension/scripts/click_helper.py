@@ -1,6 +1,11 @@
 from ..log import set_verbosity_level
 from ..config import load, mod_to_context, resource_keys
+from ..entry_points import entry_points, entry_point_index, index_file
+import os
+import sys
+import json
 import time
+import tempfile
 import click
 import logging
 import traceback
@@ -353,14 +358,49 @@ class AliasedGroup(click.Group):
   Basically just implements get_command that is used by click to choose the
   comamnd based on the name.
 
+  If an ``entry_point_group`` is given, the commands registered in that group
+  (e.g., ``bob.cli``) are taken from the :py:mod:`bob.extension.entry_points`
+  index and only imported when they are run; their short help for ``--help``
+  is cached, so that listing the commands does not import them either.
+  Commands that cannot be imported are replaced by a command that shows the
+  error, as with :py:func:`click_plugins.with_plugins`.
+
   Example
   -------
   To enable prefix aliasing of commands for a given group,
   just set ``cls=AliasedGroup`` parameter in click.group decorator.
   '''
 
-  def get_command(self, ctx, cmd_name):
+  def __init__(self, name=None, commands=None, entry_point_group=None,
+               **attrs):
+    super(AliasedGroup, self).__init__(name, commands, **attrs)
+    self.entry_point_group = entry_point_group
+    self._plugins = None
+
+  def plugins(self):
+    """Returns the entry points of the commands that are not loaded yet"""
+    if self._plugins is None:
+      self._plugins = {}
+      if self.entry_point_group is not None:
+        for entry in entry_points(self.entry_point_group):
+          self._plugins.setdefault(entry.name, entry)
+    return {name: entry for name, entry in self._plugins.items()
+            if name not in self.commands}
+
+  def list_commands(self, ctx):
+    return sorted(set(self.commands) | set(self.plugins()))
+
+  def _command(self, ctx, cmd_name):
     rv = click.Group.get_command(self, ctx, cmd_name)
+    if rv is None:
+      entry = self.plugins().get(cmd_name)
+      if entry is not None:
+        rv = _load_plugin(entry)
+        self.add_command(rv, cmd_name)
+    return rv
+
+  def get_command(self, ctx, cmd_name):
+    rv = self._command(ctx, cmd_name)
     if rv is not None:
       return rv
     matches = [x for x in self.list_commands(ctx)
@@ -368,9 +408,124 @@ class AliasedGroup(click.Group):
     if not matches:
       return None
     elif len(matches) == 1:
-      return click.Group.get_command(self, ctx, matches[0])
+      return self._command(ctx, matches[0])
     ctx.fail('Too many matches: %s' % ', '.join(sorted(matches)))
 
+  def format_commands(self, ctx, formatter):
+    plugins = self.plugins()
+    cache = _PluginHelp() if plugins else None
+    commands = []
+    for name in self.list_commands(ctx):
+      if name in plugins:
+        cached = cache.get(plugins[name])
+        if cached is not None:
+          if not cached['hidden']:
+            commands.append((name, cached['help']))
+          continue
+      cmd = self._command(ctx, name)
+      if cmd is None:
+        continue
+      if name in plugins:
+        cache.set(plugins[name], cmd)
+      if not cmd.hidden:
+        commands.append((name, cmd.get_short_help_str(_MAX_SHORT_HELP)))
+    if cache is not None:
+      cache.save()
+    if commands:
+      limit = formatter.width - 6 - max(len(name) for name, _ in commands)
+      with formatter.section('Commands'):
+        formatter.write_dl([(name, _truncate(help, limit))
+                            for name, help in commands])
+
+
+_MAX_SHORT_HELP = 1000
+
+
+def _truncate(text, limit):
+  """Shortens the short help to the width of the terminal, like click"""
+  if len(text) <= limit:
+    return text
+  return text[:max(limit - 3, 0)].rstrip() + '...'
+
+
+def _load_plugin(entry):
+  """Loads the command of the given entry point, or returns a command that
+  shows why it cannot be loaded"""
+  try:
+    return entry.load()
+  except Exception:
+    from click_plugins.core import BrokenCommand
+    return BrokenCommand(entry.name)
+
+
+class _PluginHelp(object):
+  """The short help of the commands of entry points, which is valid as long as
+  the environment (see :py:func:`bob.extension.entry_points.environment_key`),
+  the module of the entry point and the module of the command were not
+  modified"""
+
+  def __init__(self):
+    self.filename = index_file()
+    if self.filename is not None:
+      # next to the entry point index, which is specific to the environment
+      self.filename = os.path.splitext(self.filename)[0] + '.cli_help.json'
+    self.key = entry_point_index().key
+    self.entries = {}
+    self.modified = False
+    if self.filename is not None and os.path.exists(self.filename):
+      try:
+        with open(self.filename) as f:
+          self.entries = json.load(f)
+      except (ValueError, OSError):
+        self.entries = {}
+
+  @staticmethod
+  def _stat(filename):
+    try:
+      stat = os.stat(filename)
+      return [stat.st_mtime_ns, stat.st_size]
+    except (OSError, TypeError):
+      return None
+
+  def get(self, entry):
+    cached = self.entries.get(entry.value)
+    if not isinstance(cached, dict) or cached.get('key') != self.key or \
+        any(self._stat(f) != stat for f, stat in cached['files']):
+      return None
+    return cached
+
+  def set(self, entry, cmd):
+    if cmd.__class__.__name__ == 'BrokenCommand':
+      return
+    modules = [entry.module_name, getattr(cmd.callback, '__module__', None)]
+    files = []
+    for name in sorted(set(m for m in modules if m is not None)):
+      filename = getattr(sys.modules.get(name), '__file__', None)
+      stat = self._stat(filename)
+      if stat is None:
+        return
+      files.append([filename, stat])
+    self.entries[entry.value] = {
+        'key': self.key,
+        'files': files,
+        'help': cmd.get_short_help_str(_MAX_SHORT_HELP),
+        'hidden': cmd.hidden,
+    }
+    self.modified = True
+
+  def save(self):
+    if self.filename is None or not self.modified:
+      return
+    directory = os.path.dirname(self.filename)
+    try:
+      os.makedirs(directory, exist_ok=True)
+      with tempfile.NamedTemporaryFile('w', dir=directory, delete=False) as f:
+        json.dump(self.entries, f)
+      os.replace(f.name, self.filename)
+    except OSError as e:
+      logger.debug("Cannot write the command help cache `%s': %s",
+                   self.filename, e)
+
 
 def log_parameters(logger_handle, ignore=tuple()):
   """Logs the click parameters with the logging module.
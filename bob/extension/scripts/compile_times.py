@@ -0,0 +1,45 @@
+"""Reports the compile times recorded with ``BOB_BUILD_TIMES``.
+"""
+from ..compile_times import times_directory, report, format_report, \
+    DEFAULT_TIMES_DIRECTORY
+from .click_helper import verbosity_option
+import os
+import json
+import logging
+import click
+
+logger = logging.getLogger(__name__)
+
+
+@click.command(epilog='''\b
+Examples:
+
+  $ BOB_BUILD_TIMES=1 buildout
+  $ bob compile-times
+  $ bob compile-times -n 5 build/compile_times
+''')
+@click.argument('directory', required=False)
+@click.option('-n', '--top', default=20, show_default=True,
+              help='The number of translation units, headers and templates '
+              'to report.')
+@click.option('--json', 'as_json', is_flag=True,
+              help='Writes the report as JSON.')
+@verbosity_option()
+def compile_times(directory, top, as_json, **kwargs):
+    """Reports the most expensive translation units, headers and templates.
+
+    Set ``BOB_BUILD_TIMES=1`` while building a package to record the compile
+    times of all its translation units in DIRECTORY (by default, the directory
+    given by ``BOB_BUILD_TIMES``, or ``build/compile_times``).
+    """
+    directory = times_directory(directory) or \
+        os.path.realpath(DEFAULT_TIMES_DIRECTORY)
+    if not os.path.isdir(directory):
+        raise click.ClickException(
+            "No compile times were recorded in `{}'".format(directory))
+    logger.info("Reading the compile times in `%s'", directory)
+    result = report(directory, top)
+    if as_json:
+        click.echo(json.dumps(result, indent=2))
+    else:
+        click.echo(format_report(result))
@@ -7,11 +7,13 @@ The latter option is mostly useful to generate a dot graph for all Bob packages.
 
 The output is written to the given ``--output-file``, writing either the specified intermediate ``--dot-file``, or a temporary file.
 When the ``--plot-external-dependencies`` is selected, also external (Python-)dependencies will be plotted as well, in red ellipses.
+
+With ``--from-metadata``, the dependencies are read from the installed package metadata without importing any package, and the C++ externals are cached across runs.
+The ``--build-order`` writes the packages (within ``--limit-packages``) in layers, one layer per line, where each layer only depends on the previous ones, so that the packages of each layer can be rebuilt in parallel.
 """
 
 from __future__ import print_function
 import subprocess
-import pkg_resources
 import tempfile, os
 
 import argparse
@@ -27,6 +29,9 @@ def main(command_line_options = None):
   parser.add_argument("--plot-external-dependencies", '-X', action='store_true', help = "Include external dependencies into the plot?")
   parser.add_argument("--rank-base-tools-same", '-R', action = 'store_true', help = "Set the rank of packages bob.extension, bob.core and bob.blitz at the same size")
   parser.add_argument("--vertical", '-V', action = 'store_true', help = "Display the dot graph in vertical direction")
+  parser.add_argument("--from-metadata", '-M', action = 'store_true', help = "Read the dependencies from the package metadata without importing the packages")
+  parser.add_argument("--build-order", '-B', help = "Write the build order of the packages to the given file, one layer of packages per line ('-' for the standard output)")
+  parser.add_argument("--no-plot", '-N', action = 'store_true', help = "Do not call dot, e.g., when only the --build-order is needed")
   parser.add_argument("--verbose", '-v', action = 'store_true', help = "Print more information")
 
   args = parser.parse_args(command_line_options)
@@ -51,6 +56,7 @@ def main(command_line_options = None):
     if p not in dependencies:
       if args.verbose:
         print("Checking %s" % p)
+      import pkg_resources
       deps = pkg_resources.require(p)
       dependencies[p] = [d.key for d in deps[1:]]
       if args.plot_external_dependencies and p.startswith(args.limit_packages):
@@ -66,14 +72,21 @@ def main(command_line_options = None):
         has_parents.add(d)
         _add_recursive(d)
 
-  for package in packages:
-    _add_recursive(package)
-
-  # prune dependencies
-  pruned_dependencies = {}
-  for package in dependencies:
-    indirect_dependencies = set(d for i in [dependencies[dep] for dep in dependencies[package] if dep in dependencies] for d in i)
-    pruned_dependencies[package] = [dep for dep in dependencies[package] if dep not in indirect_dependencies]
+  if args.from_metadata:
+    from ..dependencies import dependency_graph
+    dependencies, cpp_dependencies = dependency_graph(packages, args.limit_packages if args.plot_external_dependencies else ())
+    for package in list(cpp_dependencies):
+      cpp_dependencies[package] = [dep for dep in cpp_dependencies[package] if not dep.startswith(args.limit_packages)]
+    has_parents.update(dep for deps in dependencies.values() for dep in deps)
+  else:
+    for package in packages:
+      _add_recursive(package)
+
+  # prune dependencies; the metadata only lists the direct requirements, so
+  # the dependencies through other packages are resolved first
+  from ..dependencies import transitive_closure, transitive_reduction
+  all_dependencies = transitive_closure(dependencies)
+  pruned_dependencies = transitive_reduction(dependencies)
 
   # split all dependencies that are from bob (i.e., that belong to the --limit-packages) or not
   bob = set(package for package in pruned_dependencies if package.startswith(args.limit_packages))
@@ -84,12 +97,29 @@ def main(command_line_options = None):
   if args.plot_external_dependencies:
     pruned_cpp_dependencies = {}
     for package in cpp_dependencies:
-      indirect_dependencies = set(d for i in [cpp_dependencies[dep] for dep in dependencies[package] if dep in dependencies and dep in cpp_dependencies] for d in i)
+      indirect_dependencies = set(d for i in [cpp_dependencies[dep] for dep in all_dependencies[package] if dep in cpp_dependencies] for d in i)
       pruned_cpp_dependencies[package] = [dep for dep in cpp_dependencies[package] if dep not in indirect_dependencies]
 
     cpp = set(dep for package in bob for dep in pruned_cpp_dependencies[package])
 
 
+  # write the build order of the bob packages
+  if args.build_order is not None:
+    from ..dependencies import build_order
+    layers = build_order(dependencies, bob)
+    if args.build_order == '-':
+      for layer in layers:
+        print(" ".join(layer))
+    else:
+      with open(args.build_order, 'w') as f:
+        for layer in layers:
+          f.write(" ".join(layer) + "\n")
+      if args.verbose:
+        print("Wrote the build order to %s" % args.build_order)
+
+  if args.no_plot:
+    return
+
   # function to return a name for the package that can serve as a dot variable
   def _n(p):
     return p.replace(".", "_").replace("-","_").replace("+","X")
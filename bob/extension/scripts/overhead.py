@@ -0,0 +1,99 @@
+"""Measures the overhead of Python bindings, and flags regressions.
+"""
+from ..overhead import run_suite, baseline_file, load_baseline, \
+    save_baseline, compare, format_results, ENTRY_POINT_GROUP
+from ..entry_points import entry_points
+from .click_helper import verbosity_option
+import json
+import logging
+import click
+
+logger = logging.getLogger(__name__)
+
+
+@click.command(epilog='''\b
+Examples:
+
+  $ bob overhead bob.example.extension
+  $ bob overhead -s 1,4096 --threshold 0.05 bob.example.library
+  $ bob overhead --save-baseline
+''')
+@click.argument('suites', nargs=-1)
+@click.option('-s', '--sizes', default='1,16,256,4096,65536',
+              show_default=True, help='The comma-separated sizes to run the '
+              'cases with arguments with.')
+@click.option('-t', '--min-time', default=0.05, show_default=True,
+              help='The minimum time of each repetition in seconds.')
+@click.option('-r', '--repetitions', default=5, show_default=True,
+              help='The number of repetitions.')
+@click.option('-T', '--threshold', default=0.1, show_default=True,
+              help='The relative slowdown that is flagged as a regression.')
+@click.option('-b', '--baseline', 'baseline_directory',
+              type=click.Path(file_okay=False),
+              help='The directory of the baselines [default: '
+              'BOB_OVERHEAD_BASELINES or ~/.cache/bob.extension/baselines].')
+@click.option('--save-baseline', 'store_baseline', is_flag=True,
+              help='Stores the results as the new baselines.')
+@click.option('--native/--no-native', default=True, show_default=True,
+              help='Also runs the native benchmarks of the libraries of the '
+              'packages, see `bob benchmark`.')
+@click.option('--json', 'json_file', type=click.Path(dir_okay=False),
+              help='Writes the results as JSON to this file, - for the '
+              'standard output.')
+@verbosity_option()
+@click.pass_context
+def overhead(ctx, suites, sizes, min_time, repetitions, threshold,
+             baseline_directory, store_baseline, native, json_file, **kwargs):
+    """Measures the overhead of the Python bindings of packages.
+
+    Each of SUITES is the name of a package that registers its benchmark
+    cases in the ``bob.overhead`` entry points, or a ``module:function``
+    returning the cases; by default, all registered suites are run. The
+    results are compared with the stored baselines; the command fails when a
+    case became slower than the baseline by more than the threshold. Without
+    a baseline of this machine, the results are stored as the baseline.
+    """
+    if not suites:
+        suites = sorted(e.name for e in entry_points(ENTRY_POINT_GROUP))
+        if not suites:
+            raise click.ClickException(
+                "No suites are registered in the `{}' entry points".format(
+                    ENTRY_POINT_GROUP))
+    try:
+        sizes = [int(s) for s in sizes.split(',')]
+    except ValueError:
+        raise click.BadParameter('expected comma-separated integers',
+                                 param_hint='--sizes')
+
+    all_results, regressions = [], 0
+    for suite in suites:
+        try:
+            results = run_suite(suite, sizes, min_time, repetitions, native)
+        except (ValueError, ImportError, RuntimeError) as e:
+            raise click.ClickException(str(e))
+        filename = baseline_file(suite, baseline_directory, results['machine'])
+        baseline = None if store_baseline else load_baseline(filename)
+        comparison = None
+        if baseline is None:
+            save_baseline(results, filename)
+            logger.info("Stored the baseline in `%s'", filename)
+        else:
+            try:
+                comparison = compare(results, baseline, threshold)
+            except ValueError as e:
+                raise click.ClickException(str(e))
+            results['comparison'] = comparison
+            regressions += sum(c['regression'] for c in comparison)
+        all_results.append(results)
+        if json_file != '-':
+            click.echo(format_results(results, comparison))
+
+    if json_file == '-':
+        click.echo(json.dumps(all_results, indent=2))
+    elif json_file is not None:
+        with open(json_file, 'w') as f:
+            json.dump(all_results, f, indent=2)
+    if regressions:
+        logger.error("%d case(s) became slower than the baseline", regressions)
+        ctx.exit(1)
+
@@ -0,0 +1,161 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Controls and reports the symbols exported by a :py:class:`bob.extension.Library`.
+
+By default, every function of a shared library is exported, including all
+inline functions and template instantiations (e.g., of blitz and boost) that
+it uses. This inflates the dynamic symbol table, and slows down loading the
+library with :py:func:`bob.extension.load_bob_library`. Libraries can be
+compiled with hidden visibility, exporting only what is marked with the
+macros of ``bob.extension/export.h``, or with a version script that exports
+only the symbols matching a list of patterns.
+"""
+
+import os
+import sys
+import subprocess
+import logging
+
+from .utils import find_executable
+
+logger = logging.getLogger(__name__)
+
+# the symbols the compiler generates for a C++ class, which should be exported
+# together with it
+_CLASS_SYMBOLS = ('vtable for ', 'VTT for ', 'typeinfo for ', 'typeinfo name for ', 'non-virtual thunk to ', 'virtual thunk to ')
+
+# nm symbol types of vague linkage, i.e., inline functions, template
+# instantiations and their static variables
+_WEAK_TYPES = ('W', 'V', 'u')
+
+
+def visibility(value=None):
+  """Returns the default symbol visibility of libraries, ``'hidden'`` or
+  ``'default'``.
+
+  If ``value`` is not given, the ``BOB_BUILD_VISIBILITY`` environment variable
+  is used, where ``hidden`` (or ``1``) selects the hidden visibility.
+  """
+
+  if value is None:
+    value = os.environ.get('BOB_BUILD_VISIBILITY', '')
+  if value is True or str(value).strip().lower() in ('hidden', '1'):
+    return 'hidden'
+  return 'default'
+
+
+def supports_version_scripts():
+  """Returns whether the linker supports version scripts and ``-Bsymbolic``,
+  i.e., whether libraries are ELF files"""
+
+  return sys.platform.startswith('linux') or sys.platform.startswith('freebsd')
+
+
+def version_script(exports):
+  """Returns a linker version script that exports only the symbols matching
+  the given ``exports``, and hides all others.
+
+  Patterns that contain ``::`` (such as ``bob::core::*``) are matched against
+  demangled C++ names including their argument lists (i.e., use
+  ``bob::core::function*`` rather than ``bob::core::function``), where the
+  virtual tables and type information of matching classes are exported as
+  well. Other patterns are matched against plain C symbols. Patterns may
+  contain the wildcards ``*`` and ``?``.
+  """
+
+  cpp = [p for p in exports if '::' in p]
+  c = [p for p in exports if '::' not in p]
+  lines = ['{', '  global:']
+  if cpp:
+    lines.append('    extern "C++" {')
+    for pattern in cpp:
+      # unquoted patterns are globs, which cannot contain spaces
+      for prefix in ('',) + _CLASS_SYMBOLS:
+        lines.append('      %s;' % (prefix + pattern).replace(' ', '?'))
+    lines.append('    };')
+  for pattern in c:
+    lines.append('    %s;' % pattern)
+  lines += ['  local:', '    *;', '};', '']
+  return '\n'.join(lines)
+
+
+def write_version_script(filename, exports):
+  """Writes the :py:func:`version_script` for the given ``exports`` into
+  ``filename``; an unchanged file is not re-written, so that the library is
+  not re-linked"""
+
+  contents = version_script(exports)
+  if os.path.exists(filename):
+    with open(filename) as f:
+      if f.read() == contents:
+        return filename
+  with open(filename, 'w') as f:
+    f.write(contents)
+  return filename
+
+
+def exported_symbols(library):
+  """Lists the symbols exported by the given shared library with ``nm``.
+
+  Returns:
+
+    [(str, str)]: The (mangled) name and ``nm`` type of each symbol, or
+    ``None`` if ``nm`` is not available
+  """
+
+  nm = find_executable('nm')
+  if not nm:
+    return None
+  if sys.platform == 'darwin':
+    command = nm[:1] + ['-g', '-U', '-P', library]
+  else:
+    command = nm[:1] + ['-D', '--defined-only', '-P', library]
+  try:
+    output = subprocess.check_output(command, stderr=subprocess.DEVNULL).decode('utf-8', 'replace')
+  except (OSError, subprocess.CalledProcessError):
+    return None
+  symbols = []
+  for line in output.splitlines():
+    fields = line.split()
+    if len(fields) >= 2:
+      symbols.append((fields[0], fields[1]))
+  return symbols
+
+
+def symbol_counts(library):
+  """Counts the symbols exported by the given shared library.
+
+  Returns:
+
+    dict: The number of ``exported`` symbols, and how many of them are
+    ``weak``, i.e., inline functions or template instantiations, which usually
+    do not need to be exported; ``None`` if the symbols cannot be listed
+  """
+
+  symbols = exported_symbols(library)
+  if symbols is None:
+    return None
+  return {
+      'exported': len(symbols),
+      'weak': sum(1 for _, kind in symbols if kind in _WEAK_TYPES),
+      }
+
+
+def report_symbols(name, library):
+  """Logs the number of symbols exported by the given library, and warns when
+  most of them are inline functions or template instantiations
+
+  Returns:
+
+    dict: The :py:func:`symbol_counts`
+  """
+
+  counts = symbol_counts(library)
+  if counts is None:
+    return None
+  logger.info("Library `%s' exports %d symbols, %d of them weak", name, counts['exported'], counts['weak'])
+  if counts['weak'] > 1000 and counts['weak'] * 2 > counts['exported']:
+    logger.warning("Library `%s' exports %d inline functions and template instantiations; "
+        "consider building it with `visibility = 'hidden'` or `exports`, see bob.extension.symbols", name, counts['weak'])
+  return counts
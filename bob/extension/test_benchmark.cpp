@@ -0,0 +1,27 @@
+/**
+ * @file bob/extension/test_benchmark.cpp
+ *
+ * @brief Benchmarks registered with bob.extension/benchmark.h, see
+ * test_benchmark.py
+ *
+ * Copyright (C) 2026 Idiap Research Institute, Martigny, Switzerland
+ */
+
+#include <bob.extension/benchmark.h>
+
+#include <vector>
+#include <numeric>
+
+BOB_BENCHMARK(sum){
+  std::vector<double> data(state.size(), 1.);
+  while (state.keep_running()){
+    bob::extension::benchmark::do_not_optimize(std::accumulate(data.begin(), data.end(), 0.));
+  }
+  state.set_items(state.size());
+}
+
+BOB_BENCHMARK(empty){
+  while (state.keep_running()){
+    bob::extension::benchmark::do_not_optimize(state);
+  }
+}
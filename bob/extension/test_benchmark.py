@@ -0,0 +1,95 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+'''Tests the native benchmarks of libraries'''
+
+import os
+import json
+import shutil
+import tempfile
+import pkg_resources
+
+import nose.tools
+from click.testing import CliRunner
+
+import bob.extension
+from .benchmark import benchmarks_enabled, find_benchmarks, run_benchmark, format_results
+from .scripts.benchmark import benchmark
+
+
+def test_benchmarks_enabled():
+  old = os.environ.get('BOB_BUILD_BENCHMARKS')
+  try:
+    os.environ['BOB_BUILD_BENCHMARKS'] = '0'
+    assert not benchmarks_enabled()
+    os.environ['BOB_BUILD_BENCHMARKS'] = '1'
+    assert benchmarks_enabled()
+    assert not benchmarks_enabled(False)
+  finally:
+    if old is None: del os.environ['BOB_BUILD_BENCHMARKS']
+    else: os.environ['BOB_BUILD_BENCHMARKS'] = old
+
+
+def test_library_benchmark():
+  old_dir = os.getcwd()
+  old = os.environ.get('BOB_BUILD_BENCHMARKS')
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    for name in ('test_documentation.cpp', 'test_benchmark.cpp'):
+      shutil.copyfile(pkg_resources.resource_filename(__name__, name), os.path.join(temp_dir, name))
+    os.chdir(temp_dir)
+    os.environ['BOB_BUILD_BENCHMARKS'] = '1'
+    library = bob.extension.Library(
+      name = 'target.bob_benchmark_test',
+      sources = ['test_documentation.cpp'],
+      include_dirs = [pkg_resources.resource_filename(__name__, 'include')],
+      version = '1.0.0',
+      benchmarks = ['test_benchmark.cpp'],
+    )
+    compile_dir = os.path.join(temp_dir, 'build', 'lib')
+    os.makedirs(compile_dir)
+    with open(os.devnull, 'w') as devnull:
+      library.compile(compile_dir, stdout=devnull)
+
+    # the executable is built next to the library
+    target_dir = os.path.join(compile_dir, 'target')
+    executables = find_benchmarks(target_dir)
+    nose.tools.eq_(executables, [os.path.join(target_dir, 'bob_benchmark_test_benchmark')])
+
+    results = run_benchmark(executables[0], sizes=[16, 1024], min_time=0.001, warmup=0.001, repetitions=2)
+    nose.tools.eq_(results['library'], 'bob_benchmark_test')
+    nose.tools.eq_([(r['kernel'], r['size']) for r in results['results']],
+                   [('sum', 16), ('sum', 1024), ('empty', 16), ('empty', 1024)])
+    for result in results['results']:
+      assert result['iterations'] >= 1
+      ns = result['ns_per_iteration']
+      assert 0 <= ns['min'] <= ns['median']
+      for counter in results['counters']:
+        assert result[counter + '_per_iteration'] >= 0
+    assert 'items_per_second' in results['results'][0]
+    assert 'items_per_second' not in results['results'][2]
+    assert 'sum' in format_results(results)
+
+    # the command runs the benchmarks of packages, directories and executables
+    runner = CliRunner()
+    result = runner.invoke(benchmark, [target_dir, '-s', '8', '-t', '0.001', '-w', '0.001', '-r', '1', '-f', 'sum', '--json', '-'])
+    nose.tools.eq_(result.exit_code, 0, result.output)
+    output = json.loads(result.output)
+    nose.tools.eq_([r['kernel'] for r in output[0]['results']], ['sum'])
+    result = runner.invoke(benchmark, [os.path.join(temp_dir, 'no_such_directory')])
+    assert result.exit_code != 0
+    assert 'BOB_BUILD_BENCHMARKS' in result.output
+
+    # the executable is linked with the library and its libraries
+    generator = bob.extension.CMakeListsGenerator('test', ['test_documentation.cpp'], target_dir, libraries=['m'], benchmark_sources=['test_benchmark.cpp'])
+    generator.generate(temp_dir, temp_dir)
+    with open(os.path.join(temp_dir, 'CMakeLists.txt')) as f:
+      lines = f.read().splitlines()
+    assert 'add_executable(${PROJECT_NAME}_benchmark ' in lines
+    assert 'target_link_libraries(${PROJECT_NAME}_benchmark PRIVATE ${PROJECT_NAME} m)' in lines
+    assert os.path.exists(os.path.join(temp_dir, 'benchmark_main.cpp'))
+  finally:
+    os.chdir(old_dir)
+    if old is None: del os.environ['BOB_BUILD_BENCHMARKS']
+    else: os.environ['BOB_BUILD_BENCHMARKS'] = old
+    shutil.rmtree(temp_dir)
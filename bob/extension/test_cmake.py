@@ -46,17 +46,21 @@ def test_cmake_list():
   lines = [line.rstrip() for line in open(os.path.join(temp_dir, "CMakeLists.txt"))]
 
   # check that all elements are properly written in the file
+  assert lines[_find(lines, 'cmake_minimum_required')] == 'cmake_minimum_required(VERSION %s)' % bob.extension.cmake.CMAKE_MINIMUM_VERSION
   assert lines[_find(lines, 'project')] == 'project(bob_cmake_test)'
-  assert lines[_find(lines, 'include')] == 'include_directories(/usr/include/test)'
-  assert lines[_find(lines, 'include_directories(SYSTEM')] == 'include_directories(SYSTEM /usr/include/test_system)'
-  assert lines[_find(lines, 'link')] == 'link_directories(/usr/include/test)'
-  assert lines[_find(lines, 'add')] == 'add_definitions(-DTEST=MACRO)'
+  assert lines[_find(lines, 'target_include_directories(${PROJECT_NAME} PRIVATE')] == 'target_include_directories(${PROJECT_NAME} PRIVATE /usr/include/test)'
+  assert lines[_find(lines, 'target_include_directories(${PROJECT_NAME} SYSTEM')] == 'target_include_directories(${PROJECT_NAME} SYSTEM PRIVATE /usr/include/test_system)'
+  assert lines[_find(lines, 'target_link_directories')] == 'target_link_directories(${PROJECT_NAME} PRIVATE /usr/include/test)'
+  assert lines[_find(lines, 'target_compile_definitions')] == 'target_compile_definitions(${PROJECT_NAME} PRIVATE TEST=MACRO)'
+
+  # no directory-scoped settings are written any more
+  assert not [l for l in lines if l.startswith(('include_directories', 'link_directories', 'add_definitions'))]
 
   index = _find(lines, 'add_library')
   assert lines[index+1].find('cmake_test.cpp') >= 0
 
-  index = _find(lines, 'set_target_properties')
-  assert lines[index+1].find('test_target') >= 0
+  assert lines[_find(lines, 'set_target_properties(${PROJECT_NAME} PROPERTIES LIBRARY_OUTPUT_DIRECTORY')].find('test_target') >= 0
+  assert not [l for l in lines if l.find('COMPILER_LAUNCHER') >= 0]
 
   assert lines[_find(lines, 'target_link_libraries')].find('some_library') >= 0
 
@@ -64,6 +68,67 @@ def test_cmake_list():
   shutil.rmtree(temp_dir)
 
 
+def test_cmake_list_launcher():
+  # checks that the compiler launcher is set as a target property
+
+  generator = bob.extension.CMakeListsGenerator(
+    name = 'bob_cmake_test',
+    sources = ['cmake_test.cpp'],
+    target_directory = "test_target",
+    compiler_launcher = '/usr/bin/ccache',
+  )
+
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    generator.generate(temp_dir, temp_dir)
+    lines = [line.rstrip() for line in open(os.path.join(temp_dir, "CMakeLists.txt"))]
+    assert lines[_find(lines, 'set_target_properties(${PROJECT_NAME} PROPERTIES C_COMPILER_LAUNCHER')] == \
+        'set_target_properties(${PROJECT_NAME} PROPERTIES C_COMPILER_LAUNCHER /usr/bin/ccache CXX_COMPILER_LAUNCHER /usr/bin/ccache)'
+  finally:
+    shutil.rmtree(temp_dir)
+
+
+def test_cmake_generator():
+  # checks the selection of the generator and the removal of stale caches
+  old = os.environ.get('BOB_BUILD_GENERATOR')
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    os.environ['BOB_BUILD_GENERATOR'] = 'Unix Makefiles'
+    with open(os.path.join(temp_dir, 'CMakeCache.txt'), 'w') as f:
+      f.write('CMAKE_GENERATOR:INTERNAL=Unix Makefiles\n')
+    generator, program = bob.extension.cmake_generator(temp_dir)
+    assert generator == 'Unix Makefiles'
+    assert os.path.exists(os.path.join(temp_dir, 'CMakeCache.txt'))
+
+    with open(os.path.join(temp_dir, 'CMakeCache.txt'), 'w') as f:
+      f.write('CMAKE_GENERATOR:INTERNAL=Ninja\n')
+    os.makedirs(os.path.join(temp_dir, 'CMakeFiles'))
+    generator, program = bob.extension.cmake_generator(temp_dir)
+    assert not os.path.exists(os.path.join(temp_dir, 'CMakeCache.txt'))
+    assert not os.path.exists(os.path.join(temp_dir, 'CMakeFiles'))
+
+    # make is only the build program of the Makefile generators
+    os.environ['BOB_BUILD_GENERATOR'] = 'Xcode'
+    assert bob.extension.cmake_generator() == ('Xcode', None)
+
+  finally:
+    if old is None: del os.environ['BOB_BUILD_GENERATOR']
+    else: os.environ['BOB_BUILD_GENERATOR'] = old
+    shutil.rmtree(temp_dir)
+
+
+def test_compiler_launcher():
+  old = os.environ.get('BOB_BUILD_LAUNCHER')
+  try:
+    os.environ['BOB_BUILD_LAUNCHER'] = 'none'
+    assert bob.extension.compiler_launcher() is None
+    os.environ['BOB_BUILD_LAUNCHER'] = '/some/where/ccache'
+    assert bob.extension.compiler_launcher() == '/some/where/ccache'
+  finally:
+    if old is None: del os.environ['BOB_BUILD_LAUNCHER']
+    else: os.environ['BOB_BUILD_LAUNCHER'] = old
+
+
 def test_library():
   old_dir = os.getcwd()
   temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
@@ -0,0 +1,163 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Tests for the recording of compile times
+"""
+
+import os
+import json
+import shutil
+import tempfile
+import pkg_resources
+
+import nose.tools
+from click.testing import CliRunner
+
+import bob.extension
+from .testing import temporary_directory, build_extensions
+from .compile_times import times_directory, parse_gcc_report, \
+    parse_time_trace, load_records, report, format_report, \
+    DEFAULT_TIMES_DIRECTORY
+from .scripts.compile_times import compile_times
+
+
+_GCC_OUTPUT = '''\
+. /usr/include/c++/12/vector
+.. /usr/include/c++/12/bits/stl_algobase.h
+. /usr/include/c++/12/vector
+test.cpp: In function 'int f()':
+test.cpp:3:7: warning: unused variable 'x' [-Wunused-variable]
+Multiple include guards may be useful for:
+/usr/include/features-time64.h
+include/local.h
+
+Time variable                                   usr           sys          wall           GGC
+ phase setup                        :   0.01 (  2%)   0.00 (  0%)   0.00 (  0%)  1576k (  5%)
+ phase parsing                      :   0.24 ( 59%)   0.15 ( 71%)   0.41 ( 65%)    22M ( 71%)
+ |name lookup                       :   0.05 ( 12%)   0.04 ( 19%)   0.11 ( 17%)  1729k (  5%)
+ template instantiation             :   0.06 ( 15%)   0.05 ( 24%)   0.08 ( 13%)  8709k ( 26%)
+ TOTAL                              :   0.41          0.21          0.63           32M
+'''
+
+
+def test_options():
+  nose.tools.eq_(times_directory('0'), None)
+  nose.tools.eq_(times_directory('1'), os.path.realpath(DEFAULT_TIMES_DIRECTORY))
+  nose.tools.eq_(times_directory('/tmp/times'), os.path.realpath('/tmp/times'))
+
+
+def test_parse_gcc_report():
+  diagnostics, phases, headers = parse_gcc_report(_GCC_OUTPUT)
+  nose.tools.eq_(diagnostics, "test.cpp: In function 'int f()':\ntest.cpp:3:7: warning: unused variable 'x' [-Wunused-variable]\n")
+  nose.tools.eq_(phases, {'phase setup': 0.0, 'phase parsing': 0.41, 'name lookup': 0.11, 'template instantiation': 0.08, 'TOTAL': 0.63})
+  nose.tools.eq_(headers, ['/usr/include/c++/12/vector', '/usr/include/c++/12/bits/stl_algobase.h'])
+
+
+def test_report():
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    with open(os.path.join(temp_dir, 'test.json'), 'w') as f:
+      json.dump({'traceEvents': [
+        {'name': 'Source', 'dur': 300000, 'args': {'detail': '/usr/include/boost/python.hpp'}},
+        {'name': 'Source', 'dur': 100000, 'args': {'detail': '/usr/include/vector'}},
+        {'name': 'InstantiateClass', 'dur': 50000, 'args': {'detail': 'std::vector<int>'}},
+        {'name': 'Total Frontend', 'dur': 600000},
+        {'name': 'Total Backend', 'dur': 200000},
+        {'name': 'Total InstantiateClass', 'dur': 50000},
+        ]}, f)
+    phases, headers, templates = parse_time_trace(os.path.join(temp_dir, 'test.json'))
+    nose.tools.eq_(phases, {'Frontend': 0.6, 'Backend': 0.2, 'InstantiateClass': 0.05})
+    nose.tools.eq_(headers, {'/usr/include/boost/python.hpp': 0.3, '/usr/include/vector': 0.1})
+    nose.tools.eq_(templates, {'std::vector<int>': 0.05})
+    os.remove(os.path.join(temp_dir, 'test.json'))
+
+    # a clang and a GCC record
+    records = [
+      {'source': '/src/a.cpp', 'object': '/build/a.o', 'compiler': 'clang', 'wall': 1.0, 'memory': 2**28, 'status': 0, 'phases': phases, 'headers': headers, 'templates': templates},
+      {'source': '/src/b.cpp', 'object': '/build/b.o', 'compiler': 'gcc', 'wall': 2.0, 'memory': None, 'status': 1, 'phases': parse_gcc_report(_GCC_OUTPUT)[1], 'headers': {'/usr/include/vector': None}, 'templates': {}},
+    ]
+    for i, record in enumerate(records):
+      with open(os.path.join(temp_dir, '%d.json' % i), 'w') as f:
+        json.dump(record, f)
+    nose.tools.eq_(len(load_records(temp_dir)), 2)
+
+    result = report(temp_dir)
+    nose.tools.eq_(result['count'], 2)
+    nose.tools.eq_(result['total'], 3.0)
+    nose.tools.eq_([u['source'] for u in result['units']], ['/src/b.cpp', '/src/a.cpp'])
+    nose.tools.eq_(result['units'][1]['frontend'], 0.6)
+    nose.tools.eq_(result['units'][1]['templates'], 0.05)
+    nose.tools.eq_(result['units'][0]['frontend'], 0.41)
+    # the header time of GCC is the frontend time of the unit
+    nose.tools.eq_(result['headers'][0], {'header': '/usr/include/vector', 'units': 2, 'time': 0.51})
+    nose.tools.eq_(result['templates'], [{'template': 'std::vector<int>', 'units': 1, 'time': 0.05}])
+    nose.tools.eq_(len(report(temp_dir, top=1)['headers']), 1)
+
+    text = format_report(result)
+    assert '/src/b.cpp (failed)' in text
+    assert 'std::vector<int>' in text
+  finally:
+    shutil.rmtree(temp_dir)
+
+
+def test_timed_extension():
+  old = os.environ.get('BOB_BUILD_TIMES')
+  with temporary_directory(chdir=True) as temp_dir:
+    try:
+      directory = os.path.join(temp_dir, 'times')
+      os.environ['BOB_BUILD_TIMES'] = directory
+      with open(os.path.join(temp_dir, 'times_test.cpp'), 'w') as f:
+        f.write(
+          '#include <Python.h>\n'
+          '#include <vector>\n'
+          'static std::vector<int> values(3);\n'
+          'static struct PyModuleDef module_definition = { PyModuleDef_HEAD_INIT, "times_test", 0, -1, 0 };\n'
+          'PyMODINIT_FUNC PyInit_times_test() { return PyModule_Create(&module_definition); }\n')
+      extension = bob.extension.Extension('times_test', ['times_test.cpp'])
+      cmd = build_extensions(temp_dir, 'times_test', [extension])
+      assert os.path.exists(cmd.get_ext_fullpath('times_test'))
+
+      records = load_records(directory)
+      nose.tools.eq_(len(records), 1)
+      nose.tools.eq_(records[0]['source'], os.path.realpath(os.path.join(temp_dir, 'times_test.cpp')))
+      assert records[0]['wall'] > 0
+      assert records[0]['memory'] > 0
+      nose.tools.eq_(records[0]['status'], 0)
+      if records[0]['compiler'] in ('gcc', 'clang'):
+        assert records[0]['phases']
+        assert any(h.endswith('vector') for h in records[0]['headers'])
+
+      result = CliRunner().invoke(compile_times, [directory, '-n', '3'])
+      nose.tools.eq_(result.exit_code, 0, result.output)
+      assert 'times_test.cpp' in result.output
+      result = CliRunner().invoke(compile_times, [os.path.join(temp_dir, 'missing')])
+      nose.tools.eq_(result.exit_code, 1)
+    finally:
+      if old is None: del os.environ['BOB_BUILD_TIMES']
+      else: os.environ['BOB_BUILD_TIMES'] = old
+
+
+def test_timed_library():
+  old_dir, old = os.getcwd(), os.environ.get('BOB_BUILD_TIMES')
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    directory = os.path.join(temp_dir, 'times')
+    os.environ['BOB_BUILD_TIMES'] = directory
+    shutil.copyfile(pkg_resources.resource_filename(__name__, 'test_documentation.cpp'), os.path.join(temp_dir, 'test_documentation.cpp'))
+    os.chdir(temp_dir)
+    library = bob.extension.Library(
+      name = 'target.bob_cmake_test',
+      sources = ['test_documentation.cpp'],
+      include_dirs = [pkg_resources.resource_filename(__name__, 'include')],
+      version = '3.2.1',
+    )
+    with open(os.devnull, 'w') as devnull:
+      library.compile(os.path.join(temp_dir, 'lib'), stdout=devnull)
+    records = load_records(directory)
+    nose.tools.eq_([os.path.basename(r['source']) for r in records], ['test_documentation.cpp'])
+    assert records[0]['wall'] > 0
+  finally:
+    if old is None: del os.environ['BOB_BUILD_TIMES']
+    else: os.environ['BOB_BUILD_TIMES'] = old
+    os.chdir(old_dir)
+    shutil.rmtree(temp_dir)
@@ -6,6 +6,9 @@
 
 from .config import load, mod_to_context
 import os
+import glob
+import shutil
+import tempfile
 import pkg_resources
 import numpy
 path = pkg_resources.resource_filename('bob.extension', 'data')
@@ -82,3 +85,52 @@ def test_load_resource():
     assert False, 'The code above should have raised an ImportError'
   except ImportError:
     pass
+
+
+EXECUTIONS = []
+
+
+def test_snapshots():
+  old = os.environ.get('BOB_CONFIG_CACHE')
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    os.environ['BOB_CONFIG_CACHE'] = os.path.join(temp_dir, 'cache')
+    config = os.path.join(temp_dir, 'config.py')
+    with open(config, 'w') as f:
+      f.write('import bob.extension.test_config as test\n'
+              'test.EXECUTIONS.append(1)\n'
+              'b = [a, a * 2]\n')
+
+    # the compiled code is cached
+    del EXECUTIONS[:]
+    c = load([config], {'a': 1})
+    assert c.b == [1, 2]
+    assert len(glob.glob(os.path.join(temp_dir, 'cache', '*', '*.code'))) == 1
+
+    # the snapshot is taken for the same file and incoming context
+    for context, b, executions in (({'a': 1}, [1, 2], 2),
+                                   ({'a': 1}, [1, 2], 2),
+                                   ({'a': 2}, [2, 4], 3)):
+      c = load([config], context, snapshot=True)
+      assert c.b == b
+      assert c.test.__name__ == 'bob.extension.test_config'
+      assert len(EXECUTIONS) == executions, EXECUTIONS
+
+    # a modified file is executed again
+    with open(config, 'a') as f:
+      f.write('d = 4\n')
+    c = load([config], {'a': 1}, snapshot=True)
+    assert c.d == 4
+    assert len(EXECUTIONS) == 4
+
+    # contexts that cannot be pickled are not snapshot
+    with open(config, 'a') as f:
+      f.write('f = lambda: 0\n')
+    for _ in range(2):
+      load([config], {'a': 1}, snapshot=True)
+    assert len(EXECUTIONS) == 6
+    assert mod_to_context(load([config], {'a': 1}))['b'] == [1, 2]
+  finally:
+    if old is None: del os.environ['BOB_CONFIG_CACHE']
+    else: os.environ['BOB_CONFIG_CACHE'] = old
+    shutil.rmtree(temp_dir)
@@ -0,0 +1,112 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+'''Tests for the import-free dependency graph and the build order'''
+
+import os
+import sys
+import shutil
+import tempfile
+
+import nose.tools
+
+from .dependencies import dependency_graph, build_order, normalize, ExternalsCache, \
+    transitive_closure, transitive_reduction
+
+
+def test_graph():
+  dependencies, externals = dependency_graph(['bob.extension'])
+  assert 'click' in dependencies['bob.extension']
+  assert 'click' in dependencies['click-plugins']
+  nose.tools.eq_(externals, {})
+  nose.tools.eq_(normalize('Click_Plugins'), 'click-plugins')
+  nose.tools.eq_(dependency_graph(['bob.extension.not_installed'])[0], {'bob.extension.not-installed': []})
+
+
+def test_build_order():
+  dependencies = {
+      'bob.io.base': ['bob.core', 'numpy'],
+      'bob.core': ['bob.blitz'],
+      'bob.blitz': ['bob.extension', 'numpy'],
+      'bob.extension': ['setuptools'],
+      'bob.ip.base': ['bob.core', 'bob.io.base'],
+      'bob.math': ['bob.core'],
+      'numpy': [],
+      'setuptools': [],
+  }
+  nose.tools.eq_(build_order(dependencies)[0], ['numpy', 'setuptools'])
+  layers = build_order(dependencies, [p for p in dependencies if p.startswith('bob')])
+  nose.tools.eq_(layers, [['bob.extension'], ['bob.blitz'], ['bob.core'], ['bob.io.base', 'bob.math'], ['bob.ip.base']])
+
+  # dependencies through packages that are not ordered are kept
+  nose.tools.eq_(build_order(dependencies, ['bob.ip.base', 'bob.blitz']), [['bob.blitz'], ['bob.ip.base']])
+
+  dependencies['bob.extension'].append('bob.io.base')
+  nose.tools.assert_raises(ValueError, build_order, dependencies)
+
+
+def test_transitive_reduction():
+  # the direct requirements, as read from the metadata
+  direct = {
+      'bob.ip.base': ['bob.io.base', 'bob.core', 'bob.extension'],
+      'bob.io.base': ['bob.core', 'numpy'],
+      'bob.core': ['bob.blitz', 'bob.extension'],
+      'bob.blitz': ['bob.extension', 'numpy'],
+      'bob.extension': ['setuptools'],
+      'numpy': [],
+      'setuptools': [],
+  }
+  closure = transitive_closure(direct)
+  nose.tools.eq_(sorted(closure['bob.core']), ['bob.blitz', 'bob.extension', 'numpy', 'setuptools'])
+  nose.tools.eq_(closure['numpy'], [])
+
+  # the transitive closure, as returned by pkg_resources.require, is pruned
+  # to the same graph
+  expected = {
+      'bob.ip.base': ['bob.io.base'],
+      'bob.io.base': ['bob.core'],
+      'bob.core': ['bob.blitz'],
+      'bob.blitz': ['bob.extension', 'numpy'],
+      'bob.extension': ['setuptools'],
+      'numpy': [],
+      'setuptools': [],
+  }
+  nose.tools.eq_(transitive_reduction(direct), expected)
+  nose.tools.eq_(transitive_reduction(closure), expected)
+
+  # cycles do not hang
+  cyclic = {'a': ['b'], 'b': ['a', 'c'], 'c': []}
+  nose.tools.eq_(sorted(transitive_closure(cyclic)['a']), ['b', 'c'])
+  nose.tools.eq_(transitive_reduction(cyclic)['a'], ['b'])
+
+
+def test_externals():
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  sys.path.insert(0, temp_dir)
+  try:
+    package = os.path.join(temp_dir, 'bob_extension_test_externals')
+    os.makedirs(package)
+    open(os.path.join(package, '__init__.py'), 'w').close()
+    version = os.path.join(package, 'version.py')
+    with open(version, 'w') as f:
+      f.write("externals = {'Boost': '1.0', 'Blitz++': '0.10'}\n")
+
+    cache_file = os.path.join(temp_dir, 'externals.json')
+    cache = ExternalsCache(cache_file)
+    nose.tools.eq_(cache.externals('bob_extension_test_externals'), ['Blitz++', 'Boost'])
+    cache.save()
+    # the package was not imported by this process
+    assert 'bob_extension_test_externals' not in sys.modules
+
+    # the cached externals are used until the version module changes
+    cache = ExternalsCache(cache_file)
+    cache.entries['bob_extension_test_externals']['externals'] = ['cached']
+    nose.tools.eq_(cache.externals('bob_extension_test_externals'), ['cached'])
+    with open(version, 'w') as f:
+      f.write("externals = {'HDF5': '1.10.0'}\n")
+    os.utime(version, ns=(0, 0))
+    nose.tools.eq_(cache.externals('bob_extension_test_externals'), ['HDF5'])
+    nose.tools.eq_(cache.externals('bob_extension_test_no_such_package'), [])
+  finally:
+    sys.path.remove(temp_dir)
+    shutil.rmtree(temp_dir)
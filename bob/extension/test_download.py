@@ -1,7 +1,15 @@
 import pkg_resources
 import os
 import shutil
-from .download import download_and_unzip
+import hashlib
+import tempfile
+import io
+import bz2
+import tarfile
+import zipfile
+import threading
+from http.server import HTTPServer, BaseHTTPRequestHandler
+from .download import download_and_unzip, cached_download
 
 
 def test_download():
@@ -9,10 +17,10 @@ def test_download():
     def download(filename):
         download_and_unzip("http://www.idiap.ch/software/bob/databases/latest/mnist.tar.bz2", filename)
         uncompressed_filename = os.path.join(os.path.dirname(filename), "data")
-        
+
         assert os.path.exists(filename)
         assert os.path.exists(uncompressed_filename)
-        
+
         os.unlink(filename)
         shutil.rmtree(uncompressed_filename)
 
@@ -20,3 +28,188 @@ def test_download():
     filename = pkg_resources.resource_filename(__name__, 'data/mnist.tar.bz2')
     download(filename)
 
+
+CONTENT = os.urandom(300000)
+SHA256 = hashlib.sha256(CONTENT).hexdigest()
+FILES = {'/file': CONTENT}
+
+
+class _Handler(BaseHTTPRequestHandler):
+    """Serves the FILES with range requests, and breaks off the first
+    response after ``fail_after`` bytes"""
+
+    requests = []
+    fail_after = None
+
+    def do_GET(self):
+        start = 0
+        if self.headers.get('Range'):
+            start = int(self.headers['Range'].split('=')[1].split('-')[0])
+        _Handler.requests.append((self.path, start))
+        if self.path not in FILES:
+            self.send_error(404)
+            return
+        body = FILES[self.path][start:]
+        self.send_response(206 if start else 200)
+        self.send_header('Content-Length', str(len(body)))
+        self.end_headers()
+        if _Handler.fail_after is not None:
+            body = body[:_Handler.fail_after]
+            _Handler.fail_after = None
+        self.wfile.write(body)
+
+    def log_message(self, *args):
+        pass
+
+
+def _serve():
+    server = HTTPServer(('127.0.0.1', 0), _Handler)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    return server, 'http://127.0.0.1:%d' % server.server_address[1]
+
+
+def test_cached_download():
+    temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+    server, url = _serve()
+    try:
+        cache = os.path.join(temp_dir, 'cache')
+
+        # the broken download is resumed where it stopped
+        _Handler.requests = []
+        _Handler.fail_after = 100000
+        path = cached_download([url + '/missing', url + '/file'], SHA256, cache)
+        with open(path, 'rb') as f:
+            assert f.read() == CONTENT
+        assert ('/file', 100000) in _Handler.requests
+        assert _Handler.requests.count(('/file', 0)) == 1
+
+        # concurrent jobs share the cached file
+        cache = os.path.join(temp_dir, 'shared')
+        _Handler.requests = []
+        filenames = [os.path.join(temp_dir, 'out%d.bin' % i) for i in range(4)]
+        threads = [threading.Thread(target=download_and_unzip,
+                                    args=(url + '/file', f),
+                                    kwargs={'sha256': SHA256,
+                                            'cache_directory': cache})
+                   for f in filenames]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        assert len(_Handler.requests) == 1
+        for f in filenames:
+            with open(f, 'rb') as f:
+                assert f.read() == CONTENT
+        path = cached_download(url + '/file', SHA256.upper(), cache)
+        assert len(_Handler.requests) == 1
+
+        # the cached file is read-only, and changes of the copies do not
+        # change it
+        assert not os.access(path, os.W_OK) or os.geteuid() == 0
+        with open(filenames[0], 'r+b') as f:
+            f.write(b'changed')
+        with open(path, 'rb') as f:
+            assert f.read() == CONTENT
+
+        # files without a hash might change, so they are not cached
+        try:
+            cached_download(url + '/file', None, cache)
+            assert False, 'a file without a hash was cached'
+        except ValueError:
+            pass
+        for _ in range(2):
+            download_and_unzip(url + '/file', filenames[0],
+                               cache_directory=cache)
+        assert len(_Handler.requests) == 3
+
+        # files with another hash are not accepted
+        try:
+            cached_download(url + '/file', '0' * 64, cache, retries=1)
+            assert False, 'the hash was not verified'
+        except RuntimeError:
+            pass
+        assert not os.path.exists(os.path.join(cache, 'sha256', '00', '0' * 64))
+    finally:
+        server.shutdown()
+        server.server_close()
+        shutil.rmtree(temp_dir)
+
+
+def _archives():
+    """Creates archives of the same two files in all supported formats"""
+    members = {'data/a.bin': os.urandom(200000), 'data/sub/b.txt': b'b' * 1000}
+    for name, mode in (('/data.tar.gz', 'w:gz'), ('/data.tar.bz2', 'w:bz2'),
+                       ('/data.tar.xz', 'w:xz'), ('/data.tar', 'w')):
+        f = io.BytesIO()
+        with tarfile.open(fileobj=f, mode=mode) as t:
+            for member, data in members.items():
+                info = tarfile.TarInfo(member)
+                info.size = len(data)
+                t.addfile(info, io.BytesIO(data))
+        FILES[name] = f.getvalue()
+    f = io.BytesIO()
+    with zipfile.ZipFile(f, 'w', zipfile.ZIP_DEFLATED) as z:
+        for member, data in members.items():
+            z.writestr(member, data)
+    FILES['/data.zip'] = f.getvalue()
+    FILES['/single.bin.bz2'] = bz2.compress(members['data/a.bin'])
+    return members
+
+
+def test_streaming_extraction():
+    members = _archives()
+    temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+    server, url = _serve()
+    try:
+        for cache in (os.path.join(temp_dir, 'cache'), '0'):
+            for name in sorted(FILES):
+                if name == '/file':
+                    continue
+                for stream in (True, False):
+                    target = os.path.join(
+                        temp_dir, 'out-%d-%s' % (stream, len(cache)))
+                    os.makedirs(target, exist_ok=True)
+                    filename = os.path.join(target, name[1:])
+                    # the first download is broken off, and resumed
+                    _Handler.fail_after = len(FILES[name]) // 2
+                    download_and_unzip(
+                        url + name, filename,
+                        sha256=hashlib.sha256(FILES[name]).hexdigest(),
+                        cache_directory=cache, stream=stream, threads=2)
+                    with open(filename, 'rb') as f:
+                        assert f.read() == FILES[name]
+                    if name == '/single.bin.bz2':
+                        extracted = {'single.bin': members['data/a.bin']}
+                    else:
+                        extracted = members
+                    for member, data in extracted.items():
+                        with open(os.path.join(target, member), 'rb') as f:
+                            assert f.read() == data, (name, member)
+                    shutil.rmtree(target)
+    finally:
+        server.shutdown()
+        server.server_close()
+        shutil.rmtree(temp_dir)
+
+
+def test_rejected_extraction():
+    _archives()
+    temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+    server, url = _serve()
+    try:
+        for cache in (os.path.join(temp_dir, 'cache'), '0'):
+            target = os.path.join(temp_dir, 'out-%s' % len(cache))
+            os.makedirs(target)
+            # files with another hash are not extracted at all
+            try:
+                download_and_unzip(url + '/data.tar.gz',
+                                   os.path.join(target, 'data.tar.gz'),
+                                   sha256='0' * 64, cache_directory=cache)
+                assert False, 'the hash was not verified'
+            except RuntimeError:
+                pass
+            assert os.listdir(target) == []
+    finally:
+        server.shutdown()
+        server.server_close()
+        shutil.rmtree(temp_dir)
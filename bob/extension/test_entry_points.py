@@ -0,0 +1,155 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+'''Tests for the entry point index and the lazy loading of commands'''
+
+import os
+import sys
+import json
+import time
+import shutil
+import tempfile
+
+import click
+import nose.tools
+from click.testing import CliRunner
+
+from . import entry_points as entry_points_module
+from .entry_points import EntryPoint, EntryPointIndex, entry_points
+from .scripts.click_helper import AliasedGroup
+
+
+PLUGIN = '''
+from bob_extension_test_command import hello
+'''
+
+COMMAND = '''
+import click
+
+@click.command()
+def hello():
+  """%s Only the first sentence is shown."""
+  click.echo('hello')
+'''
+
+
+def test_entry_points():
+  entries = {e.name: e for e in entry_points('bob.extension.test_config_load')}
+  assert 'basic_config' in entries
+  entry = entries['resource2']
+  nose.tools.eq_(entry.module_name, 'bob.extension.data.resource_config2')
+  nose.tools.eq_(entry.attrs, ('b',))
+  nose.tools.eq_(entry.dist, 'bob.extension')
+  nose.tools.eq_(entries['basic_config'].attrs, ())
+  nose.tools.eq_(entry.load(), 2)
+  nose.tools.eq_(entry_points('bob.extension.no_such_group'), [])
+
+
+def test_persistence():
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  scan = entry_points_module.scan
+  try:
+    filename = os.path.join(temp_dir, 'index.json')
+    index = EntryPointIndex(filename)
+    assert os.path.exists(filename)
+
+    # the persisted index is used as long as the environment did not change
+    def fail():
+      raise AssertionError('the distributions were scanned again')
+    entry_points_module.scan = fail
+    nose.tools.eq_(EntryPointIndex(filename).groups, index.groups)
+
+    # otherwise, the distributions are scanned again
+    with open(filename) as f:
+      persisted = json.load(f)
+    persisted['key'] = 'outdated'
+    persisted['groups'] = {}
+    with open(filename, 'w') as f:
+      json.dump(persisted, f)
+    entry_points_module.scan = scan
+    nose.tools.eq_(EntryPointIndex(filename).groups, index.groups)
+
+    # each environment has its own index
+    assert os.path.basename(entry_points_module.DEFAULT_INDEX_FILE).startswith('entry_points-')
+  finally:
+    entry_points_module.scan = scan
+    shutil.rmtree(temp_dir)
+
+
+def _group():
+  @click.group(cls=AliasedGroup)
+  def main():
+    pass
+  main._plugins = {
+      'hello': EntryPoint('hello', 'bob_extension_test_plugin:hello', 'test', 'test'),
+      'broken': EntryPoint('broken', 'bob_extension_no_such_module:cmd', 'test', 'test'),
+  }
+  return main
+
+
+def test_lazy_commands():
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  old_index = os.environ.get('BOB_ENTRY_POINT_INDEX')
+  os.environ['BOB_ENTRY_POINT_INDEX'] = os.path.join(temp_dir, 'index.json')
+  sys.path.insert(0, temp_dir)
+  try:
+    with open(os.path.join(temp_dir, 'bob_extension_test_plugin.py'), 'w') as f:
+      f.write(PLUGIN)
+    command = os.path.join(temp_dir, 'bob_extension_test_command.py')
+    with open(command, 'w') as f:
+      f.write(COMMAND % 'Says hello.')
+
+    runner = CliRunner()
+    result = runner.invoke(_group(), ['--help'])
+    nose.tools.eq_(result.exit_code, 0, result.output)
+    assert 'Says hello.' in result.output
+    assert 'broken' in result.output
+    assert 'bob_extension_test_plugin' in sys.modules
+
+    # the help of the commands is cached, so they are not imported again
+    del sys.modules['bob_extension_test_plugin']
+    result = runner.invoke(_group(), ['--help'])
+    assert 'Says hello.' in result.output
+    assert 'bob_extension_test_plugin' not in sys.modules
+
+    # until the module of the command changes
+    del sys.modules['bob_extension_test_command']
+    with open(command, 'w') as f:
+      f.write(COMMAND % 'Greets.')
+    os.utime(command, (time.time() + 10, time.time() + 10))
+    result = runner.invoke(_group(), ['--help'])
+    assert 'Greets.' in result.output
+
+    # commands are loaded when they are run, also by prefix
+    result = runner.invoke(_group(), ['hel'])
+    nose.tools.eq_(result.output, 'hello\n')
+
+    # commands that cannot be loaded show the error
+    result = runner.invoke(_group(), ['broken'])
+    assert result.exit_code != 0
+    assert 'bob_extension_no_such_module' in result.output
+  finally:
+    sys.path.remove(temp_dir)
+    sys.modules.pop('bob_extension_test_plugin', None)
+    sys.modules.pop('bob_extension_test_command', None)
+    if old_index is None:
+      del os.environ['BOB_ENTRY_POINT_INDEX']
+    else:
+      os.environ['BOB_ENTRY_POINT_INDEX'] = old_index
+    shutil.rmtree(temp_dir)
+
+
+def test_light_imports():
+  import subprocess
+  # setuptools and pkg_resources are only imported to build packages
+  output = subprocess.check_output([sys.executable, '-c',
+      'import sys, bob.extension.scripts.main_cli\n'
+      'print(" ".join(sorted(m for m in sys.modules if m.split(".")[0] in '
+      '("pkg_resources", "setuptools") or m in ("bob.extension.build", '
+      '"bob.extension.pgo", "bob.extension.scheduler"))))'])
+  nose.tools.eq_(output.decode().strip(), '')
+
+  # but the build classes are available from the package
+  import bob.extension
+  assert issubclass(bob.extension.Library, bob.extension.Extension)
+  nose.tools.assert_raises(AttributeError, getattr, bob.extension, 'no_such_name')
@@ -0,0 +1,97 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Tests for the instrumentation of processors
+"""
+
+import os
+import json
+import time
+import shutil
+import tempfile
+from functools import partial
+
+import numpy as np
+import nose.tools
+
+from .instrumentation import Instrumentation, stage_name, output_size
+from .processors import SequentialProcessor, ParallelProcessor
+
+
+def _allocate(data):
+  return np.ones(data, dtype=np.uint8)
+
+
+def _sleep(data, seconds):
+  time.sleep(seconds)
+  return data
+
+
+def _fail(data):
+  raise ValueError(data)
+
+
+def test_names_and_sizes():
+  nose.tools.eq_(stage_name(np.mean), 'mean')
+  nose.tools.eq_(stage_name(partial(_sleep, seconds=1)), '_sleep')
+  nose.tools.eq_(stage_name(SequentialProcessor([np.mean, list])), 'SequentialProcessor(mean, list)')
+  nose.tools.eq_(output_size(np.zeros(10)), 80)
+  nose.tools.eq_(output_size([b'abc', np.zeros(2, dtype=np.uint8)]), 5)
+
+
+def test_sequential():
+  instrumentation = Instrumentation(memory=True)
+  try:
+    processor = SequentialProcessor([_allocate, np.sum], instrumentation=instrumentation)
+    for _ in range(10):
+      nose.tools.eq_(processor(100000), 100000)
+    report = instrumentation.report()
+    nose.tools.eq_([stage['name'] for stage in report], ['0:_allocate', '1:sum'])
+    nose.tools.eq_([stage['calls'] for stage in report], [10, 10])
+    assert report[0]['p50'] <= report[0]['p99'] <= report[0]['max']
+    assert report[0]['allocated'] >= 100000
+    nose.tools.eq_(report[0]['output'], 100000)
+    nose.tools.eq_(report[1]['output'], np.uint64(0).nbytes)
+    assert '0:_allocate' in instrumentation.format_report()
+
+    # exceptions are recorded and re-raised
+    processor = SequentialProcessor([_fail], instrumentation=instrumentation)
+    nose.tools.assert_raises(ValueError, processor, 'error')
+    nose.tools.eq_(instrumentation.report()[-1]['errors'], 1)
+
+    # streams are instrumented as well
+    instrumentation.clear()
+    processor = SequentialProcessor([_allocate], instrumentation=instrumentation)
+    nose.tools.eq_(len(list(processor.stream([1, 2, 3]))), 3)
+    nose.tools.eq_(instrumentation.report()[0]['calls'], 3)
+  finally:
+    instrumentation.close()
+
+
+def test_parallel_and_trace():
+  instrumentation = Instrumentation(samples=5, max_events=8)
+  with ParallelProcessor([partial(_sleep, seconds=0.01), np.mean], mode='process', instrumentation=instrumentation) as processor:
+    for _ in range(6):
+      nose.tools.eq_(list(processor(4)), [4, 4])
+  report = instrumentation.report()
+  nose.tools.eq_([stage['calls'] for stage in report], [6, 6])
+  assert report[0]['p50'] >= 0.01
+  # the latencies are a sample of the calls
+  nose.tools.eq_(len(instrumentation._stages['0:_sleep']['latencies']), 5)
+
+  trace = instrumentation.trace()
+  nose.tools.eq_(len(trace['traceEvents']), 8)
+  event = trace['traceEvents'][0]
+  nose.tools.eq_(event['ph'], 'X')
+  assert event['dur'] >= 10000
+  # the processors ran in the worker processes
+  assert event['pid'] != os.getpid()
+
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    filename = os.path.join(temp_dir, 'trace.json')
+    instrumentation.write_trace(filename)
+    with open(filename) as f:
+      nose.tools.eq_(len(json.load(f)['traceEvents']), 8)
+  finally:
+    shutil.rmtree(temp_dir)
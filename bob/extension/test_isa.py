@@ -0,0 +1,114 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Tests for ISA variants of extensions and libraries
+"""
+
+import os
+import shutil
+import tempfile
+import platform
+import importlib.util
+import pkg_resources
+
+import nose.tools
+
+import bob.extension
+from .testing import temporary_directory, build_extensions
+import bob.extension.isa
+from .isa import isa_variants, isa_variant_path, supported_isa_levels, \
+    best_isa_variant, IsaFinder, ISA_FEATURES
+
+
+def test_options():
+  nose.tools.eq_(isa_variant_path('/lib/bob/core/libbob_core.so', 'x86-64-v3'), '/lib/bob/core/x86-64-v3/libbob_core.so')
+  nose.tools.eq_(isa_variants(False), [])
+  nose.tools.assert_raises(ValueError, isa_variants, 'x86-64-v9')
+  if platform.machine().lower() not in ('x86_64', 'amd64'):
+    nose.tools.eq_(isa_variants(True), [])
+    return
+
+  nose.tools.eq_(isa_variants('x86-64-v4, x86-64-v3'), ['x86-64-v3', 'x86-64-v4'])
+  old = os.environ.get('BOB_BUILD_ISA')
+  try:
+    os.environ['BOB_BUILD_ISA'] = '1'
+    nose.tools.eq_(isa_variants(), ['x86-64-v3', 'x86-64-v4'])
+    os.environ['BOB_BUILD_ISA'] = 'x86-64-v2'
+    nose.tools.eq_(isa_variants(), ['x86-64-v2'])
+    del os.environ['BOB_BUILD_ISA']
+    nose.tools.eq_(isa_variants(), [])
+  finally:
+    if old is not None: os.environ['BOB_BUILD_ISA'] = old
+
+
+def test_supported_levels():
+  if platform.machine().lower() not in ('x86_64', 'amd64'):
+    return
+  features, old = bob.extension.isa._CPU_FEATURES, os.environ.get('BOB_ISA')
+  try:
+    bob.extension.isa._CPU_FEATURES = set(ISA_FEATURES['x86-64-v3'])
+    nose.tools.eq_(supported_isa_levels(), ['x86-64-v3', 'x86-64-v2'])
+    os.environ['BOB_ISA'] = 'x86-64-v2'
+    nose.tools.eq_(supported_isa_levels(), ['x86-64-v2'])
+    os.environ['BOB_ISA'] = 'baseline'
+    nose.tools.eq_(supported_isa_levels(), [])
+  finally:
+    bob.extension.isa._CPU_FEATURES = features
+    if old is None: os.environ.pop('BOB_ISA', None)
+    else: os.environ['BOB_ISA'] = old
+
+
+def test_isa_extension():
+  levels = supported_isa_levels()
+  if not levels:
+    return
+  with temporary_directory(chdir=True) as temp_dir:
+    with open(os.path.join(temp_dir, 'isa_test.cpp'), 'w') as f:
+      f.write(
+        '#include <Python.h>\n'
+        'static struct PyModuleDef module_definition = { PyModuleDef_HEAD_INIT, "isa_test", 0, -1, 0 };\n'
+        'PyMODINIT_FUNC PyInit_isa_test() { return PyModule_Create(&module_definition); }\n')
+    extension = bob.extension.Extension('isa_test', ['isa_test.cpp'], isa_variants=[levels[0]])
+    cmd = build_extensions(temp_dir, 'isa_test', [extension])
+
+    baseline = cmd.get_ext_fullpath('isa_test')
+    variant = isa_variant_path(baseline, levels[0])
+    assert os.path.exists(baseline)
+    assert os.path.exists(variant)
+    assert '-march=%s' % levels[0] not in extension.extra_compile_args
+
+    # the best variant is imported
+    spec = IsaFinder().find_spec('isa_test', [cmd.build_lib])
+    nose.tools.eq_(spec.origin, variant)
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    nose.tools.eq_(module.__file__, variant)
+
+
+def test_isa_library():
+  levels = supported_isa_levels()
+  if not levels:
+    return
+  old_dir = os.getcwd()
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  target_dir = os.path.join(temp_dir, 'build', 'lib', 'target')
+  try:
+    shutil.copyfile(pkg_resources.resource_filename(__name__, 'test_documentation.cpp'), os.path.join(temp_dir, 'test_documentation.cpp'))
+    os.chdir(temp_dir)
+    library = bob.extension.Library(
+      name = 'target.bob_cmake_test',
+      sources = ['test_documentation.cpp'],
+      include_dirs = [pkg_resources.resource_filename(__name__, 'include')],
+      version = '3.2.1',
+      isa_variants = [levels[0]],
+    )
+    os.makedirs(target_dir)
+    with open(os.devnull, 'w') as devnull:
+      library.compile(os.path.join(temp_dir, 'build', 'lib'), stdout=devnull)
+
+    lib_name = bob.extension.get_full_libname('bob_cmake_test', target_dir)
+    assert os.path.exists(lib_name)
+    nose.tools.eq_(best_isa_variant(lib_name), os.path.join(target_dir, levels[0], os.path.basename(lib_name)))
+  finally:
+    os.chdir(old_dir)
+    shutil.rmtree(temp_dir)
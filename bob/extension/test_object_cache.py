@@ -0,0 +1,161 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Tests for the content-addressed object cache
+"""
+
+import os
+import shutil
+import logging
+import tempfile
+import pkg_resources
+
+import nose.tools
+
+import bob.extension
+from .testing import temporary_directory, build_extensions
+from .object_cache import cache_directory, key_arguments, ObjectCache, \
+    DEFAULT_CACHE_DIRECTORY
+
+
+class _Messages(logging.Handler):
+  def __init__(self):
+    logging.Handler.__init__(self)
+    self.messages = []
+  def emit(self, record):
+    self.messages.append(record.getMessage())
+
+
+def _write(filename, contents):
+  with open(filename, 'w') as f:
+    f.write(contents)
+  return filename
+
+
+def _cached_files(directory):
+  return sorted(f for _, _, files in os.walk(directory) for f in files)
+
+
+def test_options():
+  nose.tools.eq_(cache_directory('0'), None)
+  nose.tools.eq_(cache_directory('1'), DEFAULT_CACHE_DIRECTORY)
+  nose.tools.eq_(cache_directory('/tmp/objects'), os.path.realpath('/tmp/objects'))
+  nose.tools.eq_(key_arguments(['-I/a', '-isystem', '/b', '-DX=1', '-O2', '-c', '-MD', '-MF', 'x.d', '-include', 'pch.h']), ['-DX=1', '-O2', '-c', '-MD'])
+
+
+def test_object_key():
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    cache = ObjectCache(os.path.join(temp_dir, 'cache'))
+    for checkout in ('a', 'b'):
+      os.makedirs(os.path.join(temp_dir, checkout, 'include'))
+      _write(os.path.join(temp_dir, checkout, 'include', 'value.h'), '#define VALUE 42\n')
+      _write(os.path.join(temp_dir, checkout, 'test.cpp'), '#include <value.h>\nint value() { return VALUE; }\n')
+    compiler = ['c++', '-O2']
+    key_a = cache.object_key(compiler, ['-I' + os.path.join(temp_dir, 'a', 'include'), '-c'], os.path.join(temp_dir, 'a', 'test.cpp'))
+    key_b = cache.object_key(compiler, ['-I' + os.path.join(temp_dir, 'b', 'include'), '-c'], os.path.join(temp_dir, 'b', 'test.cpp'))
+    # identical code in different checkouts shares objects
+    nose.tools.eq_(key_a, key_b)
+    # but flags, macros and headers matter
+    assert cache.object_key(compiler, ['-I' + os.path.join(temp_dir, 'a', 'include'), '-DNDEBUG', '-c'], os.path.join(temp_dir, 'a', 'test.cpp')) != key_a
+    _write(os.path.join(temp_dir, 'b', 'include', 'value.h'), '#define VALUE 43\n')
+    assert cache.object_key(compiler, ['-I' + os.path.join(temp_dir, 'b', 'include'), '-c'], os.path.join(temp_dir, 'b', 'test.cpp')) != key_a
+    # objects compiled with profiles are not cached
+    assert cache.object_key(compiler, ['-fprofile-use', '-c'], os.path.join(temp_dir, 'a', 'test.cpp')) is None
+
+    # unchanged outputs are not touched
+    output = _write(os.path.join(temp_dir, 'test.o'), 'object')
+    cache.store(key_a, output)
+    os.utime(output, (1000, 1000))
+    assert cache.fetch(key_a, output)
+    nose.tools.eq_(os.path.getmtime(output), 1000)
+    assert cache.fetch(key_a, os.path.join(temp_dir, 'other', 'test.o'))
+    assert not cache.fetch(key_b[::-1], output)
+  finally:
+    shutil.rmtree(temp_dir)
+
+
+def test_link_key():
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    cache = ObjectCache(os.path.join(temp_dir, 'cache'))
+    obj = _write(os.path.join(temp_dir, 'test.o'), 'object')
+    for checkout in ('a', 'b'):
+      os.makedirs(os.path.join(temp_dir, checkout))
+      _write(os.path.join(temp_dir, checkout, 'libcore.so'), 'library')
+    linker = ['c++', '-shared']
+    key_a = cache.link_key(linker, ['-L' + os.path.join(temp_dir, 'a')], [obj], ['core', 'm'])
+    # library directories are not part of the key, only the libraries they contain
+    nose.tools.eq_(cache.link_key(linker, [], [obj], ['core', 'm'], [os.path.join(temp_dir, 'b')]), key_a)
+    assert cache.link_key(linker, ['-L' + os.path.join(temp_dir, 'a')], [obj], ['m']) != key_a
+    # a re-built library is linked again
+    _write(os.path.join(temp_dir, 'a', 'libcore.so'), 'rebuilt library')
+    assert cache.link_key(linker, ['-L' + os.path.join(temp_dir, 'a')], [obj], ['core', 'm']) != key_a
+  finally:
+    shutil.rmtree(temp_dir)
+
+
+def test_cached_extension():
+  old_cache = os.environ.get('BOB_BUILD_CACHE')
+  handler = _Messages()
+  logging.getLogger('bob.extension.object_cache').addHandler(handler)
+  logging.getLogger('bob.extension.object_cache').setLevel(logging.INFO)
+  with temporary_directory(chdir=True) as temp_dir:
+    try:
+      os.environ['BOB_BUILD_CACHE'] = os.path.join(temp_dir, 'cache')
+      _write(os.path.join(temp_dir, 'cache_test.cpp'),
+        '#include <Python.h>\n'
+        'static struct PyModuleDef module_definition = { PyModuleDef_HEAD_INIT, "cache_test", 0, -1, 0 };\n'
+        'PyMODINIT_FUNC PyInit_cache_test() { return PyModule_Create(&module_definition); }\n')
+
+      outputs = []
+      for build in ('first', 'second'):
+        extension = bob.extension.Extension('cache_test', ['cache_test.cpp'])
+        cmd = build_extensions(os.path.join(temp_dir, build), 'cache_test', [extension])
+        outputs.append(cmd.get_ext_fullpath('cache_test'))
+        if build == 'first':
+          nose.tools.eq_(handler.messages, [])
+          nose.tools.eq_(len(_cached_files(os.path.join(temp_dir, 'cache'))), 2)
+
+      # the second build takes the object and the extension from the cache
+      nose.tools.eq_(len(handler.messages), 2)
+      nose.tools.eq_(open(outputs[0], 'rb').read(), open(outputs[1], 'rb').read())
+    finally:
+      logging.getLogger('bob.extension.object_cache').removeHandler(handler)
+      if old_cache is None: del os.environ['BOB_BUILD_CACHE']
+      else: os.environ['BOB_BUILD_CACHE'] = old_cache
+
+
+def test_cached_library():
+  old_dir = os.getcwd()
+  old = dict((k, os.environ.get(k)) for k in ('BOB_BUILD_CACHE', 'BOB_BUILD_LAUNCHER'))
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    os.environ.pop('BOB_BUILD_LAUNCHER', None)
+    os.environ['BOB_BUILD_CACHE'] = os.path.join(temp_dir, 'cache')
+    shutil.copyfile(pkg_resources.resource_filename(__name__, 'test_documentation.cpp'), os.path.join(temp_dir, 'test_documentation.cpp'))
+    os.chdir(temp_dir)
+    library = bob.extension.Library(
+      name = 'target.bob_cmake_test',
+      sources = ['test_documentation.cpp'],
+      include_dirs = [pkg_resources.resource_filename(__name__, 'include')],
+      version = '3.2.1',
+    )
+    with open(os.devnull, 'w') as devnull:
+      library.compile(os.path.join(temp_dir, 'first', 'lib'), stdout=devnull)
+      cached = _cached_files(os.path.join(temp_dir, 'cache'))
+      nose.tools.eq_(len(cached), 1)
+      library.compile(os.path.join(temp_dir, 'second', 'lib'), stdout=devnull)
+    nose.tools.eq_(_cached_files(os.path.join(temp_dir, 'cache')), cached)
+    assert os.path.exists(bob.extension.get_full_libname('bob_cmake_test', os.path.join(temp_dir, 'second', 'lib', 'target')))
+
+    # an unchanged CMakeLists.txt is not re-written
+    generator = bob.extension.CMakeListsGenerator(name='bob_cmake_test', sources=['test_documentation.cpp'], target_directory=temp_dir)
+    assert generator.generate(temp_dir, temp_dir)
+    assert not generator.generate(temp_dir, temp_dir)
+  finally:
+    for k, v in old.items():
+      if v is None: os.environ.pop(k, None)
+      else: os.environ[k] = v
+    os.chdir(old_dir)
+    shutil.rmtree(temp_dir)
@@ -0,0 +1,125 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+'''Tests the benchmarks of the overhead of bindings'''
+
+import os
+import json
+import copy
+import shutil
+import tempfile
+
+import nose.tools
+from click.testing import CliRunner
+
+from .overhead import Case, run_cases, run_suite, suite_cases, compare, \
+    baseline_file, load_baseline, save_baseline, format_results, machine
+from .scripts.overhead import overhead
+
+
+def _cases():
+  return [
+    Case('empty call', dict),
+    Case('len', len, lambda size: (([0] * size,), {})),
+    Case('keywords', sum, lambda size: ((range(size),), {'start': 0})),
+  ]
+
+
+def test_run_cases():
+  results = run_cases(_cases(), sizes=[1, 100], min_time=0.001, repetitions=2)
+  nose.tools.eq_([(r['case'], r['size']) for r in results],
+                 [('empty call', None), ('len', 1), ('len', 100), ('keywords', 1), ('keywords', 100)])
+  for result in results:
+    assert result['iterations'] >= 1
+    ns = result['ns_per_call']
+    assert 0 < ns['min'] <= ns['median']
+  nose.tools.assert_raises(ValueError, suite_cases, 'bob.extension.no_such_suite')
+
+
+def test_compare():
+  results = run_suite('bob.extension.test_overhead:_cases', sizes=[10], min_time=0.001, repetitions=3)
+  assert 'keywords' in format_results(results)
+
+  # the same results are no regression
+  comparison = compare(results, results)
+  nose.tools.eq_(len(comparison), 3)
+  assert not any(c['regression'] for c in comparison)
+
+  # runs that became much slower are, unless they are too noisy
+  baseline = copy.deepcopy(results)
+  for result in baseline['results']:
+    result['ns_per_call'] = {'min': 1., 'median': 1., 'mean': 1., 'stddev': 0.}
+  baseline['results'].append({'case': 'removed', 'size': None, 'ns_per_call': result['ns_per_call']})
+  comparison = compare(results, baseline, threshold=0.1)
+  assert all(c['regression'] for c in comparison)
+  assert 'REGRESSION' in format_results(results, comparison)
+  baseline['results'][0]['ns_per_call']['stddev'] = 1e9
+  assert not compare(results, baseline)[0]['regression']
+
+  # results of other machines are not compared
+  baseline['machine'] = 'other'
+  nose.tools.assert_raises(ValueError, compare, results, baseline)
+
+  # baselines are stored per suite and machine
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    filename = baseline_file('bob.example.extension', temp_dir)
+    nose.tools.eq_(os.path.dirname(filename), temp_dir)
+    assert os.path.basename(filename).startswith('bob.example.extension-')
+    nose.tools.eq_(filename, baseline_file('bob.example.extension', temp_dir, machine()))
+    assert filename != baseline_file('bob.example.extension', temp_dir, 'other')
+    assert load_baseline(filename) is None
+    save_baseline(results, filename)
+    nose.tools.eq_(load_baseline(filename), json.loads(json.dumps(results)))
+    with open(filename, 'w') as f:
+      f.write('{')
+    assert load_baseline(filename) is None
+  finally:
+    shutil.rmtree(temp_dir)
+
+
+def test_overhead_command():
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  old = os.environ.get('BOB_OVERHEAD_BASELINES')
+  os.environ['BOB_OVERHEAD_BASELINES'] = temp_dir
+  try:
+    suite = 'bob.extension.test_overhead:_cases'
+    options = [suite, '-s', '10', '-t', '0.001', '-r', '3']
+    runner = CliRunner()
+
+    # the first run stores the baseline
+    result = runner.invoke(overhead, options)
+    nose.tools.eq_(result.exit_code, 0, result.output)
+    filename = baseline_file(suite)
+    assert os.path.exists(filename)
+
+    # regressions fail the command
+    baseline = load_baseline(filename)
+    for r in baseline['results']:
+      r['ns_per_call'] = {'min': 1., 'median': 1., 'mean': 1., 'stddev': 0.}
+    save_baseline(baseline, filename)
+    result = runner.invoke(overhead, options + ['--json', '-'])
+    nose.tools.eq_(result.exit_code, 1, result.output)
+    output = json.loads(result.output)
+    assert all(c['regression'] for c in output[0]['comparison'])
+
+    # until the baseline is stored again
+    result = runner.invoke(overhead, options + ['--save-baseline'])
+    nose.tools.eq_(result.exit_code, 0, result.output)
+    assert load_baseline(filename)['results'][0]['ns_per_call']['median'] > 1.
+
+    # baselines of other machines are never compared
+    baseline = load_baseline(filename)
+    baseline['machine'] = 'other'
+    save_baseline(baseline, filename)
+    result = runner.invoke(overhead, options)
+    assert result.exit_code != 0
+    assert 'other' in result.output
+
+    result = runner.invoke(overhead, ['bob.extension.no_such_suite'])
+    assert result.exit_code != 0
+    assert 'bob.overhead' in result.output
+  finally:
+    if old is None: del os.environ['BOB_OVERHEAD_BASELINES']
+    else: os.environ['BOB_OVERHEAD_BASELINES'] = old
+    shutil.rmtree(temp_dir)
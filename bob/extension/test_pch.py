@@ -0,0 +1,116 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Tests for precompiled headers
+"""
+
+import os
+import shutil
+import tempfile
+
+import nose.tools
+
+import bob.extension
+from .testing import temporary_directory, build_extensions
+from .pch import precompiled_headers, include_directive, \
+    DEFAULT_PRECOMPILED_HEADERS, DEFAULT_LIBRARY_PRECOMPILED_HEADERS, PCH_HEADER
+
+
+def test_precompiled_headers():
+  nose.tools.eq_(precompiled_headers(True), DEFAULT_PRECOMPILED_HEADERS)
+  nose.tools.eq_(precompiled_headers(True, DEFAULT_LIBRARY_PRECOMPILED_HEADERS), DEFAULT_LIBRARY_PRECOMPILED_HEADERS)
+  nose.tools.eq_(precompiled_headers(False), [])
+  nose.tools.eq_(precompiled_headers('blitz/array.h'), ['blitz/array.h'])
+  old = os.environ.get('BOB_BUILD_PCH')
+  try:
+    os.environ['BOB_BUILD_PCH'] = '1'
+    nose.tools.eq_(precompiled_headers(), DEFAULT_PRECOMPILED_HEADERS)
+    os.environ['BOB_BUILD_PCH'] = '0'
+    nose.tools.eq_(precompiled_headers(), [])
+  finally:
+    if old is None: del os.environ['BOB_BUILD_PCH']
+    else: os.environ['BOB_BUILD_PCH'] = old
+
+  nose.tools.eq_(include_directive('Python.h'), '<Python.h>')
+  nose.tools.eq_(include_directive('<vector>'), '<vector>')
+  nose.tools.eq_(include_directive('"local.h"'), '"local.h"')
+
+
+def test_cmake_list():
+  generator = bob.extension.CMakeListsGenerator(
+    name = 'bob_cmake_test',
+    sources = ['cmake_test.cpp'],
+    target_directory = "test_target",
+    precompiled_headers = ['<vector>', 'blitz/array.h'],
+  )
+
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    generator.generate(temp_dir, temp_dir)
+    lines = [line.rstrip() for line in open(os.path.join(temp_dir, "CMakeLists.txt"))]
+    index = lines.index('  target_precompile_headers(${PROJECT_NAME} PRIVATE "<vector>" "<blitz/array.h>")')
+    nose.tools.eq_(lines[index-1], 'if(NOT CMAKE_VERSION VERSION_LESS 3.16)')
+  finally:
+    shutil.rmtree(temp_dir)
+
+
+def test_shared_precompiled_header():
+  with temporary_directory(chdir=True) as temp_dir:
+    for name in ('first', 'second'):
+      with open(os.path.join(temp_dir, name + '.cpp'), 'w') as f:
+        f.write(
+          '#include <Python.h>\n'
+          '#include <bob.extension/documentation.h>\n'
+          'static struct PyModuleDef module_definition = { PyModuleDef_HEAD_INIT, BOB_EXT_MODULE_NAME, 0, -1, 0 };\n'
+          'PyMODINIT_FUNC BOB_EXT_ENTRY_NAME() { return PyModule_Create(&module_definition); }\n')
+    extensions = [
+      bob.extension.Extension('pch_test.%s' % name, ['%s.cpp' % name], version='1.0.0', precompiled_headers=True)
+      for name in ('first', 'second')
+    ]
+    cmd = build_extensions(temp_dir, 'pch_test', extensions)
+
+    # both extensions share a single precompiled header
+    pch_dirs = os.listdir(os.path.join(temp_dir, 'temp', 'pch'))
+    nose.tools.eq_(len(pch_dirs), 1)
+    files = sorted(os.listdir(os.path.join(temp_dir, 'temp', 'pch', pch_dirs[0])))
+    nose.tools.eq_(files[0], PCH_HEADER)
+    assert files[1] in (PCH_HEADER + '.gch', PCH_HEADER + '.pch')
+    for e in extensions:
+      assert os.path.exists(cmd.get_ext_fullpath(e.name))
+      assert '-include' not in e.extra_compile_args
+
+
+def test_outdated_precompiled_header():
+  import time
+  import subprocess
+  from .pch import precompile, dependencies
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    included = os.path.join(temp_dir, 'include', 'included.h')
+    os.makedirs(os.path.dirname(included))
+    with open(os.path.join(temp_dir, 'include', 'common.h'), 'w') as f:
+      f.write('#include "included.h"\n')
+    with open(included, 'w') as f:
+      f.write('inline int answer() { return 42; }\n')
+
+    calls = []
+    def spawn(command):
+      calls.append(command)
+      subprocess.check_call(command)
+
+    args = ['-I' + os.path.join(temp_dir, 'include')]
+    header = precompile(['g++'], ['common.h'], args, temp_dir, spawn)
+    nose.tools.eq_(len(calls), 1)
+    assert included in dependencies(header + '.gch.d')
+
+    # unchanged headers re-use the precompiled header
+    nose.tools.eq_(precompile(['g++'], ['common.h'], args, temp_dir, spawn), header)
+    nose.tools.eq_(len(calls), 1)
+
+    # a changed header, even when included indirectly, re-builds it
+    future = time.time() + 10
+    os.utime(included, (future, future))
+    nose.tools.eq_(precompile(['g++'], ['common.h'], args, temp_dir, spawn), header)
+    nose.tools.eq_(len(calls), 2)
+  finally:
+    shutil.rmtree(temp_dir)
@@ -0,0 +1,86 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Tests for link-time and profile-guided optimization
+"""
+
+import os
+import sys
+import shutil
+import tempfile
+
+import nose.tools
+
+import bob.extension
+from .testing import temporary_directory, build_extensions
+from .pgo import lto_enabled, pgo_training_command, profile_generate_flags, \
+    profile_use_flags
+from .utils import is_clang
+
+
+def test_options():
+  old = dict((k, os.environ.get(k)) for k in ('BOB_BUILD_LTO', 'BOB_BUILD_PGO'))
+  try:
+    os.environ['BOB_BUILD_LTO'] = '1'
+    os.environ['BOB_BUILD_PGO'] = ' python test.py '
+    assert lto_enabled()
+    assert not lto_enabled(False)
+    nose.tools.eq_(pgo_training_command(), 'python test.py')
+    nose.tools.eq_(pgo_training_command('nosetests'), 'nosetests')
+    del os.environ['BOB_BUILD_LTO']
+    del os.environ['BOB_BUILD_PGO']
+    assert not lto_enabled()
+    assert pgo_training_command() is None
+  finally:
+    for k, v in old.items():
+      if v is not None: os.environ[k] = v
+
+  nose.tools.eq_(profile_generate_flags('/tmp/profiles'), ['-fprofile-generate=/tmp/profiles'])
+  if not is_clang('gcc'):
+    assert '-fprofile-use=/tmp/profiles' in profile_use_flags('gcc', '/tmp/profiles')
+
+
+def test_cmake_list():
+  generator = bob.extension.CMakeListsGenerator(
+    name = 'bob_cmake_test',
+    sources = ['cmake_test.cpp'],
+    target_directory = "test_target",
+    compile_options = ['-fprofile-generate=/tmp/profiles'],
+    link_options = ['-fprofile-generate=/tmp/profiles'],
+    interprocedural_optimization = True,
+  )
+
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    generator.generate(temp_dir, temp_dir)
+    lines = [line.rstrip() for line in open(os.path.join(temp_dir, "CMakeLists.txt"))]
+    assert 'target_compile_options(${PROJECT_NAME} PRIVATE -fprofile-generate=/tmp/profiles)' in lines
+    assert 'target_link_options(${PROJECT_NAME} PRIVATE -fprofile-generate=/tmp/profiles)' in lines
+    assert '  set_target_properties(${PROJECT_NAME} PROPERTIES INTERPROCEDURAL_OPTIMIZATION TRUE)' in lines
+  finally:
+    shutil.rmtree(temp_dir)
+
+
+def test_pgo_extension():
+  with temporary_directory(chdir=True) as temp_dir:
+    with open(os.path.join(temp_dir, 'pgo_test.cpp'), 'w') as f:
+      f.write(
+        '#include <Python.h>\n'
+        'static PyObject* run(PyObject*, PyObject*) {\n'
+        '  long sum = 0; for (long i = 0; i < 100000; ++i) sum += i % 7;\n'
+        '  return PyLong_FromLong(sum);\n'
+        '}\n'
+        'static PyMethodDef module_methods[] = {{"run", run, METH_NOARGS, 0}, {0, 0, 0, 0}};\n'
+        'static struct PyModuleDef module_definition = { PyModuleDef_HEAD_INIT, "pgo_test", 0, -1, module_methods };\n'
+        'PyMODINIT_FUNC PyInit_pgo_test() { return PyModule_Create(&module_definition); }\n')
+    extension = bob.extension.Extension('pgo_test', ['pgo_test.cpp'])
+    cmd = build_extensions(temp_dir, 'pgo_test', [extension],
+        pgo_train='"%s" -c "import pgo_test; pgo_test.run()"' % sys.executable)
+
+    profiles = os.path.join(temp_dir, 'temp', 'pgo', 'pgo_test')
+    # GCC mirrors the directory structure of the object files below the profile directory
+    written = [f for _, _, files in os.walk(profiles) for f in files]
+    assert [f for f in written if f.endswith(('.gcda', '.profdata'))], written
+    assert os.path.exists(cmd.get_ext_fullpath('pgo_test'))
+    assert '-flto' not in extension.extra_compile_args
+    assert cmd.pgo_phase is None
@@ -6,8 +6,14 @@
 """Tests for pkgconfig
 """
 
+import os
+import sys
+import shutil
+import tempfile
+
 import nose
-from .pkgconfig import pkgconfig, version
+from .pkgconfig import pkgconfig, version, call_pkgconfig, resolve_packages, \
+    PackageResolver, parse_pc, cache_file, DEFAULT_CACHE_FILE
 
 test_package = 'blitz'
 pkg_config_version = '0.0'
@@ -111,3 +117,153 @@ def test_macros():
   assert len(macros[0]) == 2
   assert macros[0][0].find('HAVE_') == 0
   assert macros[0][1] == '1'
+
+
+_PC_FILES = {
+  'bobtest_base': (
+    'prefix=/opt/bob test\n'
+    'libdir=${prefix}/lib # the libraries\n'
+    'includedir=/usr/include\n'
+    'features="first second"\n'
+    '\n'
+    'Name: bobtest_base\n'
+    'Description: base package \\\n'
+    '  of the tests\n'
+    'Version: 1.2.3\n'
+    'Libs: -L/usr/lib -L${libdir}/base -lbase -pthread\n'
+    'Cflags: -I${includedir} -I/opt/base/include -DBASE=1\n'
+    ),
+  'bobtest_private': (
+    'Name: bobtest_private\n'
+    'Description: private requirement\n'
+    'Version: 0.1\n'
+    'Libs: -lprivate\n'
+    'Cflags: -I/opt/private/include\n'
+    ),
+  'bobtest_top': (
+    'prefix=${pcfiledir}/..\n'
+    '\n'
+    'Name: bobtest_top\n'
+    'Description: top package\n'
+    'Version: 4.5\n'
+    'Requires: bobtest_base >= 1.0\n'
+    'Requires.private: bobtest_private\n'
+    'Libs: -L${prefix}/lib -ltop\n'
+    'Cflags: -I${prefix}/include -DTOP -fopenmp\n'
+    ),
+  'bobtest_undefined': (
+    'Name: bobtest_undefined\n'
+    'Description: uses an undefined variable\n'
+    'Version: 2.0\n'
+    'Libs: -L${undefined}/lib -lundefined\n'
+    ),
+}
+
+
+def _write_pc_files(directory):
+  for name, contents in _PC_FILES.items():
+    with open(os.path.join(directory, name + '.pc'), 'w') as f:
+      f.write(contents)
+
+
+def _pkgconfig_path(directory):
+  """Sets PKG_CONFIG_PATH, returning a function that restores it"""
+  old = os.environ.get('PKG_CONFIG_PATH')
+  os.environ['PKG_CONFIG_PATH'] = directory
+  def _restore():
+    if old is None: del os.environ['PKG_CONFIG_PATH']
+    else: os.environ['PKG_CONFIG_PATH'] = old
+  return _restore
+
+
+def test_cache_file():
+  nose.tools.eq_(cache_file('0'), None)
+  nose.tools.eq_(cache_file('1'), DEFAULT_CACHE_FILE)
+  nose.tools.eq_(cache_file('/tmp/pkgconfig.json'), os.path.realpath('/tmp/pkgconfig.json'))
+
+
+def test_parse_pc():
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    _write_pc_files(temp_dir)
+    variables, fields = parse_pc(os.path.join(temp_dir, 'bobtest_base.pc'))
+    nose.tools.eq_([k for k, v in variables], ['pcfiledir', 'prefix', 'libdir', 'includedir', 'features'])
+    nose.tools.eq_(dict(variables)['libdir'], '/opt/bob test/lib')
+    nose.tools.eq_(dict(variables)['features'], 'first second')
+    nose.tools.eq_(fields['Description'], 'base package   of the tests')
+    nose.tools.eq_(fields['Libs'], '-L/usr/lib -L/opt/bob test/lib/base -lbase -pthread')
+  finally:
+    shutil.rmtree(temp_dir)
+
+
+def test_resolver():
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  restore = _pkgconfig_path(temp_dir)
+  try:
+    _write_pc_files(temp_dir)
+    resolver = PackageResolver()
+    resolver.default_paths()
+    calls = resolver.calls
+
+    # packages are resolved natively, like pkg-config does
+    names = ['bobtest_top', 'bobtest_base']
+    for name, record in zip(names, resolver.resolve(names)):
+      pkg = pkgconfig(name, record=record)
+      nose.tools.eq_(pkg.version, call_pkgconfig(['--modversion', name])[1].strip())
+      nose.tools.eq_(pkg.include_directories(), [k[2:] for k in call_pkgconfig(['--cflags-only-I', name])[1].split()])
+      nose.tools.eq_(pkg.libraries(), [k[2:] for k in call_pkgconfig(['--libs-only-l', name])[1].split()])
+      nose.tools.eq_(pkg.extra_link_args(), call_pkgconfig(['--libs-only-other', name])[1].split())
+      nose.tools.eq_(sorted(pkg.variable_names()), sorted(call_pkgconfig(['--print-variables', name])[1].split()))
+      for variable in pkg.variable_names():
+        nose.tools.eq_(pkg.variable(variable), call_pkgconfig(['--variable=' + variable, name])[1].strip())
+    top = pkgconfig('bobtest_top', record=resolver.resolve(['bobtest_top'])[0])
+    nose.tools.eq_(top.cflags_other(), {'define_macros': [('TOP', None), ['BASE', '1']], 'extra_compile_args': ['-fopenmp']})
+    nose.tools.eq_(top.library_directories(), [os.path.join(temp_dir, '..', 'lib'), '/opt/bob'])
+    nose.tools.eq_(resolver.calls, calls)
+
+    # packages are resolved once, others are asked from pkg-config all at once
+    resolver.resolve(['bobtest_top', 'bobtest_undefined', 'bobtest_private'])
+    nose.tools.eq_(resolver.calls, calls + 3)
+    undefined = pkgconfig('bobtest_undefined', record=resolver.resolve(['bobtest_undefined'])[0])
+    nose.tools.eq_(undefined.version, '2.0')
+    nose.tools.eq_(undefined.libraries(), ['undefined'])
+    nose.tools.eq_(resolver.calls, calls + 3)
+
+    nose.tools.assert_raises(RuntimeError, resolver.resolve, ['bobtest_top', 'bobtest_missing'])
+    nose.tools.eq_([p.name for p in resolve_packages(['bobtest_base', 'bobtest_private'])], ['bobtest_base', 'bobtest_private'])
+  finally:
+    restore()
+    shutil.rmtree(temp_dir)
+
+
+def test_resolver_persistence():
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  restore = _pkgconfig_path(temp_dir)
+  try:
+    _write_pc_files(temp_dir)
+    filename = os.path.join(temp_dir, 'cache', 'pkgconfig.json')
+    resolver = PackageResolver(filename)
+    nose.tools.eq_(resolver.resolve(['bobtest_top'])[0]['version'], '4.5')
+    resolver.save()
+    assert os.path.exists(filename)
+
+    # persisted packages are used while their files are unchanged...
+    resolver = PackageResolver(filename)
+    nose.tools.eq_(resolver.resolve(['bobtest_top'])[0]['version'], '4.5')
+    nose.tools.eq_(resolver.calls, 0)
+
+    # ... and resolved again when one of them changes
+    base = os.path.join(temp_dir, 'bobtest_base.pc')
+    with open(base, 'a') as f:
+      f.write('Requires: bobtest_private\n')
+    os.utime(base, ns=(os.stat(base).st_mtime_ns + 10**9,) * 2)
+    resolver = PackageResolver(filename)
+    assert '-lprivate' in resolver.resolve(['bobtest_top'])[0]['libs']
+
+    # corrupt cache files are ignored
+    with open(filename, 'w') as f:
+      f.write('{')
+    nose.tools.eq_(PackageResolver(filename).resolve(['bobtest_top'])[0]['version'], '4.5')
+  finally:
+    restore()
+    shutil.rmtree(temp_dir)
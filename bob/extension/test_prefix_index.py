@@ -0,0 +1,104 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Tests for the index of searched directories
+"""
+
+import os
+import shutil
+import tempfile
+
+import nose.tools
+
+from .prefix_index import PrefixIndex, index_file, prefix_index, \
+    invalidate_prefix_index, DEFAULT_INDEX_FILE
+from .utils import find_header, construct_search_paths
+
+
+def _touch(filename):
+  if not os.path.exists(os.path.dirname(filename)):
+    os.makedirs(os.path.dirname(filename))
+  open(filename, 'w').close()
+
+
+def test_index_file():
+  nose.tools.eq_(index_file('0'), None)
+  nose.tools.eq_(index_file('1'), DEFAULT_INDEX_FILE)
+  nose.tools.eq_(index_file('/tmp/index.json'), os.path.realpath('/tmp/index.json'))
+
+
+def test_listing():
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    _touch(os.path.join(temp_dir, 'include', 'boost', 'version.hpp'))
+    _touch(os.path.join(temp_dir, 'include', 'boost-1_70', 'version.hpp'))
+    _touch(os.path.join(temp_dir, 'include', '.hidden'))
+    index = PrefixIndex()
+    include = os.path.join(temp_dir, 'include')
+
+    assert index.exists(os.path.join(include, 'boost', 'version.hpp'))
+    assert not index.exists(os.path.join(include, 'blitz', 'array.h'))
+    nose.tools.eq_(index.glob(os.path.join(include, 'boost?*')), [os.path.join(include, 'boost-1_70')])
+    nose.tools.eq_(index.glob(os.path.join(include, '*')), [os.path.join(include, 'boost'), os.path.join(include, 'boost-1_70')])
+    nose.tools.eq_(index.glob(os.path.join(temp_dir, '*', 'boost')), [os.path.join(include, 'boost')])
+
+    # files added later (with a new modification time of the directory) are found
+    os.utime(include, (1000, 1000))
+    assert not index.exists(os.path.join(include, 'new.h'))
+    _touch(os.path.join(include, 'new.h'))
+    assert index.exists(os.path.join(include, 'new.h'))
+  finally:
+    shutil.rmtree(temp_dir)
+
+
+def test_persistence():
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    filename = os.path.join(temp_dir, 'cache', 'index.json')
+    include = os.path.join(temp_dir, 'include')
+    _touch(os.path.join(include, 'first.h'))
+    os.utime(include, (1000, 1000))
+
+    index = PrefixIndex(filename)
+    assert index.exists(os.path.join(include, 'first.h'))
+    index.save()
+    assert os.path.exists(filename)
+
+    # persisted listings are used while the directory is unchanged...
+    os.rename(os.path.join(include, 'first.h'), os.path.join(include, 'second.h'))
+    os.utime(include, (1000, 1000))
+    assert PrefixIndex(filename).exists(os.path.join(include, 'first.h'))
+
+    # ... and re-listed when its modification time changes
+    os.utime(include, (2000, 2000))
+    index = PrefixIndex(filename)
+    assert not index.exists(os.path.join(include, 'first.h'))
+    assert index.exists(os.path.join(include, 'second.h'))
+
+    # corrupt index files are ignored
+    with open(filename, 'w') as f:
+      f.write('{')
+    assert PrefixIndex(filename).exists(os.path.join(include, 'second.h'))
+  finally:
+    shutil.rmtree(temp_dir)
+
+
+def test_find_header():
+  old = os.environ.get('BOB_PREFIX_PATH')
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    _touch(os.path.join(temp_dir, 'include', 'boost', 'version.hpp'))
+    os.environ['BOB_PREFIX_PATH'] = temp_dir
+    invalidate_prefix_index()
+    candidates = find_header('version.hpp', subpaths=['boost', 'boost?*'])
+    nose.tools.eq_(candidates[0], os.path.join(temp_dir, 'include', 'boost', 'version.hpp'))
+    # the search paths are constructed once
+    paths = construct_search_paths(subpaths=['include'])
+    assert paths is not construct_search_paths(subpaths=['include'])
+    nose.tools.eq_(paths, construct_search_paths(subpaths=['include']))
+    assert len(prefix_index().searches) >= 2
+  finally:
+    if old is None: del os.environ['BOB_PREFIX_PATH']
+    else: os.environ['BOB_PREFIX_PATH'] = old
+    invalidate_prefix_index()
+    shutil.rmtree(temp_dir)
@@ -0,0 +1,145 @@
+/**
+ * @file bob/extension/test_processor.cpp
+ *
+ * @brief Native processors on std::vector<double> to test the fusion of
+ * native processor chains, see test_stack_processors.py
+ *
+ * Copyright (C) 2026 Idiap Research Institute, Martigny, Switzerland
+ */
+
+#include <Python.h>
+#include <bob.extension/processor.h>
+
+#include <stdexcept>
+
+typedef std::vector<double> Vector;
+
+static long conversions = 0;
+
+namespace bob{
+  namespace extension{
+    template <>
+    struct NativeConverter<Vector> {
+      static const char* name(){return "std::vector<double>";}
+
+      static bool from_python(PyObject* object, Vector& vector){
+        ++conversions;
+        PyObject* sequence = PySequence_Fast(object, "expected a sequence of floats");
+        if (!sequence) return false;
+        vector.resize(PySequence_Fast_GET_SIZE(sequence));
+        for (size_t i = 0; i < vector.size(); ++i){
+          vector[i] = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(sequence, i));
+        }
+        Py_DECREF(sequence);
+        return !PyErr_Occurred();
+      }
+
+      static PyObject* to_python(const Vector& vector){
+        ++conversions;
+        PyObject* list = PyList_New(vector.size());
+        if (!list) return 0;
+        for (size_t i = 0; i < vector.size(); ++i){
+          PyList_SET_ITEM(list, i, PyFloat_FromDouble(vector[i]));
+        }
+        return list;
+      }
+    };
+  }
+}
+
+class Affine : public bob::extension::NativeProcessor<Vector> {
+  public:
+    Affine(double scale, double offset) : scale(scale), offset(offset) {}
+
+    virtual Vector process(const Vector& input) const {
+      if (scale == 0.) throw std::runtime_error("scale must not be 0");
+      Vector output(input);
+      for (size_t i = 0; i < output.size(); ++i) output[i] = output[i] * scale + offset;
+      return output;
+    }
+
+  private:
+    double scale;
+    double offset;
+};
+
+typedef struct {
+  PyObject_HEAD
+  std::shared_ptr<Affine> cxx;
+} AffineObject;
+
+static int Affine_init(AffineObject* self, PyObject* args, PyObject*){
+  double scale, offset = 0.;
+  if (!PyArg_ParseTuple(args, "d|d", &scale, &offset)) return -1;
+  self->cxx.reset(new Affine(scale, offset));
+  return 0;
+}
+
+static PyObject* Affine_new(PyTypeObject* type, PyObject*, PyObject*){
+  AffineObject* self = (AffineObject*)type->tp_alloc(type, 0);
+  if (self) new (&self->cxx) std::shared_ptr<Affine>();
+  return (PyObject*)self;
+}
+
+static void Affine_delete(AffineObject* self){
+  self->cxx.~shared_ptr<Affine>();
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+// a non-fused call converts from and to Python for each stage
+static PyObject* Affine_call(AffineObject* self, PyObject* args, PyObject*){
+  PyObject* data;
+  if (!PyArg_ParseTuple(args, "O", &data)) return 0;
+  Vector input;
+  if (!bob::extension::NativeConverter<Vector>::from_python(data, input)) return 0;
+  try {
+    return bob::extension::NativeConverter<Vector>::to_python(self->cxx->process(input));
+  } catch (std::exception& e) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return 0;
+  }
+}
+
+static PyObject* Affine_native(AffineObject* self, void*){
+  return bob::extension::native_processor<Vector>(self->cxx);
+}
+
+static PyGetSetDef Affine_getseters[] = {
+  {"__native_processor__", (getter)Affine_native, 0, "The native processor", 0},
+  {0}
+};
+
+static PyTypeObject AffineType = {
+  PyVarObject_HEAD_INIT(0, 0)
+  0
+};
+
+static PyObject* get_conversions(PyObject*, PyObject*){
+  return PyLong_FromLong(conversions);
+}
+
+static PyMethodDef module_methods[] = {
+  {"conversions", (PyCFunction)get_conversions, METH_NOARGS, "The number of conversions so far"},
+  {0}
+};
+
+static struct PyModuleDef module_definition = {
+  PyModuleDef_HEAD_INIT, "native_test", 0, -1, module_methods
+};
+
+PyMODINIT_FUNC PyInit_native_test(){
+  AffineType.tp_name = "native_test.Affine";
+  AffineType.tp_basicsize = sizeof(AffineObject);
+  AffineType.tp_flags = Py_TPFLAGS_DEFAULT;
+  AffineType.tp_new = Affine_new;
+  AffineType.tp_init = (initproc)Affine_init;
+  AffineType.tp_dealloc = (destructor)Affine_delete;
+  AffineType.tp_call = (ternaryfunc)Affine_call;
+  AffineType.tp_getset = Affine_getseters;
+  if (PyType_Ready(&AffineType) < 0) return 0;
+  PyObject* module = PyModule_Create(&module_definition);
+  if (!module) return 0;
+  Py_INCREF(&AffineType);
+  if (PyModule_AddObject(module, "Affine", (PyObject*)&AffineType) < 0) return 0;
+  return module;
+}
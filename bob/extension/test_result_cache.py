@@ -0,0 +1,182 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Tests for the cache of processor outputs
+"""
+
+import os
+import math
+import time
+import threading
+import shutil
+import tempfile
+from functools import partial
+
+import numpy as np
+import nose.tools
+
+from .result_cache import ResultCache, CachedProcessor, hash_value, \
+    processor_identity
+from .processors import SequentialProcessor
+
+
+CALLS = []
+
+
+def _scale(data, factor=2):
+  CALLS.append(factor)
+  return data * factor
+
+
+class _Offset(object):
+  def __init__(self, offset):
+    self.offset = offset
+
+  def __call__(self, data):
+    CALLS.append(self.offset)
+    return data + self.offset
+
+
+def test_keys():
+  a = np.arange(12, dtype=np.float64).reshape(3, 4)
+  nose.tools.eq_(hash_value(a), hash_value(a.copy()))
+  # the memory layout does not matter, but the shape and dtype do
+  nose.tools.eq_(hash_value(a), hash_value(np.asfortranarray(a)))
+  assert hash_value(a) != hash_value(a.reshape(4, 3))
+  assert hash_value(a) != hash_value(a.astype(np.float32))
+  assert hash_value([a, 1]) != hash_value((a, 1))
+
+  nose.tools.eq_(processor_identity(np.sqrt), processor_identity(np.sqrt))
+  assert processor_identity(np.sqrt) != processor_identity(np.exp)
+  assert processor_identity(partial(_scale, factor=2)) != processor_identity(partial(_scale, factor=3))
+  assert processor_identity(_Offset(1)) != processor_identity(_Offset(2))
+  nose.tools.eq_(processor_identity(_Offset(1)), processor_identity(_Offset(1)))
+  assert processor_identity(SequentialProcessor([np.sqrt])) != processor_identity(SequentialProcessor([np.exp]))
+
+  # edited functions, default arguments and closures change the identity
+  def f(x): return math.sin(x)
+  edited = processor_identity(f)
+  def f(x): return math.cos(x)
+  assert processor_identity(f) != edited
+  def f(x, factor=2): return x * factor
+  edited = processor_identity(f)
+  def f(x, factor=3): return x * factor
+  assert processor_identity(f) != edited
+  def f(x): return [math.sin(v) for v in x]
+  edited = processor_identity(f)
+  def f(x): return [math.cos(v) for v in x]
+  assert processor_identity(f) != edited
+  make = lambda a: lambda x: x * a
+  assert processor_identity(make(2)) != processor_identity(make(3))
+  nose.tools.eq_(processor_identity(make(2)), processor_identity(make(2)))
+  # values that cannot be pickled cannot identify a closure
+  lock = threading.Lock()
+  nose.tools.assert_raises(ValueError, processor_identity, lambda x: lock)
+
+
+def test_cached_processor():
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    cache = ResultCache(temp_dir)
+    processor = SequentialProcessor([CachedProcessor(_Offset(1), cache), CachedProcessor(_scale, cache), list])
+    data = np.arange(5.)
+    del CALLS[:]
+    nose.tools.eq_(processor(data), [2., 4., 6., 8., 10.])
+    nose.tools.eq_(CALLS, [1, 2])
+    nose.tools.eq_((cache.hits, cache.misses), (0, 2))
+
+    # all stages are skipped for the same data
+    del CALLS[:]
+    nose.tools.eq_(processor(data.copy()), [2., 4., 6., 8., 10.])
+    nose.tools.eq_(CALLS, [])
+    nose.tools.eq_(cache.hits, 2)
+
+    # the cached arrays are memory-mapped
+    output = CachedProcessor(_scale, cache)(data + 1)
+    assert isinstance(output, np.memmap)
+    assert not output.flags.writeable
+
+    # the kwargs are part of the key
+    del CALLS[:]
+    CachedProcessor(_scale, cache)(data + 1, factor=3)
+    nose.tools.eq_(CALLS, [3])
+
+    # other outputs are pickled, and generators are not cached
+    nose.tools.eq_(CachedProcessor(list, cache)(data), list(data))
+    nose.tools.eq_(CachedProcessor(list, cache)(data), list(data))
+    generator = CachedProcessor(iter, cache)
+    nose.tools.eq_(list(generator(data)), list(data))
+    nose.tools.eq_(list(generator(data)), list(data))
+  finally:
+    shutil.rmtree(temp_dir)
+
+
+class _Counted(object):
+  def __init__(self):
+    self.identities = 0
+
+  def cache_identity(self):
+    self.identities += 1
+    return 'counted'
+
+  def __call__(self, data):
+    return data + 1
+
+
+def test_identity_once():
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    counted = _Counted()
+    processor = CachedProcessor(counted, ResultCache(temp_dir))
+    for value in range(3):
+      nose.tools.eq_(processor(value), value + 1)
+    nose.tools.eq_(processor.process_batch(range(5)), [1, 2, 3, 4, 5])
+    nose.tools.eq_(processor(0), 1)
+    # the identity is computed for the first sample only
+    nose.tools.eq_(counted.identities, 1)
+  finally:
+    shutil.rmtree(temp_dir)
+
+
+def test_eviction():
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    cache = ResultCache(temp_dir, max_size=3500)
+    processor = CachedProcessor(partial(np.full, 100, dtype=np.float64), cache)
+    for value in range(3):
+      processor(value)
+    # makes the output for 1 the least recently used one
+    past = time.time() - 100
+    for i, value in enumerate((1, 0, 2)):
+      key = cache.key(processor.processor, value, {})
+      os.utime(cache._path(key, '.npy'), (past + i, past + i))
+    processor(3)
+    assert cache.size() <= 3500
+    hits = cache.hits
+    processor(0)
+    processor(2)
+    processor(3)
+    nose.tools.eq_(cache.hits, hits + 3)
+    misses = cache.misses
+    processor(1)
+    nose.tools.eq_(cache.misses, misses + 1)
+  finally:
+    shutil.rmtree(temp_dir)
+
+
+def test_cached_batches():
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    processor = CachedProcessor(_Offset(5), ResultCache(temp_dir))
+    samples = [np.arange(3.) + i for i in range(4)]
+    del CALLS[:]
+    processor(samples[1])
+    outputs = processor.process_batch(samples)
+    assert np.allclose(outputs, [s + 5 for s in samples])
+    # only the samples that were not cached are processed
+    nose.tools.eq_(CALLS, [5, 5, 5, 5])
+    del CALLS[:]
+    processor.process_batch(samples)
+    nose.tools.eq_(CALLS, [])
+  finally:
+    shutil.rmtree(temp_dir)
@@ -0,0 +1,99 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Tests for the concurrent build of extensions
+"""
+
+import os
+import time
+import threading
+
+import nose.tools
+
+import bob.extension
+from .testing import temporary_directory, build_extensions
+from .scheduler import job_limit, JobServer, run_graph
+
+
+def test_job_limit():
+  nose.tools.eq_(job_limit(3), 3)
+  nose.tools.eq_(job_limit('0'), 1)
+  old = os.environ.get('BOB_BUILD_PARALLEL')
+  try:
+    os.environ['BOB_BUILD_PARALLEL'] = '5'
+    nose.tools.eq_(job_limit(), 5)
+    del os.environ['BOB_BUILD_PARALLEL']
+    nose.tools.eq_(job_limit(), os.cpu_count() or 1)
+  finally:
+    if old is not None: os.environ['BOB_BUILD_PARALLEL'] = old
+
+
+def test_job_server():
+  server = JobServer(4)
+  nose.tools.eq_(server.acquire(10), 4)
+  nose.tools.eq_(server.available, 0)
+  server.release(4)
+
+  # the wrapped function never runs more than limit times at once
+  server = JobServer(2)
+  state = {'running': 0, 'maximum': 0}
+  lock = threading.Lock()
+  def _job():
+    with lock:
+      state['running'] += 1
+      state['maximum'] = max(state['maximum'], state['running'])
+    time.sleep(0.02)
+    with lock:
+      state['running'] -= 1
+  job = server.wrap(_job)
+  threads = [threading.Thread(target=job) for _ in range(6)]
+  [t.start() for t in threads]
+  [t.join() for t in threads]
+  nose.tools.eq_(state['maximum'], 2)
+
+
+def test_run_graph():
+  finished = []
+  def _run(task):
+    time.sleep(0.01 if task.startswith('lib') else 0)
+    finished.append(task)
+
+  tasks = ['lib1', 'lib2', 'ext1', 'ext2', 'ext3']
+  dependencies = lambda t: [] if t.startswith('lib') else ['lib1', 'lib2']
+  run_graph(tasks, dependencies, _run, 4)
+  nose.tools.eq_(sorted(finished[:2]), ['lib1', 'lib2'])
+  nose.tools.eq_(sorted(finished[2:]), ['ext1', 'ext2', 'ext3'])
+
+  # dependents of failed tasks are not run, and the original error is raised
+  del finished[:]
+  def _fail(task):
+    if task == 'lib2': raise KeyError(task)
+    _run(task)
+  nose.tools.assert_raises(KeyError, run_graph, tasks, dependencies, _fail, 4)
+  nose.tools.eq_(finished, ['lib1'])
+
+  nose.tools.assert_raises(RuntimeError, run_graph, ['a', 'b'], lambda t: ['b'] if t == 'a' else ['a'], _run, 2)
+
+
+def test_concurrent_extensions():
+  from distutils.errors import CompileError
+  with temporary_directory(chdir=True) as temp_dir:
+    names = ['first', 'second', 'third']
+    for name in names:
+      with open(os.path.join(temp_dir, name + '.cpp'), 'w') as f:
+        f.write(
+          '#include <Python.h>\n'
+          'static struct PyModuleDef module_definition = { PyModuleDef_HEAD_INIT, "%s", 0, -1, 0 };\n'
+          'PyMODINIT_FUNC PyInit_%s() { return PyModule_Create(&module_definition); }\n' % (name, name))
+      with open(os.path.join(temp_dir, name + '_helper.cpp'), 'w') as f:
+        f.write('int %s_helper() { return 1; }\n' % name)
+    with open(os.path.join(temp_dir, 'broken.cpp'), 'w') as f:
+      f.write('this is not C++\n')
+
+    cmd = build_extensions(temp_dir, 'scheduler_test', [bob.extension.Extension(n, [n + '.cpp', n + '_helper.cpp']) for n in names], parallel=2)
+    for name in names:
+      assert os.path.exists(cmd.get_ext_fullpath(name))
+    assert cmd.job_server is None
+
+    # the error of the failing extension is reported
+    nose.tools.assert_raises(CompileError, build_extensions, temp_dir, 'scheduler_test', [bob.extension.Extension('broken', ['broken.cpp'])], parallel=2)
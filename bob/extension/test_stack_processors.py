@@ -1,8 +1,13 @@
 from functools import partial
+import os
+import time
+import threading
 import numpy as np
 import tempfile
+from bob.extension.testing import temporary_directory, built_module
 from bob.extension.processors import (
-    SequentialProcessor, ParallelProcessor)
+    SequentialProcessor, ParallelProcessor, NativeChain, releases_gil,
+    native_stage, apply_batch, stack_batch)
 
 DATA = [0, 1, 2, 3, 4]
 PROCESSORS = [partial(np.power, 2), np.mean]
@@ -18,3 +23,211 @@ def test_processors():
   proc = ParallelProcessor(PROCESSORS)
   data = proc(DATA)
   assert all(np.allclose(x1, x2) for x1, x2 in zip(data, PAR_DATA))
+
+
+def _sleep(data, seconds):
+  time.sleep(seconds)
+  return data, seconds, os.getpid()
+
+
+def _fail(data):
+  raise ValueError(data)
+
+
+def _exclusive(data, directory):
+  # fails if another processor (on a thread or in a process) runs at the same
+  # time, which is detected by the marker file
+  marker = os.open(os.path.join(directory, 'running'), os.O_CREAT | os.O_EXCL)
+  try:
+    time.sleep(0.05)
+  finally:
+    os.close(marker)
+    os.remove(os.path.join(directory, 'running'))
+  return data
+
+
+def test_parallel_modes():
+  for mode in ('thread', 'process', 'auto'):
+    with ParallelProcessor(PROCESSORS, mode=mode) as proc:
+      data = list(proc(DATA))
+      assert all(np.allclose(x1, x2) for x1, x2 in zip(data, PAR_DATA))
+
+  # processors that release the GIL run on threads, others on processes
+  assert releases_gil(partial(np.power, 2))
+  assert not releases_gil(_sleep)
+  # builtin functions usually hold the GIL, unless they state otherwise
+  assert not releases_gil(len)
+  proc = ParallelProcessor([partial(_sleep, seconds=0), lambda x: os.getpid()],
+                           mode='auto')
+  try:
+    outputs = list(proc(None))
+    assert outputs[0][2] != os.getpid()
+    assert outputs[1] == os.getpid()
+  finally:
+    proc.close()
+
+  # the processors run concurrently, and can deliver their outputs as they
+  # complete: the first one only finishes after the output of the second
+  release = threading.Event()
+  proc = ParallelProcessor(
+      [lambda data: release.wait(10), lambda data: data],
+      mode='thread', ordered=False, max_workers=2)
+  try:
+    outputs = proc('x')
+    assert next(outputs) == (1, 'x')
+    release.set()
+    assert next(outputs) == (0, True)
+  finally:
+    proc.close()
+
+  # the number of concurrent processors can be limited, also when threads and
+  # processes are mixed
+  with temporary_directory() as temp_dir:
+    on_thread = lambda data: _exclusive(data, temp_dir)
+    on_process = partial(_exclusive, directory=temp_dir)
+    for mode, processors in (('thread', [on_thread] * 3),
+                             ('auto', [on_thread, on_process] * 2)):
+      with ParallelProcessor(processors, mode=mode, max_workers=1) as proc:
+        assert list(proc('x')) == ['x'] * len(processors)
+
+  # exceptions are re-raised
+  with ParallelProcessor([_fail], mode='process') as proc:
+    try:
+      list(proc('error'))
+      assert False
+    except ValueError as e:
+      assert str(e) == 'error'
+
+
+def _slow(data, seconds=0.1):
+  time.sleep(seconds)
+  return data + 1
+
+
+def test_stream():
+  proc = SequentialProcessor(PROCESSORS)
+  samples = [np.arange(i + 1) for i in range(7)]
+  for batch_size in (1, 3, [2, 1, 4]):
+    outputs = list(proc.stream(iter(samples), batch_size=batch_size))
+    assert np.allclose(outputs, [proc(s) for s in samples])
+
+  # the stages overlap: the first stage processes the second sample while the
+  # second stage processes the first one
+  barrier = threading.Barrier(2, timeout=10)
+  def stage(data):
+    if data == 1:
+      barrier.wait()
+    return data + 1
+  proc = SequentialProcessor([stage, stage])
+  assert list(proc.stream(range(5), queue_size=1)) == [2, 3, 4, 5, 6]
+
+  # exceptions of the stages and of the samples are re-raised
+  def samples():
+    yield 1
+    raise KeyError('samples')
+  for source, stages, error in (
+      ([1, 'a', 2], [_slow, _slow], TypeError),
+      (samples(), [_slow], KeyError)):
+    try:
+      list(SequentialProcessor(stages).stream(source))
+      assert False
+    except error:
+      pass
+
+  # a stream can be abandoned
+  stream = SequentialProcessor([partial(_slow, seconds=0)]).stream(range(1000))
+  assert next(stream) == 1
+  stream.close()
+
+
+def test_native_chain():
+  with built_module('native_test', 'test_processor.cpp') as native_test:
+    Affine = native_test.Affine
+
+    assert native_stage(Affine(2.))[0] == 'std::vector<double>'
+    assert native_stage(np.mean) is None
+    assert releases_gil(Affine(2.))
+
+    # consecutive native processors are fused
+    processors = [Affine(2.), Affine(1., 1.), list, Affine(3.), Affine(1., -1.)]
+    proc = SequentialProcessor(processors)
+    stages = proc.stages()
+    assert len(stages) == 3
+    assert isinstance(stages[0], NativeChain) and stages[1] is list
+    assert proc.stages() is stages
+
+    # and convert their inputs and outputs only once
+    start = native_test.conversions()
+    assert proc([1., 2.]) == [8., 14.]
+    assert native_test.conversions() - start == 4
+    start = native_test.conversions()
+    assert SequentialProcessor(processors, fuse=False)([1., 2.]) == [8., 14.]
+    assert native_test.conversions() - start == 8
+
+    # C++ exceptions are translated
+    try:
+      SequentialProcessor([Affine(1.), Affine(0.)])([1.])
+      assert False
+    except RuntimeError as e:
+      assert 'scale must not be 0' in str(e)
+    try:
+      NativeChain([Affine(1.), np.mean])
+      assert False
+    except ValueError:
+      pass
+
+
+class _Batched(object):
+  """Adds 1 to the samples, and records how it was called"""
+
+  def __init__(self):
+    self.calls = []
+
+  def __call__(self, data):
+    self.calls.append('sample')
+    return data + 1
+
+  def process_batch(self, batch):
+    self.calls.append(batch.shape if isinstance(batch, np.ndarray) else len(batch))
+    return batch + 1 if isinstance(batch, np.ndarray) else [b + 1 for b in batch]
+
+
+def test_batches():
+  samples = [np.full(3, i, dtype=np.float64) for i in range(5)]
+  batched = _Batched()
+  assert np.allclose(apply_batch(batched, samples), [s + 1 for s in samples])
+  # the samples are stacked into a contiguous array
+  assert batched.calls == [(5, 3)]
+  assert stack_batch([1, 2]) == [1, 2]
+  assert stack_batch([np.zeros(2), np.zeros(3)])[1].shape == (3,)
+
+  # processors without the batch protocol are called for each sample
+  proc = SequentialProcessor([batched, partial(np.sum)])
+  outputs = proc.process_batch(samples)
+  assert np.allclose(outputs, [proc(s) for s in samples])
+  assert batched.calls[1] == (5, 3)
+
+  proc = ParallelProcessor([batched, np.sum])
+  outputs = proc.process_batch(samples)
+  assert len(outputs) == 5
+  assert np.allclose(outputs[2][0], samples[2] + 1)
+  assert outputs[2][1] == 6
+  with ParallelProcessor([batched, np.sum], mode='thread') as proc:
+    assert np.allclose([o[1] for o in proc.process_batch(samples)], [0, 3, 6, 9, 12])
+
+  # streams pass their batches to the processors
+  batched.calls = []
+  proc = SequentialProcessor([batched])
+  outputs = list(proc.stream(samples, batch_size=[5, 2]))
+  assert np.allclose(outputs, [s + 1 for s in samples])
+  assert batched.calls == [(2, 3), (2, 3), (1, 3)]
+
+  # the number of outputs is checked
+  class _Wrong(_Batched):
+    def process_batch(self, batch):
+      return batch[:1]
+  try:
+    apply_batch(_Wrong(), samples)
+    assert False
+  except ValueError:
+    pass
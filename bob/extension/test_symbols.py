@@ -0,0 +1,118 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Tests for the control of exported symbols
+"""
+
+import os
+import shutil
+import tempfile
+
+import nose.tools
+
+import bob.extension
+from .symbols import visibility, version_script, exported_symbols, \
+    symbol_counts, supports_version_scripts
+
+
+_SOURCE = '''\
+#include <bob.extension/export.h>
+
+namespace bob { namespace symtest {
+  template <typename T> struct Holder {
+    virtual ~Holder() {}
+    virtual T get() const { return T(); }
+  };
+  BOB_EXPORT Holder<int>* make() { return new Holder<int>(); }
+  int internal() { return 1; }
+}}
+
+extern "C" BOB_EXPORT int c_api() { return 2; }
+extern "C" int c_internal() { return 3; }
+'''
+
+
+def test_options():
+  old = os.environ.get('BOB_BUILD_VISIBILITY')
+  try:
+    os.environ.pop('BOB_BUILD_VISIBILITY', None)
+    nose.tools.eq_(visibility(), 'default')
+    nose.tools.eq_(visibility('hidden'), 'hidden')
+    nose.tools.eq_(visibility(True), 'hidden')
+    os.environ['BOB_BUILD_VISIBILITY'] = 'hidden'
+    nose.tools.eq_(visibility(), 'hidden')
+    nose.tools.eq_(visibility('default'), 'default')
+  finally:
+    if old is None: os.environ.pop('BOB_BUILD_VISIBILITY', None)
+    else: os.environ['BOB_BUILD_VISIBILITY'] = old
+
+  script = version_script(['bob::core::*', 'c_api'])
+  assert '      bob::core::*;\n' in script
+  assert '      typeinfo?for?bob::core::*;\n' in script
+  assert '    c_api;\n' in script
+  assert script.endswith('  local:\n    *;\n};\n')
+
+
+def _build(temp_dir, name, **kwargs):
+  library = bob.extension.Library(
+    name = 'target.' + name,
+    sources = ['symtest.cpp'],
+    version = '1.0.0',
+    **kwargs
+  )
+  with open(os.devnull, 'w') as devnull:
+    library.compile(os.path.join(temp_dir, 'lib'), stdout=devnull)
+  filename = bob.extension.get_full_libname(name, os.path.join(temp_dir, 'lib', 'target'))
+  assert os.path.exists(filename)
+  return library, filename
+
+
+def _names(filename):
+  return set(name for name, _ in exported_symbols(filename))
+
+
+def test_exported_symbols():
+  old_dir = os.getcwd()
+  old = os.environ.get('BOB_BUILD_VISIBILITY')
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    os.environ.pop('BOB_BUILD_VISIBILITY', None)
+    with open(os.path.join(temp_dir, 'symtest.cpp'), 'w') as f:
+      f.write(_SOURCE)
+    os.chdir(temp_dir)
+
+    # by default, everything is exported, including template instantiations
+    _, filename = _build(temp_dir, 'bob_symtest_default')
+    if exported_symbols(filename) is None:
+      return
+    names = _names(filename)
+    assert '_ZN3bob7symtest8internalEv' in names
+    assert 'c_internal' in names
+    assert symbol_counts(filename)['weak'] > 0
+
+    # with hidden visibility, only the marked functions are exported
+    _, filename = _build(temp_dir, 'bob_symtest_hidden', visibility='hidden')
+    nose.tools.eq_(_names(filename), set(['_ZN3bob7symtest4makeEv', 'c_api']))
+    nose.tools.eq_(symbol_counts(filename), {'exported': 2, 'weak': 0})
+
+    if not supports_version_scripts():
+      return
+
+    # with a version script, only the matching symbols are exported
+    library, filename = _build(temp_dir, 'bob_symtest_exports', exports=['bob::symtest::make*', 'c_*'])
+    nose.tools.eq_(_names(filename), set(['_ZN3bob7symtest4makeEv', 'c_api', 'c_internal']))
+    build_directory = os.path.join(temp_dir, 'build_cmake', 'bob_symtest_exports')
+    with open(os.path.join(build_directory, 'CMakeLists.txt')) as f:
+      cmake_lists = f.read()
+    assert '--version-script=' in cmake_lists
+    assert '-Bsymbolic-functions' in cmake_lists
+
+    # an unchanged version script is not re-written
+    script = os.path.join(build_directory, 'bob_symtest_exports.map')
+    os.utime(script, (1000, 1000))
+    _build(temp_dir, 'bob_symtest_exports', exports=['bob::symtest::make*', 'c_*'])
+    nose.tools.eq_(os.path.getmtime(script), 1000)
+  finally:
+    if old is not None: os.environ['BOB_BUILD_VISIBILITY'] = old
+    os.chdir(old_dir)
+    shutil.rmtree(temp_dir)
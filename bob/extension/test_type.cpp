@@ -0,0 +1,145 @@
+/**
+ * @file bob/extension/test_type.cpp
+ *
+ * @brief A class bound with bob::extension::ExtensionType, see test_type.py
+ *
+ * Copyright (C) 2026 Idiap Research Institute, Martigny, Switzerland
+ */
+
+#include <Python.h>
+#include <bob.extension/type.h>
+
+#include <cmath>
+#include <stdexcept>
+
+static long alive = 0;
+
+class Point {
+  public:
+    Point(double x, double y) : x(x), y(y) {
+      if (x < 0.) throw std::runtime_error("x must not be negative");
+      ++alive;
+    }
+    Point(const Point& other) : x(other.x), y(other.y) {++alive;}
+    ~Point() {--alive;}
+
+    double x;
+    double y;
+};
+
+static auto Point_doc = bob::extension::ClassDoc(
+  "type_test.Point",
+  "A point in 2D"
+).add_constructor(
+  bob::extension::FunctionDoc(
+    "Point",
+    "Creates a point"
+  )
+  .add_prototype("x, [y]", "")
+  .add_prototype("other", "")
+  .add_parameter("x", "float", "The x coordinate, which must not be negative")
+  .add_parameter("y", "float", "[Default: ``0.``] The y coordinate")
+  .add_parameter("other", ":py:class:`Point`", "The point to copy")
+);
+
+static bool Point_make(void* memory, unsigned prototype, PyObject* const* args);
+
+static bob::extension::ExtensionType<Point, 4> PointType(Point_doc, Point_make);
+
+static bool Point_make(void* memory, unsigned prototype, PyObject* const* args){
+  if (prototype == 1){
+    if (!PointType.check(args[0])){
+      PyErr_Format(PyExc_TypeError, "Point() expects a Point as 'other', not %s", Py_TYPE(args[0])->tp_name);
+      return false;
+    }
+    new (memory) Point(PointType.cxx(args[0]));
+    return true;
+  }
+  double x = PyFloat_AsDouble(args[0]);
+  double y = args[1] ? PyFloat_AsDouble(args[1]) : 0.;
+  if (PyErr_Occurred()) return false;
+  new (memory) Point(x, y);
+  return true;
+}
+
+static auto x_doc = bob::extension::VariableDoc("x", "float", "The x coordinate");
+static PyObject* Point_get_x(const Point& point){return PyFloat_FromDouble(point.x);}
+static int Point_set_x(Point& point, PyObject* value){
+  double x = PyFloat_AsDouble(value);
+  if (PyErr_Occurred()) return -1;
+  if (x < 0.) throw std::runtime_error("x must not be negative");
+  point.x = x;
+  return 0;
+}
+
+static auto y_doc = bob::extension::VariableDoc("y", "float", "The y coordinate, read-only");
+static PyObject* Point_get_y(const Point& point){return PyFloat_FromDouble(point.y);}
+
+static auto norm_doc = bob::extension::FunctionDoc(
+  "norm",
+  "The distance to the origin",
+  0,
+  true
+)
+.add_prototype("", "norm")
+.add_return("norm", "float", "The Euclidean norm");
+static PyObject* Point_norm(PyObject* self, PyObject*){
+  const Point& point = PointType.cxx(self);
+  return PyFloat_FromDouble(std::sqrt(point.x * point.x + point.y * point.y));
+}
+
+// returns points created from C++
+static PyObject* make_many(PyObject*, PyObject* args){
+  int count;
+  if (!PyArg_ParseTuple(args, "i", &count)) return 0;
+  PyObject* list = PyList_New(count);
+  if (!list) return 0;
+  for (int i = 0; i < count; ++i){
+    PyObject* point = PointType.create(Point(i, -i));
+    if (!point){
+      Py_DECREF(list);
+      return 0;
+    }
+    PyList_SET_ITEM(list, i, point);
+  }
+  return list;
+}
+
+static PyObject* get_alive(PyObject*, PyObject*){
+  return PyLong_FromLong(alive);
+}
+
+static PyObject* get_freelist_size(PyObject*, PyObject*){
+  return PyLong_FromUnsignedLong(PointType.freelist_size());
+}
+
+static PyObject* clear_freelist(PyObject*, PyObject*){
+  PointType.clear_freelist();
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef module_methods[] = {
+  {"make_many", (PyCFunction)make_many, METH_VARARGS, "Creates points in C++"},
+  {"alive", (PyCFunction)get_alive, METH_NOARGS, "The number of existing C++ points"},
+  {"freelist_size", (PyCFunction)get_freelist_size, METH_NOARGS, "The number of points in the freelist"},
+  {"clear_freelist", (PyCFunction)clear_freelist, METH_NOARGS, "Clears the freelist"},
+  {0}
+};
+
+static struct PyModuleDef module_definition = {
+  PyModuleDef_HEAD_INIT, "type_test", 0, -1, module_methods
+};
+
+PyMODINIT_FUNC PyInit_type_test(){
+  PyObject* module = PyModule_Create(&module_definition);
+  if (!module) return 0;
+  PointType
+    .add_attribute(x_doc, Point_get_x, Point_set_x)
+    .add_attribute(y_doc, Point_get_y)
+    .add_method(norm_doc, Point_norm, METH_NOARGS);
+  if (!PointType.ready(module)){
+    Py_DECREF(module);
+    return 0;
+  }
+  return module;
+}
@@ -0,0 +1,82 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+'''Tests the Python types generated by bob::extension::ExtensionType'''
+
+import nose.tools
+
+from .testing import built_module
+
+
+def test_extension_type():
+  with built_module('type_test', 'test_type.cpp') as type_test:
+    Point = type_test.Point
+
+    # the type and its documentation are generated from the ClassDoc
+    nose.tools.eq_(Point.__name__, 'Point')
+    nose.tools.eq_(Point.__module__, 'type_test')
+    assert 'A point in 2D' in Point.__doc__
+    assert 'Highlighted Attributes' in Point.__doc__
+    assert ':obj:`x`' in Point.__doc__ and ':func:`norm`' in Point.__doc__
+    assert 'The x coordinate' in Point.x.__doc__
+
+    # positional and keyword arguments
+    p = Point(3., 4.)
+    nose.tools.eq_((p.x, p.y), (3., 4.))
+    nose.tools.eq_(p.norm(), 5.)
+    nose.tools.eq_(Point(3.).y, 0.)
+    nose.tools.eq_(Point(y=2., x=1.).y, 2.)
+    nose.tools.eq_(Point(1., y=2.).y, 2.)
+    nose.tools.eq_(Point(**{'x': 1.}).x, 1.)
+    assert isinstance(p, Point)
+
+    for args, kwargs in (((1., 2., 3.), {}), ((1.,), {'x': 2.}),
+                         ((), {'z': 1.}), ((), {}), (('a',), {})):
+      nose.tools.assert_raises(TypeError, Point, *args, **kwargs)
+
+    # the arguments select the constructor prototype
+    q = Point(other=p)
+    nose.tools.eq_((q.x, q.y), (3., 4.))
+    assert q is not p
+    nose.tools.assert_raises(TypeError, Point, other=1.)
+    # also without vectorcall
+    nose.tools.eq_(Point.__new__(Point, other=p).y, 4.)
+    nose.tools.eq_(Point.__new__(Point, 1., y=2.).y, 2.)
+    nose.tools.assert_raises(TypeError, Point, p)
+    with nose.tools.assert_raises(TypeError) as e:
+      Point(y=1.)
+    assert 'none of its 2 constructor prototypes' in str(e.exception)
+    del q
+
+    # attributes
+    p.x = 6.
+    nose.tools.eq_(p.norm(), 7.2111025509279782)
+    nose.tools.assert_raises(AttributeError, setattr, p, 'y', 1.)
+    nose.tools.assert_raises(TypeError, delattr, p, 'x')
+    nose.tools.assert_raises(TypeError, setattr, p, 'x', 'a')
+
+    # C++ exceptions are translated
+    with nose.tools.assert_raises(RuntimeError) as e:
+      Point(-1.)
+    assert 'x must not be negative' in str(e.exception)
+    nose.tools.assert_raises(RuntimeError, setattr, p, 'x', -1.)
+    nose.tools.eq_(p.x, 6.)
+
+    # objects created in C++, and the reuse of deleted objects
+    del p
+    type_test.clear_freelist()
+    start = type_test.alive()
+    points = type_test.make_many(10)
+    nose.tools.eq_([q.x for q in points], list(range(10)))
+    nose.tools.eq_(type_test.alive() - start, 10)
+    del points
+    nose.tools.eq_(type_test.alive(), start)
+    nose.tools.eq_(type_test.freelist_size(), 4)
+    Point(1.)
+    nose.tools.eq_(type_test.freelist_size(), 4)
+    keep = [Point(1.), Point(2.)]
+    nose.tools.eq_(type_test.freelist_size(), 2)
+    del keep
+    type_test.clear_freelist()
+    nose.tools.eq_(type_test.freelist_size(), 0)
+    nose.tools.eq_(type_test.alive(), start)
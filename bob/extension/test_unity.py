@@ -0,0 +1,135 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Tests for unity (jumbo) builds
+"""
+
+import os
+import shutil
+import tempfile
+import platform
+import pkg_resources
+
+import nose.tools
+
+import bob.extension
+from .testing import temporary_directory, build_extensions
+from .unity import unity_batch_size, static_symbols, unity_batches, \
+    write_unity_sources, DOCUMENTATION_HELPERS
+
+
+def _write(directory, name, contents):
+  filename = os.path.join(directory, name)
+  with open(filename, 'w') as f:
+    f.write(contents)
+  return filename
+
+
+def test_batch_size():
+  nose.tools.eq_(unity_batch_size(4), 4)
+  nose.tools.eq_(unity_batch_size('3'), 3)
+  nose.tools.eq_(unity_batch_size(1), 0)
+  old = os.environ.get('BOB_BUILD_UNITY')
+  try:
+    os.environ['BOB_BUILD_UNITY'] = '8'
+    nose.tools.eq_(unity_batch_size(), 8)
+    del os.environ['BOB_BUILD_UNITY']
+    nose.tools.eq_(unity_batch_size(), 0)
+  finally:
+    if old is not None: os.environ['BOB_BUILD_UNITY'] = old
+
+
+def test_static_symbols():
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    source = _write(temp_dir, 'a.cpp',
+        '#include <bob.extension/documentation.h>\n'
+        'static auto reverse_doc = bob::extension::FunctionDoc("reverse", "");\n'
+        'static PyObject* PyBobReverse(PyObject*, PyObject* args) {\n'
+        '  static int local = 0;\n'
+        '}\n'
+        'static PyMethodDef module_methods[] = {\n'
+        '};\n'
+        'int exported(int a);\n')
+    symbols = static_symbols(source)
+    nose.tools.eq_(symbols, set(['reverse_doc', 'PyBobReverse', 'module_methods']))
+  finally:
+    shutil.rmtree(temp_dir)
+
+
+def test_batches():
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    a = _write(temp_dir, 'a.cpp', 'static int helper() { return 1; }\n')
+    b = _write(temp_dir, 'b.cpp', 'static int helper() { return 2; }\n')
+    c = _write(temp_dir, 'c.cpp', 'static std::string _split(int) { return ""; }\n')
+    d = _write(temp_dir, 'd.cpp', '#include <bob.extension/documentation.h>\n')
+    e = _write(temp_dir, 'e.c', 'static int other() { return 3; }\n')
+    f = _write(temp_dir, 'f.cpp', '#include <bob.extension/documentation.h>\n')
+
+    # colliding static symbols end up in different batches
+    nose.tools.eq_(unity_batches([a, b, c, d, e], 4), [[a, c], [b, d], [e]])
+    nose.tools.eq_(unity_batches([a, c, d], 2), [[a, c], [d]])
+    # the documentation.h helpers are guarded against multiple inclusion
+    nose.tools.eq_(unity_batches([d, f], 2), [[d, f]])
+
+    # only batches with more than one source are replaced
+    sources = write_unity_sources('test', [a, b, c], 2, os.path.join(temp_dir, 'unity'))
+    nose.tools.eq_(len(sources), 2)
+    nose.tools.eq_(sources[1], b)
+    contents = open(sources[0]).read()
+    assert '#include "%s"' % os.path.realpath(a) in contents
+    assert '#include "%s"' % os.path.realpath(c) in contents
+
+    # unchanged jumbo files are not touched
+    mtime = os.path.getmtime(sources[0])
+    os.utime(sources[0], (mtime - 100, mtime - 100))
+    write_unity_sources('test', [a, b, c], 2, os.path.join(temp_dir, 'unity'))
+    nose.tools.eq_(os.path.getmtime(sources[0]), mtime - 100)
+  finally:
+    shutil.rmtree(temp_dir)
+
+
+def test_unity_library():
+  old_dir = os.getcwd()
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  target_dir = os.path.join(temp_dir, 'build', 'lib', 'target')
+  try:
+    shutil.copyfile(pkg_resources.resource_filename(__name__, 'test_documentation.cpp'), os.path.join(temp_dir, 'test_documentation.cpp'))
+    _write(temp_dir, 'second.cpp', '#include <bob.extension/documentation.h>\nint second() { return 2; }\n')
+    os.chdir(temp_dir)
+    library = bob.extension.Library(
+      name = 'target.bob_cmake_test',
+      sources = ['test_documentation.cpp', 'second.cpp'],
+      include_dirs = [pkg_resources.resource_filename(__name__, 'include')],
+      version = '3.2.1',
+      unity_batch_size = 2,
+    )
+    compile_dir = os.path.join(temp_dir, 'build', 'lib')
+    os.makedirs(target_dir)
+    with open(os.devnull, 'w') as devnull:
+      library.compile(compile_dir, stdout=devnull)
+
+    unity_dir = os.path.join(temp_dir, 'build', 'build_cmake', 'bob_cmake_test', 'unity')
+    nose.tools.eq_(os.listdir(unity_dir), ['bob_cmake_test_unity_0.cpp'])
+    lib_name = 'libbob_cmake_test.dylib' if platform.system() == 'Darwin' else 'libbob_cmake_test.so'
+    assert os.path.exists(os.path.join(target_dir, lib_name))
+  finally:
+    os.chdir(old_dir)
+    shutil.rmtree(temp_dir)
+
+
+def test_unity_extension():
+  with temporary_directory(chdir=True) as temp_dir:
+    _write(temp_dir, 'first.cpp', 'static int helper() { return 1; }\nint first() { return helper(); }\n')
+    _write(temp_dir, 'second.cpp',
+        '#include <Python.h>\n'
+        'int first();\n'
+        'static struct PyModuleDef module_definition = { PyModuleDef_HEAD_INIT, "unity_test", 0, -1, 0 };\n'
+        'PyMODINIT_FUNC PyInit_unity_test() { first(); return PyModule_Create(&module_definition); }\n')
+    extension = bob.extension.Extension('unity_test', ['first.cpp', 'second.cpp'], unity_batch_size=2)
+    cmd = build_extensions(temp_dir, 'unity_test', [extension])
+
+    nose.tools.eq_(extension.sources, ['first.cpp', 'second.cpp'])
+    assert os.path.exists(os.path.join(temp_dir, 'temp', 'unity', 'unity_test_unity_0.cpp'))
+    assert os.path.exists(cmd.get_ext_fullpath('unity_test'))
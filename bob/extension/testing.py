@@ -0,0 +1,70 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Helpers for the tests that build extensions in temporary directories"""
+
+import os
+import sys
+import shutil
+import tempfile
+import importlib
+import contextlib
+
+
+@contextlib.contextmanager
+def temporary_directory(chdir=False):
+  """Yields a new temporary directory, which is removed afterwards; with
+  ``chdir``, it is the working directory in the meantime"""
+
+  old_dir = os.getcwd()
+  temp_dir = tempfile.mkdtemp(prefix="bob_extension_test_")
+  try:
+    if chdir:
+      os.chdir(temp_dir)
+    yield temp_dir
+  finally:
+    os.chdir(old_dir)
+    shutil.rmtree(temp_dir)
+
+
+def build_extensions(temp_dir, name, extensions, **options):
+  """Builds the extensions of the package with the given name into the
+  ``lib`` sub-directory of ``temp_dir``, using its ``temp`` sub-directory for
+  temporary files; the ``options`` are set on the :py:class:`bob.extension.build_ext`
+  command before it is run.
+
+  Returns:
+
+    :py:class:`bob.extension.build_ext`: The command that was run
+  """
+
+  from setuptools import Distribution
+  from . import build_ext
+  dist = Distribution(dict(name=name, ext_modules=extensions))
+  cmd = build_ext(dist)
+  cmd.build_lib = os.path.join(temp_dir, 'lib')
+  cmd.build_temp = os.path.join(temp_dir, 'temp')
+  for key, value in options.items():
+    setattr(cmd, key, value)
+  cmd.ensure_finalized()
+  cmd.run()
+  return cmd
+
+
+@contextlib.contextmanager
+def built_module(name, source):
+  """Builds the extension with the given name from the C++ ``source`` file of
+  this package in a temporary directory, and yields the imported module"""
+
+  import pkg_resources
+  from . import Extension
+  with temporary_directory() as temp_dir:
+    shutil.copyfile(pkg_resources.resource_filename(__name__, source),
+                    os.path.join(temp_dir, source))
+    cmd = build_extensions(temp_dir, name, [Extension(name, [os.path.join(temp_dir, source)])])
+    sys.path.insert(0, cmd.build_lib)
+    try:
+      yield importlib.import_module(name)
+    finally:
+      sys.path.remove(cmd.build_lib)
+      sys.modules.pop(name, None)
@@ -0,0 +1,148 @@
+#!/usr/bin/env python
+# vim: set fileencoding=utf-8 :
+
+"""Unity (jumbo) builds, which compile several source files in a single
+translation unit, so that common headers are parsed only once"""
+
+import os
+import re
+import logging
+
+logger = logging.getLogger(__name__)
+
+DOCUMENTATION_HELPERS = (
+    '_strip', '_split', '_align', '_align_parameter', '_prototype', '_usage',
+    '_check',
+)
+"""The ``static`` helper functions defined in every translation unit that
+includes ``bob.extension/documentation.h``"""
+
+_STATIC_RE = re.compile(
+    r'^static\s+[^;{(=]*?\b([A-Za-z_]\w*)\s*(?:\(|\[|=|;|\{)')
+_DOCUMENTATION_RE = re.compile(
+    r'^\s*#\s*include\s*[<"]bob\.extension/documentation\.h[>"]')
+
+
+def unity_batch_size(batch_size=None):
+  """Returns the number of sources to be compiled in one translation unit.
+
+  If ``batch_size`` is not given, the ``BOB_BUILD_UNITY`` environment variable
+  is used. Values smaller than 2 disable unity builds.
+
+  Returns:
+
+    int: The batch size, or ``0`` if unity builds are disabled
+  """
+
+  if batch_size is None:
+    batch_size = os.environ.get('BOB_BUILD_UNITY', 0)
+  try:
+    batch_size = int(batch_size)
+  except ValueError:
+    raise ValueError("BOB_BUILD_UNITY must be an integer, not `%s'" % batch_size)
+  return batch_size if batch_size > 1 else 0
+
+
+def _scan(source):
+  """Returns the file-scope ``static`` symbols of the given source, and whether
+  it includes ``bob.extension/documentation.h``"""
+
+  symbols = set()
+  documented = False
+  with open(source, 'rt') as f:
+    for line in f:
+      if _DOCUMENTATION_RE.match(line):
+        documented = True
+        continue
+      match = _STATIC_RE.match(line)
+      if match:
+        symbols.add(match.group(1))
+  return symbols, documented
+
+
+def static_symbols(source):
+  """Returns the names of the ``static`` objects and functions defined at file
+  scope in the given source file.
+
+  The :py:data:`DOCUMENTATION_HELPERS` are only returned if the source defines
+  them itself.
+  """
+
+  return _scan(source)[0]
+
+
+def unity_batches(sources, batch_size):
+  """Splits the given sources into batches that can be compiled together.
+
+  Only sources with the same extension are batched. A source is never added to
+  a batch that already defines one of its ``static`` symbols (see
+  :py:func:`static_symbols`). Sources that define their own static functions
+  with the names of the :py:data:`DOCUMENTATION_HELPERS` are also kept apart
+  from sources that include ``bob.extension/documentation.h``. All such
+  collisions are reported as warnings.
+
+  Returns:
+
+    [[str]]: The list of batches, each containing at most ``batch_size``
+    sources
+  """
+
+  helpers = set(DOCUMENTATION_HELPERS)
+  batches = []
+  for source in sources:
+    extension = os.path.splitext(source)[1]
+    symbols, documented = _scan(source) if os.path.exists(source) else (set(), False)
+    for batch in batches:
+      if len(batch['sources']) >= batch_size or batch['extension'] != extension:
+        continue
+      collisions = batch['symbols'] & symbols
+      if batch['documented']: collisions |= helpers & symbols
+      if documented: collisions |= helpers & batch['symbols']
+      if collisions:
+        logger.warning("Not batching `%s' with %s since they both define the static symbol(s) %s",
+            source, ', '.join("`%s'" % s for s in batch['sources']), ', '.join(sorted(collisions)))
+        continue
+      batch['sources'].append(source)
+      batch['symbols'] |= symbols
+      batch['documented'] |= documented
+      break
+    else:
+      batches.append({'sources': [source], 'symbols': set(symbols), 'documented': documented, 'extension': extension})
+
+  return [batch['sources'] for batch in batches]
+
+
+def write_unity_sources(name, sources, batch_size, directory):
+  """Writes the jumbo translation units for the given sources.
+
+  Each batch of :py:func:`unity_batches` with more than one source is written
+  to ``<directory>/<name>_unity_<index><extension>``, which includes the
+  original sources. Existing files are only re-written when their contents
+  change, so that incremental builds are not invalidated.
+
+  Returns:
+
+    [str]: The list of sources to be compiled instead of ``sources``
+  """
+
+  if not os.path.exists(directory):
+    os.makedirs(directory)
+
+  retval = []
+  for index, batch in enumerate(unity_batches(sources, batch_size)):
+    if len(batch) == 1:
+      retval.append(batch[0])
+      continue
+
+    extension = os.path.splitext(batch[0])[1]
+    filename = os.path.join(directory, '%s_unity_%d%s' % (name, index, extension))
+    contents = '// WARNING! This file is automatically generated. Do not change its contents.\n' + \
+        ''.join('#include "%s"\n' % os.path.realpath(s) for s in batch)
+
+    if not os.path.exists(filename) or open(filename).read() != contents:
+      with open(filename, 'w') as f:
+        f.write(contents)
+    logger.info("Compiling %s in the unity source `%s'", ', '.join(batch), filename)
+    retval.append(filename)
+
+  return retval
@@ -9,9 +9,17 @@ import os
 import re
 import sys
 import glob
+import functools
 import platform
-import pkg_resources
+import subprocess
 from . import DEFAULT_PREFIXES
+from .prefix_index import prefix_index
+
+
+@functools.lru_cache(maxsize=None)
+def _is_32bit():
+  # platform.architecture() runs the ``file`` command on the python executable
+  return platform.architecture()[0] == '32bit'
 
 
 def construct_search_paths(prefixes=None, subpaths=None, suffix=None):
@@ -44,7 +52,17 @@ def construct_search_paths(prefixes=None, subpaths=None, suffix=None):
   -------
   paths : [str]
       A list of unique and existing paths to be used in your search.
+
+  The search paths are only constructed once per process for the same
+  parameters and environment, see :py:func:`bob.extension.prefix_index.prefix_index`.
   """
+  key = (os.environ.get('BOB_PREFIX_PATH'), os.environ.get('CONDA_PREFIX'),
+      sys.executable, tuple(prefixes or ()), tuple(subpaths or ()), suffix)
+  return prefix_index().search_paths(key,
+      lambda: _construct_search_paths(prefixes, subpaths, suffix))
+
+
+def _construct_search_paths(prefixes, subpaths, suffix):
   search = []
   suffix = suffix or ''
 
@@ -81,9 +99,10 @@ def construct_search_paths(prefixes=None, subpaths=None, suffix=None):
     search = subsearch
 
   # Before we do a file-system check, filter out the un-existing paths
+  index = prefix_index()
   tmp = []
   for k in search:
-    tmp += glob.glob(k)
+    tmp += index.glob(k)
   search = tmp
 
   return search
@@ -114,10 +133,13 @@ def find_file(name, subpaths=None, prefixes=None):
 
   search = construct_search_paths(prefixes=prefixes, subpaths=subpaths)
 
+  # look the candidates up in the cached directory listings, which are
+  # re-listed when their directory changes
+  index = prefix_index()
   retval = []
   for path in search:
     candidate = os.path.join(path, name)
-    if os.path.exists(candidate):
+    if index.exists(candidate):
       retval.append(candidate)
 
   return retval
@@ -154,7 +176,7 @@ def find_header(name, subpaths=None, prefixes=None):
     headerpaths += [os.path.join('include', 'arm-linux-gnueabihf')]
 
   # else, consider it intel compatible
-  elif platform.architecture()[0] == '32bit':
+  elif _is_32bit():
     headerpaths += [os.path.join('include', 'i386-linux-gnu')]
   else:
     headerpaths += [os.path.join('include', 'x86_64-linux-gnu')]
@@ -212,7 +234,7 @@ def find_library(name, version=None, subpaths=None, prefixes=None,
     libpaths += [os.path.join('lib', 'arm-linux-gnueabihf')]
 
   # else, consider it intel compatible
-  elif platform.architecture()[0] == '32bit':
+  elif _is_32bit():
     libpaths += [
         os.path.join('lib', 'i386-linux-gnu'),
         os.path.join('lib32'),
@@ -292,7 +314,7 @@ def find_executable(name, subpaths=None, prefixes=None):
     binpaths += [os.path.join('bin', 'arm-linux-gnueabihf')]
 
   # else, consider it intel compatible
-  elif platform.architecture()[0] == '32bit':
+  elif _is_32bit():
     binpaths += [
         os.path.join('bin', 'i386-linux-gnu'),
         os.path.join('bin32'),
@@ -322,6 +344,30 @@ def find_executable(name, subpaths=None, prefixes=None):
   # The module names can be set with or without version number
   return find_file(name, my_subpaths, prefixes)
 
+_IS_CLANG = {}
+def is_clang(compiler):
+  """Checks if the given compiler executable is clang (or Apple clang)
+
+  Parameters
+  ----------
+  compiler : str
+      The compiler executable, e.g., ``gcc`` or ``/usr/bin/clang++``
+
+  Returns
+  -------
+  bool
+      ``True`` if ``compiler --version`` identifies clang. The results are
+      cached.
+  """
+
+  if compiler not in _IS_CLANG:
+    try:
+      out = subprocess.check_output([compiler, '--version'], stderr=subprocess.STDOUT)
+      _IS_CLANG[compiler] = b'clang' in out.lower()
+    except (OSError, subprocess.CalledProcessError):
+      _IS_CLANG[compiler] = False
+  return _IS_CLANG[compiler]
+
 def uniq(seq, idfun=None):
   """Very fast, order preserving uniq function"""
 
@@ -553,9 +599,10 @@ def link_documentation(additional_packages = ['python', 'numpy'], requirements_f
       if s.count('%s') == 1: #old style
         url = s % package_name
       else: #use new style, with mapping, try to link against specific version
+        import importlib.metadata
         try:
-          version = 'v' + pkg_resources.require(package_name)[0].version
-        except pkg_resources.DistributionNotFound:
+          version = 'v' + importlib.metadata.version(package_name)
+        except importlib.metadata.PackageNotFoundError:
           version = 'stable' #package is not a runtime dep, only referenced
         url = s % {'name': package_name, 'version': version}
 
@@ -31,6 +31,9 @@ setup(
         ],
         'bob.cli': [
             'config = bob.extension.scripts.config:config',
+            'compile-times = bob.extension.scripts.compile_times:compile_times',
+            'benchmark = bob.extension.scripts.benchmark:benchmark',
+            'overhead = bob.extension.scripts.overhead:overhead',
         ],
         # some test entry_points
         'bob.extension.test_config_load': [